@@ -84,6 +84,10 @@ typedef enum eDmtcpEvent {
   DMTCP_EVENT_PTHREAD_EXIT,
   DMTCP_EVENT_PTHREAD_RETURN,
 
+  // The coordinator aborted the checkpoint after DMTCP_EVENT_THREADS_SUSPEND
+  // (a straggler missed its deadline); undo what was done for that event.
+  DMTCP_EVENT_CKPT_ABORTED,
+
   nDmtcpEvents
 } DmtcpEvent_t;
 
@@ -141,6 +145,54 @@ EXTERNC int dmtcp_checkpoint(DMTCP_VOID) __attribute__ ((weak));
 #define dmtcp_checkpoint() \
   (dmtcp_checkpoint ? dmtcp_checkpoint() : DMTCP_NOT_PRESENT)
 
+/**
+ * Outcome of a checkpoint, as seen by this process.
+ */
+typedef struct {
+  int      handle;      // as returned by dmtcp_checkpoint_async(), else 0
+  int      isRestart;   // 1 if we are resuming from a restart
+  int      aborted;     // 1 if the coordinator aborted the checkpoint (at a
+                        //   barrier deadline); no image was written
+  uint32_t generation;  // checkpoint generation of the computation
+  uint64_t imageSize;   // bytes in our image; 0 if written by a forked child
+  uint64_t writeUsec;   // time spent writing our image
+  uint64_t totalUsec;   // request until resume; 0 after restart or if the
+                        //   checkpoint wasn't requested by this process
+} DmtcpCkptResult;
+
+typedef void (*dmtcp_ckpt_callback_t)(const DmtcpCkptResult *result,
+                                      void *arg);
+
+/**
+ * Request a checkpoint without waiting for it.  Returns a handle (>0) as soon
+ * as the coordinator has accepted the request.  When the checkpoint completes
+ * (and again in the restarted process), or is aborted, fn(result, arg) is
+ * called once.
+ * + fn may be NULL; poll dmtcp_get_ckpt_eventfd() instead.
+ * + fn runs in the checkpoint thread before the user threads resume; it must
+ *   not wait for a user thread or request another checkpoint.
+ * + Returns <=0 on error, e.g., if an earlier request is still pending.
+ */
+EXTERNC int dmtcp_checkpoint_async(dmtcp_ckpt_callback_t fn, void *arg)
+  __attribute__ ((weak));
+#define dmtcp_checkpoint_async(f,a) \
+  (dmtcp_checkpoint_async ? dmtcp_checkpoint_async(f,a) : DMTCP_NOT_PRESENT)
+
+/**
+ * Returns an eventfd that is incremented whenever a checkpoint or restart of
+ * this process completes, or a checkpoint is aborted; the result is then
+ * available through
+ * dmtcp_get_last_ckpt_result().  Returns -1 on error.
+ */
+EXTERNC int dmtcp_get_ckpt_eventfd(void) __attribute__ ((weak));
+#define dmtcp_get_ckpt_eventfd() \
+  (dmtcp_get_ckpt_eventfd ? dmtcp_get_ckpt_eventfd() : -1)
+EXTERNC int dmtcp_get_last_ckpt_result(DmtcpCkptResult *result)
+  __attribute__ ((weak));
+#define dmtcp_get_last_ckpt_result(r) \
+  (dmtcp_get_last_ckpt_result ? dmtcp_get_last_ckpt_result(r) \
+                              : DMTCP_NOT_PRESENT)
+
 /**
  * Prevent a checkpoint from starting until dmtcp_enable_checkpoint() is
  * called.
@@ -163,6 +215,52 @@ EXTERNC int dmtcp_enable_ckpt(DMTCP_VOID) __attribute__ ((weak));
 #define dmtcp_enable_ckpt() \
  (dmtcp_enable_ckpt ? dmtcp_enable_ckpt() : DMTCP_NOT_PRESENT)
 
+/**
+ * Exclude [addr, addr+len) from future checkpoints, e.g., a cache or scratch
+ * buffer that the application can cheaply rebuild.  The range is widened to
+ * page boundaries.  On restart, the range is restored according to policy:
+ * + DMTCP_EXCLUDE_SKIP: not restored at all; the range is left unmapped.
+ * + DMTCP_EXCLUDE_ZERO: remapped as private zero pages.
+ * + DMTCP_EXCLUDE_FILE: remapped from the backing file (which must not have
+ *   changed since checkpoint).  Only pages that are still the file contents
+ *   are meaningful; ranges that aren't file mappings get zero pages.
+ * Registering a range replaces any earlier registration it overlaps.
+ * + Returns 1 on success, <=0 on error
+ */
+#define DMTCP_EXCLUDE_SKIP 0
+#define DMTCP_EXCLUDE_ZERO 1
+#define DMTCP_EXCLUDE_FILE 2
+EXTERNC int dmtcp_ckpt_exclude_region(void *addr, size_t len, int policy)
+  __attribute__ ((weak));
+#define dmtcp_ckpt_exclude_region(a,l,p) \
+ (dmtcp_ckpt_exclude_region ? dmtcp_ckpt_exclude_region(a,l,p) \
+                            : DMTCP_NOT_PRESENT)
+
+/**
+ * Checkpoint [addr, addr+len) normally again, undoing
+ * dmtcp_ckpt_exclude_region() for that range.
+ * + Returns 1 on success, <=0 on error
+ */
+EXTERNC int dmtcp_ckpt_include_region(void *addr, size_t len)
+  __attribute__ ((weak));
+#define dmtcp_ckpt_include_region(a,l) \
+ (dmtcp_ckpt_include_region ? dmtcp_ckpt_include_region(a,l) \
+                            : DMTCP_NOT_PRESENT)
+
+/**
+ * Called once per excluded region after restart, so that the application
+ * can regenerate its contents.  It runs in the checkpoint thread after file
+ * descriptors were restored, but before the user threads resume; it must not
+ * wait for any user thread.  Pass NULL to unregister.
+ * + Returns 1 on success, <=0 on error
+ */
+typedef void (*dmtcp_excluded_region_fn_t)(void *addr, size_t len, int policy);
+EXTERNC int dmtcp_set_excluded_region_callback(dmtcp_excluded_region_fn_t fn)
+  __attribute__ ((weak));
+#define dmtcp_set_excluded_region_callback(f) \
+ (dmtcp_set_excluded_region_callback ? dmtcp_set_excluded_region_callback(f) \
+                                     : DMTCP_NOT_PRESENT)
+
 // See: test/plugin/sleep1 dir and sibling directories for examples:
 EXTERNC void dmtcp_event_hook(DmtcpEvent_t event, DmtcpEventData_t *data)
   __attribute((weak));
@@ -53,7 +53,10 @@ typedef char * VA; /* VA = virtual address */
 
 typedef enum ProcMapsAreaProperties {
   DMTCP_ZERO_PAGE = 0x0001,
-  DMTCP_SKIP_WRITING_TEXT_SEGMENTS = 0x0002
+  DMTCP_SKIP_WRITING_TEXT_SEGMENTS = 0x0002,
+  DMTCP_SYSV_SHM_AREA = 0x0004,
+  DMTCP_SHARED_AREA_REF = 0x0008,
+  DMTCP_FILE_BACKED_REF = 0x0010
 } ProcMapsAreaProperties;
 
 typedef union ProcMapsArea {
@@ -97,6 +100,23 @@ typedef union ProcMapsArea {
 
     uint64_t properties;
 
+    // SysV shm key and shmget() flags used by mtcp_restart to recreate the
+    // segment; only valid if properties has DMTCP_SYSV_SHM_AREA.
+    union {
+      int shmkey;
+      uint64_t __shmkey;
+    };
+    union {
+      int shmflg;
+      uint64_t __shmflg;
+    };
+
+    // Backing file size and mtime, validated by mtcp_restart before mapping
+    // the file; only valid if properties has DMTCP_FILE_BACKED_REF.
+    uint64_t filesize;
+    uint64_t mtime_sec;
+    uint64_t mtime_nsec;
+
     char name[FILENAMESIZE];
   };
   char _padding[4096];
@@ -6,6 +6,10 @@
 
 namespace dmtcp {
 
+// A snapshot of /proc/self/maps, taken once by the constructor.  The areas
+// are kept as compact records in an arena that is reused (and sized from the
+// previous snapshot) so that taking a snapshot at checkpoint time neither
+// reads /proc/self/maps twice nor allocates memory while it is parsed.
 class ProcSelfMaps
 {
   public:
@@ -21,17 +25,42 @@ class ProcSelfMaps
     size_t getNumAreas() const { return numAreas; }
 
     int getNextArea(ProcMapsArea* area);
+    // Start over with the first area of the same snapshot.
+    void rewind() { areaIdx = 0; }
+
+    // True if addr lies in the arena; its contents are useless after restart.
+    static bool isArenaAddr(VA addr);
+
+    struct Record {
+      uint64_t addr;
+      uint64_t endAddr;
+      uint64_t offset;
+      uint64_t inodenum;
+      uint32_t devmajor;
+      uint32_t devminor;
+      uint64_t nameOffset; // into names; nameLen == 0 for no name
+      uint32_t nameLen;
+      uint16_t prot;
+      uint16_t shared;
+    };
 
   private:
-    unsigned long int readDec();
-    unsigned long int readHex();
-    bool isValidData();
+    void allocArena(size_t wantAreas, size_t wantNameBytes);
+    bool readText(int fd);
+    bool parseText();
+    int queryAreas(int fd);
+
+    char *arena;
+    size_t arenaSize;
+    Record *areas;
+    char *names;
+    size_t maxAreas;
+    size_t maxNameBytes;
+    bool ownArena;
 
-    char *data;
-    size_t dataIdx;
+    size_t areaIdx;
     size_t numAreas;
-    size_t numBytes;
-    int fd;
+    size_t numNameBytes;
     int numAllocExpands;
 };
 
@@ -64,6 +64,7 @@ enum ProtectedFds {
   ENVIRON_FD,
   NS_FD,
   DEBUG_SOCKET_FD,
+  SPARE_COORD_FD,
   FD_END
 };
 
@@ -88,6 +89,7 @@ enum ProtectedFds {
 #define PROTECTED_ENVIRON_FD              protectedFdBase() + ENVIRON_FD
 #define PROTECTED_NS_FD                   protectedFdBase() + NS_FD
 #define PROTECTED_DEBUG_SOCKET_FD         protectedFdBase() + DEBUG_SOCKET_FD
+#define PROTECTED_SPARE_COORD_FD          protectedFdBase() + SPARE_COORD_FD
 #define PROTECTED_FD_END                  protectedFdBase() + FD_END
 
 #define DMTCP_IS_PROTECTED_FD(fd) \
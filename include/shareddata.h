@@ -37,6 +37,8 @@
 #define MAX_PTRACE_ID_MAPS       256
 #define MAX_INCOMING_CONNECTIONS 10240
 #define MAX_INODE_PID_MAPS       10240
+#define MAX_SHARED_AREA_MAPS     1024
+#define MAX_FD_LEADER_MAPS       131072  // Hash table; a power of two.
 #define CON_ID_LEN \
   (sizeof(DmtcpUniqueProcessId) + sizeof(int64_t))
 
@@ -96,6 +98,28 @@ typedef struct InodeConnIdMap {
   char id[CON_ID_LEN];
 } InodeConnIdMap;
 
+// Ckpt owner of a MAP_SHARED region, identified by the backing object and the
+// mapped window.  Only the owner writes the contents to its ckpt image.
+typedef struct SharedAreaOwnerMap {
+  uint64_t devnum;
+  uint64_t inode;
+  uint64_t offset;
+  uint64_t size;
+  DmtcpUniqueProcessId owner;
+} SharedAreaOwnerMap;
+
+// An fd taking part in fd leader election.  Open file descriptions are looked
+// up by the (devnum, inode) of the file and told apart with kcmp(KCMP_FILE).
+// Entries of older elections (generation) count as free slots.
+typedef struct FdLeaderMap {
+  uint64_t devnum;
+  uint64_t inode;
+  uint32_t generation;
+  pid_t realPid;
+  int32_t fd;
+  int32_t _pad;
+} FdLeaderMap;
+
 struct Header {
   uint64_t initialized;
 
@@ -121,6 +145,8 @@ struct Header {
 
   uint64_t numIncomingConMaps;
   uint64_t numInodeConnIdMaps;
+  uint64_t numSharedAreaOwnerMaps;
+  uint64_t fdLeaderGeneration;
 
   uint64_t logMask;
 
@@ -133,6 +159,8 @@ struct Header {
   struct PtyNameMap ptyNameMap[MAX_PTY_NAME_MAPS];
   struct IncomingConMap incomingConMap[MAX_INCOMING_CONNECTIONS];
   InodeConnIdMap inodeConnIdMap[MAX_INODE_PID_MAPS];
+  SharedAreaOwnerMap sharedAreaOwnerMap[MAX_SHARED_AREA_MAPS];
+  FdLeaderMap fdLeaderMap[MAX_FD_LEADER_MAPS];
 
   char versionStr[32];
   DmtcpUniqueProcessId compId;
@@ -201,6 +229,12 @@ void getMissingConMaps(struct IncomingConMap **map, uint32_t *nmaps);
 
 void insertInodeConnIdMaps(vector<InodeConnIdMap> &maps);
 bool getCkptLeaderForFile(dev_t devnum, ino_t inode, void *id);
+
+bool claimSharedArea(dev_t devnum, ino_t inode, off_t offset, size_t size);
+bool getSharedAreaOwner(dev_t devnum, ino_t inode, off_t offset, size_t size,
+                        DmtcpUniqueProcessId *owner);
+bool electFdLeaders(vector<FdLeaderMap> &fds, vector<bool> *isLeader);
+
 uint32_t getLogMask(void);
 void setLogMask(uint32_t mask);
 }
@@ -246,8 +246,9 @@ namespace dmtcp
           _do_lock_tbl();
           JASSERT(lseek(fd, 0, SEEK_END) != -1);
 
-          jalib::JBinarySerializeWriterRaw mapwr(mapFile, fd);
+          jalib::JBinarySerializeBufferedWriter mapwr(mapFile, fd);
           mapwr.serializeMap(_idMapTable);
+          mapwr.flush();
 
           _do_unlock_tbl();
           Util::unlockFile(fd);
@@ -264,7 +265,7 @@ namespace dmtcp
           //Util::lockFile(fd);
           _do_lock_tbl();
 
-          jalib::JBinarySerializeReaderRaw maprd(mapFile, fd);
+          jalib::JBinarySerializeBufferedReader maprd(mapFile, fd);
           maprd.rewind();
 
           while (!maprd.isEOF()) {
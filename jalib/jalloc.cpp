@@ -27,9 +27,21 @@
 #include "jalib.h"
 #include "jalloc.h"
 
-// Make highest chunk size large; avoid a raw_alloc calling mmap()
-//   during /proc/self/maps
-#define MAX_CHUNKSIZE (4*1024)
+// Size classes are powers of two from MIN_CHUNKSIZE to MAX_CHUNKSIZE.  Make
+//   the highest chunk size large; avoid a raw_alloc calling mmap()
+//   during /proc/self/maps.  Larger objects come from the large-object arena.
+#define MIN_CHUNKSIZE 64
+#define MAX_CHUNKSIZE (64*1024)
+#define NUM_SIZE_CLASSES 11
+// The classes up to 4096 bytes are cached per thread, at most
+//   THREAD_CACHE_BYTES (and 16 chunks) per class.
+#define NUM_CACHED_CLASSES 7
+#define THREAD_CACHE_BYTES (16*1024)
+#define MAX_THREAD_CACHE_CHUNKS 16
+// The large-object arena grows by at least this much at a time.
+#define LARGE_SEGMENT_SIZE (4*1024*1024)
+// Free space the large-object arena keeps in reserve for a checkpoint.
+#define LARGE_PRE_EXPAND_SIZE (1024*1024)
 
 using namespace jalib;
 
@@ -40,6 +52,7 @@ static bool _initialized = false;
 
 #include <sys/mman.h>
 #include <stdlib.h>
+#include <sched.h>
 
 namespace jalib
 {
@@ -122,23 +135,21 @@ inline void _dealloc_raw(void* ptr, size_t n)
 #endif
 }
 
-template <size_t _N>
+struct FreeItem {
+  FreeItem* next;
+};
+
+// No constructor: instances are static and zero-initialized, and may be used
+// before static constructors run.
 class JFixedAllocStack {
 public:
-  enum { N=_N };
-  JFixedAllocStack() {
-    if (_blockSize == 0) {
-      _blockSize = 4*MAX_CHUNKSIZE;
-    }
-    _root = NULL;
-    _numExpands = 0;
-  }
-
-  void initialize(int blockSize) {
+  void initialize(size_t chunkSize, size_t blockSize) {
+    _chunkSize = chunkSize;
     _blockSize = blockSize;
   }
 
-  size_t chunkSize() { return N; }
+  size_t chunkSize() { return _chunkSize; }
+  size_t blockSize() { return _blockSize; }
 
   //allocate a chunk of size N
   void* allocate() {
@@ -167,13 +178,18 @@ public:
   void deallocate(void* ptr) {
     if (ptr == NULL) return;
     FreeItem* item = static_cast<FreeItem*>(ptr);
+    deallocateChain(item, item);
+  }
+
+  // Push the chain first..last (linked through next) back in one step.
+  void deallocateChain(FreeItem* first, FreeItem* last) {
     do {
       /* Atomically does the following operation:
-       *   item->next = _root;
-       *   _root = item;
+       *   last->next = _root;
+       *   _root = first;
        */
-      item->next = _root;
-    } while (!__sync_bool_compare_and_swap(&_root, item->next, item));
+      last->next = _root;
+    } while (!__sync_bool_compare_and_swap(&_root, last->next, first));
   }
 
   int numExpands() {
@@ -181,9 +197,12 @@ public:
   }
 
   void preExpand() {
-    // Force at least numChunks chunks to become free.
-    const int numAllocs = 10;
-    void *allocatedItem[numAllocs];
+    // Force at least numAllocs chunks to become free; fewer of the largest.
+    int numAllocs = 10;
+    if (_chunkSize * numAllocs > _blockSize) {
+      numAllocs = _blockSize / _chunkSize;
+    }
+    void *allocatedItem[10];
     for (int i=0; i<numAllocs; i++) {
       allocatedItem[i] = allocate();
     }
@@ -206,75 +225,303 @@ protected:
       //jalib::fflush(stderr);
       abort();
     }
-    FreeItem* bufs = static_cast<FreeItem*>(_alloc_raw(_blockSize));
-    int count = _blockSize / sizeof(FreeItem);
-    for(int i=0; i<count-1; ++i){
-      bufs[i].next=bufs+i+1;
+    char* buf = static_cast<char*>(_alloc_raw(_blockSize));
+    size_t count = _blockSize / _chunkSize;
+    for(size_t i=0; i<count-1; ++i){
+      ((FreeItem*) (buf + i * _chunkSize))->next =
+        (FreeItem*) (buf + (i + 1) * _chunkSize);
     }
-
-    do {
-      /* Atomically does the following operation:
-       *   bufs[count-1].next = _root;
-       *   _root = bufs;
-       */
-      bufs[count-1].next = _root;
-    } while (!__sync_bool_compare_and_swap(&_root, bufs[count-1].next, bufs));
+    deallocateChain((FreeItem*) buf, (FreeItem*) (buf + (count-1)*_chunkSize));
   }
 
-protected:
-  struct FreeItem {
-    union {
-      FreeItem* next;
-      char buf[N];
-    };
-  };
 private:
   FreeItem* volatile _root;
-  size_t _blockSize = 0;
+  size_t _chunkSize;
+  size_t _blockSize;
   char padding[128];
   int volatile _numExpands;
 };
 
+/* Objects larger than MAX_CHUNKSIZE are carved, in whole pages, out of
+ * segments that are never unmapped; freed pages are returned to the kernel
+ * with MADV_DONTNEED instead.  So, unlike one mmap() per object, large
+ * objects don't change /proc/self/maps once the arena is big enough.  The
+ * free extents are kept in an address-ordered list, with the header in the
+ * extent itself.
+ *
+ * The lock is only ever tried: a thread holding it may have been suspended
+ * for checkpoint.  If it can't be had, a new object is mmap()ed directly,
+ * and a freed one is pushed on a lock-free pending list, which the next
+ * holder of the lock drains: only then can it tell an arena extent (which
+ * must not be munmap()ed) from a directly mmap()ed object.
+ */
+class JLargeAllocArena {
+public:
+  void* allocate(size_t n) {
+    size_t size = roundUp(n);
+    if (!tryLock()) {
+      return _alloc_raw(size);
+    }
+    drainPending();
+    Extent* ext = findFit(size);
+    if (ext == NULL && _numSegments == MAX_SEGMENTS) {
+      // A segment that isn't tracked would be munmap()ed piecemeal when its
+      // objects are freed; map the object directly instead.
+      unlock();
+      return _alloc_raw(size);
+    }
+    if (ext == NULL) {
+      size_t segSize = size > LARGE_SEGMENT_SIZE ? size : LARGE_SEGMENT_SIZE;
+      void* seg = _alloc_raw(segSize);
+      if (seg == MAP_FAILED) {
+        unlock();
+        return seg;
+      }
+      __sync_fetch_and_add(&_numExpands, 1);
+      _bytesReserved += segSize;
+      _segStart[_numSegments] = (char*) seg;
+      _segEnd[_numSegments] = (char*) seg + segSize;
+      _numSegments++;
+      insert((char*) seg, segSize);
+      ext = findFit(size);
+    }
+    // Carve from the end, so that the extent header stays where it is.
+    void* p;
+    if (ext->size == size) {
+      unlink(ext);
+      p = ext;
+    } else {
+      ext->size -= size;
+      p = (char*) ext + ext->size;
+    }
+    _bytesInUse += size;
+    unlock();
+    return p;
+  }
+
+  void deallocate(void* ptr, size_t n) {
+    size_t size = roundUp(n);
+    if (!tryLock()) {
+      Extent* ext = (Extent*) ptr;
+      ext->size = size;
+      do {
+        ext->next = _pending;
+      } while (!__sync_bool_compare_and_swap(&_pending, ext->next, ext));
+      return;
+    }
+    release((char*) ptr, size);
+    drainPending();
+    unlock();
+  }
+
+  void preExpand() {
+    deallocate(allocate(LARGE_PRE_EXPAND_SIZE), LARGE_PRE_EXPAND_SIZE);
+  }
+
+  int numExpands() { return _numExpands; }
+  size_t bytesReserved() { return _bytesReserved; }
+  size_t bytesInUse() { return _bytesInUse; }
+
+private:
+  struct Extent {
+    size_t size;
+    Extent* next;
+  };
+  enum { MAX_SEGMENTS = 256 };
+
+  static size_t roundUp(size_t n) {
+    size_t pageSize = sysconf(_SC_PAGESIZE);
+    return (n + pageSize - 1) & ~(pageSize - 1);
+  }
+
+  bool tryLock() {
+    for (int i = 0; i < 1000; i++) {
+      if (__sync_bool_compare_and_swap(&_lock, 0, 1)) {
+        return true;
+      }
+      sched_yield();
+    }
+    return false;
+  }
+  void unlock() { __sync_lock_release(&_lock); }
+
+  // Called with the lock held.
+  void release(char* p, size_t size) {
+    if (!contains(p)) {
+      // Was mmap()ed directly while the lock was held.
+      _dealloc_raw(p, size);
+      return;
+    }
+    madvise(p, size, MADV_DONTNEED);
+    _bytesInUse -= size;
+    insert(p, size);
+  }
+
+  // Called with the lock held.
+  void drainPending() {
+    Extent* ext = __sync_lock_test_and_set(&_pending, (Extent*) NULL);
+    while (ext != NULL) {
+      Extent* next = ext->next;
+      release((char*) ext, ext->size);
+      ext = next;
+    }
+  }
+
+  Extent* findFit(size_t size) {
+    for (Extent* e = _free; e != NULL; e = e->next) {
+      if (e->size >= size) {
+        return e;
+      }
+    }
+    return NULL;
+  }
+
+  void unlink(Extent* ext) {
+    Extent** pp = &_free;
+    while (*pp != ext) {
+      pp = &(*pp)->next;
+    }
+    *pp = ext->next;
+  }
+
+  bool contains(char* p) {
+    for (int i = 0; i < _numSegments; i++) {
+      if (p >= _segStart[i] && p < _segEnd[i]) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Insert [p, p+size), which is in one of the segments, into the free list,
+  // merging with its neighbors.
+  void insert(char* p, size_t size) {
+    Extent* prev = NULL;
+    Extent* cur = _free;
+    while (cur != NULL && (char*) cur < p) {
+      prev = cur;
+      cur = cur->next;
+    }
+    Extent* ext;
+    if (prev != NULL && (char*) prev + prev->size == p) {
+      prev->size += size;
+      ext = prev;
+    } else {
+      ext = (Extent*) p;
+      ext->size = size;
+      ext->next = cur;
+      if (prev != NULL) {
+        prev->next = ext;
+      } else {
+        _free = ext;
+      }
+    }
+    if (cur != NULL && (char*) ext + ext->size == (char*) cur) {
+      ext->size += cur->size;
+      ext->next = cur->next;
+    }
+  }
+
+  Extent* _free;
+  Extent* volatile _pending;
+  int volatile _lock;
+  int volatile _numExpands;
+  size_t _bytesReserved;
+  size_t _bytesInUse;
+  int _numSegments;
+  char* _segStart[MAX_SEGMENTS];
+  char* _segEnd[MAX_SEGMENTS];
+};
+
+/* A small per-thread magazine of free chunks in front of each of the
+ * smaller global stacks, so that threads don't contend on them.  The busy
+ * flag makes it safe against a signal handler (e.g., the checkpoint signal)
+ * that allocates while the thread is in the middle of an update: the
+ * handler then goes to the global stack directly.
+ */
+struct ThreadCache {
+  FreeItem* head[NUM_CACHED_CLASSES];
+  int count[NUM_CACHED_CLASSES];
+  int volatile busy;
+};
+
 } // namespace jalib
 
-jalib::JFixedAllocStack<64>   lvl1;
-jalib::JFixedAllocStack<256>  lvl2;
-jalib::JFixedAllocStack<1024> lvl3;
-#if MAX_CHUNKSIZE <= 1024
-# error MAX_CHUNKSIZE must be larger
-#endif
-jalib::JFixedAllocStack<MAX_CHUNKSIZE> lvl4;
+static jalib::JFixedAllocStack sizeClass[NUM_SIZE_CLASSES];
+static jalib::JLargeAllocArena largeArena;
+static __thread jalib::ThreadCache threadCache;
+static int threadCacheLimit[NUM_CACHED_CLASSES];
+
+static inline int sizeClassIndex(size_t n)
+{
+  if (n <= MIN_CHUNKSIZE) {
+    return 0;
+  }
+  // Index of the smallest power of two >= n, relative to MIN_CHUNKSIZE.
+  return (sizeof(long) * 8 - __builtin_clzl(n - 1)) - 6;
+}
 
 void jalib::JAllocDispatcher::initialize(void)
 {
-  if (fred_record_replay_enabled != 0 && fred_record_replay_enabled()) {
-    /* We need a greater arena size to eliminate mmap() calls that could happen
-       at different times for record vs. replay. */
-    lvl1.initialize(1024*1024*16);
-    lvl2.initialize(1024*1024*16);
-    lvl3.initialize(1024*32*16);
-    lvl4.initialize(1024*32*16);
-  } else {
-    lvl1.initialize(1024*16);
-    lvl2.initialize(1024*16);
-    lvl3.initialize(1024*32);
-    lvl4.initialize(1024*32);
+  bool fred = fred_record_replay_enabled != 0 && fred_record_replay_enabled();
+  for (int i = 0; i < NUM_SIZE_CLASSES; i++) {
+    size_t chunkSize = MIN_CHUNKSIZE << i;
+    size_t blockSize;
+    if (fred) {
+      /* We need a greater arena size to eliminate mmap() calls that could
+         happen at different times for record vs. replay. */
+      blockSize = chunkSize <= 256 ? 1024*1024*16 : 1024*32*16;
+    } else {
+      blockSize = chunkSize <= 256 ? 1024*16 : 1024*32;
+    }
+    if (blockSize < 8 * chunkSize) {
+      blockSize = 8 * chunkSize;
+    }
+    sizeClass[i].initialize(chunkSize, blockSize);
+  }
+  for (int i = 0; i < NUM_CACHED_CLASSES; i++) {
+    threadCacheLimit[i] = THREAD_CACHE_BYTES / (MIN_CHUNKSIZE << i);
+    if (threadCacheLimit[i] > MAX_THREAD_CACHE_CHUNKS) {
+      threadCacheLimit[i] = MAX_THREAD_CACHE_CHUNKS;
+    }
   }
   _initialized = true;
 }
+
 void* jalib::JAllocDispatcher::allocate(size_t n)
 {
   if (!_initialized) {
     initialize();
   }
-  void *retVal;
-  if(n <= lvl1.chunkSize()) retVal = lvl1.allocate(); else
-  if(n <= lvl2.chunkSize()) retVal = lvl2.allocate(); else
-  if(n <= lvl3.chunkSize()) retVal = lvl3.allocate(); else
-  if(n <= lvl4.chunkSize()) retVal = lvl4.allocate(); else
-  retVal = _alloc_raw(n);
-  return retVal;
+  if (n > MAX_CHUNKSIZE) {
+    return largeArena.allocate(n);
+  }
+  int i = sizeClassIndex(n);
+  ThreadCache *tc = &threadCache;
+  if (i >= NUM_CACHED_CLASSES || tc->busy) {
+    return sizeClass[i].allocate();
+  }
+
+  tc->busy = 1;
+  if (tc->count[i] == 0) {
+    // Refill half of the magazine from the global stack.
+    for (int j = 0; j < threadCacheLimit[i] / 2; j++) {
+      FreeItem* item = (FreeItem*) sizeClass[i].allocate();
+      item->next = tc->head[i];
+      tc->head[i] = item;
+      tc->count[i]++;
+    }
+  }
+  FreeItem* item = tc->head[i];
+  if (item != NULL) {
+    tc->head[i] = item->next;
+    tc->count[i]--;
+    item->next = NULL;
+  }
+  tc->busy = 0;
+  return item != NULL ? item : sizeClass[i].allocate();
 }
+
 void jalib::JAllocDispatcher::deallocate(void* ptr, size_t n)
 {
   if (!_initialized) {
@@ -282,23 +529,99 @@ void jalib::JAllocDispatcher::deallocate(void* ptr, size_t n)
     jalib::write(2, msg, sizeof(msg));
     abort();
   }
-  if(n <= lvl1.N) lvl1.deallocate(ptr); else
-  if(n <= lvl2.N) lvl2.deallocate(ptr); else
-  if(n <= lvl3.N) lvl3.deallocate(ptr); else
-  if(n <= lvl4.N) lvl4.deallocate(ptr); else
-  _dealloc_raw(ptr, n);
+  if (ptr == NULL) {
+    return;
+  }
+  if (n > MAX_CHUNKSIZE) {
+    largeArena.deallocate(ptr, n);
+    return;
+  }
+  int i = sizeClassIndex(n);
+  ThreadCache *tc = &threadCache;
+  if (i >= NUM_CACHED_CLASSES || tc->busy) {
+    sizeClass[i].deallocate(ptr);
+    return;
+  }
+
+  tc->busy = 1;
+  FreeItem* item = (FreeItem*) ptr;
+  item->next = tc->head[i];
+  tc->head[i] = item;
+  tc->count[i]++;
+  if (tc->count[i] > threadCacheLimit[i]) {
+    // Give half of the magazine back to the global stack in one step.
+    FreeItem* last = item;
+    for (int j = 1; j < threadCacheLimit[i] / 2; j++) {
+      last = last->next;
+    }
+    tc->head[i] = last->next;
+    tc->count[i] -= threadCacheLimit[i] / 2;
+    sizeClass[i].deallocateChain(item, last);
+  }
+  tc->busy = 0;
+}
+
+/* The thread is about to exit, but its TLS and thread_local destructors are
+ * still to run.  The busy flag is left set, so that what they allocate and
+ * free goes to the global stacks instead of a magazine nobody will flush.
+ */
+void jalib::JAllocDispatcher::flushThreadCache()
+{
+  ThreadCache *tc = &threadCache;
+  if (!_initialized || tc->busy) {
+    return;
+  }
+  tc->busy = 1;
+  for (int i = 0; i < NUM_CACHED_CLASSES; i++) {
+    FreeItem* item = tc->head[i];
+    tc->head[i] = NULL;
+    tc->count[i] = 0;
+    while (item != NULL) {
+      FreeItem* next = item->next;
+      sizeClass[i].deallocate(item);
+      item = next;
+    }
+  }
 }
+
 int jalib::JAllocDispatcher::numExpands()
 {
-  return lvl1.numExpands() + lvl2.numExpands() +
-         lvl3.numExpands() + lvl4.numExpands();
+  int n = largeArena.numExpands();
+  for (int i = 0; i < NUM_SIZE_CLASSES; i++) {
+    n += sizeClass[i].numExpands();
+  }
+  return n;
 }
+
 void jalib::JAllocDispatcher::preExpand()
 {
-  lvl1.preExpand();
-  lvl2.preExpand();
-  lvl3.preExpand();
-  lvl4.preExpand();
+  if (!_initialized) {
+    initialize();
+  }
+  for (int i = 0; i < NUM_SIZE_CLASSES; i++) {
+    sizeClass[i].preExpand();
+  }
+  largeArena.preExpand();
+}
+
+size_t jalib::JAllocDispatcher::formatStats(char *buf, size_t len)
+{
+  size_t n = 0;
+  for (int i = 0; i < NUM_SIZE_CLASSES && n < len; i++) {
+    size_t expands = sizeClass[i].numExpands();
+    if (expands == 0) {
+      continue;
+    }
+    n += snprintf(buf + n, len - n, "%s%zu:%zuB/%zux",
+                  n == 0 ? "" : " ", sizeClass[i].chunkSize(),
+                  expands * sizeClass[i].blockSize(), expands);
+  }
+  if (n < len) {
+    n += snprintf(buf + n, len - n, "%slarge:%zuB/%zuB/%dx",
+                  n == 0 ? "" : " ", largeArena.bytesInUse(),
+                  largeArena.bytesReserved(), largeArena.numExpands());
+  }
+  return n < len ? n : len - 1;
 }
 
 #else
@@ -314,6 +637,13 @@ void jalib::JAllocDispatcher::deallocate(void* ptr, size_t)
 {
   ::free(ptr);
 }
+void jalib::JAllocDispatcher::flushThreadCache()
+{
+}
+size_t jalib::JAllocDispatcher::formatStats(char *buf, size_t len)
+{
+  return 0;
+}
 
 #endif
 
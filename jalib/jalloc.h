@@ -49,6 +49,12 @@ namespace jalib
       }
       static int numExpands();
       static void preExpand();
+      // Return the calling thread's cached chunks, and stop caching for it;
+      // call before it exits.
+      static void flushThreadCache();
+      // One-line summary of the memory reserved per size class and by the
+      // large-object arena, for logging.
+      static size_t formatStats(char *buf, size_t len);
   };
 
   class JAlloc {
@@ -27,6 +27,11 @@
 #include <dlfcn.h>
 
 #include <fstream>
+#include <new>
+#include <limits.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <execinfo.h>  /* For backtrace() */
 
 #include "jalib.h"
@@ -127,6 +132,7 @@ jassert_internal::JAssert::~JAssert()
     // while(1) sleep(1);
 #ifdef LOGGING
     jbacktrace();
+    jflight_dump();
 #endif // ifdef LOGGING
   }
 
@@ -144,6 +150,194 @@ jassert_internal::JAssert::~JAssert()
   }
 }
 
+bool jassert_internal::jlog_enabled ( LogSource logSrc )
+{
+  return (jalib::getLogMask() & (logSrc | FLIGHTREC)) != 0;
+}
+
+jassert_internal::JLogEntry::JLogEntry ( LogSource logSrc )
+  : JASSERT_CONT_A(*this)
+  , JASSERT_CONT_B(*this)
+  , _assert(NULL)
+{
+  if (jalib::getLogMask() & logSrc) {
+    _assert = new (_assertStorage.buf) JAssert(logSrc, false);
+  } else {
+    _event.fileLine = NULL;
+    _event.func = NULL;
+    _event.msg = NULL;
+    _event.logSrc = logSrc;
+    _event.numArgs = 0;
+  }
+}
+
+jassert_internal::JLogEntry::~JLogEntry()
+{
+  if (_assert != NULL) {
+    _assert->~JAssert();
+  } else {
+    jflight_record(_event);
+  }
+}
+
+jassert_internal::JLogEntry&
+jassert_internal::JLogEntry::LogContext ( const char *fileLine,
+                                          const char *func )
+{
+  if (_assert != NULL) {
+    _assert->Print('[').Print(getpid()).Print("] TRACE at ")
+      .Print(jassert_basename(fileLine)).Print(" in ").Print(func);
+  } else {
+    _event.fileLine = fileLine;
+    _event.func = func;
+  }
+  return *this;
+}
+
+jassert_internal::JLogEntry&
+jassert_internal::JLogEntry::Print ( const char *t )
+{
+  static const char reason[] = "; REASON='";
+  if (_assert != NULL) {
+    _assert->Print(t);
+  } else if (_event.msg == NULL && t != NULL &&
+             strncmp(t, reason, sizeof(reason) - 1) == 0) {
+    // Only a literal message can be kept; it outlives this call.
+    _event.msg = t + sizeof(reason) - 1;
+  }
+  return *this;
+}
+
+jassert_internal::JLogEntry&
+jassert_internal::JLogEntry::Text ( const char *msg )
+{
+  if (_assert != NULL) {
+    _assert->Text(msg);
+  }
+  return *this;
+}
+
+/* The flight recorder: one ring of events per thread.  A thread claims a ring
+ * the first time it records an event, and only that thread ever writes to it,
+ * so recording takes no locks.  The rings are dumped, in binary, on a failed
+ * JASSERT or on request (dmtcp_command --flight-recorder), and are decoded
+ * offline by util/dmtcp_flightrec.py.  Rings aren't reclaimed when a thread
+ * exits; once all of them are claimed, new threads record nothing.
+ */
+#define JFLIGHT_MAX_RINGS   128
+#define JFLIGHT_RING_EVENTS 1024   // power of two
+
+struct JFlightRing
+{
+  pid_t tid;
+  volatile uint64_t head;   // number of events ever recorded
+  jassert_internal::JFlightEvent events[JFLIGHT_RING_EVENTS];
+};
+
+static JFlightRing *flightRings[JFLIGHT_MAX_RINGS];
+static volatile int numFlightRings = 0;
+static __thread JFlightRing *myFlightRing = NULL;
+static __thread bool myFlightRingUnavailable = false;
+
+static JFlightRing *claimFlightRing()
+{
+  int idx = __sync_fetch_and_add(&numFlightRings, 1);
+  if (idx >= JFLIGHT_MAX_RINGS) {
+    __sync_fetch_and_sub(&numFlightRings, 1);
+    return NULL;
+  }
+  void *addr = jalib::mmap(NULL, sizeof(JFlightRing), PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (addr == MAP_FAILED) {
+    return NULL;
+  }
+  JFlightRing *ring = (JFlightRing*) addr;
+  ring->tid = jalib::syscall(SYS_gettid);
+  ring->head = 0;
+  flightRings[idx] = ring;
+  return ring;
+}
+
+void jassert_internal::jflight_record ( JFlightEvent& e )
+{
+  if (e.fileLine == NULL || myFlightRingUnavailable) {
+    return;
+  }
+  if (myFlightRing == NULL) {
+    myFlightRing = claimFlightRing();
+    if (myFlightRing == NULL) {
+      myFlightRingUnavailable = true;
+      return;
+    }
+  }
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  e.timestamp = (uint64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+
+  JFlightRing *ring = myFlightRing;
+  ring->events[ring->head & (JFLIGHT_RING_EVENTS - 1)] = e;
+  __sync_synchronize();
+  ring->head++;
+}
+
+// Computed by set_log_file(), so that jflight_dump() needs no allocation.
+static char flightRecPath[PATH_MAX];
+
+static void writeFlightString(int fd, const char *str)
+{
+  uint32_t len = (str == NULL) ? 0 : strlen(str);
+  jalib::writeAll(fd, &len, sizeof(len));
+  jalib::writeAll(fd, str, len);
+}
+
+// DOES:  write all rings to $DMTCP_TMPDIR/flightrec.<uniquePid>.
+// WITHOUT malloc or stdio, since we may be called from a failed JASSERT:
+// only static buffers and jalib's raw I/O.
+// Layout:  "JFLIGHT1", then per event:  tid (int32), logSrc, numArgs
+// (uint32), timestamp, args[numArgs] (uint64), and then the file:line,
+// function and message as (uint32 length, bytes).
+void jassert_internal::jflight_dump ()
+{
+  int numRings = numFlightRings;
+  if (numRings > JFLIGHT_MAX_RINGS) numRings = JFLIGHT_MAX_RINGS;
+  if (numRings == 0 || flightRecPath[0] == '\0') {
+    return;
+  }
+  int fd = jalib::open(flightRecPath, O_WRONLY | O_CREAT | O_TRUNC,
+                       S_IRUSR | S_IWUSR);
+  if (fd == -1) {
+    return;
+  }
+  jalib::writeAll(fd, "JFLIGHT1", 8);
+  for (int i = 0; i < numRings; i++) {
+    JFlightRing *ring = flightRings[i];
+    if (ring == NULL) continue;
+    uint64_t head = ring->head;
+    uint64_t first = head > JFLIGHT_RING_EVENTS ? head - JFLIGHT_RING_EVENTS : 0;
+    for (uint64_t n = first; n < head; n++) {
+      const JFlightEvent &e = ring->events[n & (JFLIGHT_RING_EVENTS - 1)];
+      int32_t tid = ring->tid;
+      uint32_t numArgs = e.numArgs;
+      if (numArgs > JFLIGHT_MAX_ARGS) numArgs = JFLIGHT_MAX_ARGS;
+      jalib::writeAll(fd, &tid, sizeof(tid));
+      jalib::writeAll(fd, &e.logSrc, sizeof(e.logSrc));
+      jalib::writeAll(fd, &numArgs, sizeof(numArgs));
+      jalib::writeAll(fd, &e.timestamp, sizeof(e.timestamp));
+      jalib::writeAll(fd, e.args, numArgs * sizeof(e.args[0]));
+      writeFlightString(fd, e.fileLine);
+      writeFlightString(fd, e.func);
+      writeFlightString(fd, e.msg);
+    }
+  }
+  jalib::close(fd);
+
+  jassert_safe_print("   Flight recorder written to ");
+  jassert_safe_print(flightRecPath);
+  jassert_safe_print("\n   Try:  util/dmtcp_flightrec.py ");
+  jassert_safe_print(flightRecPath);
+  jassert_safe_print("\n");
+}
+
 const char* jassert_internal::jassert_basename ( const char* str )
 {
   for ( const char* c = str; c[0] != '\0' && c[1] !='\0' ; ++c ) {
@@ -296,6 +490,11 @@ void jassert_internal::set_log_file(const jalib::string& path,
 {
   tmpDir() = _tmpDir;
   uniquePidStr() = _uniquePidStr;
+  if (snprintf(flightRecPath, sizeof(flightRecPath), "%s/flightrec.%s",
+               _tmpDir.c_str(), _uniquePidStr.c_str()) >=
+        (int) sizeof(flightRecPath)) {
+    flightRecPath[0] = '\0';
+  }
 
   theLogFilePath() = path;
   if ( theLogFileFd != -1 ) jalib::close ( theLogFileFd );
@@ -28,6 +28,7 @@
 #include <iostream>
 #include <sstream>
 #include <string.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <errno.h>
 #include <execinfo.h> /* For backtrace() */
@@ -97,6 +98,7 @@ namespace jassert_internal
     PID     = 0x00000100,
     SYSV    = 0x00000200,
     TIMER   = 0x00000400,
+    FLIGHTREC = 0x80000000,  // Record the JLOGs that aren't printed
     ALL     = 0xFFFFFFFF,
   };
 
@@ -147,6 +149,84 @@ namespace jassert_internal
   };
 
 
+#define JFLIGHT_MAX_ARGS 4
+
+  /// One JLOG call, as kept by the flight recorder: the call site and the
+  /// raw values of its integral and pointer arguments.
+  struct JFlightEvent
+  {
+    uint64_t timestamp;   // CLOCK_MONOTONIC, in nanoseconds
+    const char *fileLine;
+    const char *func;
+    const char *msg;
+    uint32_t logSrc;
+    uint32_t numArgs;
+    uint64_t args[JFLIGHT_MAX_ARGS];
+  };
+
+  template < typename T >
+  inline void jflight_arg ( JFlightEvent&, const T& ) {}
+  template < typename T >
+  inline void jflight_arg ( JFlightEvent& e, T* t )
+  {
+    if (e.numArgs < JFLIGHT_MAX_ARGS) e.args[e.numArgs++] = (uint64_t) t;
+  }
+#define JFLIGHT_ARG(type) \
+  inline void jflight_arg ( JFlightEvent& e, type t ) \
+  { \
+    if (e.numArgs < JFLIGHT_MAX_ARGS) e.args[e.numArgs++] = (uint64_t) t; \
+  }
+  JFLIGHT_ARG(bool)
+  JFLIGHT_ARG(short)
+  JFLIGHT_ARG(unsigned short)
+  JFLIGHT_ARG(int)
+  JFLIGHT_ARG(unsigned int)
+  JFLIGHT_ARG(long)
+  JFLIGHT_ARG(unsigned long)
+  JFLIGHT_ARG(long long)
+  JFLIGHT_ARG(unsigned long long)
+#undef JFLIGHT_ARG
+
+  bool jlog_enabled ( LogSource logSrc );
+  void jflight_record ( JFlightEvent& e );
+  void jflight_dump ();
+
+  /// A JLOG call.  If its source is in the log mask, it is formatted and
+  /// printed like any other JASSERT message.  Otherwise (FLIGHTREC set), only
+  /// the raw arguments are kept in this thread's flight recorder.
+  class JLogEntry
+  {
+    public:
+      JLogEntry ( LogSource logSrc );
+      ~JLogEntry();
+
+      JLogEntry& LogContext ( const char *fileLine, const char *func );
+      template < typename T > JLogEntry& Print ( const T& t )
+      {
+        if (_assert != NULL) {
+          _assert->Print ( t );
+        } else {
+          jflight_arg ( _event, t );
+        }
+        return *this;
+      }
+      JLogEntry& Print ( const char *t );
+      JLogEntry& Text ( const char* msg );
+
+      JLogEntry& JASSERT_CONT_A;
+      JLogEntry& JASSERT_CONT_B;
+
+      template < typename T > JLogEntry& operator << ( const T& t )
+      { return Print ( t ); }
+    private:
+      JAssert *_assert;
+      JFlightEvent _event;
+      union {
+        char buf[sizeof(JAssert)];
+        long double align;
+      } _assertStorage;
+  };
+
   const char* jassert_basename ( const char* str );
   dmtcp::ostream& jassert_output_stream();
   void jassert_safe_print ( const char* );
@@ -221,15 +301,18 @@ namespace jassert_internal
 #endif
 
 #define JLOG_HELPER(msg) \
-  JASSERT_CONTEXT("TRACE", msg).JASSERT_CONT_A
+  LogContext(__FILE__ ":" JASSERT_LINE, JASSERT_FUNC) \
+    .Print("; REASON='" msg "'\n").JASSERT_CONT_A
 
+// The log mask is tested before anything is formatted.
 #ifdef LOGGING
 #define JLOG(src) \
-  jassert_internal::JAssert(jassert_internal::src, false).JLOG_HELPER
+  if (!jassert_internal::jlog_enabled(jassert_internal::src)){} \
+  else jassert_internal::JLogEntry(jassert_internal::src).JLOG_HELPER
 #else
 #define JLOG(src) \
   if (true){} \
-  else jassert_internal::JAssert(jassert_internal::src, false).JLOG_HELPER
+  else jassert_internal::JLogEntry(jassert_internal::src).JLOG_HELPER
 #endif
 
 #define JNOTE(msg) if(jassert_quiet >= 1){}else \
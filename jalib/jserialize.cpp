@@ -23,6 +23,8 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
+#include <string.h>
+#include <algorithm>
 #include "jalib.h"
 #include "jserialize.h"
 #include "jassert.h"
@@ -115,3 +117,118 @@ void jalib::JBinarySerializeReaderRaw::readOrWrite ( void* buffer, size_t len )
     .Text("read() failed");
   _bytes += len;
 }
+
+jalib::JBinarySerializeBufferedWriter::JBinarySerializeBufferedWriter
+  ( const jalib::string& path, int fd )
+  : JBinarySerializeWriterRaw ( path, fd )
+  , _buf ( (char*) JALLOC_HELPER_MALLOC ( JSERIALIZE_BUFFER_SIZE ) )
+  , _len ( 0 )
+{}
+
+jalib::JBinarySerializeBufferedWriter::~JBinarySerializeBufferedWriter()
+{
+  flush();
+  JALLOC_HELPER_FREE ( _buf );
+}
+
+void jalib::JBinarySerializeBufferedWriter::flush()
+{
+  if (_len > 0) {
+    size_t ret = jalib::writeAll(_fd, _buf, _len);
+    JASSERT(ret == _len) (filename()) (_len) (JASSERT_ERRNO)
+      .Text( "write() failed" );
+    _len = 0;
+  }
+}
+
+void jalib::JBinarySerializeBufferedWriter::rewind()
+{
+  flush();
+  JBinarySerializeWriterRaw::rewind();
+}
+
+bool jalib::JBinarySerializeBufferedWriter::isempty()
+{
+  return _len == 0 && JBinarySerializeWriterRaw::isempty();
+}
+
+void jalib::JBinarySerializeBufferedWriter::readOrWrite ( void* buffer,
+                                                         size_t len )
+{
+  if (_len + len > JSERIALIZE_BUFFER_SIZE) {
+    flush();
+  }
+  if (len >= JSERIALIZE_BUFFER_SIZE) {
+    // Too large to be worth copying.
+    JBinarySerializeWriterRaw::readOrWrite(buffer, len);
+    return;
+  }
+  memcpy(_buf + _len, buffer, len);
+  _len += len;
+  _bytes += len;
+}
+
+jalib::JBinarySerializeBufferedReader::JBinarySerializeBufferedReader
+  ( const jalib::string& path, int fd )
+  : JBinarySerializeReaderRaw ( path, fd )
+  , _buf ( (char*) JALLOC_HELPER_MALLOC ( JSERIALIZE_BUFFER_SIZE ) )
+  , _pos ( 0 )
+  , _end ( 0 )
+{}
+
+jalib::JBinarySerializeBufferedReader::~JBinarySerializeBufferedReader()
+{
+  flush();
+  JALLOC_HELPER_FREE ( _buf );
+}
+
+void jalib::JBinarySerializeBufferedReader::flush()
+{
+  if (_pos < _end) {
+    off_t unread = _end - _pos;
+    JASSERT(lseek(_fd, -unread, SEEK_CUR) != -1) (filename()) (unread)
+      (JASSERT_ERRNO) .Text("Cannot seek back over read-ahead data");
+  }
+  _pos = _end = 0;
+}
+
+void jalib::JBinarySerializeBufferedReader::rewind()
+{
+  _pos = _end = 0;
+  JBinarySerializeReaderRaw::rewind();
+}
+
+bool jalib::JBinarySerializeBufferedReader::isEOF()
+{
+  return _pos == _end && JBinarySerializeReaderRaw::isEOF();
+}
+
+void jalib::JBinarySerializeBufferedReader::readOrWrite ( void* buffer,
+                                                         size_t len )
+{
+  char *dest = (char*) buffer;
+  size_t remaining = len;
+  while (remaining > 0) {
+    if (_pos == _end) {
+      if (remaining >= JSERIALIZE_BUFFER_SIZE) {
+        JBinarySerializeReaderRaw::readOrWrite(dest, remaining);
+        _bytes -= remaining;
+        break;
+      }
+      ssize_t ret;
+      do {
+        ret = jalib::read(_fd, _buf, JSERIALIZE_BUFFER_SIZE);
+      } while (ret == -1 && (errno == EINTR || errno == EAGAIN));
+      JASSERT(ret > 0) (filename()) (JASSERT_ERRNO) (ret) (len)
+        .Text("read() failed");
+      _pos = 0;
+      _end = ret;
+    }
+    size_t n = std::min(remaining, _end - _pos);
+    memcpy(dest, _buf + _pos, n);
+    _pos += n;
+    dest += n;
+    remaining -= n;
+  }
+  _bytes += len;
+}
@@ -38,8 +38,34 @@
     JASSERT(versionCheck == correctValue)(versionCheck)(correctValue)(o.filename()) \
             .Text("invalid file format"); }
 
+// Size of the buffer of JBinarySerializeBufferedWriter/Reader.
+#define JSERIALIZE_BUFFER_SIZE (64 * 1024)
+
 namespace jalib
 {
+  // Types that serialize as their raw bytes.  Vectors and maps of them are
+  // copied in bulk, without per-element assert points.  Other types opt in
+  // with JSERIALIZE_POD_TYPE(T), at global scope.
+  template < typename T >
+  struct JSerializePod { enum { value = false }; };
+
+#define JSERIALIZE_POD_TYPE(T) \
+  namespace jalib { \
+    template <> struct JSerializePod< T > { enum { value = true }; }; \
+  }
+
+  template <> struct JSerializePod<char> { enum { value = true }; };
+  template <> struct JSerializePod<signed char> { enum { value = true }; };
+  template <> struct JSerializePod<unsigned char> { enum { value = true }; };
+  template <> struct JSerializePod<short> { enum { value = true }; };
+  template <> struct JSerializePod<unsigned short> { enum { value = true }; };
+  template <> struct JSerializePod<int> { enum { value = true }; };
+  template <> struct JSerializePod<unsigned int> { enum { value = true }; };
+  template <> struct JSerializePod<long> { enum { value = true }; };
+  template <> struct JSerializePod<unsigned long> { enum { value = true }; };
+  template <> struct JSerializePod<long long> { enum { value = true }; };
+  template <>
+  struct JSerializePod<unsigned long long> { enum { value = true }; };
 
   class JBinarySerializer
   {
@@ -83,7 +109,12 @@ namespace jalib
         t.resize ( len );
 
         //now serialize all the elements
-        for ( size_t i=0; i<len; ++i )
+        if ( JSerializePod<T>::value )
+        {
+          if ( len > 0 )
+            readOrWrite ( &t[0], len * sizeof ( T ) );
+        }
+        else for ( size_t i=0; i<len; ++i )
         {
           JSERIALIZE_ASSERT_POINT ( "[" );
           serialize ( t[i] );
@@ -115,7 +146,9 @@ namespace jalib
         serialize ( len );
 
         //now serialize all the elements
-        if (isReader()) {
+        if (JSerializePod<K>::value && JSerializePod<V>::value) {
+          serializePodMap(t, len);
+        } else if (isReader()) {
           K key; V val;
           for (size_t i = 0; i < len; i++) {
             serializePair(key, val);
@@ -133,6 +166,27 @@ namespace jalib
         JSERIALIZE_ASSERT_POINT ( "endmap" );
       }
 
+      template < typename K, typename V >
+      void serializePodMap ( dmtcp::map<K, V>& t, uint32_t len )
+      {
+        if (isReader()) {
+          K key; V val;
+          for (size_t i = 0; i < len; i++) {
+            readOrWrite(&key, sizeof(K));
+            readOrWrite(&val, sizeof(V));
+            t[key] = val;
+          }
+        } else {
+          for ( typename dmtcp::map<K, V>::iterator i = t.begin();
+                i != t.end();
+                ++i ) {
+            K key = i->first;
+            readOrWrite(&key, sizeof(K));
+            readOrWrite(&i->second, sizeof(V));
+          }
+        }
+      }
+
       const jalib::string& filename() const {return _filename;}
       size_t bytes() const { return _bytes; }
     private:
@@ -176,6 +230,26 @@ namespace jalib
       ~JBinarySerializeWriter();
   };
 
+  /* Writes go through a JSERIALIZE_BUFFER_SIZE buffer instead of costing a
+   * write() each.  flush(), also called by the destructor, must be called
+   * before anyone else writes to the fd.
+   */
+  class JBinarySerializeBufferedWriter : public JBinarySerializeWriterRaw
+  {
+    public:
+      JBinarySerializeBufferedWriter ( const jalib::string& file, int fd );
+      ~JBinarySerializeBufferedWriter();
+      void readOrWrite ( void* buffer, size_t len );
+      void rewind();
+      bool isempty();
+      void flush();
+    private:
+      JBinarySerializeBufferedWriter ( const JBinarySerializeBufferedWriter& );
+      void operator= ( const JBinarySerializeBufferedWriter& );
+      char *_buf;
+      size_t _len;
+  };
+
   class JBinarySerializeReaderRaw : public JBinarySerializer
   {
     public:
@@ -190,6 +264,28 @@ namespace jalib
       int _fd;
   };
 
+  /* Reads ahead JSERIALIZE_BUFFER_SIZE bytes at a time.  flush(), also called
+   * by the destructor, seeks the fd back over the unconsumed read-ahead, so
+   * that the next reader of the fd starts where this one stopped.  Hence, the
+   * fd must be seekable.
+   */
+  class JBinarySerializeBufferedReader : public JBinarySerializeReaderRaw
+  {
+    public:
+      JBinarySerializeBufferedReader ( const jalib::string& file, int fd );
+      ~JBinarySerializeBufferedReader();
+      void readOrWrite ( void* buffer, size_t len );
+      void rewind();
+      bool isEOF();
+      void flush();
+    private:
+      JBinarySerializeBufferedReader ( const JBinarySerializeBufferedReader& );
+      void operator= ( const JBinarySerializeBufferedReader& );
+      char *_buf;
+      size_t _pos;
+      size_t _end;
+  };
+
   class JBinarySerializeReader : public JBinarySerializeReaderRaw
   {
     public:
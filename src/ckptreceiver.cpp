@@ -0,0 +1,330 @@
+/****************************************************************************
+ *   Copyright (C) 2006-2013 by Jason Ansel, Kapil Arya, and Gene Cooperman *
+ *   jansel@csail.mit.edu, kapil@ccs.neu.edu, gene@ccs.neu.edu              *
+ *                                                                          *
+ *  This file is part of DMTCP.                                             *
+ *                                                                          *
+ *  DMTCP is free software: you can redistribute it and/or                  *
+ *  modify it under the terms of the GNU Lesser General Public License as   *
+ *  published by the Free Software Foundation, either version 3 of the      *
+ *  License, or (at your option) any later version.                         *
+ *                                                                          *
+ *  DMTCP is distributed in the hope that it will be useful,                *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with DMTCP:dmtcp/src.  If not, see                        *
+ *  <http://www.gnu.org/licenses/>.                                         *
+ ****************************************************************************/
+
+#include <errno.h>
+#include <limits.h>
+#include <netdb.h>
+#include <string.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include "util.h"
+#include "ckptreceiver.h"
+#include "syscallwrappers.h"
+#include "constants.h"
+
+using namespace dmtcp;
+
+#define UNIX_ADDR_PREFIX "unix:"
+
+/* Resolves addr and calls fn(socket, sockaddr, len) for each candidate
+ * address until it succeeds.  Returns the socket, or -1.
+ */
+static int with_addr(const string& addr, bool passive,
+                     int (*fn)(int, const struct sockaddr*, socklen_t))
+{
+  if (Util::strStartsWith(addr, UNIX_ADDR_PREFIX)) {
+    struct sockaddr_un un;
+    string path = addr.substr(strlen(UNIX_ADDR_PREFIX));
+    if (path.length() >= sizeof(un.sun_path)) {
+      errno = ENAMETOOLONG;
+      return -1;
+    }
+    memset(&un, 0, sizeof(un));
+    un.sun_family = AF_UNIX;
+    strcpy(un.sun_path, path.c_str());
+    int sock = _real_socket(AF_UNIX, SOCK_STREAM, 0);
+    if (sock != -1 && fn(sock, (struct sockaddr*) &un, sizeof(un)) == -1) {
+      _real_close(sock);
+      sock = -1;
+    }
+    return sock;
+  }
+
+  size_t colon = addr.rfind(':');
+  if (colon == string::npos) {
+    errno = EINVAL;
+    return -1;
+  }
+  string host = addr.substr(0, colon);
+  string port = addr.substr(colon + 1);
+  struct addrinfo hints;
+  struct addrinfo *res;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_UNSPEC;
+  hints.ai_socktype = SOCK_STREAM;
+  hints.ai_flags = passive ? AI_PASSIVE : 0;
+  if (getaddrinfo(host.empty() ? NULL : host.c_str(), port.c_str(),
+                  &hints, &res) != 0) {
+    errno = EHOSTUNREACH;
+    return -1;
+  }
+  int sock = -1;
+  for (struct addrinfo *r = res; r != NULL && sock == -1; r = r->ai_next) {
+    sock = _real_socket(r->ai_family, r->ai_socktype, r->ai_protocol);
+    if (sock != -1 && fn(sock, r->ai_addr, r->ai_addrlen) == -1) {
+      _real_close(sock);
+      sock = -1;
+    }
+  }
+  freeaddrinfo(res);
+  return sock;
+}
+
+static int connect_to(int sock, const struct sockaddr *sa, socklen_t len)
+{
+  int rc;
+  do {
+    rc = _real_connect(sock, sa, len);
+  } while (rc == -1 && errno == EINTR);
+  return rc;
+}
+
+static int bind_and_listen(int sock, const struct sockaddr *sa, socklen_t len)
+{
+  int one = 1;
+  setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  if (_real_bind(sock, sa, len) == -1) {
+    return -1;
+  }
+  return _real_listen(sock, 128);
+}
+
+int CkptReceiver::connect(const string& addr)
+{
+  return with_addr(addr, false, connect_to);
+}
+
+int CkptReceiver::listen(const string& addr)
+{
+  if (Util::strStartsWith(addr, UNIX_ADDR_PREFIX)) {
+    unlink(addr.substr(strlen(UNIX_ADDR_PREFIX)).c_str());
+  }
+  return with_addr(addr, true, bind_and_listen);
+}
+
+static int send_request(const string& addr, CkptReceiver::Op op,
+                        const string& name)
+{
+  int fd = CkptReceiver::connect(addr);
+  if (fd == -1) {
+    return -1;
+  }
+  const char *secret = getenv(ENV_VAR_CKPT_RECEIVER_SECRET);
+  if (secret == NULL) {
+    secret = "";
+  }
+  CkptReceiver::Request req;
+  memset(&req, 0, sizeof(req));
+  strncpy(req.magic, CKPT_RECEIVER_MAGIC, sizeof(req.magic));
+  req.op = op;
+  req.nameLen = name.length();
+  req.uid = getuid();
+  req.secretLen = strlen(secret);
+  if (req.secretLen > CKPT_RECEIVER_MAX_SECRET_LEN ||
+      Util::writeAll(fd, &req, sizeof(req)) != sizeof(req) ||
+      Util::writeAll(fd, name.c_str(), name.length()) !=
+        (ssize_t) name.length() ||
+      // Without a secret, the receiver may have replied and closed already.
+      (req.secretLen > 0 &&
+       Util::writeAll(fd, secret, req.secretLen) != (ssize_t) req.secretLen)) {
+    _real_close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+int CkptReceiver::openPut(const string& addr, const string& name)
+{
+  return send_request(addr, PUT, name);
+}
+
+int64_t CkptReceiver::finishPut(int fd)
+{
+  uint64_t size;
+  int64_t ret = -1;
+  char trailer[CKPT_RECEIVER_TRAILER_LEN];
+  strncpy(trailer, CKPT_RECEIVER_TRAILER, sizeof(trailer));
+  if (Util::writeAll(fd, trailer, sizeof(trailer)) == sizeof(trailer) &&
+      shutdown(fd, SHUT_WR) == 0 &&
+      Util::readAll(fd, &size, sizeof(size)) == sizeof(size)) {
+    ret = size;
+  }
+  _real_close(fd);
+  return ret;
+}
+
+int CkptReceiver::openXor(const string& addr, const string& paritySet,
+                          uint32_t index, uint32_t groupSize,
+                          uint32_t generation, const string& name)
+{
+  int fd = send_request(addr, XOR, paritySet);
+  if (fd == -1) {
+    return -1;
+  }
+  XorMember member;
+  memset(&member, 0, sizeof(member));
+  member.index = index;
+  member.groupSize = groupSize;
+  member.nameLen = name.length();
+  member.generation = generation;
+  if (Util::writeAll(fd, &member, sizeof(member)) != sizeof(member) ||
+      Util::writeAll(fd, name.c_str(), name.length()) !=
+        (ssize_t) name.length()) {
+    _real_close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+string CkptReceiver::findParity(const string& addr, const string& name)
+{
+  int fd = send_request(addr, FIND, name);
+  if (fd == -1) {
+    return "";
+  }
+  int64_t len;
+  char buf[PATH_MAX + 1];
+  string paritySet;
+  if (Util::readAll(fd, &len, sizeof(len)) == sizeof(len) &&
+      len > 0 && len <= PATH_MAX &&
+      Util::readAll(fd, buf, len) == len) {
+    buf[len] = '\0';
+    paritySet = buf;
+  }
+  _real_close(fd);
+  return paritySet;
+}
+
+int CkptReceiver::openGet(const string& addr, const string& name,
+                          uint32_t *uid)
+{
+  int fd = send_request(addr, GET, name);
+  if (fd == -1) {
+    return -1;
+  }
+  GetReply reply;
+  if (Util::readAll(fd, &reply, sizeof(reply)) != sizeof(reply) ||
+      reply.size < 0) {
+    _real_close(fd);
+    return -1;
+  }
+  *uid = reply.uid;
+  return fd;
+}
+
+bool CkptReceiver::readRequest(int fd, Op *op, string *name, uint32_t *uid,
+                               string *secret)
+{
+  Request req;
+  if (Util::readAll(fd, &req, sizeof(req)) != sizeof(req) ||
+      strncmp(req.magic, CKPT_RECEIVER_MAGIC, sizeof(req.magic)) != 0 ||
+      req.op < PUT || req.op > FIND ||
+      req.nameLen == 0 || req.nameLen > PATH_MAX ||
+      req.secretLen > CKPT_RECEIVER_MAX_SECRET_LEN) {
+    return false;
+  }
+  char buf[PATH_MAX + 1];
+  char secretBuf[CKPT_RECEIVER_MAX_SECRET_LEN];
+  if (Util::readAll(fd, buf, req.nameLen) != (ssize_t) req.nameLen ||
+      Util::readAll(fd, secretBuf, req.secretLen) != (ssize_t) req.secretLen) {
+    return false;
+  }
+  buf[req.nameLen] = '\0';
+  if (strlen(buf) != req.nameLen || !isImageName(buf)) {
+    return false;
+  }
+  *op = (Op) req.op;
+  *name = buf;
+  *uid = req.uid;
+  secret->assign(secretBuf, req.secretLen);
+  return true;
+}
+
+CkptReceiver::ImageHash::ImageHash()
+  : _a(0x87c37b91114253d5ULL), _b(0x4cf5ad432745937fULL), _total(0),
+    _tailLen(0)
+{
+}
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix64(uint64_t k)
+{
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  return k ^ (k >> 33);
+}
+
+void CkptReceiver::ImageHash::mix(uint64_t w)
+{
+  _a = rotl64(_a ^ (w * 0x87c37b91114253d5ULL), 31) * 0x4cf5ad432745937fULL;
+  _b = rotl64(_b ^ (w * 0x52dce729da3ed25bULL), 33) * 0x38495ab5c2b2ae35ULL;
+}
+
+void CkptReceiver::ImageHash::update(const void *buf, size_t len)
+{
+  const unsigned char *p = (const unsigned char*) buf;
+  _total += len;
+  while (_tailLen > 0 && _tailLen < sizeof(_tail) && len > 0) {
+    _tail[_tailLen++] = *p++;
+    len--;
+  }
+  if (_tailLen == sizeof(_tail)) {
+    uint64_t w;
+    memcpy(&w, _tail, sizeof(w));
+    mix(w);
+    _tailLen = 0;
+  }
+  for (; len >= sizeof(uint64_t); len -= sizeof(uint64_t)) {
+    uint64_t w;
+    memcpy(&w, p, sizeof(w));
+    mix(w);
+    p += sizeof(w);
+  }
+  memcpy(_tail + _tailLen, p, len);
+  _tailLen += len;
+}
+
+void CkptReceiver::ImageHash::final(uint64_t hash[2])
+{
+  uint64_t w = 0;
+  memcpy(&w, _tail, _tailLen);
+  uint64_t a = _a ^ w ^ _total;
+  uint64_t b = _b ^ rotl64(w, 29) ^ (_total << 1);
+  hash[0] = fmix64(a + b);
+  hash[1] = fmix64(b ^ rotl64(a, 17));
+}
+
+// Image names are plain file names.
+bool CkptReceiver::isImageName(const char *name)
+{
+  return name[0] != '\0' && strchr(name, '/') == NULL &&
+         strcmp(name, ".") != 0 && strcmp(name, "..") != 0 &&
+         strlen(name) < sizeof(((ParityMember*) 0)->name);
+}
@@ -0,0 +1,157 @@
+/****************************************************************************
+ *   Copyright (C) 2006-2013 by Jason Ansel, Kapil Arya, and Gene Cooperman *
+ *   jansel@csail.mit.edu, kapil@ccs.neu.edu, gene@ccs.neu.edu              *
+ *                                                                          *
+ *  This file is part of DMTCP.                                             *
+ *                                                                          *
+ *  DMTCP is free software: you can redistribute it and/or                  *
+ *  modify it under the terms of the GNU Lesser General Public License as   *
+ *  published by the Free Software Foundation, either version 3 of the      *
+ *  License, or (at your option) any later version.                         *
+ *                                                                          *
+ *  DMTCP is distributed in the hope that it will be useful,                *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with DMTCP:dmtcp/src.  If not, see                        *
+ *  <http://www.gnu.org/licenses/>.                                         *
+ ****************************************************************************/
+
+#ifndef CKPT_RECEIVER_H
+#define CKPT_RECEIVER_H
+
+#include <stdint.h>
+#include "dmtcpalloc.h"
+
+/* Protocol spoken with dmtcp_ckpt_receiver, which keeps checkpoint images
+ * (in RAM, or in a directory of its own) for processes on other nodes.  Each
+ * connection carries one request header, the image name and the shared
+ * secret (DMTCP_CKPT_RECEIVER_SECRET).  A receiver serves only its own user:
+ * over a unix socket, the peer must have the receiver's uid; over TCP, the
+ * request must carry the receiver's secret and uid.  Then:
+ *   PUT:  the image and CKPT_RECEIVER_TRAILER, up to shutdown(SHUT_WR); the
+ *         receiver replies with the size stored (uint64_t) once the image is
+ *         complete.  An image only replaces the previous one of the same name
+ *         once it is complete: a stream that does not end with the trailer
+ *         (the writer died) is dropped.
+ *   GET:  the receiver replies with a GetReply (size -1 if it does not
+ *         have the image), followed by the image.
+ *   XOR:  the name is that of a parity set, and is followed by an XorMember
+ *         and the member's image name; then as for PUT, except that the
+ *         image is XORed into the parity of its group.  Once every member
+ *         has been received, the parity set is stored like an image (a
+ *         ParityHeader, groupSize ParityMembers, and the parity), under the
+ *         name of the set, and replaces the previous one.  All members are
+ *         of one checkpoint generation; the ImageHash of each tells a
+ *         rebuild whether the surviving images are those the parity was
+ *         computed from.
+ *   FIND: the name is that of an image; the receiver replies with the
+ *         length (int64_t, -1 if none) and name of a parity set that has it.
+ * The receiver address is HOST:PORT, or unix:PATH.
+ */
+#define CKPT_RECEIVER_MAGIC "DMTCP_CKPT_RCV2"
+#define CKPT_RECEIVER_MAX_SECRET_LEN 256
+#define CKPT_RECEIVER_TRAILER "DMTCP_CKPT_END1"
+#define CKPT_RECEIVER_TRAILER_LEN 16
+#define CKPT_PARITY_MAGIC "DMTCP_PARITY_V2"
+#define CKPT_PARITY_SUFFIX ".xor"
+#define CKPT_PARITY_MAX_GROUP_SIZE 64
+
+namespace dmtcp
+{
+  namespace CkptReceiver
+  {
+    enum Op {
+      PUT = 1,
+      GET = 2,
+      XOR = 3,
+      FIND = 4
+    };
+
+    struct Request {
+      char magic[16];
+      uint32_t op;
+      uint32_t nameLen;
+      uint32_t uid;
+      uint32_t secretLen;
+    };
+
+    struct GetReply {
+      int64_t size;
+      uint32_t uid;   // owner of the image: the uid of the receiver
+      uint32_t reserved;
+    };
+
+    struct XorMember {
+      uint32_t index;
+      uint32_t groupSize;
+      uint32_t nameLen;
+      uint32_t generation;
+    };
+
+    struct ParityHeader {
+      char magic[16];
+      uint32_t groupSize;
+      uint32_t generation;  // checkpoint generation of all the members
+      uint64_t paritySize;
+    };
+
+    struct ParityMember {
+      uint64_t size;
+      uint64_t hash[2];
+      char name[256];
+    };
+
+    // A 128-bit (non-cryptographic) hash of a stream of any chunking.
+    class ImageHash
+    {
+      public:
+        ImageHash();
+        void update(const void *buf, size_t len);
+        void final(uint64_t hash[2]);
+
+      private:
+        void mix(uint64_t w);
+
+        uint64_t _a;
+        uint64_t _b;
+        uint64_t _total;
+        unsigned char _tail[sizeof(uint64_t)];
+        size_t _tailLen;
+    };
+
+    // Returns a socket connected to addr, or -1.
+    int connect(const string& addr);
+    // Returns a socket listening on addr ("HOST:PORT", ":PORT" or
+    // "unix:PATH"), or -1.
+    int listen(const string& addr);
+
+    // Start streaming image name to the receiver; write it to the returned
+    // fd, and then call finishPut() on it (or on a dup of it).
+    int openPut(const string& addr, const string& name);
+    // Sends the trailer; returns the size the receiver stored, or -1.
+    // Closes fd.
+    int64_t finishPut(int fd);
+    // Returns an fd to read image name from, or -1 if the receiver is
+    // unreachable or does not have it.  The owner of the image is returned
+    // in uid.
+    int openGet(const string& addr, const string& name, uint32_t *uid);
+    // Start streaming image name of the given checkpoint generation, member
+    // index of a group of groupSize, to the parity set paritySet; finish
+    // with finishPut().
+    int openXor(const string& addr, const string& paritySet,
+                uint32_t index, uint32_t groupSize, uint32_t generation,
+                const string& name);
+    // Returns the name of a parity set that has image name, or "".
+    string findParity(const string& addr, const string& name);
+
+    // For the receiver.
+    bool readRequest(int fd, Op *op, string *name, uint32_t *uid,
+                     string *secret);
+    bool isImageName(const char *name);
+  };
+}
+
+#endif
@@ -36,12 +36,21 @@
 #include <signal.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <errno.h>
 #include "constants.h"
 #include "util.h"
 #include "syscallwrappers.h"
 #include "dmtcp.h"
 #include "protectedfds.h"
 #include "ckptserializer.h"
+#include "ckptreceiver.h"
+#include "coordinatorapi.h"
+#include "processinfo.h"
+#include "../jalib/jfilesystem.h"
 
 // aarch64 doesn't define SYS_pipe kernel call by default.
 #if defined(__aarch64__)
@@ -84,7 +93,11 @@ static void prepare_sigchld_handler()
   sigaction(SIGCHLD, &default_sigchld_action, &saved_sigchld_action);
 }
 
-static void restore_sigchld_handler_and_wait_for_zombie(pid_t pid)
+/* If status is not NULL, the exit status of the child is returned in it (0
+ * if it could not be had).
+ */
+static void restore_sigchld_handler_and_wait_for_zombie(pid_t pid,
+                                                        int *status = NULL)
 {
     /* This is done to avoid calling the user SIGCHLD handler when gzip
      * or another compression utility exits.
@@ -103,7 +116,11 @@ static void restore_sigchld_handler_and_wait_for_zombie(pid_t pid)
     sigfillset(&suspend_sigset);
     sigdelset(&suspend_sigset, SIGCHLD);
     _real_sigsuspend(&suspend_sigset);
-    JWARNING(_real_waitpid(pid, NULL, 0) != -1) (pid) (JASSERT_ERRNO);
+    int wstatus = 0;
+    JWARNING(_real_waitpid(pid, &wstatus, 0) != -1) (pid) (JASSERT_ERRNO);
+    if (status != NULL) {
+      *status = wstatus;
+    }
     pid = -1;
     sigaction(SIGCHLD, &saved_sigchld_action, NULL);
 }
@@ -193,24 +210,83 @@ static int open_ckpt_to_write_gz(int fd, int pipe_fds[2], char *gzip_path)
   return open_ckpt_to_write(fd,pipe_fds,gzip_args);
 }
 
+/* If DMTCP_CKPT_RECEIVER names a dmtcp_ckpt_receiver, images are streamed
+ * to it instead of being written to the ckpt dir.
+ */
+static const char *ckpt_receiver()
+{
+  const char *receiver = getenv(ENV_VAR_CKPT_RECEIVER);
+  return receiver != NULL && receiver[0] != '\0' ? receiver : NULL;
+}
+
+/* If DMTCP_CKPT_CHUNK_STORE names a directory, the image is piped through
+ * dmtcp_ckpt_chunker, which keeps its chunks there (once for all generations)
+ * and writes a manifest of them to the ckpt file.  This replaces compression.
+ */
+static int open_ckpt_to_write_chunks(int fd, const char *chunkStore,
+                                     bool *use_compression)
+{
+  int pipe_fds[2];
+  prepare_sigchld_handler();
+  if (_real_pipe(pipe_fds) == -1) {
+    JWARNING(false) (JASSERT_ERRNO)
+      .Text("Error creating pipe. Chunk store won't be used.");
+    sigaction(SIGCHLD, &saved_sigchld_action, NULL);
+    return fd;
+  }
+
+  string chunker = Util::getPath("dmtcp_ckpt_chunker");
+  char *chunker_args[] = {
+    const_cast<char*> (chunker.c_str()),
+    const_cast<char*> ("-s"),
+    const_cast<char*> (chunkStore),
+    NULL
+  };
+  JLOG(DMTCP)("open_ckpt_to_write_chunks\n") (chunkStore);
+  fd = open_ckpt_to_write(fd, pipe_fds, chunker_args);
+  *use_compression = pipe_fds[0] != -1;
+  if (!*use_compression) {
+    sigaction(SIGCHLD, &saved_sigchld_action, NULL);
+  }
+  return fd;
+}
+
+/* If receiverFd is not -1, it is the stream to the checkpoint receiver to
+ * write the image to.
+ */
 static int perform_open_ckpt_image_fd(const char *tempCkptFilename,
+                                      int receiverFd,
                                       bool *use_compression,
                                       int *fdCkptFileOnDisk)
 {
   *use_compression = false;  /* default value */
 
-  /* 1. Open fd to checkpoint image on disk */
-  /* Create temp checkpoint file and write magic number to it */
-  int flags = O_CREAT | O_TRUNC | O_WRONLY;
-  int fd = _real_open(tempCkptFilename, flags, 0600);
+  int fd;
+  if (receiverFd != -1) {
+    /* 1. Stream to the checkpoint receiver */
+    fd = receiverFd;
+  } else {
+    /* 1. Open fd to checkpoint image on disk */
+    /* Create temp checkpoint file and write magic number to it */
+    int flags = O_CREAT | O_TRUNC | O_WRONLY;
+    fd = _real_open(tempCkptFilename, flags, 0600);
+    JASSERT(fd != -1) (tempCkptFilename) (JASSERT_ERRNO)
+      .Text ("Error creating file.");
+  }
   *fdCkptFileOnDisk = fd; /* if use_compression, fd will be reset to pipe */
-  JASSERT(fd != -1) (tempCkptFilename) (JASSERT_ERRNO)
-    .Text ("Error creating file.");
 
 #ifdef FAST_RST_VIA_MMAP
   return fd;
 #endif
 
+  const char *chunkStore = getenv(ENV_VAR_CKPT_CHUNK_STORE);
+  if (chunkStore != NULL && chunkStore[0] != '\0' && receiverFd == -1) {
+    fd = open_ckpt_to_write_chunks(fd, chunkStore, use_compression);
+    if (*use_compression) {
+      return fd;
+    }
+  }
+
   /* 2. Test if using GZIP/HBICT compression */
   /* 2a. Test if using GZIP compression */
   int use_gzip_compression = 0;
@@ -374,6 +450,146 @@ open_ckpt_to_write(int fd, int pipe_fds[2], char **extcomp_args)
 }
 
 
+/*
+ * Multi-level checkpointing: if DMTCP_LOCAL_CKPT_DIR names a node-local
+ * directory (tmpfs, NVMe, ...), the image is written there, and the
+ * checkpoint completes as soon as the local write does.  A background drainer
+ * process then copies the image to its usual place in the (global) ckpt dir,
+ * and reports to the coordinator once the copy has been renamed into place.
+ * The copy keeps the mtime of the local image, so that dmtcp_restart can tell
+ * a drained copy (same mtime) from an image of a later checkpoint that was
+ * written to the ckpt dir directly (newer); it prefers the local copy unless
+ * the latter.
+ */
+static string local_ckpt_filename(const string& ckptFilename)
+{
+  const char *localCkptDir = getenv(ENV_VAR_LOCAL_CKPT_DIR);
+  if (localCkptDir == NULL || localCkptDir[0] == '\0' ||
+      ProcessInfo::instance().getCkptDir() == localCkptDir) {
+    return "";
+  }
+  return string(localCkptDir) + "/" +
+    jalib::Filesystem::BaseName(ckptFilename);
+}
+
+static bool copy_ckpt_image(const char *src, const char *dest)
+{
+  const size_t bufSize = 4 * 1024 * 1024;
+  int in = _real_open(src, O_RDONLY, 0);
+  if (in == -1) {
+    return false;
+  }
+  int out = _real_open(dest, O_CREAT | O_TRUNC | O_WRONLY, 0600);
+  if (out == -1) {
+    _real_close(in);
+    return false;
+  }
+  // The copy buffer is large; map it directly instead of going through JAlloc.
+  char *buf = (char*) mmap(NULL, bufSize, PROT_READ | PROT_WRITE,
+                           MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  bool ok = buf != MAP_FAILED;
+  while (ok) {
+    ssize_t rc = Util::readAll(in, buf, bufSize);
+    if (rc <= 0) {
+      ok = rc == 0;
+      break;
+    }
+    ok = Util::writeAll(out, buf, rc) == rc;
+  }
+  if (buf != MAP_FAILED) {
+    munmap(buf, bufSize);
+  }
+  struct stat st;
+  if (ok && fstat(in, &st) == 0) {
+    struct timespec times[2] = { st.st_atim, st.st_mtim };
+    ok = futimens(out, times) == 0;
+  }
+  ok = ok && fsync(out) == 0;
+  ok = _real_close(out) == 0 && ok;
+  _real_close(in);
+  return ok;
+}
+
+static void drain_ckpt_image(const string& localFilename,
+                             const string& ckptFilename)
+{
+  /* Successive drainers of the same image are serialized through a lock file
+   * next to the local image, so that an older generation never gets renamed
+   * over a newer one in the global ckpt dir.  The last one out removes it; a
+   * drainer that was waiting on the removed file starts over.
+   */
+  string lockFilename = localFilename + ".drain";
+  int lockfd = -1;
+  while (true) {
+    lockfd = _real_open(lockFilename.c_str(), O_CREAT | O_RDWR, 0600);
+    JWARNING(lockfd != -1) (lockFilename) (JASSERT_ERRNO);
+    if (lockfd == -1) {
+      break;
+    }
+    struct stat fdStat;
+    struct stat pathStat;
+    if (flock(lockfd, LOCK_EX) != 0) {
+      JWARNING(false) (lockFilename) (JASSERT_ERRNO);
+      _real_close(lockfd);
+      lockfd = -1;
+      break;
+    }
+    if (fstat(lockfd, &fdStat) == 0 &&
+        stat(lockFilename.c_str(), &pathStat) == 0 &&
+        fdStat.st_dev == pathStat.st_dev && fdStat.st_ino == pathStat.st_ino) {
+      break;
+    }
+    _real_close(lockfd);
+  }
+
+  string tempCkptFilename = ckptFilename + ".temp";
+  if (!copy_ckpt_image(localFilename.c_str(), tempCkptFilename.c_str())) {
+    JWARNING(false) (localFilename) (tempCkptFilename) (JASSERT_ERRNO)
+      .Text("Failed to copy checkpoint image to global ckpt dir.");
+    unlink(tempCkptFilename.c_str());
+  } else if (rename(tempCkptFilename.c_str(), ckptFilename.c_str()) != 0) {
+    JWARNING(false) (tempCkptFilename) (ckptFilename) (JASSERT_ERRNO);
+  } else {
+    JLOG(DMTCP)("checkpoint image drained") (localFilename) (ckptFilename);
+    CoordinatorAPI::instance().sendCkptDurable();
+  }
+
+  if (lockfd != -1) {
+    unlink(lockFilename.c_str());
+    _real_close(lockfd);
+  }
+}
+
+static void start_ckpt_image_drainer(const string& localFilename,
+                                     const string& ckptFilename)
+{
+  /* Double fork, as in test_and_prepare_for_forked_ckpt(), so that the
+   * drainer is reparented to init and never shows up as a child of the user
+   * process.
+   */
+  prepare_sigchld_handler();
+  pid_t cpid = _real_sys_fork();
+  if (cpid == -1) {
+    JWARNING(false) (JASSERT_ERRNO)
+      .Text("Failed to fork drainer; copying image to global ckpt dir now.");
+    sigaction(SIGCHLD, &saved_sigchld_action, NULL);
+    drain_ckpt_image(localFilename, ckptFilename);
+    return;
+  } else if (cpid > 0) {
+    restore_sigchld_handler_and_wait_for_zombie(cpid);
+    return;
+  }
+
+  pid_t grandchild_pid = _real_sys_fork();
+  JWARNING(grandchild_pid != -1) (JASSERT_ERRNO)
+    .Text("Failed to fork drainer; image is only in the local ckpt dir.");
+  if (grandchild_pid != 0) {
+    _exit(0); /* child exits */
+  }
+  drain_ckpt_image(localFilename, ckptFilename);
+  _exit(0);
+}
+
 void CkptSerializer::createCkptDir()
 {
   string ckptDir = ProcessInfo::instance().getCkptDir();
@@ -384,17 +600,166 @@ void CkptSerializer::createCkptDir()
 
   JASSERT(0 == access(ckptDir.c_str(), X_OK|W_OK)) (ckptDir)
     .Text("ERROR: Missing execute- or write-access to checkpoint dir");
+
+  string localFilename =
+    local_ckpt_filename(ProcessInfo::instance().getCkptFilename());
+  if (!localFilename.empty()) {
+    string localCkptDir = jalib::Filesystem::DirName(localFilename);
+    JASSERT(mkdir(localCkptDir.c_str(), S_IRWXU) == 0 || errno == EEXIST)
+      (JASSERT_ERRNO) (localCkptDir)
+      .Text("Error creating local checkpoint directory");
+
+    JASSERT(0 == access(localCkptDir.c_str(), X_OK|W_OK)) (localCkptDir)
+      .Text("ERROR: Missing execute- or write-access to local checkpoint dir");
+  }
 }
 
 // See comments above for open_ckpt_to_read()
+static uint64_t lastImageSize = 0;
+static uint64_t lastImageWriteUsec = 0;
+
+void CkptSerializer::lastImageStats(uint64_t *size, uint64_t *writeUsec)
+{
+  *size = lastImageSize;
+  *writeUsec = lastImageWriteUsec;
+}
+
+/* Token bucket for the write bandwidth: it fills at writeBandwidth bytes/sec,
+ * up to a burst of a quarter second's worth, and every chunk written must be
+ * paid for from it.
+ */
+static uint64_t writeBandwidth = 0;
+static double writeTokens = 0;
+static struct timespec writeTokensTime;
+
+void CkptSerializer::setWriteBandwidth(uint64_t bytesPerSec)
+{
+  writeBandwidth = bytesPerSec;
+  writeTokens = bytesPerSec / 4;
+  clock_gettime(CLOCK_MONOTONIC, &writeTokensTime);
+  if (bytesPerSec > 0) {
+    JLOG(DMTCP)("checkpoint write bandwidth (bytes/sec)") (bytesPerSec);
+  }
+}
+
+ssize_t CkptSerializer::writeAll(int fd, const void *buf, size_t count)
+{
+  if (writeBandwidth == 0) {
+    return Util::writeAll(fd, buf, count);
+  }
+
+  const double burst = writeBandwidth / 4 > 4096 ? writeBandwidth / 4 : 4096;
+  const char *ptr = (const char *) buf;
+  size_t left = count;
+  while (left > 0) {
+    size_t chunk = left < burst ? left : (size_t) burst;
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    writeTokens += (now.tv_sec - writeTokensTime.tv_sec
+                    + (now.tv_nsec - writeTokensTime.tv_nsec) / 1e9)
+                   * writeBandwidth;
+    if (writeTokens > burst) {
+      writeTokens = burst;
+    }
+    writeTokensTime = now;
+    if (writeTokens < chunk) {
+      double wait = (chunk - writeTokens) / writeBandwidth;
+      struct timespec t;
+      t.tv_sec = (time_t) wait;
+      t.tv_nsec = (long) ((wait - t.tv_sec) * 1e9);
+      while (nanosleep(&t, &t) == -1 && errno == EINTR);
+    }
+    // Whatever was slept for is paid for by the next refill.
+    writeTokens -= chunk;
+    if (Util::writeAll(fd, ptr, chunk) != (ssize_t) chunk) {
+      return -1;
+    }
+    ptr += chunk;
+    left -= chunk;
+  }
+  return count;
+}
+
+static uint32_t xorIndex = 0;
+static uint32_t xorGroupSize = 0;
+static string xorReceiver;
+static string xorParitySet;
+
+void CkptSerializer::setXorGroup(uint32_t index, uint32_t groupSize,
+                                 const string& receiver,
+                                 const string& paritySet)
+{
+  xorIndex = index;
+  xorGroupSize = groupSize;
+  xorReceiver = receiver;
+  xorParitySet = paritySet;
+  if (groupSize > 0) {
+    JLOG(DMTCP)("XOR parity group") (paritySet) (index) (groupSize)
+      (receiver);
+  }
+}
+
+/* Stream the complete image to the receiver keeping the parity of its group.
+ * A failure only costs the redundancy, not the checkpoint.
+ */
+static void send_ckpt_image_to_parity(const string& imageFilename)
+{
+  string imageName = jalib::Filesystem::BaseName(imageFilename);
+  int in = _real_open(imageFilename.c_str(), O_RDONLY, 0);
+  int out = in == -1 ? -1
+    : CkptReceiver::openXor(xorReceiver, xorParitySet, xorIndex, xorGroupSize,
+                            ProcessInfo::instance().get_generation(),
+                            imageName);
+  bool ok = out != -1;
+  const size_t bufSize = 4 * 1024 * 1024;
+  void *buf = ok ? mmap(NULL, bufSize, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0)
+                 : MAP_FAILED;
+  ok = ok && buf != MAP_FAILED;
+  while (ok) {
+    ssize_t rc = Util::readAll(in, buf, bufSize);
+    if (rc <= 0) {
+      ok = rc == 0;
+      break;
+    }
+    ok = CkptSerializer::writeAll(out, buf, rc) == rc;
+  }
+  if (buf != MAP_FAILED) {
+    munmap(buf, bufSize);
+  }
+  if (out != -1) {
+    ok = CkptReceiver::finishPut(out) != -1 && ok;
+  }
+  if (in != -1) {
+    _real_close(in);
+  }
+  JWARNING(ok) (imageFilename) (xorReceiver) (xorParitySet) (JASSERT_ERRNO)
+    .Text("Failed to add checkpoint image to its XOR parity.");
+  if (ok) {
+    JLOG(DMTCP)("checkpoint image added to XOR parity")
+      (imageName) (xorParitySet);
+  }
+}
+
 void CkptSerializer::writeCkptImage(void *mtcpHdr, size_t mtcpHdrLen)
 {
+  struct timespec start;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  lastImageSize = 0;
+  lastImageWriteUsec = 0;
+
   string ckptFilename = ProcessInfo::instance().getCkptFilename();
-  string tempCkptFilename = ckptFilename;
+  const char *receiver = ckpt_receiver();
+  string localFilename = receiver != NULL ? ""
+                                          : local_ckpt_filename(ckptFilename);
+  string imageFilename = localFilename.empty() ? ckptFilename : localFilename;
+  string tempCkptFilename = imageFilename;
   tempCkptFilename += ".temp";
 
   JLOG(DMTCP)("Thread performing checkpoint.") (dmtcp_gettid());
-  createCkptDir();
+  if (receiver == NULL) {
+    createCkptDir();
+  }
   forked_ckpt_status = test_and_prepare_for_forked_ckpt();
   if (forked_ckpt_status == FORKED_CKPT_PARENT) {
     JLOG(DMTCP)("*** Using forked checkpointing.\n");
@@ -408,10 +773,25 @@ void CkptSerializer::writeCkptImage(void *mtcpHdr, size_t mtcpHdrLen)
   int fdCkptFileOnDisk = -1;
   int fd = -1;
 
-  fd = perform_open_ckpt_image_fd(tempCkptFilename.c_str(), &use_compression,
-                                  &fdCkptFileOnDisk);
+  string imageName = jalib::Filesystem::BaseName(imageFilename);
+  int putFd = -1;
+  if (receiver != NULL) {
+    putFd = CkptReceiver::openPut(receiver, imageName);
+    if (putFd == -1) {
+      // Losing the checkpoint is better than losing the process.
+      JWARNING(false) (receiver) (imageName) (JASSERT_ERRNO)
+        .Text("Checkpoint receiver unreachable; writing the image to the"
+              " ckpt dir instead.");
+      receiver = NULL;
+      createCkptDir();
+    }
+  }
+  fd = perform_open_ckpt_image_fd(tempCkptFilename.c_str(), putFd,
+                                  &use_compression, &fdCkptFileOnDisk);
   JASSERT(fdCkptFileOnDisk >= 0 );
   JASSERT(use_compression || fd == fdCkptFileOnDisk);
+  // mtcp_writememoryareas() closes fd; keep the stream open for the reply.
+  int receiverFd = receiver != NULL ? _real_dup(fdCkptFileOnDisk) : -1;
 
   // The rest of this function is for compatibility with original definition.
   writeDmtcpHeader(fd);
@@ -422,24 +802,74 @@ void CkptSerializer::writeCkptImage(void *mtcpHdr, size_t mtcpHdrLen)
   JLOG(DMTCP) ( "MTCP is about to write checkpoint image." )(ckptFilename);
   mtcp_writememoryareas(fd);
 
+  bool imageOk = true;
   if (use_compression) {
     /* In perform_open_ckpt_image_fd(), we set SIGCHLD to our own handler.
      * Restore it now.
      */
-    restore_sigchld_handler_and_wait_for_zombie(ckpt_extcomp_child_pid);
+    int status;
+    restore_sigchld_handler_and_wait_for_zombie(ckpt_extcomp_child_pid,
+                                                &status);
+    // E.g., dmtcp_ckpt_chunker could not write to its chunk store.
+    imageOk = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+    JWARNING(imageOk) (imageFilename) (status)
+      .Text("Compression process failed; keeping the previous checkpoint"
+            " image.");
 
     /* IF OUT OF DISK SPACE, REPORT IT HERE. */
-    JASSERT(fsync(fdCkptFileOnDisk) != -1) (JASSERT_ERRNO)
+    JASSERT(receiver != NULL || fsync(fdCkptFileOnDisk) != -1) (JASSERT_ERRNO)
       .Text("(compression): fsync error on checkpoint file");
     JASSERT(_real_close(fdCkptFileOnDisk) == 0) (JASSERT_ERRNO)
       .Text("(compression): error closing checkpoint file.");
   }
 
-  /* Now that temp checkpoint file is complete, rename it over old permanent
-   * checkpoint file.  Uses rename() syscall, which doesn't change i-nodes.
-   * So, gzip process can continue to write to file even after renaming.
-   */
-  JASSERT(rename(tempCkptFilename.c_str(), ckptFilename.c_str()) == 0);
+  if (!imageOk) {
+    if (receiver != NULL) {
+      // Without the trailer, the receiver discards the stream.
+      _real_close(receiverFd);
+    } else {
+      unlink(tempCkptFilename.c_str());
+    }
+  } else if (receiver != NULL) {
+    /* The receiver replaces its previous copy only once it has the whole
+     * image, as rename() does below.
+     */
+    int64_t size = CkptReceiver::finishPut(receiverFd);
+    JWARNING(size != -1) (receiver) (imageName)
+      .Text("Checkpoint receiver failed to store the image; it keeps the"
+            " previous one.");
+    imageOk = size != -1;
+    lastImageSize = imageOk ? size : 0;
+  } else {
+    /* Now that temp checkpoint file is complete, rename it over old permanent
+     * checkpoint file.  Uses rename() syscall, which doesn't change i-nodes.
+     * So, gzip process can continue to write to file even after renaming.
+     */
+    JASSERT(rename(tempCkptFilename.c_str(), imageFilename.c_str()) == 0);
+
+    struct stat st;
+    if (stat(imageFilename.c_str(), &st) == 0) {
+      lastImageSize = st.st_size;
+    }
+  }
+
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+  lastImageWriteUsec = (end.tv_sec - start.tv_sec) * 1000000 +
+                       (end.tv_nsec - start.tv_nsec) / 1000;
+
+  if (imageOk && receiver == NULL && xorGroupSize > 0) {
+    send_ckpt_image_to_parity(imageFilename);
+  }
+
+  if (imageOk && !localFilename.empty()) {
+    if (forked_ckpt_status == FORKED_CKPT_CHILD) {
+      // Already in the background; no need for another process.
+      drain_ckpt_image(localFilename, ckptFilename);
+    } else {
+      start_ckpt_image_drainer(localFilename, ckptFilename);
+    }
+  }
 
   if (forked_ckpt_status == FORKED_CKPT_CHILD) {
     // Use _exit() instead of exit() to avoid popping atexit() handlers
@@ -455,8 +885,9 @@ void CkptSerializer::writeDmtcpHeader(int fd)
   const ssize_t len = strlen(DMTCP_FILE_HEADER);
   JASSERT(write(fd, DMTCP_FILE_HEADER, len) == len);
 
-  jalib::JBinarySerializeWriterRaw wr("", fd);
+  jalib::JBinarySerializeBufferedWriter wr("", fd);
   ProcessInfo::instance().serialize(wr);
+  wr.flush();
   ssize_t written = len + wr.bytes();
 
   // We must write in multiple of PAGE_SIZE
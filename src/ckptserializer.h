@@ -34,6 +34,18 @@ namespace dmtcp
     void createCkptDir();
     void writeCkptImage(void *mtcpHdr, size_t mtcpHdrLen);
     void writeDmtcpHeader(int fd);
+    // Size and write time of the last image written by this process; the
+    // size is 0 if the image was written by a forked child.
+    void lastImageStats(uint64_t *size, uint64_t *writeUsec);
+    // Limit the rate at which writeAll() writes the image; the coordinator
+    // hands out the rate with DMT_DO_CHECKPOINT.  0 means unlimited.
+    void setWriteBandwidth(uint64_t bytesPerSec);
+    ssize_t writeAll(int fd, const void *buf, size_t count);
+    // Once written, stream the image to the ckpt receiver at receiver, to be
+    // XORed into parity set paritySet as member index of a group of
+    // groupSize; also handed out with DMT_DO_CHECKPOINT.  groupSize 0 is off.
+    void setXorGroup(uint32_t index, uint32_t groupSize,
+                     const string& receiver, const string& paritySet);
   };
 }
 
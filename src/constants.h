@@ -76,10 +76,17 @@
 #define ENV_VAR_NAME_PORT "DMTCP_COORD_PORT"
 #define ENV_VAR_NAME_RESTART_DIR  "DMTCP_RESTART_DIR"
 #define ENV_VAR_CKPT_INTR "DMTCP_CHECKPOINT_INTERVAL"
+#define ENV_VAR_MTBF "DMTCP_MTBF"
 #define ENV_VAR_ORIG_LD_PRELOAD "DMTCP_ORIG_LD_PRELOAD"
 #define ENV_VAR_HIJACK_LIBS "DMTCP_HIJACK_LIBS"
 #define ENV_VAR_HIJACK_LIBS_M32 "DMTCP_HIJACK_LIBS_M32"
 #define ENV_VAR_CHECKPOINT_DIR "DMTCP_CHECKPOINT_DIR"
+#define ENV_VAR_LOCAL_CKPT_DIR "DMTCP_LOCAL_CKPT_DIR"
+#define ENV_VAR_RESTART_PREFETCH_BW "DMTCP_RESTART_PREFETCH_BW"
+#define ENV_VAR_CKPT_RECEIVER "DMTCP_CKPT_RECEIVER"
+#define ENV_VAR_CKPT_RECEIVER_SECRET "DMTCP_CKPT_RECEIVER_SECRET"
+#define ENV_VAR_XOR_RECEIVERS "DMTCP_XOR_RECEIVERS"
+#define ENV_VAR_CKPT_CHUNK_STORE "DMTCP_CKPT_CHUNK_STORE"
 #define ENV_VAR_TMPDIR "DMTCP_TMPDIR"
 #define ENV_VAR_CKPT_OPEN_FILES "DMTCP_CKPT_OPEN_FILES"
 #define ENV_VAR_ALLOW_OVERWRITE_WITH_CKPTED_FILES "DMTCP_ALLOW_OVERWRITE_WITH_CKPTED_FILES"
@@ -92,6 +99,7 @@
 // Keep in sync with plugin/batch-queue/rm_pmi.h
 #define ENV_VAR_EXPLICIT_SRUN "DMTCP_EXPLICIT_SRUN"
 #define ENV_VAR_SKIP_WRITING_TEXT_SEGMENTS "DMTCP_SKIP_WRITING_TEXT_SEGMENTS"
+#define ENV_VAR_SKIP_UNMODIFIED_FILE_PAGES "DMTCP_SKIP_UNMODIFIED_FILE_PAGES"
 
 #define ENV_VAR_COORD_LOGFILE "DMTCP_COORD_LOG_FILENAME"
 
@@ -118,6 +126,7 @@
 #define LIBDL_BASE_FUNC_STR "dlinfo"
 #define ENV_VAR_DLSYM_OFFSET "DMTCP_DLSYM_OFFSET"
 #define ENV_VAR_DLSYM_OFFSET_M32 "DMTCP_DLSYM_OFFSET_M32"
+#define ENV_VAR_WRAPPER_CACHE "DMTCP_WRAPPER_CACHE"
 #define ENV_VAR_REMOTE_SHELL_CMD "DMTCP_REMOTE_SHELL_CMD"
 #define ENV_VAR_PROTECTED_FD_BASE "DMTCP_PROTECTED_FD_BASE"
 
@@ -133,6 +142,11 @@
     ENV_VAR_PLUGIN, \
     ENV_VAR_PLUGIN_32, \
     ENV_VAR_CHECKPOINT_DIR,\
+    ENV_VAR_LOCAL_CKPT_DIR,\
+    ENV_VAR_CKPT_RECEIVER,\
+    ENV_VAR_CKPT_RECEIVER_SECRET,\
+    ENV_VAR_XOR_RECEIVERS,\
+    ENV_VAR_CKPT_CHUNK_STORE,\
     ENV_VAR_TMPDIR,\
     ENV_VAR_CKPT_OPEN_FILES,\
     ENV_VAR_QUIET,\
@@ -144,8 +158,10 @@
     ENV_VAR_SCREENDIR, \
     ENV_VAR_DLSYM_OFFSET, \
     ENV_VAR_DLSYM_OFFSET_M32, \
+    ENV_VAR_WRAPPER_CACHE, \
     ENV_VAR_VIRTUAL_PID, \
     ENV_VAR_SKIP_WRITING_TEXT_SEGMENTS, \
+    ENV_VAR_SKIP_UNMODIFIED_FILE_PAGES, \
     ENV_VAR_PROTECTED_FD_BASE, \
     ENV_DELTACOMPRESSION
 
@@ -155,6 +171,8 @@
 #define RESTART_SCRIPT_EXT "sh"
 
 #define DMTCP_FILE_HEADER "DMTCP_CHECKPOINT_IMAGE_v2.0\n"
+// An image kept in a chunk store (dmtcp_ckpt_chunker) starts with this.
+#define DMTCP_CHUNKS_HEADER "CKPT_CHUNKS_V1\n"
 
 // #define MIN_SIGNAL 1
 // #define MAX_SIGNAL 30
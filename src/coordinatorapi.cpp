@@ -26,6 +26,7 @@
 #include <arpa/inet.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <sys/stat.h>
 #include <poll.h>
 #include <unistd.h>
 #include "coordinatorapi.h"
@@ -57,6 +58,12 @@ void dmtcp_CoordinatorAPI_EventHook(DmtcpEvent_t event, DmtcpEventData_t *data)
 
     case DMTCP_EVENT_THREADS_SUSPEND:
       JASSERT(CoordinatorAPI::instance().isValid());
+      // An unclaimed spare connection would never reach SUSPENDED.
+      CoordinatorAPI::closeSpareConnection();
+      break;
+
+    case DMTCP_EVENT_PRE_EXEC:
+      CoordinatorAPI::closeSpareConnection();
       break;
 
     case DMTCP_EVENT_RESTART:
@@ -82,6 +89,12 @@ void CoordinatorAPI::restart()
   instance()._nsSock.close();
 }
 
+/* A connection to the coordinator, registered ahead of time for the next
+ * fork()ed child.  The handshake is sent right after a fork() and its reply is
+ * read only at the next fork(), so that fork() doesn't wait on the coordinator.
+ */
+static jalib::JSocket spareSock(-1);
+
 static uint32_t getCkptInterval()
 {
   uint32_t ret = DMTCPMESSAGE_SAME_CKPT_INTERVAL;
@@ -111,6 +124,10 @@ static jalib::JSocket createNewSocketToCoordinator(CoordinatorMode mode)
 //{ }
 
 static CoordinatorAPI *coordAPIInst = NULL;
+/* Size of the image just written, as reported by the checkpoint thread once
+ * the write completed; 0 if unknown (e.g., a forked child writes it).
+ */
+static uint64_t ckptImageSize = 0;
 CoordinatorAPI& CoordinatorAPI::instance()
 {
   //static SysVIPC *inst = new SysVIPC(); return *inst;
@@ -159,6 +176,8 @@ void CoordinatorAPI::resetOnFork(CoordinatorAPI& coordAPI)
   // The coordinator won't send any msg in response to DMT_UPDATE... so no need
   // to call recvCoordinatorHandshake().
   instance()._nsSock.close();
+  // The parent's spare connection, if any, isn't ours to use.
+  spareSock.close();
 }
 
 /* Recompute the protected coordinator fd and reset the coordiantor socket.
@@ -650,15 +669,19 @@ void CoordinatorAPI::createNewConnectionBeforeFork(string& progname)
     .Text("Process attempted to call fork() while in --no-coordinator mode\n"
           "  Because the coordinator is embedded in a single process,\n"
           "    DMTCP will not work with multiple processes.");
-  struct sockaddr_storage addr;
-  uint32_t len;
-  SharedData::getCoordAddr((struct sockaddr *)&addr, &len);
-  socklen_t addrlen = len;
-  _coordinatorSocket = jalib::JClientSocket((struct sockaddr *)&addr, addrlen);
-  JASSERT(_coordinatorSocket.isValid());
-
-  DmtcpMessage hello_local(DMT_NEW_WORKER);
-  DmtcpMessage hello_remote = sendRecvHandshake(hello_local, progname);
+  DmtcpMessage hello_remote;
+  if (!useSpareConnection(&hello_remote)) {
+    struct sockaddr_storage addr;
+    uint32_t len;
+    SharedData::getCoordAddr((struct sockaddr *)&addr, &len);
+    socklen_t addrlen = len;
+    _coordinatorSocket = jalib::JClientSocket((struct sockaddr *)&addr,
+                                              addrlen);
+    JASSERT(_coordinatorSocket.isValid());
+
+    DmtcpMessage hello_local(DMT_NEW_WORKER);
+    hello_remote = sendRecvHandshake(hello_local, progname);
+  }
   JASSERT(hello_remote.virtualPid != -1);
 
   if (dmtcp_virtual_to_real_pid) {
@@ -669,6 +692,71 @@ void CoordinatorAPI::createNewConnectionBeforeFork(string& progname)
   }
 }
 
+/* Called by the parent after fork().  Only the handshake is sent here; the
+ * reply is read by useSpareConnection() at the next fork().
+ */
+void CoordinatorAPI::createSpareConnectionAfterFork(string& progname)
+{
+  JASSERT(!spareSock.isValid());
+  struct sockaddr_storage addr;
+  uint32_t len;
+  SharedData::getCoordAddr((struct sockaddr *)&addr, &len);
+  socklen_t addrlen = len;
+  jalib::JSocket sock = jalib::JClientSocket((struct sockaddr *)&addr, addrlen);
+  if (!sock.isValid()) {
+    return;
+  }
+  sock.changeFd(PROTECTED_SPARE_COORD_FD);
+  // Don't let a child that exec()s outside of our wrappers hold it open.
+  fcntl(sock.sockfd(), F_SETFD, FD_CLOEXEC);
+
+  DmtcpMessage msg(DMT_NEW_SPARE_WORKER);
+  msg.virtualPid = -1;
+  if (dmtcp_virtual_to_real_pid) {
+    msg.realPid = dmtcp_virtual_to_real_pid(getpid());
+  } else {
+    msg.realPid = getpid();
+  }
+  string hostname = jalib::Filesystem::GetCurrentHostname();
+  msg.extraBytes = hostname.length() + 1 + progname.length() + 1;
+
+  sock << msg;
+  sock.writeAll(hostname.c_str(), hostname.length() + 1);
+  sock.writeAll(progname.c_str(), progname.length() + 1);
+  spareSock = sock;
+}
+
+/* Take over the spare connection, if there is one that the coordinator has
+ * accepted.  A spare whose handshake reached the coordinator during a
+ * checkpoint is rejected; we then fall back to a fresh connection.
+ */
+bool CoordinatorAPI::useSpareConnection(DmtcpMessage *hello_remote)
+{
+  if (!spareSock.isValid()) {
+    return false;
+  }
+  hello_remote->poison();
+  spareSock >> *hello_remote;
+  hello_remote->assertValid();
+  if (hello_remote->type == DMT_KILL_PEER) {
+    JLOG(DMTCP)("Received KILL message from coordinator, exiting");
+    _real_exit (0);
+  }
+  if (hello_remote->type != DMT_ACCEPT) {
+    JLOG(DMTCP)("spare coordinator connection rejected") (hello_remote->type);
+    spareSock.close();
+    return false;
+  }
+  _coordinatorSocket = spareSock;
+  spareSock = jalib::JSocket(-1);
+  return true;
+}
+
+void CoordinatorAPI::closeSpareConnection()
+{
+  spareSock.close();
+}
+
 void CoordinatorAPI::connectToCoordOnRestart(CoordinatorMode  mode,
                                              string progname,
                                              UniquePid compGroup,
@@ -709,6 +797,11 @@ void CoordinatorAPI::connectToCoordOnRestart(CoordinatorMode  mode,
   JLOG(DMTCP)("Coordinator handshake RECEIVED!!!!!");
 }
 
+void CoordinatorAPI::setCkptImageSize(uint64_t size)
+{
+  ckptImageSize = size;
+}
+
 void CoordinatorAPI::sendCkptFilename()
 {
   if (noCoordinator()) return;
@@ -728,13 +821,42 @@ void CoordinatorAPI::sendCkptFilename()
     shellType = remoteShellType;
   }
 
-  JLOG(DMTCP)("recording filenames") (ckptFilename) (hostname) (shellType);
-  msg.extraBytes = ckptFilename.length() + 1 + hostname.length() + 1+ strlen(shellType) + 1;
+  // Tell coordinator the node-local dir, if the image is first written there.
+  const char *localCkptDir = getenv(ENV_VAR_LOCAL_CKPT_DIR);
+  if (localCkptDir == NULL) {
+    localCkptDir = "";
+  }
+
+  // Image size, for the coordinator's checkpoint cost estimate.
+  msg.ckptImageSize = ckptImageSize;
+
+  JLOG(DMTCP)("recording filenames") (ckptFilename) (hostname) (shellType)
+    (localCkptDir) (msg.ckptImageSize);
+  msg.extraBytes = ckptFilename.length() + 1 + hostname.length() + 1+ strlen(shellType) + 1
+                   + strlen(localCkptDir) + 1;
  
   _coordinatorSocket << msg;
   _coordinatorSocket.writeAll(ckptFilename.c_str(), ckptFilename.length() + 1);
   _coordinatorSocket.writeAll(shellType, strlen(shellType) + 1);
   _coordinatorSocket.writeAll(hostname.c_str(), hostname.length() + 1);
+  _coordinatorSocket.writeAll(localCkptDir, strlen(localCkptDir) + 1);
+}
+
+// Called by the background drainer once the image copied from the node-local
+// ckpt dir has been renamed into place in the global ckpt dir.  The drainer
+// is a separate process, so it uses its own connection to the coordinator.
+void CoordinatorAPI::sendCkptDurable()
+{
+  if (noCoordinator()) return;
+  jalib::JSocket sock = createNewSocketToCoordinator(COORD_ANY);
+  if (!sock.isValid()) {
+    JWARNING(false) .Text("Failed to report durable checkpoint image.");
+    return;
+  }
+  DmtcpMessage msg(DMT_CKPT_DURABLE);
+  msg.compGroup = ProcessInfo::instance().compGroup();
+  sock << msg;
+  sock.close();
 }
 
 
@@ -67,6 +67,9 @@ namespace dmtcp
                                    CoordinatorInfo *coordInfo,
                                    struct in_addr  *localIP);
       void createNewConnectionBeforeFork(string& progname);
+      void createSpareConnectionAfterFork(string& progname);
+      static void closeSpareConnection();
+      static void setCkptImageSize(uint64_t size);
       void connectToCoordOnRestart(CoordinatorMode  mode,
                                    string progname,
                                    UniquePid compGroup,
@@ -98,6 +101,7 @@ namespace dmtcp
       bool updateGlobalCkptDir(const char *dir);
 
       void sendCkptFilename();
+      void sendCkptDurable();
 
       int sendKeyValPairToCoordinator(const char *id,
                                       const void *key, uint32_t key_len,
@@ -118,6 +122,7 @@ namespace dmtcp
       void createNewConnToCoord(CoordinatorMode mode);
       DmtcpMessage sendRecvHandshake(DmtcpMessage msg, string progname,
                                      UniquePid *compId = NULL);
+      bool useSpareConnection(DmtcpMessage *hello_remote);
 
       jalib::JSocket          _coordinatorSocket;
       jalib::JSocket          _nsSock;
@@ -0,0 +1,434 @@
+/****************************************************************************
+ *   Copyright (C) 2006-2013 by Jason Ansel, Kapil Arya, and Gene Cooperman *
+ *   jansel@csail.mit.edu, kapil@ccs.neu.edu, gene@ccs.neu.edu              *
+ *                                                                          *
+ *  This file is part of DMTCP.                                             *
+ *                                                                          *
+ *  DMTCP is free software: you can redistribute it and/or                  *
+ *  modify it under the terms of the GNU Lesser General Public License as   *
+ *  published by the Free Software Foundation, either version 3 of the      *
+ *  License, or (at your option) any later version.                         *
+ *                                                                          *
+ *  DMTCP is distributed in the hope that it will be useful,                *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with DMTCP:dmtcp/src.  If not, see                        *
+ *  <http://www.gnu.org/licenses/>.                                         *
+ ****************************************************************************/
+
+
+/* dmtcp_ckpt_chunker: keep checkpoint images in a content-addressed chunk
+ * store.
+ *
+ * With dmtcp_launch --ckpt-chunk-store DIR, the image is piped through this
+ * program instead of gzip.  The image is cut into chunks at content-defined
+ * boundaries (a gear rolling hash over the bytes), so that an unchanged run
+ * of memory yields the same chunks in every generation, wherever it lies in
+ * the image.  Each chunk is stored once in DIR, under its hash; what is
+ * written to the ckpt dir is a manifest: the DMTCP_CHUNKS_HEADER, the path of
+ * the store, and one ChunkRef per chunk.  A chunk already in the store is not
+ * written again.  dmtcp_restart (or dmtcp_image) runs 'dmtcp_ckpt_chunker -x'
+ * to expand the manifest back into the image, as it runs 'gzip -d'.
+ *
+ * Chunks are named by a 128-bit hash.  It is not a cryptographic hash: the
+ * store is trusted, but the expanded chunks are checked against it.  Chunks
+ * no longer referenced by any manifest are only removed by --gc.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "constants.h"
+#include "util.h"
+#include "../jalib/jassert.h"
+#include "../jalib/jconvert.h"
+#include "../jalib/jfilesystem.h"
+
+#define BINARY_NAME "dmtcp_ckpt_chunker"
+
+#define MIN_CHUNK_SIZE (16 * 1024)
+#define MAX_CHUNK_SIZE (256 * 1024)
+// A boundary is taken where the low bits of the rolling hash are all zero:
+// on average every 64 KB after MIN_CHUNK_SIZE.
+#define CHUNK_BOUNDARY_MASK ((1ULL << 16) - 1)
+#define INPUT_BUFFER_SIZE (16 * MAX_CHUNK_SIZE)
+
+using namespace dmtcp;
+
+static const char* theUsage =
+  "Usage: dmtcp_ckpt_chunker -s DIR\n"
+  "       dmtcp_ckpt_chunker -x [-s DIR]\n"
+  "       dmtcp_ckpt_chunker -s DIR --gc MANIFEST...\n\n"
+  "Store the checkpoint image read from stdin in the chunk store DIR, and\n"
+  "write its manifest to stdout; with -x, expand the manifest read from stdin\n"
+  "back into the image (DIR overrides the store named in the manifest).\n"
+  "With --gc, remove the chunks of DIR that none of the manifests refer to;\n"
+  "only run it while no checkpoint is being written to DIR.\n\n"
+  "Options:\n"
+  "  -s, --store DIR\n"
+  "              Chunk store directory\n"
+  "  -x, --expand\n"
+  "              Expand a manifest into the image\n"
+  "  --gc MANIFEST...\n"
+  "              Remove the chunks not referred to by these manifests\n"
+  "  --help\n"
+  "              Print this message and exit.\n"
+  "  --version\n"
+  "              Print version information and exit.\n"
+  "\n"
+  HELP_AND_CONTACT_INFO
+  "\n"
+;
+
+struct ManifestHeader {
+  char magic[16];
+  uint32_t storeLen;
+  uint32_t reserved;
+};
+
+// The last ChunkRef has len 0, and the size of the image in hash[0].
+struct ChunkRef {
+  uint64_t hash[2];
+  uint32_t len;
+  uint32_t reserved;
+};
+
+static uint64_t gear[256];
+
+static uint64_t splitmix64(uint64_t *state)
+{
+  uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+
+// The gear table must be the same for every generation, so that boundaries
+// are found at the same places.
+static void initGear()
+{
+  uint64_t state = 0x444d5443505f4752ULL;
+  for (size_t i = 0; i < 256; i++) {
+    gear[i] = splitmix64(&state);
+  }
+}
+
+// Returns the length of the chunk at the start of buf[0..len).
+static size_t findBoundary(const unsigned char *buf, size_t len)
+{
+  if (len <= MIN_CHUNK_SIZE) {
+    return len;
+  }
+  size_t end = len < MAX_CHUNK_SIZE ? len : MAX_CHUNK_SIZE;
+  uint64_t h = 0;
+  for (size_t i = MIN_CHUNK_SIZE; i < end; i++) {
+    h = (h << 1) + gear[buf[i]];
+    if ((h & CHUNK_BOUNDARY_MASK) == 0) {
+      return i + 1;
+    }
+  }
+  return end;
+}
+
+static inline uint64_t rotl64(uint64_t x, int r)
+{
+  return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t fmix64(uint64_t k)
+{
+  k ^= k >> 33;
+  k *= 0xff51afd7ed558ccdULL;
+  k ^= k >> 33;
+  k *= 0xc4ceb9fe1a85ec53ULL;
+  return k ^ (k >> 33);
+}
+
+// Two independent 64-bit lanes over the 8-byte words of the chunk.
+static void hashChunk(const void *buf, size_t len, uint64_t hash[2])
+{
+  const unsigned char *p = (const unsigned char*) buf;
+  uint64_t a = 0x87c37b91114253d5ULL ^ len;
+  uint64_t b = 0x4cf5ad432745937fULL + len;
+  size_t i = 0;
+  for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+    uint64_t w;
+    memcpy(&w, p + i, sizeof(w));
+    a = rotl64(a ^ (w * 0x87c37b91114253d5ULL), 31) * 0x4cf5ad432745937fULL;
+    b = rotl64(b ^ (w * 0x52dce729da3ed25bULL), 33) * 0x38495ab5c2b2ae35ULL;
+  }
+  uint64_t w = 0;
+  memcpy(&w, p + i, len - i);
+  a ^= w;
+  b ^= rotl64(w, 29);
+  hash[0] = fmix64(a + b);
+  hash[1] = fmix64(b ^ rotl64(a, 17));
+}
+
+static string chunkName(const ChunkRef& ref)
+{
+  char name[64];
+  sprintf(name, "%016llx%016llx-%x", (unsigned long long) ref.hash[0],
+          (unsigned long long) ref.hash[1], ref.len);
+  return name;
+}
+
+// Chunks are spread over 256 subdirectories of the store.
+static string chunkPath(const string& store, const ChunkRef& ref)
+{
+  string name = chunkName(ref);
+  return store + "/" + name.substr(0, 2) + "/" + name;
+}
+
+static bool writeChunk(const string& store, const ChunkRef& ref,
+                       const void *buf)
+{
+  string path = chunkPath(store, ref);
+  struct stat st;
+  if (stat(path.c_str(), &st) == 0 && st.st_size == ref.len) {
+    return false;
+  }
+
+  string dir = jalib::Filesystem::DirName(path);
+  JASSERT(mkdir(dir.c_str(), S_IRWXU) == 0 || errno == EEXIST)
+    (dir) (JASSERT_ERRNO) .Text("Error creating chunk store directory");
+  string tmpPath = dir + "/.tmp." + jalib::XToString(getpid()) + "." +
+                   chunkName(ref);
+  int fd = open(tmpPath.c_str(), O_CREAT | O_TRUNC | O_WRONLY, 0600);
+  JASSERT(fd != -1) (tmpPath) (JASSERT_ERRNO) .Text("Error creating chunk");
+  JASSERT(Util::writeAll(fd, buf, ref.len) == (ssize_t) ref.len)
+    (tmpPath) (JASSERT_ERRNO) .Text("Error writing chunk");
+  JASSERT(close(fd) == 0) (tmpPath) (JASSERT_ERRNO);
+  JASSERT(rename(tmpPath.c_str(), path.c_str()) == 0)
+    (tmpPath) (path) (JASSERT_ERRNO);
+  return true;
+}
+
+static void writeManifestHeader(int fd, const string& store)
+{
+  ManifestHeader hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  strncpy(hdr.magic, DMTCP_CHUNKS_HEADER, sizeof(hdr.magic));
+  hdr.storeLen = store.length();
+  JASSERT(Util::writeAll(fd, &hdr, sizeof(hdr)) == sizeof(hdr) &&
+          Util::writeAll(fd, store.c_str(), store.length()) ==
+            (ssize_t) store.length())
+    (JASSERT_ERRNO) .Text("Error writing manifest");
+}
+
+static string readManifestHeader(int fd, const char *what)
+{
+  ManifestHeader hdr;
+  char store[PATH_MAX];
+  JASSERT(Util::readAll(fd, &hdr, sizeof(hdr)) == sizeof(hdr) &&
+          strncmp(hdr.magic, DMTCP_CHUNKS_HEADER, sizeof(hdr.magic)) == 0 &&
+          hdr.storeLen < sizeof(store) &&
+          Util::readAll(fd, store, hdr.storeLen) == (ssize_t) hdr.storeLen)
+    (what) .Text("Not a chunk store manifest");
+  store[hdr.storeLen] = '\0';
+  return store;
+}
+
+static void storeImage(const string& store)
+{
+  JASSERT(mkdir(store.c_str(), S_IRWXU) == 0 || errno == EEXIST)
+    (store) (JASSERT_ERRNO) .Text("Error creating chunk store");
+  char absStore[PATH_MAX];
+  JASSERT(realpath(store.c_str(), absStore) != NULL) (store) (JASSERT_ERRNO);
+  writeManifestHeader(STDOUT_FILENO, absStore);
+
+  unsigned char *buf = (unsigned char*) malloc(INPUT_BUFFER_SIZE);
+  JASSERT(buf != NULL);
+  size_t begin = 0;
+  size_t end = 0;
+  bool eof = false;
+  uint64_t total = 0;
+  uint64_t numChunks = 0;
+  uint64_t numNewChunks = 0;
+  uint64_t newBytes = 0;
+  while (!eof || begin < end) {
+    if (!eof && end - begin < MAX_CHUNK_SIZE) {
+      memmove(buf, buf + begin, end - begin);
+      end -= begin;
+      begin = 0;
+      ssize_t rc = Util::readAll(STDIN_FILENO, buf + end,
+                                 INPUT_BUFFER_SIZE - end);
+      JASSERT(rc != -1) (JASSERT_ERRNO) .Text("Error reading image");
+      end += rc;
+      eof = end < INPUT_BUFFER_SIZE;
+      continue;
+    }
+
+    ChunkRef ref;
+    memset(&ref, 0, sizeof(ref));
+    ref.len = findBoundary(buf + begin, end - begin);
+    hashChunk(buf + begin, ref.len, ref.hash);
+    if (writeChunk(absStore, ref, buf + begin)) {
+      numNewChunks++;
+      newBytes += ref.len;
+    }
+    JASSERT(Util::writeAll(STDOUT_FILENO, &ref, sizeof(ref)) == sizeof(ref))
+      (JASSERT_ERRNO) .Text("Error writing manifest");
+    begin += ref.len;
+    total += ref.len;
+    numChunks++;
+  }
+  free(buf);
+
+  ChunkRef last;
+  memset(&last, 0, sizeof(last));
+  last.hash[0] = total;
+  JASSERT(Util::writeAll(STDOUT_FILENO, &last, sizeof(last)) == sizeof(last))
+    (JASSERT_ERRNO) .Text("Error writing manifest");
+
+  // The writer fsyncs the manifest once this process is gone; the chunks it
+  // refers to must be on disk by then.
+  int storeFd = open(absStore, O_RDONLY);
+  JASSERT(storeFd != -1 && syncfs(storeFd) == 0) (absStore) (JASSERT_ERRNO)
+    .Text("Error syncing chunk store");
+  close(storeFd);
+  JTRACE("image stored") (absStore) (total) (numChunks) (numNewChunks)
+    (newBytes);
+}
+
+static void expandImage(const string& storeArg)
+{
+  string store = readManifestHeader(STDIN_FILENO, "stdin");
+  if (!storeArg.empty()) {
+    store = storeArg;
+  }
+
+  unsigned char *buf = (unsigned char*) malloc(MAX_CHUNK_SIZE);
+  JASSERT(buf != NULL);
+  uint64_t total = 0;
+  while (true) {
+    ChunkRef ref;
+    JASSERT(Util::readAll(STDIN_FILENO, &ref, sizeof(ref)) == sizeof(ref))
+      .Text("Manifest is cut off");
+    if (ref.len == 0) {
+      JASSERT(ref.hash[0] == total) (ref.hash[0]) (total)
+        .Text("Manifest size mismatch");
+      break;
+    }
+    JASSERT(ref.len <= MAX_CHUNK_SIZE) (ref.len) .Text("Invalid manifest");
+
+    string path = chunkPath(store, ref);
+    int fd = open(path.c_str(), O_RDONLY);
+    JASSERT(fd != -1) (path) (JASSERT_ERRNO) .Text("Chunk missing from store");
+    JASSERT(Util::readAll(fd, buf, ref.len) == (ssize_t) ref.len)
+      (path) (JASSERT_ERRNO) .Text("Error reading chunk");
+    close(fd);
+    uint64_t hash[2];
+    hashChunk(buf, ref.len, hash);
+    JASSERT(hash[0] == ref.hash[0] && hash[1] == ref.hash[1]) (path)
+      .Text("Chunk is corrupt");
+    JASSERT(Util::writeAll(STDOUT_FILENO, buf, ref.len) == (ssize_t) ref.len)
+      (JASSERT_ERRNO) .Text("Error writing image");
+    total += ref.len;
+  }
+  free(buf);
+}
+
+static void collectGarbage(const string& store, char **manifests, int n)
+{
+  set<string> live;
+  for (int i = 0; i < n; i++) {
+    int fd = open(manifests[i], O_RDONLY);
+    JASSERT(fd != -1) (manifests[i]) (JASSERT_ERRNO);
+    readManifestHeader(fd, manifests[i]);
+    while (true) {
+      ChunkRef ref;
+      JASSERT(Util::readAll(fd, &ref, sizeof(ref)) == sizeof(ref))
+        (manifests[i]) .Text("Manifest is cut off");
+      if (ref.len == 0) {
+        break;
+      }
+      live.insert(chunkName(ref));
+    }
+    close(fd);
+  }
+
+  uint64_t numRemoved = 0;
+  DIR *storeDir = opendir(store.c_str());
+  JASSERT(storeDir != NULL) (store) (JASSERT_ERRNO);
+  struct dirent *sub;
+  while ((sub = readdir(storeDir)) != NULL) {
+    if (sub->d_name[0] == '.') {
+      continue;
+    }
+    string subPath = store + "/" + sub->d_name;
+    DIR *dir = opendir(subPath.c_str());
+    if (dir == NULL) {
+      continue;
+    }
+    struct dirent *d;
+    while ((d = readdir(dir)) != NULL) {
+      // Dot-files are chunks still being written (".tmp.<pid>.<name>").
+      if (d->d_name[0] == '.' || live.find(d->d_name) != live.end()) {
+        continue;
+      }
+      string path = subPath + "/" + d->d_name;
+      JWARNING(unlink(path.c_str()) == 0) (path) (JASSERT_ERRNO);
+      numRemoved++;
+    }
+    closedir(dir);
+  }
+  closedir(storeDir);
+  JNOTE("removed unreferenced chunks") (store) (live.size()) (numRemoved);
+}
+
+#define shift argc--,argv++
+
+int main(int argc, char **argv)
+{
+  string store;
+  bool expand = false;
+
+  initializeJalib();
+
+  shift;
+  while (argc > 0) {
+    string s = argv[0];
+    if (s == "--help") {
+      printf("%s", theUsage);
+      return 0;
+    } else if (s == "--version") {
+      printf("%s", DMTCP_VERSION_AND_COPYRIGHT_INFO);
+      return 0;
+    } else if (argc > 1 && (s == "-s" || s == "--store")) {
+      store = argv[1];
+      shift; shift;
+    } else if (s == "-x" || s == "--expand") {
+      expand = true;
+      shift;
+    } else if (argc > 1 && s == "--gc" && !store.empty()) {
+      shift;
+      collectGarbage(store, argv, argc);
+      return 0;
+    } else {
+      fprintf(stderr, "%s", theUsage);
+      return DMTCP_FAIL_RC;
+    }
+  }
+
+  if (expand) {
+    expandImage(store);
+  } else if (!store.empty()) {
+    initGear();
+    storeImage(store);
+  } else {
+    fprintf(stderr, "%s", theUsage);
+    return DMTCP_FAIL_RC;
+  }
+  return 0;
+}
@@ -0,0 +1,778 @@
+/****************************************************************************
+ *   Copyright (C) 2006-2013 by Jason Ansel, Kapil Arya, and Gene Cooperman *
+ *   jansel@csail.mit.edu, kapil@ccs.neu.edu, gene@ccs.neu.edu              *
+ *                                                                          *
+ *  This file is part of DMTCP.                                             *
+ *                                                                          *
+ *  DMTCP is free software: you can redistribute it and/or                  *
+ *  modify it under the terms of the GNU Lesser General Public License as   *
+ *  published by the Free Software Foundation, either version 3 of the      *
+ *  License, or (at your option) any later version.                         *
+ *                                                                          *
+ *  DMTCP is distributed in the hope that it will be useful,                *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with DMTCP:dmtcp/src.  If not, see                        *
+ *  <http://www.gnu.org/licenses/>.                                         *
+ ****************************************************************************/
+
+/* dmtcp_ckpt_receiver: keep checkpoint images for processes elsewhere.
+ *
+ * Processes launched with --ckpt-receiver stream their images here instead
+ * of writing them to the ckpt dir, and dmtcp_restart --ckpt-receiver fetches
+ * them back for mtcp_restart.  Images are kept in RAM, or, with --dir, in a
+ * directory of this node.  The protocol is described in ckptreceiver.h.
+ * Each connection is served by a thread of its own.
+ *
+ * The receiver also keeps the XOR parity of groups of images written to
+ * node-local storage on other nodes (dmtcp_coordinator --xor-group-size), so
+ * that dmtcp_restart can rebuild an image lost with its node.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+
+#include "constants.h"
+#include "util.h"
+#include "ckptreceiver.h"
+#include "../jalib/jassert.h"
+#include "../jalib/jconvert.h"
+
+#define BINARY_NAME "dmtcp_ckpt_receiver"
+
+#define DEFAULT_RECEIVER_SOCKET "/tmp/dmtcp_ckpt_receiver."
+#define IMAGE_CHUNK_SIZE (4 * 1024 * 1024)
+
+using namespace dmtcp;
+
+static const char* theUsage =
+  "Usage: dmtcp_ckpt_receiver [OPTIONS]\n\n"
+  "Receive checkpoint images streamed by processes launched with\n"
+  "'dmtcp_launch --ckpt-receiver', and serve them back to\n"
+  "'dmtcp_restart --ckpt-receiver'.  Only requests of the user running the\n"
+  "receiver are served.\n\n"
+  "Options:\n"
+  "  -l, --listen HOST:PORT|:PORT|unix:PATH\n"
+  "              Address to listen on\n"
+  "              (default: unix:" DEFAULT_RECEIVER_SOCKET "UID)\n"
+  "  --secret-file PATH (environment variable DMTCP_CKPT_RECEIVER_SECRET)\n"
+  "              Shared secret that requests must carry; required to listen\n"
+  "              on TCP.  Processes and dmtcp_restart take it from\n"
+  "              DMTCP_CKPT_RECEIVER_SECRET.\n"
+  "  -d, --dir PATH\n"
+  "              Keep the images in this directory instead of in RAM\n"
+  "  -q, --quiet\n"
+  "              Skip NOTE messages\n"
+  "  --help\n"
+  "              Print this message and exit.\n"
+  "  --version\n"
+  "              Print version information and exit.\n"
+  "\n"
+  HELP_AND_CONTACT_INFO
+  "\n"
+;
+
+// An image kept in RAM.  It is freed once it has been replaced by a newer
+// image of the same name and no GET is still sending it.
+struct Image {
+  vector<char*> chunks;
+  uint64_t size;
+  int refs;
+};
+
+static string imageDir;
+static string theSecret;
+static map<string, Image*> images;
+static pthread_mutex_t imagesLock = PTHREAD_MUTEX_INITIALIZER;
+
+/* A parity set being received.  The parity of the members received so far is
+ * kept in chunks, zero-filled beyond the end of the shorter images.  If a
+ * member is sent again before the set is complete (it has gone on to a newer
+ * checkpoint without the others) or fails, the set is discarded.  Protected
+ * by imagesLock.
+ */
+struct ParitySet {
+  uint32_t groupSize;
+  uint32_t generation;
+  uint32_t numReceived;
+  vector<CkptReceiver::ParityMember> members;
+  vector<bool> sending;
+  vector<char*> chunks;
+  uint64_t size;
+  int refs;
+  bool discarded;
+};
+
+static map<string, ParitySet*> paritySets;
+
+// A stream is complete once it ends with the trailer, which is not part of
+// the image.
+static bool isTrailer(const char *tail)
+{
+  char trailer[CKPT_RECEIVER_TRAILER_LEN];
+  strncpy(trailer, CKPT_RECEIVER_TRAILER, sizeof(trailer));
+  return memcmp(tail, trailer, sizeof(trailer)) == 0;
+}
+
+static void releaseImage(Image *image)
+{
+  pthread_mutex_lock(&imagesLock);
+  bool last = --image->refs == 0;
+  pthread_mutex_unlock(&imagesLock);
+  if (last) {
+    for (size_t i = 0; i < image->chunks.size(); i++) {
+      free(image->chunks[i]);
+    }
+    delete image;
+  }
+}
+
+static bool appendToImage(Image *image, const void *buf, size_t len)
+{
+  const char *ptr = (const char*) buf;
+  while (len > 0) {
+    size_t off = image->size % IMAGE_CHUNK_SIZE;
+    if (off == 0) {
+      char *chunk = (char*) malloc(IMAGE_CHUNK_SIZE);
+      if (chunk == NULL) {
+        return false;
+      }
+      image->chunks.push_back(chunk);
+    }
+    size_t n = IMAGE_CHUNK_SIZE - off < len ? IMAGE_CHUNK_SIZE - off : len;
+    memcpy(image->chunks.back() + off, ptr, n);
+    image->size += n;
+    ptr += n;
+    len -= n;
+  }
+  return true;
+}
+
+static void storeImageInRAM(const string& name, Image *image)
+{
+  pthread_mutex_lock(&imagesLock);
+  Image *old = images[name];
+  images[name] = image;
+  pthread_mutex_unlock(&imagesLock);
+  if (old != NULL) {
+    releaseImage(old);
+  }
+}
+
+static bool putImageInRAM(int fd, const string& name, uint64_t *size)
+{
+  Image *image = new Image();
+  image->size = 0;
+  image->refs = 1;
+  ssize_t rc;
+  do {
+    size_t off = image->size % IMAGE_CHUNK_SIZE;
+    if (off == 0) {
+      char *chunk = (char*) malloc(IMAGE_CHUNK_SIZE);
+      if (chunk == NULL) {
+        JWARNING(false) (name) (image->size) .Text("Out of memory");
+        releaseImage(image);
+        return false;
+      }
+      image->chunks.push_back(chunk);
+    }
+    rc = read(fd, image->chunks.back() + off, IMAGE_CHUNK_SIZE - off);
+    if (rc > 0) {
+      image->size += rc;
+    }
+  } while (rc > 0 || (rc == -1 && errno == EINTR));
+  if (rc == -1) {
+    JWARNING(false) (name) (JASSERT_ERRNO) .Text("Image stream failed");
+    releaseImage(image);
+    return false;
+  }
+
+  char tail[CKPT_RECEIVER_TRAILER_LEN];
+  for (size_t i = 0; i < sizeof(tail) && image->size >= sizeof(tail); i++) {
+    uint64_t off = image->size - sizeof(tail) + i;
+    tail[i] = image->chunks[off / IMAGE_CHUNK_SIZE][off % IMAGE_CHUNK_SIZE];
+  }
+  if (image->size < sizeof(tail) || !isTrailer(tail)) {
+    JWARNING(false) (name) (image->size)
+      .Text("Image stream cut off; keeping the previous image");
+    releaseImage(image);
+    return false;
+  }
+  image->size -= sizeof(tail);
+
+  storeImageInRAM(name, image);
+  *size = image->size;
+  return true;
+}
+
+static bool putImageInDir(int fd, const string& name, uint64_t *size)
+{
+  string path = imageDir + "/" + name;
+  string tmpPath = path + ".XXXXXX";
+  int out = mkstemp(&tmpPath[0]);
+  if (out == -1) {
+    JWARNING(false) (tmpPath) (JASSERT_ERRNO) .Text("Error creating file");
+    return false;
+  }
+  char buf[64 * 1024];
+  ssize_t rc;
+  *size = 0;
+  while ((rc = read(fd, buf, sizeof(buf))) != 0) {
+    if (rc == -1 && errno == EINTR) {
+      continue;
+    }
+    if (rc == -1 || Util::writeAll(out, buf, rc) != rc) {
+      JWARNING(false) (name) (JASSERT_ERRNO) .Text("Image stream failed");
+      close(out);
+      unlink(tmpPath.c_str());
+      return false;
+    }
+    *size += rc;
+  }
+  char tail[CKPT_RECEIVER_TRAILER_LEN];
+  if (*size < sizeof(tail) ||
+      pread(out, tail, sizeof(tail), *size - sizeof(tail)) !=
+        (ssize_t) sizeof(tail) ||
+      !isTrailer(tail)) {
+    JWARNING(false) (name) (*size)
+      .Text("Image stream cut off; keeping the previous image");
+    close(out);
+    unlink(tmpPath.c_str());
+    return false;
+  }
+  *size -= sizeof(tail);
+  if (ftruncate(out, *size) == -1 ||
+      fsync(out) == -1 || close(out) == -1 ||
+      rename(tmpPath.c_str(), path.c_str()) == -1) {
+    JWARNING(false) (path) (JASSERT_ERRNO) .Text("Error storing image");
+    unlink(tmpPath.c_str());
+    return false;
+  }
+  return true;
+}
+
+static void getImageFromRAM(int fd, const string& name)
+{
+  pthread_mutex_lock(&imagesLock);
+  map<string, Image*>::iterator it = images.find(name);
+  Image *image = it == images.end() ? NULL : it->second;
+  if (image != NULL) {
+    image->refs++;
+  }
+  pthread_mutex_unlock(&imagesLock);
+
+  CkptReceiver::GetReply reply;
+  memset(&reply, 0, sizeof(reply));
+  reply.size = image == NULL ? -1 : image->size;
+  reply.uid = geteuid();
+  if (Util::writeAll(fd, &reply, sizeof(reply)) != sizeof(reply) ||
+      image == NULL) {
+    if (image != NULL) {
+      releaseImage(image);
+    }
+    return;
+  }
+  uint64_t left = image->size;
+  for (size_t i = 0; i < image->chunks.size() && left > 0; i++) {
+    size_t n = left < IMAGE_CHUNK_SIZE ? left : IMAGE_CHUNK_SIZE;
+    if (Util::writeAll(fd, image->chunks[i], n) != (ssize_t) n) {
+      break;
+    }
+    left -= n;
+  }
+  releaseImage(image);
+}
+
+static void getImageFromDir(int fd, const string& name)
+{
+  string path = imageDir + "/" + name;
+  int in = open(path.c_str(), O_RDONLY);
+  struct stat st;
+  CkptReceiver::GetReply reply;
+  memset(&reply, 0, sizeof(reply));
+  reply.size = in != -1 && fstat(in, &st) == 0 ? st.st_size : -1;
+  reply.uid = geteuid();
+  if (Util::writeAll(fd, &reply, sizeof(reply)) == sizeof(reply) &&
+      reply.size > 0) {
+    char buf[64 * 1024];
+    ssize_t rc;
+    while ((rc = Util::readAll(in, buf, sizeof(buf))) > 0 &&
+           Util::writeAll(fd, buf, rc) == rc);
+  }
+  if (in != -1) {
+    close(in);
+  }
+}
+
+static void freeParitySet(ParitySet *set)
+{
+  for (size_t i = 0; i < set->chunks.size(); i++) {
+    free(set->chunks[i]);
+  }
+  delete set;
+}
+
+// Called with imagesLock held.
+static void discardParitySet(const string& setName, ParitySet *set)
+{
+  JWARNING(false) (setName) (set->numReceived) (set->groupSize)
+    .Text("Discarding incomplete parity set");
+  set->discarded = true;
+  map<string, ParitySet*>::iterator it = paritySets.find(setName);
+  if (it != paritySets.end() && it->second == set) {
+    paritySets.erase(it);
+  }
+}
+
+static bool storeParitySet(const string& setName, ParitySet *set)
+{
+  CkptReceiver::ParityHeader hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  strncpy(hdr.magic, CKPT_PARITY_MAGIC, sizeof(hdr.magic));
+  hdr.groupSize = set->groupSize;
+  hdr.generation = set->generation;
+  hdr.paritySize = set->size;
+  size_t membersLen = set->groupSize * sizeof(CkptReceiver::ParityMember);
+
+  if (imageDir.empty()) {
+    Image *image = new Image();
+    image->size = 0;
+    image->refs = 1;
+    bool ok = appendToImage(image, &hdr, sizeof(hdr)) &&
+              appendToImage(image, &set->members[0], membersLen);
+    for (size_t i = 0; ok && i < set->chunks.size(); i++) {
+      uint64_t left = set->size - i * (uint64_t) IMAGE_CHUNK_SIZE;
+      ok = appendToImage(image, set->chunks[i],
+                         left < IMAGE_CHUNK_SIZE ? left : IMAGE_CHUNK_SIZE);
+    }
+    if (!ok) {
+      JWARNING(false) (setName) .Text("Out of memory");
+      releaseImage(image);
+      return false;
+    }
+    storeImageInRAM(setName, image);
+    return true;
+  }
+
+  string path = imageDir + "/" + setName;
+  string tmpPath = path + ".XXXXXX";
+  int out = mkstemp(&tmpPath[0]);
+  bool ok = out != -1 &&
+            Util::writeAll(out, &hdr, sizeof(hdr)) == sizeof(hdr) &&
+            Util::writeAll(out, &set->members[0], membersLen) ==
+              (ssize_t) membersLen;
+  for (size_t i = 0; ok && i < set->chunks.size(); i++) {
+    uint64_t left = set->size - i * (uint64_t) IMAGE_CHUNK_SIZE;
+    size_t n = left < IMAGE_CHUNK_SIZE ? left : IMAGE_CHUNK_SIZE;
+    ok = Util::writeAll(out, set->chunks[i], n) == (ssize_t) n;
+  }
+  if (out != -1) {
+    ok = fsync(out) == 0 && close(out) == 0 && ok &&
+         rename(tmpPath.c_str(), path.c_str()) == 0;
+  }
+  if (!ok) {
+    JWARNING(false) (path) (JASSERT_ERRNO) .Text("Error storing parity");
+    unlink(tmpPath.c_str());
+  }
+  return ok;
+}
+
+static bool xorIntoParitySet(int fd, const string& setName, uint64_t *size)
+{
+  CkptReceiver::XorMember m;
+  char name[sizeof(((CkptReceiver::ParityMember*) 0)->name)];
+  if (Util::readAll(fd, &m, sizeof(m)) != sizeof(m) ||
+      m.groupSize == 0 || m.groupSize > CKPT_PARITY_MAX_GROUP_SIZE ||
+      m.index >= m.groupSize || m.nameLen >= sizeof(name) ||
+      Util::readAll(fd, name, m.nameLen) != (ssize_t) m.nameLen) {
+    JWARNING(false) (setName) .Text("Invalid parity set member");
+    return false;
+  }
+  name[m.nameLen] = '\0';
+  if (strlen(name) != m.nameLen || !CkptReceiver::isImageName(name) ||
+      !Util::strEndsWith(setName, CKPT_PARITY_SUFFIX)) {
+    JWARNING(false) (setName) (name) .Text("Invalid parity set member");
+    return false;
+  }
+
+  pthread_mutex_lock(&imagesLock);
+  map<string, ParitySet*>::iterator it = paritySets.find(setName);
+  ParitySet *set = it == paritySets.end() ? NULL : it->second;
+  if (set != NULL && m.generation < set->generation) {
+    // A straggler of an earlier checkpoint must not taint the parity.
+    pthread_mutex_unlock(&imagesLock);
+    JWARNING(false) (setName) (name) (m.generation) (set->generation)
+      .Text("Image of an earlier generation; not using it");
+    return false;
+  }
+  if (set != NULL &&
+      (set->generation != m.generation || set->groupSize != m.groupSize || set->sending[m.index] ||
+       set->members[m.index].size != 0 || set->members[m.index].name[0])) {
+    discardParitySet(setName, set);
+    set = NULL;
+  }
+  if (set == NULL) {
+    set = new ParitySet();
+    set->groupSize = m.groupSize;
+    set->generation = m.generation;
+    set->numReceived = 0;
+    set->members.resize(m.groupSize);
+    memset(&set->members[0], 0,
+           m.groupSize * sizeof(CkptReceiver::ParityMember));
+    set->sending.resize(m.groupSize, false);
+    set->size = 0;
+    set->refs = 0;
+    set->discarded = false;
+    paritySets[setName] = set;
+  }
+  set->refs++;
+  set->sending[m.index] = true;
+  pthread_mutex_unlock(&imagesLock);
+
+  char *buf = (char*) malloc(IMAGE_CHUNK_SIZE);
+  char tail[CKPT_RECEIVER_TRAILER_LEN];
+  size_t tailLen = 0;
+  CkptReceiver::ImageHash hash;
+  uint64_t total = 0;
+  bool ok = buf != NULL;
+  for (size_t k = 0; ok; k++) {
+    ssize_t n = Util::readAll(fd, buf, IMAGE_CHUNK_SIZE);
+    if (n == -1) {
+      ok = false;
+      break;
+    }
+    // Hash all but the last bytes received, which may be the trailer.
+    if (n >= (ssize_t) sizeof(tail)) {
+      hash.update(tail, tailLen);
+      hash.update(buf, n - sizeof(tail));
+      memcpy(tail, buf + n - sizeof(tail), sizeof(tail));
+      tailLen = sizeof(tail);
+    } else if (n > 0) {
+      size_t keep = tailLen + n > sizeof(tail) ? sizeof(tail) - n : tailLen;
+      hash.update(tail, tailLen - keep);
+      memmove(tail, tail + tailLen - keep, keep);
+      memcpy(tail + keep, buf, n);
+      tailLen = keep + n;
+    }
+    pthread_mutex_lock(&imagesLock);
+    if (!set->discarded && n > 0) {
+      if (k == set->chunks.size()) {
+        set->chunks.push_back((char*) calloc(1, IMAGE_CHUNK_SIZE));
+      }
+      if (set->chunks[k] == NULL) {
+        ok = false;
+      } else {
+        uint64_t *dst = (uint64_t*) set->chunks[k];
+        const uint64_t *src = (const uint64_t*) buf;
+        size_t words = (n + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+        memset(buf + n, 0, words * sizeof(uint64_t) - n);
+        for (size_t i = 0; i < words; i++) {
+          dst[i] ^= src[i];
+        }
+      }
+    }
+    pthread_mutex_unlock(&imagesLock);
+    total += n;
+    if (n < IMAGE_CHUNK_SIZE) {
+      break;
+    }
+  }
+  free(buf);
+  // Without the trailer, the member died while sending its image.
+  ok = ok && tailLen == sizeof(tail) && isTrailer(tail);
+
+  bool complete = false;
+  pthread_mutex_lock(&imagesLock);
+  set->refs--;
+  set->sending[m.index] = false;
+  if (!ok && !set->discarded) {
+    JWARNING(false) (setName) (name) (JASSERT_ERRNO)
+      .Text("Image stream failed");
+    discardParitySet(setName, set);
+  }
+  if (ok && !set->discarded) {
+    // The trailer was XORed in with the image; take it out again.
+    total -= sizeof(tail);
+    for (size_t i = 0; i < sizeof(tail); i++) {
+      uint64_t off = total + i;
+      set->chunks[off / IMAGE_CHUNK_SIZE][off % IMAGE_CHUNK_SIZE] ^= tail[i];
+    }
+    set->members[m.index].size = total;
+    hash.final(set->members[m.index].hash);
+    strcpy(set->members[m.index].name, name);
+    if (total > set->size) {
+      set->size = total;
+    }
+    if (++set->numReceived == set->groupSize) {
+      paritySets.erase(setName);
+      complete = true;
+    }
+  } else {
+    ok = false;
+  }
+  bool release = set->discarded && set->refs == 0;
+  pthread_mutex_unlock(&imagesLock);
+
+  if (complete) {
+    ok = storeParitySet(setName, set);
+    if (ok) {
+      JNOTE("stored parity set") (setName) (set->groupSize) (set->size);
+    }
+    freeParitySet(set);
+  } else if (release) {
+    freeParitySet(set);
+  }
+  *size = total;
+  return ok;
+}
+
+static bool parityHasMember(const char *hdrBuf, size_t len, const string& name)
+{
+  const CkptReceiver::ParityHeader *hdr =
+    (const CkptReceiver::ParityHeader*) hdrBuf;
+  if (len < sizeof(*hdr) ||
+      strncmp(hdr->magic, CKPT_PARITY_MAGIC, sizeof(hdr->magic)) != 0 ||
+      hdr->groupSize > CKPT_PARITY_MAX_GROUP_SIZE ||
+      len < sizeof(*hdr) +
+              hdr->groupSize * sizeof(CkptReceiver::ParityMember)) {
+    return false;
+  }
+  const CkptReceiver::ParityMember *members =
+    (const CkptReceiver::ParityMember*) (hdr + 1);
+  for (uint32_t i = 0; i < hdr->groupSize; i++) {
+    if (strncmp(members[i].name, name.c_str(), sizeof(members[i].name)) == 0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void findParitySet(int fd, const string& name)
+{
+  const size_t hdrLen = sizeof(CkptReceiver::ParityHeader) +
+    CKPT_PARITY_MAX_GROUP_SIZE * sizeof(CkptReceiver::ParityMember);
+  string found;
+
+  if (imageDir.empty()) {
+    pthread_mutex_lock(&imagesLock);
+    map<string, Image*>::iterator it;
+    for (it = images.begin(); it != images.end() && found.empty(); it++) {
+      Image *image = it->second;
+      if (Util::strEndsWith(it->first, CKPT_PARITY_SUFFIX) &&
+          image->chunks.size() > 0 &&
+          parityHasMember(image->chunks[0],
+                          image->size < IMAGE_CHUNK_SIZE ? image->size
+                                                         : IMAGE_CHUNK_SIZE,
+                          name)) {
+        found = it->first;
+      }
+    }
+    pthread_mutex_unlock(&imagesLock);
+  } else {
+    DIR *dir = opendir(imageDir.c_str());
+    struct dirent *d;
+    char *buf = (char*) malloc(hdrLen);
+    while (dir != NULL && buf != NULL && found.empty() &&
+           (d = readdir(dir)) != NULL) {
+      if (!Util::strEndsWith(d->d_name, CKPT_PARITY_SUFFIX)) {
+        continue;
+      }
+      string path = imageDir + "/" + d->d_name;
+      int in = open(path.c_str(), O_RDONLY);
+      if (in != -1) {
+        ssize_t n = Util::readAll(in, buf, hdrLen);
+        if (n > 0 && parityHasMember(buf, n, name)) {
+          found = d->d_name;
+        }
+        close(in);
+      }
+    }
+    free(buf);
+    if (dir != NULL) {
+      closedir(dir);
+    }
+  }
+
+  int64_t len = found.empty() ? -1 : found.length();
+  if (Util::writeAll(fd, &len, sizeof(len)) == sizeof(len) && len > 0) {
+    Util::writeAll(fd, found.c_str(), len);
+  }
+}
+
+// Compares in time independent of where the strings differ.
+static bool secretsEqual(const string& a, const string& b)
+{
+  unsigned char diff = a.length() != b.length();
+  for (size_t i = 0; i < a.length() && i < b.length(); i++) {
+    diff |= a[i] ^ b[i];
+  }
+  return diff == 0;
+}
+
+/* Only requests of our own user are served: a unix socket peer must have our
+ * uid; a TCP peer must know the secret, and claim our uid.
+ */
+static bool isAuthorized(int fd, uint32_t uid, const string& secret)
+{
+  struct sockaddr_storage addr;
+  socklen_t len = sizeof(addr);
+  if (getsockname(fd, (struct sockaddr*) &addr, &len) == 0 &&
+      addr.ss_family == AF_UNIX) {
+    struct ucred cred;
+    socklen_t credLen = sizeof(cred);
+    return getsockopt(fd, SOL_SOCKET, SO_PEERCRED, &cred, &credLen) == 0 &&
+           cred.uid == geteuid();
+  }
+  return !theSecret.empty() && secretsEqual(secret, theSecret) &&
+         uid == geteuid();
+}
+
+static void *serveConnection(void *arg)
+{
+  int fd = (int) (intptr_t) arg;
+  CkptReceiver::Op op;
+  string name;
+  uint32_t uid;
+  string secret;
+  if (!CkptReceiver::readRequest(fd, &op, &name, &uid, &secret)) {
+    JWARNING(false) .Text("Invalid request; closing connection");
+  } else if (!isAuthorized(fd, uid, secret)) {
+    JWARNING(false) (name) (uid)
+      .Text("Unauthorized request; closing connection");
+  } else if (op == CkptReceiver::PUT) {
+    uint64_t size;
+    bool ok = imageDir.empty() ? putImageInRAM(fd, name, &size)
+                               : putImageInDir(fd, name, &size);
+    if (ok) {
+      JNOTE("stored image") (name) (size);
+      Util::writeAll(fd, &size, sizeof(size));
+    }
+  } else if (op == CkptReceiver::XOR) {
+    uint64_t size;
+    if (xorIntoParitySet(fd, name, &size)) {
+      Util::writeAll(fd, &size, sizeof(size));
+    }
+  } else if (op == CkptReceiver::FIND) {
+    findParitySet(fd, name);
+  } else {
+    JNOTE("sending image") (name);
+    if (imageDir.empty()) {
+      getImageFromRAM(fd, name);
+    } else {
+      getImageFromDir(fd, name);
+    }
+  }
+  close(fd);
+  return NULL;
+}
+
+#define shift argc--,argv++
+
+int main(int argc, char **argv)
+{
+  string listenAddr = string("unix:") + DEFAULT_RECEIVER_SOCKET +
+                      jalib::XToString(geteuid());
+  string secretFile;
+
+  initializeJalib();
+
+  shift;
+  while (argc > 0) {
+    string s = argv[0];
+    if (s == "--help") {
+      printf("%s", theUsage);
+      return 0;
+    } else if (s == "--version") {
+      printf("%s", DMTCP_VERSION_AND_COPYRIGHT_INFO);
+      return 0;
+    } else if (argc > 1 && (s == "-l" || s == "--listen")) {
+      listenAddr = argv[1];
+      shift; shift;
+    } else if (argc > 1 && s == "--secret-file") {
+      secretFile = argv[1];
+      shift; shift;
+    } else if (argc > 1 && (s == "-d" || s == "--dir")) {
+      imageDir = argv[1];
+      shift; shift;
+    } else if (s == "-q" || s == "--quiet") {
+      jassert_quiet++;
+      shift;
+    } else {
+      fprintf(stderr, "%s", theUsage);
+      return DMTCP_FAIL_RC;
+    }
+  }
+
+  if (!imageDir.empty()) {
+    struct stat st;
+    JASSERT(stat(imageDir.c_str(), &st) == 0 && S_ISDIR(st.st_mode))
+      (imageDir) .Text("Not a directory");
+  }
+
+  if (!secretFile.empty()) {
+    struct stat st;
+    int fd = open(secretFile.c_str(), O_RDONLY);
+    JASSERT(fd != -1 && fstat(fd, &st) == 0) (secretFile) (JASSERT_ERRNO);
+    JWARNING((st.st_mode & (S_IRWXG | S_IRWXO)) == 0) (secretFile)
+      .Text("Secret file is readable by other users");
+    char buf[CKPT_RECEIVER_MAX_SECRET_LEN + 1];
+    ssize_t n = Util::readAll(fd, buf, sizeof(buf));
+    close(fd);
+    JASSERT(n > 0 && n <= CKPT_RECEIVER_MAX_SECRET_LEN) (secretFile) (n)
+      .Text("Invalid secret file");
+    theSecret.assign(buf, n);
+    while (!theSecret.empty() && theSecret[theSecret.length() - 1] == '\n') {
+      theSecret.erase(theSecret.length() - 1);
+    }
+  } else if (getenv(ENV_VAR_CKPT_RECEIVER_SECRET) != NULL) {
+    theSecret = getenv(ENV_VAR_CKPT_RECEIVER_SECRET);
+  }
+  JASSERT(Util::strStartsWith(listenAddr, "unix:") || !theSecret.empty())
+    (listenAddr)
+    .Text("Listening on TCP requires a shared secret: "
+          "use --secret-file or DMTCP_CKPT_RECEIVER_SECRET.");
+
+  // A restarting process may go away in the middle of a GET.
+  signal(SIGPIPE, SIG_IGN);
+
+  int listenFd = CkptReceiver::listen(listenAddr);
+  JASSERT(listenFd != -1) (listenAddr) (JASSERT_ERRNO)
+    .Text("Error listening for checkpoint images");
+  JNOTE("dmtcp_ckpt_receiver listening") (listenAddr)
+    (imageDir.empty() ? "(RAM)" : imageDir);
+
+  while (true) {
+    int fd = accept(listenFd, NULL, NULL);
+    if (fd == -1) {
+      if (errno != EINTR && errno != ECONNABORTED) {
+        // E.g. EMFILE: wait for some connections to finish.
+        JWARNING(false) (JASSERT_ERRNO) .Text("Error accepting connection");
+        usleep(100 * 1000);
+      }
+      continue;
+    }
+    pthread_t thread;
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&thread, &attr, serveConnection,
+                       (void*) (intptr_t) fd) != 0) {
+      JWARNING(false) (JASSERT_ERRNO) .Text("Error creating thread");
+      close(fd);
+    }
+    pthread_attr_destroy(&attr);
+  }
+  return 0;
+}
@@ -20,6 +20,7 @@
  ****************************************************************************/
 
 #include <stdio.h>
+#include <string.h>
 
 #include "coordinatorapi.h"
 #include "util.h"
@@ -56,6 +57,8 @@ static const char* theUsage =
   "    -kc, --kcheckpoint     Checkpoint all nodes, kill all nodes when done\n"
 // "    -xc, --xcheckpoint  deprecated synonym for '-kc': kill nodes if done\n"
   "    -i, --interval <val>   Update ckpt interval to <val> seconds (0=never)\n"
+  "    -f, --flight-recorder  Dump the JLOG flight recorder of all nodes\n"
+  "                           (needs --debug-logs FLIGHTREC, LOGGING builds)\n"
   "    -k, --kill             Kill all nodes\n"
   "    -q, --quit             Kill all nodes and quit\n"
   "\n"
@@ -102,6 +105,9 @@ int main ( int argc, char** argv )
                isdigit(argv[0][2])) { // else if -p0, for example
       setenv(ENV_VAR_NAME_PORT, argv[0]+2, 1);
       shift;
+    } else if (s == "--flight-recorder") {
+      request = "f";
+      shift;
     }else if(s == "h" || s == "-h" || s == "--help" || s == "?"){
       fprintf(stderr, theUsage, "");
       return 1;
@@ -119,7 +125,7 @@ int main ( int argc, char** argv )
         fprintf(stderr, theUsage, "");
         return 1;
       } else if (*cmd == 's' || *cmd == 'i' || *cmd == 'c' || *cmd == 'b' ||
-                 *cmd == 'K' || *cmd == 'k' ||
+                 *cmd == 'K' || *cmd == 'k' || *cmd == 'f' ||
                  *cmd == 'q' || *cmd == 'l') {
         request = s;
         if (*cmd == 'i') {
@@ -174,13 +180,14 @@ int main ( int argc, char** argv )
     coordinatorAPI.connectAndSendUserCommand(*(cmd+1), &coordCmdStatus);
     break;
   case 's':
-    coordinatorAPI.connectAndSendUserCommand(*cmd, &coordCmdStatus,
+    workerList = coordinatorAPI.connectAndSendUserCommand(*cmd, &coordCmdStatus,
                                         &numPeers, &isRunning, &ckptInterval);
     break;
   case 'l':
     workerList = coordinatorAPI.connectAndSendUserCommand(*cmd, &coordCmdStatus);
     break;
   case 'c':
+  case 'f':
   case 'k':
   case 'q':
     workerList = coordinatorAPI.connectAndSendUserCommand(*cmd, &coordCmdStatus);
@@ -209,6 +216,10 @@ int main ( int argc, char** argv )
 	      "  Either a checkpoint is\n"
 	      " currently happening or there are no connected processes.\n");
       break;
+    case CoordCmdStatus::ERROR_CKPT_ABORTED:
+      fprintf(stderr, "Checkpoint aborted: a process missed the coordinator's"
+              " barrier deadline.\n");
+      break;
     default:
       fprintf(stderr, "Unknown error\n");
       break;
@@ -236,6 +247,14 @@ int main ( int argc, char** argv )
       } else {
         printf("  CKPT_INTERVAL=0 (checkpoint manually)\n");
       }
+      // Checkpoint cost and adaptive interval info, one item per line.
+      if (workerList) {
+        for (char *line = strtok(workerList, "\n"); line != NULL;
+             line = strtok(NULL, "\n")) {
+          printf("  %s\n", line);
+        }
+        JALLOC_HELPER_FREE(workerList);
+      }
     } else {
       if (workerList) {
         printf("%s",workerList);
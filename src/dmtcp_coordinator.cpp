@@ -65,6 +65,7 @@
 #include "syscallwrappers.h"
 #include "util.h"
 #include "restartscript.h"
+#include "ckptreceiver.h"
 #include "../jalib/jassert.h"
 #include "../jalib/jconvert.h"
 #include "../jalib/jtimer.h"
@@ -82,7 +83,10 @@
 #include <fcntl.h>
 #include <limits.h>  // for HOST_NAME_MAX
 #include <time.h>
+#include <math.h>
 #include <sys/prctl.h>
+#include <sys/un.h>
+#include <strings.h>
 #undef min
 #undef max
 
@@ -98,6 +102,7 @@ static const char* theHelpMessage =
   "  Kc : Checkpoint and then kill all nodes\n"
   "  i : Print current checkpoint interval\n"
   "      (To change checkpoint interval, use dmtcp_command)\n"
+  "  f : Dump the flight recorder of all nodes\n"
   "  k : Kill all nodes\n"
   "  q : Kill all nodes and quit\n"
   "  ? : Show this message\n"
@@ -129,6 +134,46 @@ static const char* theUsage =
   "  -i, --interval (environment variable DMTCP_CHECKPOINT_INTERVAL):\n"
   "      Time in seconds between automatic checkpoints\n"
   "      (default: 0, disabled)\n"
+  "  --mtbf SECONDS (environment variable DMTCP_MTBF):\n"
+  "      Expected mean time between failures of the computation.  Enables\n"
+  "      adaptive checkpointing: after each checkpoint, the interval is set\n"
+  "      to the optimum (Young/Daly) for the measured checkpoint cost.\n"
+  "      (default: 0, use the fixed interval)\n"
+  "  --metrics-port PORT\n"
+  "      Serve metrics over HTTP on localhost:PORT, in Prometheus text format,\n"
+  "      or as JSON if the request path contains 'json'\n"
+  "  --metrics-socket PATH\n"
+  "      Serve the metrics on a UNIX domain socket instead, which only this\n"
+  "      user may connect to.  A request is an HTTP GET, or a single line\n"
+  "      ('json' or 'prometheus') for nc/socat\n"
+  "  --barrier-timeout [BARRIER=]SECONDS\n"
+  "      Deadline for reaching a checkpoint barrier (e.g. SUSPENDED, DRAINED,\n"
+  "      CHECKPOINTED), or for all barriers if none is named; may be repeated.\n"
+  "      On a missed deadline, the processes holding the barrier back are\n"
+  "      reported, and asked to dump their flight recorders\n"
+  "  --abort-on-timeout\n"
+  "      If the SUSPENDED barrier misses its deadline, abort the checkpoint\n"
+  "      and resume the computation instead of waiting\n"
+  "  --write-slots N\n"
+  "      Let at most N peers write their checkpoint images at the same time;\n"
+  "      the others start as writers finish (default: 0, unlimited)\n"
+  "  --write-slots-per-host N\n"
+  "      Let at most N peers on any one host write at the same time\n"
+  "      (default: 0, unlimited)\n"
+  "  --write-bandwidth MB/s\n"
+  "      Share this much write bandwidth per host evenly among the peers\n"
+  "      writing there at the same time (default: 0, unlimited)\n"
+  "      With forked checkpointing, a peer reports CHECKPOINTED once its\n"
+  "      child is forked, so the write slots then bound only the forks; each\n"
+  "      child still keeps to the bandwidth share of its parent\n"
+  "  --xor-group-size N\n"
+  "      Protect images written to node-local storage (--local-ckptdir) by\n"
+  "      XOR parity over groups of N peers on distinct hosts, kept by the\n"
+  "      dmtcp_ckpt_receiver of a host outside each group; dmtcp_restart\n"
+  "      --xor-receivers rebuilds a lost image of a group (default: 0, off)\n"
+  "  --xor-receiver-port PORT\n"
+  "      Port of the dmtcp_ckpt_receiver on each host (default: 7780); the\n"
+  "      receivers and the processes share DMTCP_CKPT_RECEIVER_SECRET\n"
   "  --coord-logfile PATH (environment variable DMTCP_COORD_LOG_FILENAME\n"
   "              Coordinator will dump its logs to the given file\n"
   "  -q, --quiet \n"
@@ -190,7 +235,100 @@ static uint32_t theDefaultCheckpointInterval = 0; /* Reset to this on new comp.
 static bool isRestarting = false;
 static bool timerExpired = false;
 
+/* Adaptive checkpointing.  If theMtbf is set, theCheckpointInterval is
+ * recomputed after every checkpoint from the measured checkpoint cost (the
+ * time from DMT_DO_SUSPEND until DMT_DO_RESUME, smoothed over generations).
+ */
+static double theMtbf = 0;
+static double theCkptCost = 0;
+static double lastCkptDuration = 0;
+static uint64_t lastCkptImagesSize = 0;
+static uint64_t curCkptImagesSize = 0;
+static struct timespec ckptStartTime;
+
+/* Metrics, served on --metrics-port/--metrics-socket.  Barrier phases are
+ * timed from the moment the previous barrier was reached (or the checkpoint
+ * was started) until every peer has reached the next one.
+ */
+struct CkptGenerationStats {
+  uint32_t generation;
+  uint64_t bytes;
+  double duration;
+  time_t completed;
+};
+#define CKPT_HISTORY_SIZE 16
+static double phaseDuration[WorkerState::_MAX];
+static WorkerState::eWorkerState curPhase = WorkerState::UNKNOWN;
+static uint64_t phaseStartTime = 0;
+static uint64_t numCheckpoints = 0;
+static uint64_t totalCkptImagesSize = 0;
+static vector<CkptGenerationStats> ckptHistory;
+
+/* Straggler detection.  When a barrier is reached, the NUM_STRAGGLERS clients
+ * that were slowest to reach it are recorded.  A barrier that misses its
+ * --barrier-timeout deadline is handled once by checkBarrierDeadline().
+ */
+struct Straggler {
+  int clientNumber;
+  string progname;
+  string hostname;
+  pid_t pid;
+  double seconds;
+};
+#define NUM_STRAGGLERS 5
+static vector<Straggler> stragglers[WorkerState::_MAX];
+static double barrierTimeout[WorkerState::_MAX];
+static bool haveBarrierTimeouts = false;
+static bool abortOnTimeout = false;
+static bool barrierDeadlineHandled = false;
+static bool ckptAborted = false;
+static uint64_t numBarrierTimeouts = 0;
+static uint64_t numCkptsAborted = 0;
+
+/* Checkpoint write scheduling.  With --write-slots or --write-slots-per-host,
+ * DMT_DO_CHECKPOINT is sent at the DRAINED barrier only to as many peers as
+ * there are free write slots, taking the hosts in turn; each waiting peer is
+ * sent it once a writer reports CHECKPOINTED (or disconnects).  With
+ * --write-bandwidth, every writer is also told its share of the bandwidth of
+ * its host, which it enforces while writing its image.
+ *
+ * With forked checkpointing (DMTCP_FORKED_CHECKPOINT), a peer reports
+ * CHECKPOINTED as soon as it has forked the child that writes its image, so a
+ * write slot is freed before the write is done.  The slots then do not bound
+ * the concurrent writers; the bandwidth shares, inherited by each child, are
+ * still honored but may add up to more than --write-bandwidth.
+ */
+static size_t writeSlots = 0;
+static size_t writeSlotsPerHost = 0;
+static uint64_t writeBandwidth = 0; // bytes/sec per host
+static vector<CoordClient*> waitingWriters;
+static vector<CoordClient*> activeWriters;
+static map<string, size_t> numHostWriters;
+
+/* XOR parity groups (--xor-group-size).  At the DRAINED barrier, the peers
+ * are split into groups of peers on distinct hosts where possible.  Each peer
+ * is told with DMT_DO_CHECKPOINT where to send its image once written: the
+ * dmtcp_ckpt_receiver of a host outside its group, which keeps the XOR of
+ * the group's images as the parity set "ckpt_xor_<comp>_<group>.xor".
+ */
+struct XorAssignment {
+  uint32_t member;
+  uint32_t groupSize;
+  string receiver;
+  string paritySet;
+};
+static size_t xorGroupSize = 0;
+static int xorReceiverPort = 7780;
+static map<CoordClient*, XorAssignment> xorAssignments;
+
+static int theMetricsPort = -1;
+static string theMetricsSocket;
+static jalib::JSocket *metricsListenSock = NULL;
+
 static void resetCkptTimer();
+static uint32_t optimalCheckpointInterval();
+static double expectedCheckpointOverhead();
+static uint64_t getCurrTimestamp();
 
 const int STDIN_FD = fileno ( stdin );
 
@@ -211,6 +349,19 @@ static string tmpDir;
 static string ckptDir;
 static string globalCkptDir;
 
+// Multi-level checkpointing: workers started with --local-ckptdir write their
+// images to a node-local dir and drain them to ckptDir in the background.
+// A generation is globally durable once every such image has been drained.
+static string localCkptDir;
+// Drain reports may arrive before the checkpoint itself has completed.
+static size_t numLocalCkptImages = 0;
+static uint32_t drainingGeneration = 0;
+static bool drainingCkptWritten = false;
+static size_t numImagesToDrain = 0;
+// The processes whose images of drainingGeneration have been drained.
+static set<UniquePid> drainedImages;
+static uint32_t durableGeneration = 0;
+
 #define MAX_EVENTS 10000
 struct epoll_event events[MAX_EVENTS];
 int epollFd;
@@ -232,15 +383,26 @@ CoordClient::CoordClient(const jalib::JSocket& sock,
   : _sock(sock)
 {
   _isNSWorker = isNSWorker;
+  _isSpare = false;
   _realPid = hello_remote.realPid;
   _clientNumber = theNextClientNumber++;
   _identity = hello_remote.from;
   _state = hello_remote.state;
+  _stateTime = getCurrTimestamp();
   _virtualPid = 0;
+  _numMessages = 0;
+  _numBytes = 0;
+  _connectTime = getCurrTimestamp();
   struct sockaddr_in *in = (struct sockaddr_in*) addr;
   _ip = inet_ntoa(in->sin_addr);
 }
 
+void CoordClient::setState(WorkerState::eWorkerState value)
+{
+  _state = value;
+  _stateTime = getCurrTimestamp();
+}
+
 void CoordClient::readProcessInfo(DmtcpMessage& msg)
 {
   if (msg.extraBytes > 0) {
@@ -289,6 +451,10 @@ void DmtcpCoordinator::handleUserCommand(char cmd, DmtcpMessage* reply /*= NULL*
   case 'd':
     broadcastMessage(DMT_UPDATE_LOGGING);
     break;
+  case 'f':
+    JNOTE("Dumping flight recorders of all connected peers...");
+    broadcastMessage(DMT_DUMP_FLIGHT_RECORDER);
+    break;
   case 'e':
   {
     ComputationStatus s = getStatus();
@@ -371,6 +537,10 @@ void DmtcpCoordinator::handleUserCommand(char cmd, DmtcpMessage* reply /*= NULL*
       reply->numPeers = s.numPeers;
       reply->isRunning = running;
       reply->theCheckpointInterval = theCheckpointInterval;
+      replyData = printCkptCost();
+      if (!replyData.empty()) {
+        reply->extraBytes = replyData.length() + 1;
+      }
     } else {
       printStatus(s.numPeers, running);
     }
@@ -403,19 +573,50 @@ void DmtcpCoordinator::printStatus(size_t numPeers, bool isRunning)
     o << theCheckpointInterval << std::endl;
   }
 
+  o << printCkptCost();
+
   o << "Exit on last client: " << exitOnLast << std::endl
     << "Kill after checkpoint: " << killAfterCkpt << std::endl
 
     // << "Kill after checkpoint (first time only): " << killAfterCkptOnce
     // << std::endl
     << "Computation Id: " << compId << std::endl
-    << "Checkpoint Dir: " << ckptDir << std::endl
-    << "NUM_PEERS=" << numPeers << std::endl
+    << "Checkpoint Dir: " << ckptDir << std::endl;
+
+  if (!localCkptDir.empty()) {
+    o << "Local Checkpoint Dir: " << localCkptDir << std::endl
+      << "Globally Durable Generation: " << durableGeneration;
+    if (drainingCkptWritten && durableGeneration != drainingGeneration) {
+      o << " (generation " << drainingGeneration << " draining, "
+        << numImagesToDrain - drainedImages.size() << " images pending)";
+    }
+    o << std::endl;
+  }
+
+  o << "NUM_PEERS=" << numPeers << std::endl
     << "RUNNING=" << (isRunning ? "yes" : "no") << std::endl;
   printf("%s", o.str().c_str());
   fflush(stdout);
 }
 
+string DmtcpCoordinator::printCkptCost()
+{
+  ostringstream o;
+  if (theMtbf > 0) {
+    o << "MTBF: " << theMtbf << " (adaptive checkpoint interval)" << std::endl;
+  }
+  if (lastCkptDuration > 0) {
+    o << "Last Checkpoint Duration: " << lastCkptDuration << " s, "
+      << lastCkptImagesSize << " bytes" << std::endl
+      << "Estimated Checkpoint Cost: " << theCkptCost << " s" << std::endl;
+  }
+  if (theMtbf > 0 && theCheckpointInterval > 0) {
+    o << "Expected Overhead: " << std::fixed << std::setprecision(1)
+      << 100 * expectedCheckpointOverhead() << "%" << std::endl;
+  }
+  return o.str();
+}
+
 string DmtcpCoordinator::printList()
 {
   ostringstream o;
@@ -430,16 +631,510 @@ string DmtcpCoordinator::printList()
       << "(" << clients[i]->ip() << ")"
 #endif
       << ", " << clients[i]->identity()
-      << ", " << clients[i]->state()
-      << '\n';
+      << ", " << clients[i]->state();
+    if (clients[i]->isSpare()) {
+      o << " (spare)";
+    }
+    o << '\n';
   }
   return o.str();
 }
 
+static string stateName(WorkerState::eWorkerState state)
+{
+  ostringstream o;
+  o << state;
+  // Drop the "WorkerState::" prefix.
+  return o.str().substr(o.str().find(':') + 2);
+}
+
+// Quotes a string for a JSON value or a Prometheus label value.
+static string quote(const string& str)
+{
+  string res = "\"";
+  for (size_t i = 0; i < str.length(); i++) {
+    char c = str[i];
+    if (c == '"' || c == '\\') {
+      res += '\\';
+      res += c;
+    } else if (c == '\n') {
+      res += "\\n";
+    } else if ((unsigned char) c < ' ') {
+      res += '?';
+    } else {
+      res += c;
+    }
+  }
+  return res + "\"";
+}
+
+/* Prometheus text format by default; JSON has the same data, plus the
+ * history of the last CKPT_HISTORY_SIZE checkpoint generations.
+ */
+string DmtcpCoordinator::printMetrics(bool json)
+{
+  ComputationStatus s = getStatus();
+  uint64_t now = getCurrTimestamp();
+  bool inProgress = s.numPeers > 0 &&
+    (workersRunningAndSuspendMsgSent || s.minimumState != WorkerState::RUNNING);
+  double barrierWait = inProgress ? (now - phaseStartTime) / 1e9 : 0;
+  const CkptGenerationStats *last =
+    ckptHistory.empty() ? NULL : &ckptHistory.back();
+
+  size_t peersByState[WorkerState::_MAX] = {0};
+  size_t numSpares = 0;
+  for (size_t i = 0; i < clients.size(); i++) {
+    if (clients[i]->isSpare()) {
+      numSpares++;
+    } else {
+      peersByState[clients[i]->state()]++;
+    }
+  }
+  map<string, size_t> nsEntries;
+  lookupService.entryCounts(&nsEntries);
+  map<string, size_t>::iterator ns;
+
+  ostringstream o;
+  o << std::fixed << std::setprecision(6);
+  if (json) {
+    o << "{\n  \"computation\": " << quote(compId.toString()) << ",\n"
+      << "  \"generation\": " << compId.computationGeneration() << ",\n"
+      << "  \"num_peers\": " << s.numPeers << ",\n"
+      << "  \"spare_connections\": " << numSpares << ",\n"
+      << "  \"peers_by_state\": {";
+    const char *sep = "";
+    for (int i = 0; i < WorkerState::_MAX; i++) {
+      if (peersByState[i] > 0) {
+        o << sep << quote(stateName((WorkerState::eWorkerState) i)) << ": "
+          << peersByState[i];
+        sep = ", ";
+      }
+    }
+    o << "},\n"
+      << "  \"checkpoint_in_progress\": " << (inProgress ? "true" : "false")
+      << ",\n"
+      << "  \"last_barrier\": " << quote(stateName(curPhase)) << ",\n"
+      << "  \"barrier_wait_seconds\": " << barrierWait << ",\n"
+      << "  \"barrier_phase_seconds\": {";
+    sep = "";
+    for (int i = WorkerState::SUSPENDED; i < WorkerState::_MAX; i++) {
+      if (phaseDuration[i] > 0) {
+        o << sep << quote(stateName((WorkerState::eWorkerState) i)) << ": "
+          << phaseDuration[i];
+        sep = ", ";
+      }
+    }
+    o << "},\n  \"slowest_clients\": {";
+    sep = "";
+    for (int i = WorkerState::SUSPENDED; i < WorkerState::_MAX; i++) {
+      if (stragglers[i].empty()) {
+        continue;
+      }
+      o << sep << "\n    " << quote(stateName((WorkerState::eWorkerState) i))
+        << ": [";
+      const char *sep2 = "";
+      for (size_t j = 0; j < stragglers[i].size(); j++) {
+        const Straggler &st = stragglers[i][j];
+        o << sep2 << "{\"client\": " << st.clientNumber
+          << ", \"progname\": " << quote(st.progname)
+          << ", \"hostname\": " << quote(st.hostname)
+          << ", \"virtual_pid\": " << st.pid
+          << ", \"seconds\": " << st.seconds << "}";
+        sep2 = ", ";
+      }
+      o << "]";
+      sep = ",";
+    }
+    o << "},\n"
+      << "  \"barrier_timeouts_total\": " << numBarrierTimeouts << ",\n"
+      << "  \"checkpoints_aborted_total\": " << numCkptsAborted << ",\n"
+      << "  \"checkpoints_total\": " << numCheckpoints << ",\n"
+      << "  \"checkpoint_bytes_total\": " << totalCkptImagesSize << ",\n"
+      << "  \"seconds_since_last_checkpoint\": ";
+    if (last != NULL) {
+      o << difftime(time(NULL), last->completed);
+    } else {
+      o << "null";
+    }
+    o << ",\n  \"durable_generation\": " << durableGeneration << ",\n"
+      << "  \"checkpoint_history\": [";
+    sep = "";
+    for (size_t i = 0; i < ckptHistory.size(); i++) {
+      const CkptGenerationStats &st = ckptHistory[i];
+      o << sep << "\n    {\"generation\": " << st.generation
+        << ", \"bytes\": " << st.bytes
+        << ", \"seconds\": " << st.duration
+        << ", \"bytes_per_second\": "
+        << (st.duration > 0 ? st.bytes / st.duration : 0)
+        << ", \"completed\": " << st.completed << "}";
+      sep = ",";
+    }
+    o << "],\n  \"name_service_entries\": {";
+    sep = "";
+    for (ns = nsEntries.begin(); ns != nsEntries.end(); ns++) {
+      o << sep << quote(ns->first) << ": " << ns->second;
+      sep = ", ";
+    }
+    o << "},\n  \"clients\": [";
+    sep = "";
+    for (size_t i = 0; i < clients.size(); i++) {
+      CoordClient *c = clients[i];
+      double age = (now - c->connectTime()) / 1e9;
+      o << sep << "\n    {\"number\": " << c->clientNumber()
+        << ", \"progname\": " << quote(c->progname())
+        << ", \"hostname\": " << quote(c->hostname())
+        << ", \"virtual_pid\": " << c->identity().pid()
+        << ", \"real_pid\": " << c->realPid()
+        << ", \"state\": " << quote(stateName(c->state()))
+        << ", \"spare\": " << (c->isSpare() ? "true" : "false")
+        << ", \"messages\": " << c->numMessages()
+        << ", \"bytes\": " << c->numBytes()
+        << ", \"messages_per_second\": "
+        << (age > 0 ? c->numMessages() / age : 0) << "}";
+      sep = ",";
+    }
+    o << "]\n}\n";
+    return o.str();
+  }
+
+  o << "# HELP dmtcp_peers Connected peers, by worker state.\n"
+    << "# TYPE dmtcp_peers gauge\n";
+  for (int i = 0; i < WorkerState::_MAX; i++) {
+    if (peersByState[i] > 0) {
+      o << "dmtcp_peers{state="
+        << quote(stateName((WorkerState::eWorkerState) i)) << "} "
+        << peersByState[i] << "\n";
+    }
+  }
+  o << "# HELP dmtcp_spare_connections Pre-opened connections for forks.\n"
+    << "# TYPE dmtcp_spare_connections gauge\n"
+    << "dmtcp_spare_connections " << numSpares << "\n"
+    << "# HELP dmtcp_generation Current checkpoint generation.\n"
+    << "# TYPE dmtcp_generation gauge\n"
+    << "dmtcp_generation " << compId.computationGeneration() << "\n"
+    << "# HELP dmtcp_checkpoint_in_progress 1 while a checkpoint or restart"
+       " is in its barriers.\n"
+    << "# TYPE dmtcp_checkpoint_in_progress gauge\n"
+    << "dmtcp_checkpoint_in_progress " << inProgress << "\n"
+    << "# HELP dmtcp_barrier_wait_seconds Time spent waiting for the next"
+       " barrier after the one named.\n"
+    << "# TYPE dmtcp_barrier_wait_seconds gauge\n"
+    << "dmtcp_barrier_wait_seconds{last_barrier="
+    << quote(stateName(curPhase)) << "} " << barrierWait << "\n"
+    << "# HELP dmtcp_barrier_phase_seconds Time to reach each barrier in the"
+       " last checkpoint or restart.\n"
+    << "# TYPE dmtcp_barrier_phase_seconds gauge\n";
+  for (int i = WorkerState::SUSPENDED; i < WorkerState::_MAX; i++) {
+    if (phaseDuration[i] > 0) {
+      o << "dmtcp_barrier_phase_seconds{phase="
+        << quote(stateName((WorkerState::eWorkerState) i)) << "} "
+        << phaseDuration[i] << "\n";
+    }
+  }
+  o << "# HELP dmtcp_barrier_straggler_seconds Time after the previous"
+       " barrier at which the slowest clients reached each barrier.\n"
+    << "# TYPE dmtcp_barrier_straggler_seconds gauge\n";
+  for (int i = WorkerState::SUSPENDED; i < WorkerState::_MAX; i++) {
+    for (size_t j = 0; j < stragglers[i].size(); j++) {
+      const Straggler &st = stragglers[i][j];
+      o << "dmtcp_barrier_straggler_seconds{phase="
+        << quote(stateName((WorkerState::eWorkerState) i))
+        << ",rank=\"" << j + 1 << "\",client=\"" << st.clientNumber
+        << "\",progname=" << quote(st.progname)
+        << ",hostname=" << quote(st.hostname) << "} " << st.seconds << "\n";
+    }
+  }
+  o << "# HELP dmtcp_barrier_timeouts_total Barriers that missed their"
+       " --barrier-timeout deadline.\n"
+    << "# TYPE dmtcp_barrier_timeouts_total counter\n"
+    << "dmtcp_barrier_timeouts_total " << numBarrierTimeouts << "\n"
+    << "# HELP dmtcp_checkpoints_aborted_total Checkpoints aborted by"
+       " --abort-on-timeout.\n"
+    << "# TYPE dmtcp_checkpoints_aborted_total counter\n"
+    << "dmtcp_checkpoints_aborted_total " << numCkptsAborted << "\n";
+  o << "# HELP dmtcp_checkpoints_total Completed checkpoints.\n"
+    << "# TYPE dmtcp_checkpoints_total counter\n"
+    << "dmtcp_checkpoints_total " << numCheckpoints << "\n"
+    << "# HELP dmtcp_checkpoint_bytes_total Bytes of all checkpoint images.\n"
+    << "# TYPE dmtcp_checkpoint_bytes_total counter\n"
+    << "dmtcp_checkpoint_bytes_total " << totalCkptImagesSize << "\n";
+  if (last != NULL) {
+    o << "# HELP dmtcp_last_checkpoint_bytes Image bytes of the last"
+         " checkpoint.\n"
+      << "# TYPE dmtcp_last_checkpoint_bytes gauge\n"
+      << "dmtcp_last_checkpoint_bytes{generation=\"" << last->generation
+      << "\"} " << last->bytes << "\n"
+      << "# HELP dmtcp_last_checkpoint_seconds Duration of the last"
+         " checkpoint.\n"
+      << "# TYPE dmtcp_last_checkpoint_seconds gauge\n"
+      << "dmtcp_last_checkpoint_seconds{generation=\"" << last->generation
+      << "\"} " << last->duration << "\n"
+      << "# HELP dmtcp_last_checkpoint_bytes_per_second Throughput of the"
+         " last checkpoint.\n"
+      << "# TYPE dmtcp_last_checkpoint_bytes_per_second gauge\n"
+      << "dmtcp_last_checkpoint_bytes_per_second{generation=\""
+      << last->generation << "\"} "
+      << (last->duration > 0 ? last->bytes / last->duration : 0) << "\n"
+      << "# HELP dmtcp_seconds_since_last_checkpoint Time since the last"
+         " checkpoint completed.\n"
+      << "# TYPE dmtcp_seconds_since_last_checkpoint gauge\n"
+      << "dmtcp_seconds_since_last_checkpoint "
+      << difftime(time(NULL), last->completed) << "\n";
+  }
+  if (!localCkptDir.empty()) {
+    o << "# HELP dmtcp_durable_generation Last generation fully drained to"
+         " the global checkpoint dir.\n"
+      << "# TYPE dmtcp_durable_generation gauge\n"
+      << "dmtcp_durable_generation " << durableGeneration << "\n";
+  }
+  o << "# HELP dmtcp_name_service_entries Name service entries, by"
+       " database.\n"
+    << "# TYPE dmtcp_name_service_entries gauge\n";
+  for (ns = nsEntries.begin(); ns != nsEntries.end(); ns++) {
+    o << "dmtcp_name_service_entries{db=" << quote(ns->first) << "} "
+      << ns->second << "\n";
+  }
+  o << "# HELP dmtcp_client_messages_total Messages received from each"
+       " client.\n"
+    << "# TYPE dmtcp_client_messages_total counter\n";
+  for (size_t i = 0; i < clients.size(); i++) {
+    o << "dmtcp_client_messages_total{client=\""
+      << clients[i]->clientNumber() << "\",progname="
+      << quote(clients[i]->progname()) << ",hostname="
+      << quote(clients[i]->hostname()) << "} "
+      << clients[i]->numMessages() << "\n";
+  }
+  o << "# HELP dmtcp_client_received_bytes_total Bytes received from each"
+       " client.\n"
+    << "# TYPE dmtcp_client_received_bytes_total counter\n";
+  for (size_t i = 0; i < clients.size(); i++) {
+    o << "dmtcp_client_received_bytes_total{client=\""
+      << clients[i]->clientNumber() << "\",progname="
+      << quote(clients[i]->progname()) << ",hostname="
+      << quote(clients[i]->hostname()) << "} "
+      << clients[i]->numBytes() << "\n";
+  }
+  return o.str();
+}
+
+static void trackDrainingGeneration(uint32_t generation)
+{
+  if (generation != drainingGeneration) {
+    drainingGeneration = generation;
+    drainingCkptWritten = false;
+    numImagesToDrain = 0;
+    drainedImages.clear();
+  }
+}
+
+static void checkDurableGeneration()
+{
+  if (drainingCkptWritten && drainedImages.size() >= numImagesToDrain &&
+      durableGeneration != drainingGeneration) {
+    durableGeneration = drainingGeneration;
+    if (numImagesToDrain > 0) {
+      JNOTE("Checkpoint images drained to global ckpt dir")
+        (durableGeneration) (ckptDir);
+    }
+  }
+}
+
+// Called once all images of the current generation have been written.  Images
+// written to a node-local dir are durable only after they've been drained.
+static void updateDurableGeneration()
+{
+  trackDrainingGeneration(compId.computationGeneration());
+  drainingCkptWritten = true;
+  numImagesToDrain = numLocalCkptImages;
+  checkDurableGeneration();
+}
+
+/* Daly's higher-order estimate of the optimum compute time between
+ * checkpoints, for checkpoint cost C and mean time between failures M:
+ *   T = sqrt(2CM) * (1 + sqrt(C/2M)/3 + (C/2M)/9) - C,  if C < 2M
+ *   T = M,                                             otherwise
+ * Until a checkpoint has been measured, a cost of one second is assumed.
+ */
+static uint32_t optimalCheckpointInterval()
+{
+  double C = theCkptCost > 0 ? theCkptCost : 1.0;
+  double M = theMtbf;
+  double T = M;
+  if (C < 2 * M) {
+    double r = C / (2 * M);
+    T = sqrt(2 * C * M) * (1 + sqrt(r) / 3 + r / 9) - C;
+  }
+  return T < 1 ? 1 : (uint32_t) (T + 0.5);
+}
+
+/* Expected fraction of time lost to checkpoints and to recomputation after a
+ * failure, for the current interval: C/(T+C) + (T+C)/2M.  Uses the same
+ * assumed cost as above until a checkpoint has been measured.
+ */
+static double expectedCheckpointOverhead()
+{
+  double T = theCheckpointInterval;
+  double C = theCkptCost > 0 ? theCkptCost : 1.0;
+  if (T == 0 || theMtbf == 0) {
+    return 0;
+  }
+  return C / (T + C) + (T + C) / (2 * theMtbf);
+}
+
+static void updateCheckpointCost()
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  lastCkptDuration = (now.tv_sec - ckptStartTime.tv_sec) +
+                     (now.tv_nsec - ckptStartTime.tv_nsec) / 1e9;
+  lastCkptImagesSize = curCkptImagesSize;
+
+  // Exponential moving average, so one slow checkpoint (e.g., a busy
+  // filesystem) doesn't swing the interval too far.
+  if (theCkptCost == 0) {
+    theCkptCost = lastCkptDuration;
+  } else {
+    theCkptCost = 0.5 * theCkptCost + 0.5 * lastCkptDuration;
+  }
+
+  if (theMtbf > 0) {
+    uint32_t oldInterval = theCheckpointInterval;
+    theCheckpointInterval = optimalCheckpointInterval();
+    JNOTE("Adaptive checkpoint interval")
+      (lastCkptDuration) (lastCkptImagesSize) (theCkptCost) (theMtbf)
+      (oldInterval) (theCheckpointInterval) (expectedCheckpointOverhead());
+  }
+}
+
+static bool slowerThan(const Straggler& a, const Straggler& b)
+{
+  return a.seconds > b.seconds;
+}
+
+// Called when every client has reached the barrier, before phaseStartTime is
+// reset.
+static void recordStragglers(WorkerState::eWorkerState barrier)
+{
+  vector<Straggler> &slowest = stragglers[barrier];
+  slowest.clear();
+  for (size_t i = 0; i < clients.size(); i++) {
+    CoordClient *client = clients[i];
+    if (client->state() != barrier) {
+      continue;
+    }
+    Straggler st;
+    st.clientNumber = client->clientNumber();
+    st.progname = client->progname();
+    st.hostname = client->hostname();
+    st.pid = client->identity().pid();
+    st.seconds = client->stateTime() > phaseStartTime
+                   ? (client->stateTime() - phaseStartTime) / 1e9 : 0;
+    slowest.push_back(st);
+  }
+  std::sort(slowest.begin(), slowest.end(), slowerThan);
+  if (slowest.size() > NUM_STRAGGLERS) {
+    slowest.resize(NUM_STRAGGLERS);
+  }
+  if (!slowest.empty()) {
+    JTRACE("slowest client to reach barrier") (barrier)
+      (slowest[0].progname) (slowest[0].pid) (slowest[0].hostname)
+      (slowest[0].seconds);
+  }
+}
+
+static void updatePhaseTime(WorkerState::eWorkerState newPhase)
+{
+  if (newPhase != curPhase) {
+    uint64_t now = getCurrTimestamp();
+    // Without clients, there was no barrier to time.
+    if (curPhase != WorkerState::UNKNOWN) {
+      phaseDuration[newPhase] = (now - phaseStartTime) / 1e9;
+      recordStragglers(newPhase);
+    }
+    phaseStartTime = now;
+    curPhase = newPhase;
+    barrierDeadlineHandled = false;
+  }
+}
+
+// The barrier that clients in this state are working towards, or UNKNOWN.
+static WorkerState::eWorkerState nextBarrier(WorkerState::eWorkerState state)
+{
+  switch (state) {
+    case WorkerState::RUNNING:
+      return workersRunningAndSuspendMsgSent ? WorkerState::SUSPENDED
+                                             : WorkerState::UNKNOWN;
+    case WorkerState::SUSPENDED:
+      return WorkerState::FD_LEADER_ELECTION;
+    case WorkerState::FD_LEADER_ELECTION:
+      return WorkerState::PRE_CKPT_NAME_SERVICE_DATA_REGISTER;
+    case WorkerState::PRE_CKPT_NAME_SERVICE_DATA_REGISTER:
+      return WorkerState::PRE_CKPT_NAME_SERVICE_DATA_QUERY;
+    case WorkerState::PRE_CKPT_NAME_SERVICE_DATA_QUERY:
+      return WorkerState::DRAINED;
+    case WorkerState::DRAINED:
+    case WorkerState::RESTARTING:
+      return WorkerState::CHECKPOINTED;
+#ifdef COORD_NAMESERVICE
+    case WorkerState::CHECKPOINTED:
+      return WorkerState::NAME_SERVICE_DATA_REGISTERED;
+    case WorkerState::NAME_SERVICE_DATA_REGISTERED:
+      return WorkerState::DONE_QUERYING;
+    case WorkerState::DONE_QUERYING:
+      return WorkerState::REFILLED;
+#else
+    case WorkerState::CHECKPOINTED:
+      return WorkerState::REFILLED;
+#endif
+    case WorkerState::REFILLED:
+      return WorkerState::RUNNING;
+    default:
+      return WorkerState::UNKNOWN;
+  }
+}
+
+/* While working towards these barriers, workers exchange name service
+ * requests and replies with the coordinator over their coordinator socket,
+ * so no unsolicited message may be sent to them.
+ */
+static bool isNameServiceBarrier(WorkerState::eWorkerState barrier)
+{
+  return barrier == WorkerState::PRE_CKPT_NAME_SERVICE_DATA_REGISTER ||
+         barrier == WorkerState::PRE_CKPT_NAME_SERVICE_DATA_QUERY ||
+         barrier == WorkerState::NAME_SERVICE_DATA_REGISTERED ||
+         barrier == WorkerState::DONE_QUERYING;
+}
+
+static void recordCkptGeneration()
+{
+  CkptGenerationStats st;
+  st.generation = compId.computationGeneration();
+  st.bytes = lastCkptImagesSize;
+  st.duration = lastCkptDuration;
+  st.completed = time(NULL);
+  if (ckptHistory.size() == CKPT_HISTORY_SIZE) {
+    ckptHistory.erase(ckptHistory.begin());
+  }
+  ckptHistory.push_back(st);
+  numCheckpoints++;
+  totalCkptImagesSize += lastCkptImagesSize;
+}
+
 void DmtcpCoordinator::updateMinimumState(WorkerState::eWorkerState oldState)
 {
   WorkerState::eWorkerState newState = minimumState();
   JTRACE("updating minimum state")(oldState)(newState);
+  updatePhaseTime(newState);
+
+  if (ckptAborted) {
+    // Until every peer is back to RUNNING, a late straggler may report
+    // SUSPENDED; it must not be taken for the SUSPENDED barrier.
+    if (newState == WorkerState::RUNNING && getStatus().minimumStateUnanimous) {
+      JNOTE("All peers resumed after the aborted checkpoint");
+      ckptAborted = false;
+    }
+    return;
+  }
 
   if ( oldState == WorkerState::RUNNING
        && newState == WorkerState::SUSPENDED )
@@ -469,7 +1164,7 @@ void DmtcpCoordinator::updateMinimumState(WorkerState::eWorkerState oldState)
        && newState == WorkerState::DRAINED )
   {
     JNOTE ( "checkpointing all nodes" );
-    broadcastMessage ( DMT_DO_CHECKPOINT );
+    startCkptWrites();
   }
 
 #ifdef COORD_NAMESERVICE
@@ -477,6 +1172,7 @@ void DmtcpCoordinator::updateMinimumState(WorkerState::eWorkerState oldState)
        && newState == WorkerState::CHECKPOINTED )
   {
     RestartScript::writeScript(ckptDir,
+                               localCkptDir,
                                uniqueCkptFilenames,
                                ckptTimeStamp,
                                theCheckpointInterval,
@@ -485,6 +1181,7 @@ void DmtcpCoordinator::updateMinimumState(WorkerState::eWorkerState oldState)
                                _restartFilenames,
                                _rshCmdFileNames,
                                _sshCmdFileNames);
+    updateDurableGeneration();
 
     if (killAfterCkpt || killAfterCkptOnce) {
       JNOTE("Checkpoint Done. Killing all peers.");
@@ -524,12 +1221,14 @@ void DmtcpCoordinator::updateMinimumState(WorkerState::eWorkerState oldState)
        && newState == WorkerState::CHECKPOINTED )
   {
     RestartScript::writeScript(ckptDir,
+                               localCkptDir,
                                uniqueCkptFilenames,
                                ckptTimeStamp,
                                theCheckpointInterval,
                                thePort,
                                compId,
                                _restartFilenames);
+    updateDurableGeneration();
 
     if (killAfterCkpt || killAfterCkptOnce) {
       JNOTE("Checkpoint Done. Killing all peers.");
@@ -557,6 +1256,10 @@ void DmtcpCoordinator::updateMinimumState(WorkerState::eWorkerState oldState)
     broadcastMessage ( DMT_DO_RESUME );
 
     JTIMER_STOP ( checkpoint );
+    if (!isRestarting) {
+      updateCheckpointCost();
+      recordCkptGeneration();
+    }
     isRestarting = false;
 
     resetCkptTimer();
@@ -586,6 +1289,7 @@ void DmtcpCoordinator::onData(CoordClient *client)
     extraData = new char[msg.extraBytes];
     client->sock().readAll(extraData, msg.extraBytes);
   }
+  client->countMessage(msg.extraBytes);
 
   switch ( msg.type )
   {
@@ -599,6 +1303,10 @@ void DmtcpCoordinator::onData(CoordClient *client)
       JTRACE ("got DMT_OK message")
         ( oldState )( msg.from )( msg.state )( newState );
 
+      if (oldState == WorkerState::DRAINED
+          && msg.state == WorkerState::CHECKPOINTED) {
+        finishCkptWrite(client);
+      }
       updateMinimumState(oldState);
       break;
     }
@@ -613,11 +1321,21 @@ void DmtcpCoordinator::onData(CoordClient *client)
       string hostname;
       string shellType;
 
+      string localDir;
+
       ckptFilename = extraData;
       shellType = extraData + ckptFilename.length() + 1;
       hostname = extraData + shellType.length() + 1 + ckptFilename.length() + 1;
-
-      JTRACE ( "recording restart info with shellType" ) ( ckptFilename ) ( hostname ) (shellType);
+      localDir = extraData + shellType.length() + 1 + ckptFilename.length() + 1
+                 + hostname.length() + 1;
+
+      JTRACE ( "recording restart info with shellType" ) ( ckptFilename ) ( hostname ) (shellType)
+        (localDir);
+      if (!localDir.empty()) {
+        localCkptDir = localDir;
+        numLocalCkptImages++;
+      }
+      curCkptImagesSize += msg.ckptImageSize;
       if (shellType.empty()) {
         _restartFilenames[hostname].push_back ( ckptFilename );
       } else if (shellType == "rsh") {
@@ -681,6 +1399,7 @@ void DmtcpCoordinator::onData(CoordClient *client)
           (client->hostname()) (client->progname()) (msg.from) (client->identity());
         client->identity(msg.from);
         client->realPid(msg.realPid);
+        client->isSpare(false);
     }
     break;
     case DMT_UPDATE_PROCESS_INFO_AFTER_INIT_OR_EXEC:
@@ -720,6 +1439,9 @@ static void preExitCleanup()
   removeStaleSharedAreaFile();
   JTRACE("Removing port-file") (thePortFile);
   unlink(thePortFile.c_str());
+  if (!theMetricsSocket.empty()) {
+    unlink(theMetricsSocket.c_str());
+  }
 }
 
 void DmtcpCoordinator::onDisconnect(CoordClient *client)
@@ -738,6 +1460,7 @@ void DmtcpCoordinator::onDisconnect(CoordClient *client)
   client->sock().close();
   JNOTE ( "client disconnected" ) ( client->identity() ) (client->progname());
   _virtualPidToClientMap.erase(client->virtualPid());
+  finishCkptWrite(client);
 
   ComputationStatus s = getStatus();
   if (s.numPeers < 1) {
@@ -797,6 +1520,21 @@ void DmtcpCoordinator::onConnect()
     return;
   }
 
+  if (hello_remote.type == DMT_CKPT_DURABLE) {
+    uint32_t generation = hello_remote.compGroup.computationGeneration();
+    JTRACE("Received DMT_CKPT_DURABLE msg") (hello_remote.from) (generation);
+    // Only reports for the current generation count, and only once for each
+    // process; those for a generation that has since been superseded, or
+    // from a drainer that ran again for the same image, are dropped.
+    trackDrainingGeneration(compId.computationGeneration());
+    if (generation == drainingGeneration &&
+        drainedImages.insert(hello_remote.from).second) {
+      checkDurableGeneration();
+    }
+    remote.close();
+    return;
+  }
+
   if (hello_remote.type == DMT_UPDATE_GLOBAL_CKPT_DIR) {
     JASSERT(hello_remote.extraBytes > 0) (hello_remote.extraBytes);
     ComputationStatus s = getStatus();
@@ -920,11 +1658,13 @@ void DmtcpCoordinator::onConnect()
     client->virtualPid(hello_remote.from.pid());
     _virtualPidToClientMap[client->virtualPid()] = client;
     isRestarting = true;
-  } else if (hello_remote.type == DMT_NEW_WORKER) {
+  } else if (hello_remote.type == DMT_NEW_WORKER ||
+             hello_remote.type == DMT_NEW_SPARE_WORKER) {
     JASSERT(hello_remote.state == WorkerState::RUNNING ||
             hello_remote.state == WorkerState::UNKNOWN);
     JASSERT(hello_remote.virtualPid == -1);
     client->virtualPid(getNewVirtualPid());
+    client->isSpare(hello_remote.type == DMT_NEW_SPARE_WORKER);
     if (!validateNewWorkerProcess(hello_remote, remote, client,
                                   &remoteAddr, remoteLen)) {
       return;
@@ -940,6 +1680,7 @@ void DmtcpCoordinator::onConnect()
 
   clients.push_back(client);
   addDataSocket(client);
+  updatePhaseTime(minimumState());
 
   JTRACE("END") (clients.size());
 }
@@ -1157,13 +1898,19 @@ bool DmtcpCoordinator::startCheckpoint()
   uniqueCkptFilenames = false;
   ComputationStatus s = getStatus();
   if ( s.minimumState == WorkerState::RUNNING && s.minimumStateUnanimous
-       && !workersRunningAndSuspendMsgSent )
+       && !workersRunningAndSuspendMsgSent && !ckptAborted )
   {
     time(&ckptTimeStamp);
     JTIMER_START ( checkpoint );
     _restartFilenames.clear();
     _rshCmdFileNames.clear();
     _sshCmdFileNames.clear();
+    numLocalCkptImages = 0;
+    curCkptImagesSize = 0;
+    clock_gettime(CLOCK_MONOTONIC, &ckptStartTime);
+    curPhase = WorkerState::RUNNING;
+    phaseStartTime = getCurrTimestamp();
+    barrierDeadlineHandled = false;
     JNOTE ( "starting checkpoint, suspending all nodes" )( s.numPeers );
     compId.incrementGeneration();
     JNOTE("Incremented computationGeneration") (compId.computationGeneration());
@@ -1184,6 +1931,94 @@ bool DmtcpCoordinator::startCheckpoint()
   }
 }
 
+// Milliseconds until the pending barrier misses its deadline, or -1.
+int DmtcpCoordinator::barrierTimeoutMs()
+{
+  if (!haveBarrierTimeouts || barrierDeadlineHandled || ckptAborted) {
+    return -1;
+  }
+  ComputationStatus s = getStatus();
+  WorkerState::eWorkerState barrier = nextBarrier(s.minimumState);
+  if (s.numPeers < 1 || barrier == WorkerState::UNKNOWN ||
+      barrierTimeout[barrier] == 0) {
+    return -1;
+  }
+  double left = barrierTimeout[barrier] -
+                (getCurrTimestamp() - phaseStartTime) / 1e9;
+  return left <= 0 ? 0 : (int) (left * 1000) + 1;
+}
+
+void DmtcpCoordinator::checkBarrierDeadline()
+{
+  if (barrierTimeoutMs() != 0) {
+    return;
+  }
+  barrierDeadlineHandled = true;
+  numBarrierTimeouts++;
+
+  ComputationStatus s = getStatus();
+  WorkerState::eWorkerState barrier = nextBarrier(s.minimumState);
+  double waited = (getCurrTimestamp() - phaseStartTime) / 1e9;
+  bool dumpFlightRecorder = !isNameServiceBarrier(barrier);
+  DmtcpMessage msg(DMT_DUMP_FLIGHT_RECORDER);
+  ostringstream o;
+  size_t numLate = 0;
+  for (size_t i = 0; i < clients.size(); i++) {
+    CoordClient *client = clients[i];
+    if (client->state() != s.minimumState) {
+      continue;
+    }
+    if (++numLate <= NUM_STRAGGLERS) {
+      o << "\n    " << client->clientNumber() << ", " << client->progname()
+        << "[" << client->identity().pid() << ":" << client->realPid()
+        << "]@" << client->hostname() << ", " << client->identity()
+        << (client->isSpare() ? " (spare)" : "");
+    }
+    // The flight recorder is dumped once the straggler next waits for a
+    // message from us.
+    if (dumpFlightRecorder && !client->isSpare()) {
+      client->sock() << msg;
+    }
+  }
+  if (numLate > NUM_STRAGGLERS) {
+    o << "\n    ... and " << numLate - NUM_STRAGGLERS << " more";
+  }
+  if (s.minimumState == WorkerState::RESTARTING && numPeers > s.numPeers) {
+    o << "\n    " << numPeers - s.numPeers << " processes not yet restarted";
+  }
+  JWARNING(false) (barrier) (waited) (numLate) (o.str())
+    .Text("Barrier deadline missed; stragglers listed");
+
+  if (abortOnTimeout && barrier == WorkerState::SUSPENDED) {
+    abortCheckpoint();
+  }
+}
+
+/* Only a checkpoint waiting at the SUSPENDED barrier can be aborted: the
+ * peers have done nothing for it beyond DMTCP_EVENT_THREADS_SUSPEND.  Peers
+ * that suspend late find DMT_ABORT_CKPT queued behind DMT_DO_SUSPEND.
+ */
+void DmtcpCoordinator::abortCheckpoint()
+{
+  JNOTE("Aborting checkpoint, resuming all nodes")
+    (compId.computationGeneration());
+  broadcastMessage(DMT_ABORT_CKPT);
+  workersRunningAndSuspendMsgSent = false;
+  ckptAborted = true;
+  numCkptsAborted++;
+  resetCkptTimer();
+
+  if (blockUntilDone) {
+    DmtcpMessage blockUntilDoneReply(DMT_USER_CMD_RESULT);
+    blockUntilDoneReply.coordCmdStatus = CoordCmdStatus::ERROR_CKPT_ABORTED;
+    jalib::JSocket remote(blockUntilDoneRemote);
+    remote << blockUntilDoneReply;
+    remote.close();
+    blockUntilDone = false;
+    blockUntilDoneRemote = -1;
+  }
+}
+
 void DmtcpCoordinator::broadcastMessage(DmtcpMessageType type, int numPeers)
 {
   DmtcpMessage msg;
@@ -1217,6 +2052,195 @@ void DmtcpCoordinator::broadcastMessage(DmtcpMessageType type, int numPeers)
   JTRACE ("sending message")( type );
 }
 
+// The peers (not spares), taking one from each host in turn; hosts gets the
+// hosts in the order they were first seen.
+static vector<CoordClient*> peersByHostInTurn(vector<string> *hosts)
+{
+  vector<CoordClient*> peers;
+  map<string, vector<CoordClient*> > hostClients;
+  for (size_t i = 0; i < clients.size(); i++) {
+    if (clients[i]->isSpare()) {
+      continue;
+    }
+    const string& host = clients[i]->hostname();
+    if (hostClients.find(host) == hostClients.end()) {
+      hosts->push_back(host);
+    }
+    hostClients[host].push_back(clients[i]);
+  }
+  for (size_t n = 0; ; n++) {
+    bool taken = false;
+    for (size_t i = 0; i < hosts->size(); i++) {
+      if (n < hostClients[(*hosts)[i]].size()) {
+        peers.push_back(hostClients[(*hosts)[i]][n]);
+        taken = true;
+      }
+    }
+    if (!taken) {
+      break;
+    }
+  }
+  return peers;
+}
+
+static void assignXorGroups()
+{
+  xorAssignments.clear();
+  if (xorGroupSize < 2) {
+    return;
+  }
+
+  vector<string> hosts;
+  vector<CoordClient*> peers = peersByHostInTurn(&hosts);
+  map<string, string> hostIp;
+  for (size_t i = 0; i < peers.size(); i++) {
+    hostIp[peers[i]->hostname()] = peers[i]->ip();
+  }
+
+  // Consecutive peers are on distinct hosts as long as there are enough of
+  // them.  A last group of one is merged into the one before.
+  size_t numGroups = (peers.size() + xorGroupSize - 1) / xorGroupSize;
+  if (numGroups > 1 && peers.size() % xorGroupSize == 1) {
+    numGroups--;
+  }
+  bool parityInGroup = false;
+  for (size_t g = 0; g < numGroups; g++) {
+    size_t begin = g * xorGroupSize;
+    size_t end = g + 1 == numGroups ? peers.size() : begin + xorGroupSize;
+    set<string> groupHosts;
+    for (size_t i = begin; i < end; i++) {
+      groupHosts.insert(peers[i]->hostname());
+    }
+    // The parity goes to the next host (in turn) outside the group.
+    string parityHost = peers[begin]->hostname();
+    for (size_t h = 0; h < hosts.size(); h++) {
+      const string& host = hosts[(g + 1 + h) % hosts.size()];
+      if (groupHosts.find(host) == groupHosts.end()) {
+        parityHost = host;
+        break;
+      }
+    }
+    parityInGroup |= groupHosts.find(parityHost) != groupHosts.end();
+
+    ostringstream paritySet;
+    paritySet << "ckpt_xor_" << compId.toString() << "_" << g << CKPT_PARITY_SUFFIX;
+    for (size_t i = begin; i < end; i++) {
+      XorAssignment& a = xorAssignments[peers[i]];
+      a.member = i - begin;
+      a.groupSize = end - begin;
+      a.receiver = hostIp[parityHost] + ":" +
+                   jalib::XToString(xorReceiverPort);
+      a.paritySet = paritySet.str();
+    }
+  }
+  JNOTE("assigned XOR parity groups") (peers.size()) (numGroups)
+    (hosts.size());
+  JWARNING(!parityInGroup) (hosts.size()) (xorGroupSize)
+    .Text("Too few hosts: some parity is kept on a host of its own group,"
+          " and will not survive the loss of that host");
+}
+
+void DmtcpCoordinator::startCkptWrites()
+{
+  waitingWriters.clear();
+  activeWriters.clear();
+  numHostWriters.clear();
+  assignXorGroups();
+  if (writeSlots == 0 && writeSlotsPerHost == 0 && writeBandwidth == 0 &&
+      xorAssignments.empty()) {
+    broadcastMessage(DMT_DO_CHECKPOINT);
+    return;
+  }
+
+  // Queue the peers one host at a time in turn, so that the first free slots
+  // are spread over as many hosts as possible.
+  for (size_t i = 0; i < clients.size(); i++) {
+    if (clients[i]->isSpare()) {
+      sendDoCheckpoint(clients[i]);
+    } else {
+      numHostWriters[clients[i]->hostname()]++;
+    }
+  }
+  vector<string> hosts;
+  waitingWriters = peersByHostInTurn(&hosts);
+  dispatchCkptWrites();
+}
+
+void DmtcpCoordinator::dispatchCkptWrites()
+{
+  size_t i = 0;
+  while (i < waitingWriters.size() &&
+         (writeSlots == 0 || activeWriters.size() < writeSlots)) {
+    CoordClient *client = waitingWriters[i];
+    if (writeSlotsPerHost > 0) {
+      size_t onHost = 0;
+      for (size_t j = 0; j < activeWriters.size(); j++) {
+        if (activeWriters[j]->hostname() == client->hostname()) {
+          onHost++;
+        }
+      }
+      if (onHost >= writeSlotsPerHost) {
+        i++;
+        continue;
+      }
+    }
+    waitingWriters.erase(waitingWriters.begin() + i);
+    activeWriters.push_back(client);
+    sendDoCheckpoint(client);
+  }
+  JTRACE("checkpoint writers") (activeWriters.size()) (waitingWriters.size());
+}
+
+void DmtcpCoordinator::finishCkptWrite(CoordClient *client)
+{
+  vector<CoordClient*>::iterator it;
+  it = std::find(waitingWriters.begin(), waitingWriters.end(), client);
+  if (it != waitingWriters.end()) {
+    waitingWriters.erase(it);
+  }
+  it = std::find(activeWriters.begin(), activeWriters.end(), client);
+  if (it != activeWriters.end()) {
+    activeWriters.erase(it);
+    dispatchCkptWrites();
+  }
+}
+
+void DmtcpCoordinator::sendDoCheckpoint(CoordClient *client)
+{
+  DmtcpMessage msg(DMT_DO_CHECKPOINT);
+  msg.compGroup = compId;
+  if (writeBandwidth > 0 && !client->isSpare()) {
+    // The writers that may be active on this host at the same time.
+    size_t n = numHostWriters[client->hostname()];
+    if (writeSlotsPerHost > 0) {
+      n = std::min(n, writeSlotsPerHost);
+    }
+    if (writeSlots > 0) {
+      n = std::min(n, writeSlots);
+    }
+    msg.ckptWriteBandwidth = writeBandwidth / n;
+  }
+  map<CoordClient*, XorAssignment>::iterator xor_it;
+  xor_it = xorAssignments.find(client);
+  string extraData;
+  if (xor_it != xorAssignments.end()) {
+    const XorAssignment& a = xor_it->second;
+    msg.xorMember = a.member;
+    msg.xorGroupSize = a.groupSize;
+    extraData = a.receiver;
+    extraData.push_back('\0');
+    extraData += a.paritySet;
+    extraData.push_back('\0');
+    msg.extraBytes = extraData.length();
+  }
+  client->sock() << msg;
+  if (msg.extraBytes > 0) {
+    client->sock().writeAll(extraData.data(), msg.extraBytes);
+  }
+  JTRACE("sending message") (msg.type) (client->clientNumber())
+    (msg.ckptWriteBandwidth);
+}
+
 DmtcpCoordinator::ComputationStatus DmtcpCoordinator::getStatus() const
 {
   ComputationStatus status;
@@ -1228,7 +2252,11 @@ DmtcpCoordinator::ComputationStatus DmtcpCoordinator::getStatus() const
   bool unanimous = true;
   for (size_t i = 0; i < clients.size(); i++) {
     WorkerState::eWorkerState cliState = clients[i]->state();
-    count++;
+    // A spare connection takes part in the barriers (its owner closes it
+    // before the SUSPENDED barrier), but it isn't a process yet.
+    if (!clients[i]->isSpare()) {
+      count++;
+    }
     unanimous = unanimous && (min==cliState || min==INITIAL_MIN);
     if ( cliState < min ) min = cliState;
     if ( cliState > max ) max = cliState;
@@ -1397,11 +2425,164 @@ void DmtcpCoordinator::updateCheckpointInterval(uint32_t interval)
     }
     JNOTE ( "CheckpointInterval updated (for this computation only)" )
       ( oldInterval ) ( theCheckpointInterval );
+    if ( theMtbf > 0 && interval != DMTCPMESSAGE_SAME_CKPT_INTERVAL ) {
+      JNOTE ( "MTBF given; the adaptive checkpoint interval replaces this"
+              " one after the next checkpoint" ) ( theMtbf );
+    }
     firstClient = false;
     resetCkptTimer();
   }
 }
 
+/* A metrics request is read, and answered, without blocking the event loop:
+ * once complete, the reply is sent as the socket becomes writable, and the
+ * connection closed.
+ */
+struct MetricsRequest {
+  MetricsRequest(int fd) : sock(fd), sent(0) {}
+  jalib::JSocket sock;
+  string data;
+  string reply;
+  size_t sent;
+};
+#define MAX_METRICS_REQUEST 8192
+static set<void*> metricsRequests;
+
+static void closeMetricsRequest(MetricsRequest *req)
+{
+  req->sock.close();
+  metricsRequests.erase(req);
+  delete req;
+}
+
+static void onMetricsConnect()
+{
+  jalib::JSocket remote = metricsListenSock->accept();
+  if (!remote.isValid()) {
+    return;
+  }
+  MetricsRequest *req = new MetricsRequest(remote.sockfd());
+  struct epoll_event ev;
+  ev.events = EPOLLIN;
+  ev.data.ptr = req;
+  JASSERT(epoll_ctl(epollFd, EPOLL_CTL_ADD, remote.sockfd(), &ev) != -1)
+    (JASSERT_ERRNO);
+  metricsRequests.insert(req);
+}
+
+static void onMetricsWritable(MetricsRequest *req)
+{
+  while (req->sent < req->reply.length()) {
+    ssize_t rc = send(req->sock.sockfd(), req->reply.data() + req->sent,
+                      req->reply.length() - req->sent, MSG_NOSIGNAL);
+    if (rc == -1 && errno == EINTR) {
+      continue;
+    }
+    if (rc == -1 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+      return;
+    }
+    if (rc <= 0) {
+      break;
+    }
+    req->sent += rc;
+  }
+  closeMetricsRequest(req);
+}
+
+static void onMetricsData(MetricsRequest *req)
+{
+  char buf[1024];
+  ssize_t rc = read(req->sock.sockfd(), buf, sizeof(buf));
+  if (rc <= 0) {
+    closeMetricsRequest(req);
+    return;
+  }
+  req->data.append(buf, rc);
+
+  const string &data = req->data;
+  bool isHttp = data.compare(0, 4, "GET ") == 0 ||
+                data.compare(0, 5, "HEAD ") == 0;
+  size_t eol = data.find('\n');
+  bool complete = eol != string::npos &&
+    (!isHttp || data.find("\r\n\r\n") != string::npos ||
+     data.find("\n\n") != string::npos);
+  if (!complete) {
+    if (data.length() > MAX_METRICS_REQUEST) {
+      closeMetricsRequest(req);
+    }
+    return;
+  }
+
+  bool json = data.substr(0, eol).find("json") != string::npos;
+  string body = prog.printMetrics(json);
+  string reply;
+  if (isHttp) {
+    ostringstream hdr;
+    hdr << "HTTP/1.0 200 OK\r\n"
+        << "Content-Type: "
+        << (json ? "application/json" : "text/plain; version=0.0.4") << "\r\n"
+        << "Content-Length: " << body.length() << "\r\n"
+        << "Connection: close\r\n\r\n";
+    reply = hdr.str();
+    if (data.compare(0, 4, "GET ") == 0) {
+      reply += body;
+    }
+  } else {
+    reply = body;
+  }
+  req->reply = reply;
+
+  int fd = req->sock.sockfd();
+  struct epoll_event ev;
+  ev.events = EPOLLOUT;
+  ev.data.ptr = req;
+  if (fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK) == -1 ||
+      epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &ev) == -1) {
+    closeMetricsRequest(req);
+    return;
+  }
+  onMetricsWritable(req);
+}
+
+static void openMetricsSocket()
+{
+  if (theMetricsPort >= 0) {
+    metricsListenSock = new jalib::JServerSocket(jalib::JSockAddr("127.0.0.1"),
+                                                 theMetricsPort, 16);
+    JASSERT(metricsListenSock->isValid()) (theMetricsPort) (JASSERT_ERRNO)
+      .Text("Failed to create metrics socket.");
+    JTRACE("Serving metrics") (metricsListenSock->port());
+  } else if (!theMetricsSocket.empty()) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    JASSERT(theMetricsSocket.length() < sizeof(addr.sun_path))
+      (theMetricsSocket) .Text("Metrics socket path is too long.");
+    strcpy(addr.sun_path, theMetricsSocket.c_str());
+    // A socket file left behind by an earlier coordinator; anything else at
+    // that path is not ours to remove.
+    struct stat st;
+    if (lstat(theMetricsSocket.c_str(), &st) == 0) {
+      JASSERT(S_ISSOCK(st.st_mode)) (theMetricsSocket)
+        .Text("Metrics socket path exists and is not a socket.");
+      JASSERT(unlink(theMetricsSocket.c_str()) == 0)
+        (theMetricsSocket) (JASSERT_ERRNO);
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    JASSERT(fd != -1) (JASSERT_ERRNO);
+    metricsListenSock = new jalib::JSocket(fd);
+    // Only our own user may connect.
+    mode_t oldMask = umask(0077);
+    bool bound = metricsListenSock->bind((struct sockaddr*) &addr,
+                                         sizeof(addr));
+    umask(oldMask);
+    JASSERT(bound && metricsListenSock->listen(16))
+      (theMetricsSocket) (JASSERT_ERRNO)
+      .Text("Failed to create metrics socket.");
+    JTRACE("Serving metrics") (theMetricsSocket);
+  }
+}
+
 void DmtcpCoordinator::eventLoop(bool daemon)
 {
   struct epoll_event ev;
@@ -1413,6 +2594,13 @@ void DmtcpCoordinator::eventLoop(bool daemon)
   JASSERT(epoll_ctl(epollFd, EPOLL_CTL_ADD, listenSock->sockfd(), &ev) != -1)
     (JASSERT_ERRNO);
 
+  if (metricsListenSock != NULL) {
+    ev.events = EPOLLIN;
+    ev.data.ptr = metricsListenSock;
+    JASSERT(epoll_ctl(epollFd, EPOLL_CTL_ADD, metricsListenSock->sockfd(), &ev)
+            != -1) (JASSERT_ERRNO);
+  }
+
   if (!daemon &&
       // epoll_ctl below fails if STDIN is pointing to /dev/null.
       // Not sure why.
@@ -1433,9 +2621,11 @@ void DmtcpCoordinator::eventLoop(bool daemon)
     // has expired.
     int nfds;
     do {
-      nfds = epoll_wait(epollFd, events, MAX_EVENTS, -1);
+      nfds = epoll_wait(epollFd, events, MAX_EVENTS, barrierTimeoutMs());
     } while (nfds < 0 && errno == EINTR && !timerExpired);
 
+    checkBarrierDeadline();
+
 
     // The ckpt timer has expired; it's time to checkpoint.
     if (nfds == -1 && errno == EINTR && timerExpired) {
@@ -1455,8 +2645,10 @@ void DmtcpCoordinator::eventLoop(bool daemon)
           (events[n].events & EPOLLRDHUP) ||
 #endif
           (events[n].events & EPOLLERR)) {
-        JASSERT(ptr != listenSock);
-        if (ptr == (void*) STDIN_FILENO) {
+        JASSERT(ptr != listenSock && ptr != metricsListenSock);
+        if (metricsRequests.count(ptr) > 0) {
+          closeMetricsRequest((MetricsRequest*) ptr);
+        } else if (ptr == (void*) STDIN_FILENO) {
           JASSERT(epoll_ctl(epollFd, EPOLL_CTL_DEL, STDIN_FILENO, &ev) != -1)
             (JASSERT_ERRNO);
           close(STDIN_FD);
@@ -1466,6 +2658,10 @@ void DmtcpCoordinator::eventLoop(bool daemon)
       } else if (events[n].events & EPOLLIN) {
         if (ptr == (void*) listenSock) {
           onConnect();
+        } else if (ptr == (void*) metricsListenSock) {
+          onMetricsConnect();
+        } else if (metricsRequests.count(ptr) > 0) {
+          onMetricsData((MetricsRequest*) ptr);
         } else if (ptr == (void*) STDIN_FILENO) {
           char buf[1];
           int ret = Util::readAll(STDIN_FD, buf, sizeof(buf));
@@ -1481,6 +2677,10 @@ void DmtcpCoordinator::eventLoop(bool daemon)
         } else {
           onData((CoordClient*)ptr);
         }
+      } else if (events[n].events & EPOLLOUT) {
+        if (metricsRequests.count(ptr) > 0) {
+          onMetricsWritable((MetricsRequest*) ptr);
+        }
       }
     }
   }
@@ -1557,6 +2757,35 @@ void set_long_cmdline(char *argv0, const char *port) {
 
 #define shift argc--; argv++
 
+static size_t parseWriteSlots(const string& arg)
+{
+  char *end;
+  long n = strtol(arg.c_str(), &end, 10);
+  JASSERT(*end == '\0' && n >= 0) (arg) .Text("Invalid number of write slots");
+  return n;
+}
+
+// [BARRIER=]SECONDS
+static void parseBarrierTimeout(const string& arg)
+{
+  size_t eq = arg.find('=');
+  double seconds = strtod(arg.c_str() + (eq == string::npos ? 0 : eq + 1),
+                          NULL);
+  JASSERT(seconds > 0) (arg) .Text("Invalid barrier timeout");
+  haveBarrierTimeouts = true;
+  for (int i = WorkerState::RUNNING; i < WorkerState::_MAX; i++) {
+    if (eq == string::npos) {
+      barrierTimeout[i] = seconds;
+    } else if (strcasecmp(arg.substr(0, eq).c_str(),
+                          stateName((WorkerState::eWorkerState) i).c_str())
+               == 0) {
+      barrierTimeout[i] = seconds;
+      return;
+    }
+  }
+  JASSERT(eq == string::npos) (arg) .Text("Unknown barrier name");
+}
+
 int main ( int argc, char** argv )
 {
   Util::setProtectedFdBase();
@@ -1632,6 +2861,42 @@ int main ( int argc, char** argv )
                isdigit(argv[0][2])) { // else if -i5, for example
       setenv(ENV_VAR_CKPT_INTR, argv[0]+2, 1);
       shift;
+    } else if (argc > 1 && s == "--mtbf") {
+      setenv(ENV_VAR_MTBF, argv[1], 1);
+      shift; shift;
+    } else if (argc > 1 && s == "--barrier-timeout") {
+      parseBarrierTimeout(argv[1]);
+      shift; shift;
+    } else if (s == "--abort-on-timeout") {
+      abortOnTimeout = true;
+      shift;
+    } else if (argc > 1 && s == "--write-slots") {
+      writeSlots = parseWriteSlots(argv[1]);
+      shift; shift;
+    } else if (argc > 1 && s == "--write-slots-per-host") {
+      writeSlotsPerHost = parseWriteSlots(argv[1]);
+      shift; shift;
+    } else if (argc > 1 && s == "--xor-group-size") {
+      xorGroupSize = parseWriteSlots(argv[1]);
+      JASSERT(xorGroupSize <= CKPT_PARITY_MAX_GROUP_SIZE) (xorGroupSize)
+        .Text("XOR group too large");
+      shift; shift;
+    } else if (argc > 1 && s == "--xor-receiver-port") {
+      xorReceiverPort = jalib::StringToInt(argv[1]);
+      shift; shift;
+    } else if (argc > 1 && s == "--write-bandwidth") {
+      char *end;
+      double mbps = strtod(argv[1], &end);
+      JASSERT(end != argv[1] && *end == '\0' && mbps >= 0) (argv[1])
+        .Text("Invalid write bandwidth");
+      writeBandwidth = (uint64_t) (mbps * 1024 * 1024);
+      shift; shift;
+    } else if (argc > 1 && s == "--metrics-port") {
+      theMetricsPort = jalib::StringToInt( argv[1] );
+      shift; shift;
+    } else if (argc > 1 && s == "--metrics-socket") {
+      theMetricsSocket = argv[1];
+      shift; shift;
     } else if (argc>1 && (s == "-p" || s == "--port" || s == "--coord-port")) {
       thePort = jalib::StringToInt( argv[1] );
       shift; shift;
@@ -1707,6 +2972,7 @@ int main ( int argc, char** argv )
     Util::writeCoordPortToFile(thePort, thePortFile.c_str());
   }
   JTRACE("Listening on port")(thePort);
+  openMetricsSocket();
 
   //parse checkpoint interval
   const char* interval = getenv ( ENV_VAR_CKPT_INTR );
@@ -1715,6 +2981,20 @@ int main ( int argc, char** argv )
     theCheckpointInterval = theDefaultCheckpointInterval;
   }
 
+  const char* mtbf = getenv ( ENV_VAR_MTBF );
+  if ( mtbf != NULL ) {
+    theMtbf = strtod ( mtbf, NULL );
+    JASSERT ( theMtbf >= 0 ) ( mtbf ) .Text ( "Invalid MTBF" );
+    if ( theMtbf > 0 && theCheckpointInterval == 0 ) {
+      theDefaultCheckpointInterval = optimalCheckpointInterval();
+      theCheckpointInterval = theDefaultCheckpointInterval;
+    } else if ( theMtbf > 0 ) {
+      JNOTE ( "MTBF given; the adaptive checkpoint interval replaces the"
+              " '-i' interval after the first checkpoint" )
+        ( theCheckpointInterval ) ( theMtbf );
+    }
+  }
+
 #if 0
   if (!quiet) {
     JASSERT_STDERR <<
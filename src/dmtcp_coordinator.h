@@ -43,7 +43,9 @@ namespace dmtcp
       int clientNumber() const { return _clientNumber; }
       string ip() const { return _ip; }
       WorkerState::eWorkerState state() const { return _state; }
-      void setState ( WorkerState::eWorkerState value ) { _state = value; }
+      void setState(WorkerState::eWorkerState value);
+      // When the client last changed state (getCurrTimestamp() nanoseconds).
+      uint64_t stateTime() const { return _stateTime; }
       void progname(string pname){ _progname = pname; }
       string progname(void) const { return _progname; }
       void hostname(string hname){ _hostname = hname; }
@@ -53,6 +55,15 @@ namespace dmtcp
       pid_t virtualPid(void) const { return _virtualPid; }
       void virtualPid(pid_t pid) { _virtualPid = pid; }
       int isNSWorker() {return _isNSWorker;}
+      bool isSpare() const { return _isSpare; }
+      void isSpare(bool spare) { _isSpare = spare; }
+      void countMessage(size_t extraBytes) {
+        _numMessages++;
+        _numBytes += sizeof(DmtcpMessage) + extraBytes;
+      }
+      uint64_t numMessages() const { return _numMessages; }
+      uint64_t numBytes() const { return _numBytes; }
+      uint64_t connectTime() const { return _connectTime; }
 
       void readProcessInfo(DmtcpMessage& msg);
 
@@ -61,12 +72,17 @@ namespace dmtcp
       int _clientNumber;
       jalib::JSocket _sock;
       WorkerState::eWorkerState _state;
+      uint64_t _stateTime;
       string _hostname;
       string _progname;
       string _ip;
       pid_t _realPid;
       pid_t _virtualPid;
       int _isNSWorker;
+      bool _isSpare;
+      uint64_t _numMessages;
+      uint64_t _numBytes;
+      uint64_t _connectTime;
   };
 
   class DmtcpCoordinator
@@ -90,10 +106,19 @@ namespace dmtcp
       void initializeComputation();
       void broadcastMessage(DmtcpMessageType type, int numPeers = -1);
       bool startCheckpoint();
+      int barrierTimeoutMs();
+      void checkBarrierDeadline();
+      void abortCheckpoint();
+      void startCkptWrites();
+      void dispatchCkptWrites();
+      void finishCkptWrite(CoordClient *client);
+      void sendDoCheckpoint(CoordClient *client);
 
       void handleUserCommand(char cmd, DmtcpMessage* reply = NULL);
       void printStatus(size_t numPeers, bool isRunning);
       string printList();
+      string printCkptCost();
+      string printMetrics(bool json);
 
       void processDmtUserCmd(DmtcpMessage& hello_remote,
                              jalib::JSocket& remote);
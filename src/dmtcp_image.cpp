@@ -0,0 +1,686 @@
+/****************************************************************************
+ *   Copyright (C) 2006-2010 by Jason Ansel, Kapil Arya, and Gene Cooperman *
+ *   jansel@csail.mit.edu, kapil@ccs.neu.edu, gene@ccs.neu.edu              *
+ *                                                                          *
+ *  This file is part of DMTCP.                                             *
+ *                                                                          *
+ *  DMTCP is free software: you can redistribute it and/or                  *
+ *  modify it under the terms of the GNU Lesser General Public License as   *
+ *  published by the Free Software Foundation, either version 3 of the      *
+ *  License, or (at your option) any later version.                         *
+ *                                                                          *
+ *  DMTCP is distributed in the hope that it will be useful,                *
+ *  but WITHOUT ANY WARRANTY; without even the implied warranty of          *
+ *  MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the           *
+ *  GNU Lesser General Public License for more details.                     *
+ *                                                                          *
+ *  You should have received a copy of the GNU Lesser General Public        *
+ *  License along with DMTCP:dmtcp/src.  If not, see                        *
+ *  <http://www.gnu.org/licenses/>.                                         *
+ ****************************************************************************/
+
+/* dmtcp_image: inspect checkpoint images offline.
+ *
+ * The image is parsed the same way as mtcp_restart parses it (see
+ * read_one_memory_area() and mtcp_simulateread() in mtcp/mtcp_restart.c):
+ * the MTCP header starts at a multiple of sizeof(MtcpHeader) after the DMTCP
+ * header, and is followed by Area records, each one followed by its data
+ * unless the area is a zero area, a reference to file pages, or a skipped
+ * text segment.  An Area with size -1 ends the list.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <algorithm>
+
+#include "constants.h"
+#include "procmapsarea.h"
+#include "util.h"
+#include "mtcp/mtcp_header.h"
+#include "../jalib/jassert.h"
+#include "../jalib/jfilesystem.h"
+
+#define BINARY_NAME "dmtcp_image"
+
+using namespace dmtcp;
+
+// Copied from mtcp/mtcp_restart.c.
+#define GZIP_FIRST 037
+// DMTCP_CHUNKS_HEADER
+#define CHUNKS_FIRST 'C'
+
+static const char* theUsage =
+  "Usage: dmtcp_image COMMAND <ckpt.dmtcp> [ckpt2.dmtcp]\n\n"
+  "Inspect a checkpoint image.\n\n"
+  "Commands:\n"
+  "  stats IMAGE\n"
+  "              Print, for each memory area, its size, the fraction of zero\n"
+  "              pages, of unmodified file pages saved as references, and of\n"
+  "              pages duplicated elsewhere in the image, and an entropy-based\n"
+  "              estimate of the compressed size.\n"
+  "  diff OLD_IMAGE NEW_IMAGE\n"
+  "              Compare two generations page by page.\n"
+  "  verify IMAGE\n"
+  "              Check that the image is complete and consistent, and that\n"
+  "              files referenced by the image are unchanged.\n"
+  "  bench IMAGE\n"
+  "              Measure read, decompress and parse throughput.\n"
+  "\n"
+  "Gzip-compressed images are read through 'gzip -d', and manifests of\n"
+  "images in a chunk store through 'dmtcp_ckpt_chunker -x'.\n"
+  "\n"
+  "  --help\n"
+  "              Print this message and exit.\n"
+  "  --version\n"
+  "              Print version information and exit.\n"
+  "\n"
+  HELP_AND_CONTACT_INFO
+  "\n"
+;
+
+#define PAGE MTCP_PAGE_SIZE
+#define KB(x) ((unsigned long long) ((x) / 1024))
+
+static double now()
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint64_t pageHash(const char *page)
+{
+  const uint64_t *p = (const uint64_t*) page;
+  uint64_t hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < PAGE / sizeof(uint64_t); i++) {
+    hash = (hash ^ p[i]) * 1099511628211ULL;
+    hash ^= hash >> 29;
+  }
+  return hash;
+}
+
+static bool pageIsZero(const char *page)
+{
+  const uint64_t *p = (const uint64_t*) page;
+  for (size_t i = 0; i < PAGE / sizeof(uint64_t); i++) {
+    if (p[i] != 0) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Order-0 entropy of the page, in bytes: a rough bound for gzip's output.
+static double pageEntropyBytes(const char *page)
+{
+  unsigned count[256] = {0};
+  for (size_t i = 0; i < PAGE; i++) {
+    count[(unsigned char) page[i]]++;
+  }
+  double bits = 0;
+  for (int i = 0; i < 256; i++) {
+    if (count[i] != 0) {
+      double p = (double) count[i] / PAGE;
+      bits -= count[i] * log2(p);
+    }
+  }
+  return bits / 8;
+}
+
+static bool areaHasData(const Area &area)
+{
+  return (area.properties & (DMTCP_ZERO_PAGE | DMTCP_FILE_BACKED_REF |
+                             DMTCP_SKIP_WRITING_TEXT_SEGMENTS)) == 0;
+}
+
+static const char *areaKind(const Area &area)
+{
+  if (area.properties & DMTCP_FILE_BACKED_REF) return "fileref";
+  if (area.properties & DMTCP_SKIP_WRITING_TEXT_SEGMENTS) return "text";
+  if (area.properties & DMTCP_SYSV_SHM_AREA) return "sysvshm";
+  if (area.properties & DMTCP_SHARED_AREA_REF) return "shmref";
+  if (area.properties & DMTCP_ZERO_PAGE) return "zero";
+  return "data";
+}
+
+class ImageReader
+{
+  public:
+    ImageReader(const char *path)
+      : _path(path), _fd(-1), _decompPid(-1), _bytes(0),
+        _truncated(false), _done(false)
+    {
+      _fd = open(path, O_RDONLY);
+      JASSERT(_fd != -1) (path) (JASSERT_ERRNO) .Text("Failed to open image");
+      unsigned char c = 0;
+      JASSERT(read(_fd, &c, 1) == 1) (path) .Text("Empty image");
+      JASSERT(lseek(_fd, 0, SEEK_SET) == 0) (path);
+      _compressed = (c == GZIP_FIRST || c == CHUNKS_FIRST);
+      if (c == GZIP_FIRST) {
+        startDecompressor("gzip", "-d");
+      } else if (c == CHUNKS_FIRST) {
+        startDecompressor("dmtcp_ckpt_chunker", "-x");
+      }
+    }
+
+    ~ImageReader()
+    {
+      close(_fd);
+      if (_decompPid != -1) {
+        kill(_decompPid, SIGTERM);
+        waitpid(_decompPid, NULL, 0);
+      }
+    }
+
+    bool compressed() const { return _compressed; }
+    bool truncated() const { return _truncated; }
+    bool done() const { return _done; }
+    uint64_t bytesRead() const { return _bytes; }
+    const MtcpHeader& mtcpHeader() const { return _mtcpHdr; }
+
+    // Skips the DMTCP header; returns false if there is no MTCP header.
+    bool readMtcpHeader()
+    {
+      while (readFully(&_mtcpHdr, sizeof(_mtcpHdr))) {
+        if (strcmp(_mtcpHdr.signature, MTCP_SIGNATURE) == 0) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // Returns false at the end of the area list, or if the image is cut off.
+    bool nextArea(Area *area)
+    {
+      if (!readFully(area, sizeof(*area))) {
+        _truncated = true;
+        return false;
+      }
+      if (area->size == (size_t) -1) {
+        _done = true;
+        return false;
+      }
+      return true;
+    }
+
+    bool readData(void *buf, size_t len) { return readFully(buf, len); }
+
+  private:
+    bool readFully(void *buf, size_t len)
+    {
+      ssize_t rc = Util::readAll(_fd, buf, len);
+      if (rc > 0) {
+        _bytes += rc;
+      }
+      return rc == (ssize_t) len;
+    }
+
+    void startDecompressor(const char *cmd, const char *arg)
+    {
+      int fds[2];
+      JASSERT(pipe(fds) == 0) (JASSERT_ERRNO);
+      _decompPid = fork();
+      JASSERT(_decompPid != -1) (JASSERT_ERRNO);
+      if (_decompPid == 0) {
+        dup2(_fd, STDIN_FILENO);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[0]);
+        close(fds[1]);
+        close(_fd);
+        execlp(cmd, cmd, arg, (char*) NULL);
+        JASSERT(false) (cmd) (JASSERT_ERRNO)
+          .Text("Failed to launch decompressor.");
+      }
+      close(fds[1]);
+      close(_fd);
+      _fd = fds[0];
+    }
+
+    const char *_path;
+    int _fd;
+    pid_t _decompPid;
+    uint64_t _bytes;
+    bool _compressed;
+    bool _truncated;
+    bool _done;
+    MtcpHeader _mtcpHdr;
+};
+
+static void *allocBuffer(size_t len)
+{
+  void *buf = mmap(NULL, len, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  JASSERT(buf != MAP_FAILED) (len) (JASSERT_ERRNO);
+  return buf;
+}
+
+/* Calls fn(area, page, addr) for every page of every area: page is NULL for
+ * pages that are not stored in the image.  Data is read one chunk at a time.
+ */
+#define CHUNK_PAGES 256
+
+template <typename Fn>
+static bool forEachPage(ImageReader &img, Fn &fn)
+{
+  char *buf = (char*) allocBuffer(CHUNK_PAGES * PAGE);
+  Area area;
+  while (img.nextArea(&area)) {
+    fn.beginArea(area);
+    for (size_t done = 0; done < area.size; ) {
+      size_t len = std::min(area.size - done, (size_t) CHUNK_PAGES * PAGE);
+      bool hasData = areaHasData(area);
+      if (hasData && !img.readData(buf, len)) {
+        munmap(buf, CHUNK_PAGES * PAGE);
+        return false;
+      }
+      for (size_t off = 0; off < len; off += PAGE) {
+        fn.page(area, hasData ? buf + off : NULL, area.addr + done + off);
+      }
+      done += len;
+    }
+  }
+  munmap(buf, CHUNK_PAGES * PAGE);
+  return img.done();
+}
+
+/*****************************************************************************
+ * stats
+ *****************************************************************************/
+
+struct AreaStats {
+  Area area;  // first record of the area
+  VA end;
+  const char *kind;
+  uint64_t size, stored, zero, fileRef, dup;
+  double entropy;
+};
+
+class StatsCollector
+{
+  public:
+    vector<AreaStats> areas;
+    set<uint64_t> seen;
+
+    void beginArea(const Area &area)
+    {
+      // Consecutive records of one mapping are reported together.
+      if (!areas.empty() && areas.back().end == area.addr &&
+          strcmp(areas.back().area.name, area.name) == 0 &&
+          areas.back().area.prot == area.prot) {
+        if (strcmp(areas.back().kind, areaKind(area)) != 0) {
+          areas.back().kind = "mixed";
+        }
+      } else {
+        AreaStats st;
+        memset(&st, 0, sizeof(st));
+        st.area = area;
+        st.end = area.addr;
+        st.kind = areaKind(area);
+        areas.push_back(st);
+      }
+    }
+
+    void page(const Area &area, const char *page, VA addr)
+    {
+      AreaStats &st = areas.back();
+      st.size += PAGE;
+      st.end = addr + PAGE;
+      if (area.properties & (DMTCP_FILE_BACKED_REF |
+                             DMTCP_SKIP_WRITING_TEXT_SEGMENTS)) {
+        st.fileRef += PAGE;
+      } else if (page == NULL || pageIsZero(page)) {
+        st.zero += PAGE;
+      }
+      if (page != NULL) {
+        st.stored += PAGE;
+        if (!pageIsZero(page)) {
+          if (!seen.insert(pageHash(page)).second) {
+            st.dup += PAGE;
+          }
+          st.entropy += pageEntropyBytes(page);
+        }
+      }
+    }
+};
+
+static double pct(uint64_t part, uint64_t whole)
+{
+  return whole == 0 ? 0 : 100.0 * part / whole;
+}
+
+static int doStats(const char *path)
+{
+  ImageReader img(path);
+  JASSERT(img.readMtcpHeader()) (path) .Text("No MTCP header in image");
+
+  StatsCollector stats;
+  bool complete = forEachPage(img, stats);
+
+  printf("%-33s %-4s %-7s %10s %10s %6s %6s %6s %10s  %s\n",
+         "address", "prot", "kind", "size(KB)", "stored(KB)", "zero%",
+         "fref%", "dup%", "estgz(KB)", "name");
+  AreaStats total;
+  memset(&total, 0, sizeof(total));
+  for (size_t i = 0; i < stats.areas.size(); i++) {
+    const AreaStats &st = stats.areas[i];
+    printf("%16p-%16p %c%c%c%c %-7s %10llu %10llu %6.1f %6.1f %6.1f %10llu  %s\n",
+           st.area.addr, st.end,
+           (st.area.prot & PROT_READ) ? 'r' : '-',
+           (st.area.prot & PROT_WRITE) ? 'w' : '-',
+           (st.area.prot & PROT_EXEC) ? 'x' : '-',
+           (st.area.flags & MAP_SHARED) ? 's' : 'p',
+           st.kind, KB(st.size), KB(st.stored),
+           pct(st.zero, st.size), pct(st.fileRef, st.size),
+           pct(st.dup, st.size), KB((uint64_t) st.entropy), st.area.name);
+    total.size += st.size;
+    total.stored += st.stored;
+    total.zero += st.zero;
+    total.fileRef += st.fileRef;
+    total.dup += st.dup;
+    total.entropy += st.entropy;
+  }
+
+  printf("\nareas: %zu  memory: %llu KB  stored: %llu KB  image: %llu KB%s\n",
+         stats.areas.size(), KB(total.size), KB(total.stored),
+         KB(img.bytesRead()), img.compressed() ? " (uncompressed)" : "");
+  printf("zero: %.1f%%  file refs: %.1f%%  duplicate pages: %.1f%%"
+         "  entropy-estimated gzip size: %llu KB\n",
+         pct(total.zero, total.size), pct(total.fileRef, total.size),
+         pct(total.dup, total.size), KB((uint64_t) total.entropy));
+  if (!complete) {
+    printf("WARNING: image is truncated\n");
+    return 1;
+  }
+  return 0;
+}
+
+/*****************************************************************************
+ * diff
+ *****************************************************************************/
+
+// Hash values for pages that are not stored.
+#define ZERO_PAGE_HASH ((uint64_t) 0)
+#define FILE_REF_HASH  ((uint64_t) 1)
+
+typedef std::pair<VA, uint64_t> PageEntry;
+
+static uint64_t pageKey(const Area &area, const char *page)
+{
+  if (page == NULL) {
+    return (area.properties & DMTCP_ZERO_PAGE) ? ZERO_PAGE_HASH
+                                               : FILE_REF_HASH;
+  }
+  return pageIsZero(page) ? ZERO_PAGE_HASH : pageHash(page);
+}
+
+class PageIndexer
+{
+  public:
+    vector<PageEntry> pages;
+    void beginArea(const Area &area) {}
+    void page(const Area &area, const char *page, VA addr)
+    {
+      pages.push_back(PageEntry(addr, pageKey(area, page)));
+    }
+};
+
+struct DiffCounts {
+  uint64_t same, changed, added, removed;
+};
+
+class PageComparer
+{
+  public:
+    PageComparer(vector<PageEntry> &oldPages) : _old(oldPages) {}
+
+    map<string, DiffCounts> byName;
+    vector<bool> matched;
+
+    void beginArea(const Area &area)
+    {
+      _counts = &byName[area.name];
+    }
+
+    void page(const Area &area, const char *page, VA addr)
+    {
+      vector<PageEntry>::iterator it =
+        std::lower_bound(_old.begin(), _old.end(), PageEntry(addr, 0));
+      if (it == _old.end() || it->first != addr) {
+        _counts->added++;
+        return;
+      }
+      matched[it - _old.begin()] = true;
+      if (it->second == pageKey(area, page)) {
+        _counts->same++;
+      } else {
+        _counts->changed++;
+      }
+    }
+
+  private:
+    vector<PageEntry> &_old;
+    DiffCounts *_counts;
+};
+
+static int doDiff(const char *oldPath, const char *newPath)
+{
+  PageIndexer index;
+  {
+    ImageReader img(oldPath);
+    JASSERT(img.readMtcpHeader()) (oldPath) .Text("No MTCP header in image");
+    JASSERT(forEachPage(img, index)) (oldPath) .Text("Image is truncated");
+  }
+  std::sort(index.pages.begin(), index.pages.end());
+
+  PageComparer cmp(index.pages);
+  cmp.matched.resize(index.pages.size(), false);
+  {
+    ImageReader img(newPath);
+    JASSERT(img.readMtcpHeader()) (newPath) .Text("No MTCP header in image");
+    JASSERT(forEachPage(img, cmp)) (newPath) .Text("Image is truncated");
+  }
+
+  // Pages of the old image not seen in the new one were unmapped.  Their
+  // area names are no longer known; count them separately.
+  uint64_t removed = 0;
+  for (size_t i = 0; i < cmp.matched.size(); i++) {
+    if (!cmp.matched[i]) {
+      removed++;
+    }
+  }
+
+  printf("%10s %10s %10s  %s\n", "same(KB)", "changed(KB)", "new(KB)",
+         "name");
+  DiffCounts total;
+  memset(&total, 0, sizeof(total));
+  map<string, DiffCounts>::iterator it;
+  for (it = cmp.byName.begin(); it != cmp.byName.end(); it++) {
+    const DiffCounts &c = it->second;
+    printf("%10llu %10llu %10llu  %s\n", KB(c.same * PAGE),
+           KB(c.changed * PAGE), KB(c.added * PAGE),
+           it->first.empty() ? "[anonymous]" : it->first.c_str());
+    total.same += c.same;
+    total.changed += c.changed;
+    total.added += c.added;
+  }
+  uint64_t all = total.same + total.changed + total.added;
+  printf("\nsame: %llu KB  changed: %llu KB (%.1f%%)  new: %llu KB"
+         "  unmapped since %s: %llu KB\n",
+         KB(total.same * PAGE), KB(total.changed * PAGE),
+         pct(total.changed, all), KB(total.added * PAGE),
+         jalib::Filesystem::BaseName(oldPath).c_str(), KB(removed * PAGE));
+  return 0;
+}
+
+/*****************************************************************************
+ * verify
+ *****************************************************************************/
+
+static int doVerify(const char *path)
+{
+  ImageReader img(path);
+  int errors = 0;
+  if (!img.readMtcpHeader()) {
+    printf("%s: no MTCP header\n", path);
+    return 1;
+  }
+
+  char *buf = (char*) allocBuffer(CHUNK_PAGES * PAGE);
+  vector<std::pair<VA, VA> > ranges;
+  const uint64_t knownProperties =
+    DMTCP_ZERO_PAGE | DMTCP_SKIP_WRITING_TEXT_SEGMENTS | DMTCP_SYSV_SHM_AREA |
+    DMTCP_SHARED_AREA_REF | DMTCP_FILE_BACKED_REF;
+  Area area;
+  int numAreas = 0;
+  while (img.nextArea(&area)) {
+    numAreas++;
+    if (memchr(area.name, '\0', sizeof(area.name)) == NULL) {
+      area.name[sizeof(area.name) - 1] = '\0';
+      printf("area %d: name is not terminated\n", numAreas);
+      errors++;
+    }
+    if (((uint64_t) area.addr % PAGE) != 0 || (area.size % PAGE) != 0 ||
+        area.size == 0 || area.addr + area.size < area.addr) {
+      printf("area %d (%s): bad address range %p+%zx\n",
+             numAreas, area.name, area.addr, area.size);
+      errors++;
+      break;
+    }
+    if ((area.properties & ~knownProperties) != 0) {
+      printf("area %d (%s): unknown properties 0x%llx\n",
+             numAreas, area.name, (unsigned long long) area.properties);
+      errors++;
+    }
+
+    if ((area.properties & DMTCP_FILE_BACKED_REF) != 0) {
+      struct stat st;
+      if (stat(area.name, &st) == -1) {
+        printf("area %d: referenced file %s is missing\n", numAreas, area.name);
+        errors++;
+      } else if ((uint64_t) st.st_size != area.filesize ||
+                 (uint64_t) st.st_mtim.tv_sec != area.mtime_sec ||
+                 (uint64_t) st.st_mtim.tv_nsec != area.mtime_nsec) {
+        printf("area %d: referenced file %s has changed\n",
+               numAreas, area.name);
+        errors++;
+      }
+    }
+
+    // SysV shm data records lie inside the segment record before them.
+    if (area.properties != DMTCP_SYSV_SHM_AREA) {
+      ranges.push_back(std::make_pair(area.addr, area.addr + area.size));
+    }
+
+    if (areaHasData(area)) {
+      for (size_t done = 0; done < area.size; ) {
+        size_t len = std::min(area.size - done, (size_t) CHUNK_PAGES * PAGE);
+        if (!img.readData(buf, len)) {
+          break;
+        }
+        done += len;
+      }
+    }
+  }
+  munmap(buf, CHUNK_PAGES * PAGE);
+
+  if (!img.done()) {
+    printf("image is truncated after %d areas (%llu bytes)\n",
+           numAreas, (unsigned long long) img.bytesRead());
+    errors++;
+  }
+
+  std::sort(ranges.begin(), ranges.end());
+  for (size_t i = 1; i < ranges.size(); i++) {
+    if (ranges[i].first < ranges[i - 1].second) {
+      printf("areas overlap: %p-%p and %p-%p\n",
+             ranges[i - 1].first, ranges[i - 1].second,
+             ranges[i].first, ranges[i].second);
+      errors++;
+    }
+  }
+
+  printf("%s: %d areas, %s\n", path, numAreas,
+         errors == 0 ? "OK" : "FAILED");
+  return errors == 0 ? 0 : 1;
+}
+
+/*****************************************************************************
+ * bench
+ *****************************************************************************/
+
+class NullConsumer
+{
+  public:
+    uint64_t memory;
+    NullConsumer() : memory(0) {}
+    void beginArea(const Area &area) {}
+    void page(const Area &area, const char *page, VA addr) { memory += PAGE; }
+};
+
+static int doBench(const char *path)
+{
+  struct stat st;
+  JASSERT(stat(path, &st) == 0) (path) (JASSERT_ERRNO);
+  const double mb = 1024.0 * 1024.0;
+
+  // Read the file as stored, after asking the kernel to drop it from the
+  // page cache (this only works for clean pages).
+  int fd = open(path, O_RDONLY);
+  JASSERT(fd != -1) (path) (JASSERT_ERRNO);
+  posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+  char *buf = (char*) allocBuffer(CHUNK_PAGES * PAGE);
+  double start = now();
+  ssize_t rc;
+  while ((rc = read(fd, buf, CHUNK_PAGES * PAGE)) > 0) {
+  }
+  double readTime = now() - start;
+  close(fd);
+  munmap(buf, CHUNK_PAGES * PAGE);
+  printf("read:   %10.1f MB in %7.3f s  %8.1f MB/s\n",
+         st.st_size / mb, readTime, st.st_size / mb / readTime);
+
+  // Now from the page cache, through the decompressor and the parser.
+  ImageReader img(path);
+  start = now();
+  JASSERT(img.readMtcpHeader()) (path) .Text("No MTCP header in image");
+  NullConsumer consumer;
+  bool complete = forEachPage(img, consumer);
+  double parseTime = now() - start;
+  printf("%s %10.1f MB in %7.3f s  %8.1f MB/s (%.1f MB/s of memory)\n",
+         img.compressed() ? "decomp:" : "parse: ",
+         img.bytesRead() / mb, parseTime, img.bytesRead() / mb / parseTime,
+         consumer.memory / mb / parseTime);
+  return complete ? 0 : 1;
+}
+
+int main(int argc, char **argv)
+{
+  initializeJalib();
+
+  if (argc > 1 && strcmp(argv[1], "--help") == 0) {
+    printf("%s", theUsage);
+    return 0;
+  }
+  if (argc > 1 && strcmp(argv[1], "--version") == 0) {
+    printf("%s", DMTCP_VERSION_AND_COPYRIGHT_INFO);
+    return 0;
+  }
+  if (argc == 3 && strcmp(argv[1], "stats") == 0) {
+    return doStats(argv[2]);
+  } else if (argc == 4 && strcmp(argv[1], "diff") == 0) {
+    return doDiff(argv[2], argv[3]);
+  } else if (argc == 3 && strcmp(argv[1], "verify") == 0) {
+    return doVerify(argv[2]);
+  } else if (argc == 3 && strcmp(argv[1], "bench") == 0) {
+    return doBench(argv[2]);
+  }
+  printf("%s", theUsage);
+  return DMTCP_FAIL_RC;
+}
@@ -90,6 +90,21 @@ static const char* theUsage =
   "  --ckptdir PATH (environment variable DMTCP_CHECKPOINT_DIR)\n"
   "              Directory to store checkpoint images\n"
   "              (default: curr dir at launch)\n"
+  "  --local-ckptdir PATH (environment variable DMTCP_LOCAL_CKPT_DIR)\n"
+  "              Write checkpoint images to this node-local directory first\n"
+  "              (e.g., tmpfs or NVMe), and copy them to the checkpoint dir\n"
+  "              in the background after the computation resumes.\n"
+  "              (default: write directly to the checkpoint dir)\n"
+  "  --ckpt-receiver HOST:PORT|unix:PATH\n"
+  "              (environment variable DMTCP_CKPT_RECEIVER)\n"
+  "              Stream checkpoint images to a dmtcp_ckpt_receiver (e.g., on\n"
+  "              a neighbor node) instead of writing them to the ckpt dir.\n"
+  "              Over TCP, the receiver's secret must be in environment\n"
+  "              variable DMTCP_CKPT_RECEIVER_SECRET.\n"
+  "  --ckpt-chunk-store DIR (environment variable DMTCP_CKPT_CHUNK_STORE)\n"
+  "              Keep checkpoint images as chunks in this directory, each\n"
+  "              chunk stored once for all generations; the ckpt dir gets\n"
+  "              manifests of them (see dmtcp_ckpt_chunker).  Replaces gzip.\n"
   "  --ckpt-open-files\n"
   "  --checkpoint-open-files\n"
   "              Checkpoint open files and restore old working dir.\n"
@@ -98,6 +113,11 @@ static const char* theUsage =
   "              If used with --checkpoint-open-files, allows a saved file\n"
   "              to overwrite its existing copy at original location\n"
   "              (default: file overwrites are not allowed)\n"
+  "  --skip-unmodified-file-pages\n"
+  "              (environment variable DMTCP_SKIP_UNMODIFIED_FILE_PAGES)\n"
+  "              Don't save pages of private file mappings (libraries, mmap'ed\n"
+  "              data files) that were never modified; restart maps them from\n"
+  "              the original files, which must not change. (default: save)\n"
   "  --ckpt-signal signum\n"
   "              Signal number used internally by DMTCP for checkpointing\n"
   "              (default: SIGUSR2/12).\n"
@@ -297,6 +317,15 @@ static void processArgs(int *orig_argc, char ***orig_argv,
     } else if (argc>1 && (s == "-c" || s == "--ckptdir")) {
       setenv(ENV_VAR_CHECKPOINT_DIR, argv[1], 1);
       shift; shift;
+    } else if (argc>1 && s == "--local-ckptdir") {
+      setenv(ENV_VAR_LOCAL_CKPT_DIR, argv[1], 1);
+      shift; shift;
+    } else if (argc>1 && s == "--ckpt-chunk-store") {
+      setenv(ENV_VAR_CKPT_CHUNK_STORE, argv[1], 1);
+      shift; shift;
+    } else if (argc>1 && s == "--ckpt-receiver") {
+      setenv(ENV_VAR_CKPT_RECEIVER, argv[1], 1);
+      shift; shift;
     } else if (argc>1 && (s == "-t" || s == "--tmpdir")) {
       tmpdir_arg = argv[1];
       shift; shift;
@@ -309,6 +338,9 @@ static void processArgs(int *orig_argc, char ***orig_argv,
     } else if (s == "--allow-file-overwrite") {
       setenv(ENV_VAR_ALLOW_OVERWRITE_WITH_CKPTED_FILES, "1", 0);
       shift;
+    } else if (s == "--skip-unmodified-file-pages") {
+      setenv(ENV_VAR_SKIP_UNMODIFIED_FILE_PAGES, "1", 0);
+      shift;
     } else if (s == "--ptrace") {
       enablePtracePlugin = true;
       shift;
@@ -25,7 +25,9 @@
 #include <sys/fcntl.h>
 #include <sys/wait.h>
 #include <sys/mman.h>
+#include <sys/socket.h>
 #include <limits.h>
+#include <time.h>
 #include <elf.h>
 #include "config.h"
 #ifdef HAS_PR_SET_PTRACER
@@ -34,6 +36,7 @@
 
 #include "constants.h"
 #include "coordinatorapi.h"
+#include "ckptreceiver.h"
 #include "util.h"
 #include "uniquepid.h"
 #include "dmtcp_dlsym.h"
@@ -53,6 +56,8 @@ using namespace dmtcp;
 #ifdef HBICT_DELTACOMP
 #define HBICT_FIRST 'H'
 #endif
+// DMTCP_CHUNKS_HEADER: a manifest, expanded by dmtcp_ckpt_chunker.
+#define CHUNKS_FIRST 'C'
 
 static void setEnvironFd();
 
@@ -99,6 +104,33 @@ static const char* theUsage =
   "              (default: use the same directory used in previous checkpoint)\n"
   "  --tmpdir PATH (environment variable DMTCP_TMPDIR)\n"
   "              Directory to store temporary files (default: $TMDPIR or /tmp)\n"
+  "  --local-ckptdir PATH (environment variable DMTCP_LOCAL_CKPT_DIR)\n"
+  "              Node-local directory that checkpoint images were first\n"
+  "              written to.  A copy of an image found there is used instead\n"
+  "              of the given one, unless the given one is newer.\n"
+  "  --ckpt-receiver HOST:PORT|unix:PATH\n"
+  "              (environment variable DMTCP_CKPT_RECEIVER)\n"
+  "              Fetch checkpoint images that are not found locally from\n"
+  "              this dmtcp_ckpt_receiver (over TCP, with the secret in\n"
+  "              environment variable DMTCP_CKPT_RECEIVER_SECRET).\n"
+  "  --ckpt-chunk-store DIR\n"
+  "              Look for the chunks of images kept in a chunk store\n"
+  "              (dmtcp_launch --ckpt-chunk-store) in DIR instead of in the\n"
+  "              store they were written to.\n"
+  "  --xor-receivers HOST:PORT[,HOST:PORT...]\n"
+  "              (environment variable DMTCP_XOR_RECEIVERS)\n"
+  "              Rebuild a missing checkpoint image from the XOR parity of\n"
+  "              its group (dmtcp_coordinator --xor-group-size), kept by one\n"
+  "              of these dmtcp_ckpt_receivers, and the other images of the\n"
+  "              group, found in --local-ckptdir or next to the given image.\n"
+  "  --prefetch-bandwidth MB_PER_SEC\n"
+  "              (environment variable DMTCP_RESTART_PREFETCH_BW)\n"
+  "              Read ahead the checkpoint images, which is done in the\n"
+  "              background while the process tree is created, at most\n"
+  "              this fast.  (default: 0, unlimited)\n"
+  "  --no-prefetch\n"
+  "              Don't read ahead the checkpoint images; each process reads\n"
+  "              its image only when it is restored.\n"
   "  -q, --quiet (or set environment variable DMTCP_QUIET = 0, 1, or 2)\n"
   "              Skip NOTE messages; if given twice, also skip WARNINGs\n"
   "  --coord-logfile PATH (environment variable DMTCP_COORD_LOG_FILENAME\n"
@@ -123,6 +155,180 @@ typedef map<UniquePid, RestoreTarget*> RestoreTargetMap;
 RestoreTargetMap targets;
 RestoreTargetMap independentProcessTreeRoots;
 bool noStrictChecking = false;
+static string ckptReceiver;
+
+// An image that is not found locally is fetched from the ckpt receiver.
+static bool isRemoteImage(const string& path)
+{
+  return !ckptReceiver.empty() && !jalib::Filesystem::FileExists(path);
+}
+
+static vector<string> xorReceivers;
+static string chunkStore;
+
+// True if the image open on fd is the one the parity was computed from; a
+// newer generation of it often has the same size.
+static bool isParityMember(int fd, const CkptReceiver::ParityMember& member)
+{
+  struct stat st;
+  if (fstat(fd, &st) == -1 || (uint64_t) st.st_size != member.size) {
+    return false;
+  }
+  CkptReceiver::ImageHash hash;
+  vector<char> buf(4 * 1024 * 1024);
+  ssize_t n;
+  while ((n = Util::readAll(fd, &buf[0], buf.size())) > 0) {
+    hash.update(&buf[0], n);
+  }
+  uint64_t h[2];
+  hash.final(h);
+  return n == 0 && lseek(fd, 0, SEEK_SET) == 0 &&
+         h[0] == member.hash[0] && h[1] == member.hash[1];
+}
+
+/* Rebuild image path from the parity set read from parityFd: the XOR of the
+ * parity and of the images of the rest of its group, found in searchDirs.
+ */
+static bool rebuildImage(int parityFd, const string& path,
+                         const vector<string>& searchDirs)
+{
+  string name = jalib::Filesystem::BaseName(path);
+  CkptReceiver::ParityHeader hdr;
+  if (Util::readAll(parityFd, &hdr, sizeof(hdr)) != sizeof(hdr) ||
+      strncmp(hdr.magic, CKPT_PARITY_MAGIC, sizeof(hdr.magic)) != 0 ||
+      hdr.groupSize < 2 || hdr.groupSize > CKPT_PARITY_MAX_GROUP_SIZE) {
+    JWARNING(false) (path) .Text("Invalid parity set");
+    return false;
+  }
+  vector<CkptReceiver::ParityMember> members(hdr.groupSize);
+  size_t membersLen = hdr.groupSize * sizeof(members[0]);
+  if (Util::readAll(parityFd, &members[0], membersLen) !=
+        (ssize_t) membersLen) {
+    JWARNING(false) (path) .Text("Invalid parity set");
+    return false;
+  }
+
+  size_t lost = members.size();
+  vector<int> fds(members.size(), -1);
+  bool ok = true;
+  for (size_t i = 0; i < members.size(); i++) {
+    members[i].name[sizeof(members[i].name) - 1] = '\0';
+    if (name == members[i].name) {
+      lost = i;
+      continue;
+    }
+    for (size_t d = 0; d < searchDirs.size() && fds[i] == -1; d++) {
+      string memberPath = searchDirs[d] + "/" + members[i].name;
+      fds[i] = open(memberPath.c_str(), O_RDONLY);
+      if (fds[i] != -1 && !isParityMember(fds[i], members[i])) {
+        // A different generation of the image; it is of no use.
+        JTRACE("Image is not the one in the parity set") (memberPath);
+        close(fds[i]);
+        fds[i] = -1;
+      }
+    }
+    if (fds[i] == -1) {
+      JWARNING(false) (path) (members[i].name) (members[i].size)
+        (hdr.generation)
+        .Text("Image of the same XOR group (of the same generation) also"
+              " missing; cannot rebuild");
+      ok = false;
+    }
+  }
+  ok = ok && lost < members.size() && members[lost].size <= hdr.paritySize;
+
+  string tempPath = path + ".temp";
+  int out = -1;
+  if (ok) {
+    out = open(tempPath.c_str(), O_CREAT | O_WRONLY | O_TRUNC, 0600);
+    JWARNING(out != -1) (tempPath) (JASSERT_ERRNO);
+    ok = out != -1;
+  }
+  const size_t bufSize = 4 * 1024 * 1024;
+  vector<uint64_t> parity(bufSize / sizeof(uint64_t));
+  vector<uint64_t> buf(bufSize / sizeof(uint64_t));
+  CkptReceiver::ImageHash hash;
+  for (uint64_t offset = 0; ok && offset < members[lost].size;
+       offset += bufSize) {
+    size_t len = members[lost].size - offset < bufSize
+                 ? members[lost].size - offset : bufSize;
+    size_t parityLen = hdr.paritySize - offset < bufSize
+                       ? hdr.paritySize - offset : bufSize;
+    ok = Util::readAll(parityFd, &parity[0], parityLen) == (ssize_t) parityLen;
+    for (size_t i = 0; ok && i < members.size(); i++) {
+      if (i == lost || offset >= members[i].size) {
+        continue;
+      }
+      ssize_t n = Util::readAll(fds[i], &buf[0], bufSize);
+      ok = n > 0;
+      if (ok) {
+        memset((char*) &buf[0] + n, 0, bufSize - n);
+      }
+      for (size_t w = 0; ok && w < buf.size(); w++) {
+        parity[w] ^= buf[w];
+      }
+    }
+    ok = ok && Util::writeAll(out, &parity[0], len) == (ssize_t) len;
+    hash.update(&parity[0], len);
+  }
+  if (ok) {
+    uint64_t h[2];
+    hash.final(h);
+    ok = h[0] == members[lost].hash[0] && h[1] == members[lost].hash[1];
+    JWARNING(ok) (path) .Text("Rebuilt image does not match its parity set");
+  }
+
+  for (size_t i = 0; i < fds.size(); i++) {
+    if (fds[i] != -1) {
+      close(fds[i]);
+    }
+  }
+  if (out != -1) {
+    ok = fsync(out) == 0 && close(out) == 0 && ok;
+    if (ok) {
+      ok = rename(tempPath.c_str(), path.c_str()) == 0;
+    }
+    if (!ok) {
+      JWARNING(false) (path) (JASSERT_ERRNO)
+        .Text("Failed to rebuild image from XOR parity");
+      unlink(tempPath.c_str());
+    }
+  }
+  return ok;
+}
+
+// Rebuild a lost image from the XOR parity of its group, kept by one of the
+// xorReceivers.
+static bool rebuildFromParity(const string& path,
+                              const vector<string>& searchDirs)
+{
+  string name = jalib::Filesystem::BaseName(path);
+  for (size_t i = 0; i < xorReceivers.size(); i++) {
+    string paritySet = CkptReceiver::findParity(xorReceivers[i], name);
+    if (paritySet.empty()) {
+      continue;
+    }
+    uint32_t uid;
+    int fd = CkptReceiver::openGet(xorReceivers[i], paritySet, &uid);
+    if (fd == -1) {
+      continue;
+    }
+    if (uid != getuid() && !noStrictChecking) {
+      JWARNING(false) (xorReceivers[i]) (paritySet) (uid) (getuid())
+        .Text("Parity set belongs to another user; not using it.");
+      close(fd);
+      continue;
+    }
+    bool ok = rebuildImage(fd, path, searchDirs);
+    close(fd);
+    if (ok) {
+      JNOTE("Rebuilt lost ckpt image from XOR parity")
+        (path) (xorReceivers[i]) (paritySet);
+      return true;
+    }
+  }
+  return false;
+}
 static string thePortFile;
 CoordinatorMode allowedModes = COORD_ANY;
 
@@ -137,8 +343,8 @@ class RestoreTarget
     RestoreTarget(const string& path)
       : _path(path)
     {
-      JASSERT(jalib::Filesystem::FileExists(_path)) (_path)
-        .Text ( "checkpoint file missing" );
+      JASSERT(jalib::Filesystem::FileExists(_path) || isRemoteImage(_path))
+        (_path) .Text ( "checkpoint file missing" );
 
       _fd = readCkptHeader(_path, &_pInfo);
       uint64_t clock_gettime_offset =
@@ -358,6 +564,9 @@ class RestoreTarget
         // the abs-path of ckpt-image.
         string dirName = jalib::Filesystem::DirName(_path);
         int dirfd = open(dirName.c_str(), O_RDONLY);
+        if (dirfd == -1 && isRemoteImage(_path)) {
+          dirfd = open(".", O_RDONLY);
+        }
         JASSERT(dirfd != -1) (JASSERT_ERRNO);
         if (dirfd != PROTECTED_CKPT_DIR_FD) {
           JASSERT(dup2(dirfd, PROTECTED_CKPT_DIR_FD) == PROTECTED_CKPT_DIR_FD);
@@ -562,16 +771,38 @@ static int open_ckpt_to_read(const char *filename)
     NULL
   };
 #endif
+  static string chunker_path = Util::getPath("dmtcp_ckpt_chunker");
+  static const char *chunker_args[] = {
+    const_cast<char*> ("dmtcp_ckpt_chunker"),
+    const_cast<char*> ("-x"),
+    NULL,
+    NULL,
+    NULL
+  };
   pid_t cpid;
 
-  fc = first_char(filename);
-  fd = open(filename, O_RDONLY);
-  JASSERT(fd>=0)(filename).Text("Failed to open file.");
+  if (isRemoteImage(filename)) {
+    uint32_t uid;
+    fd = CkptReceiver::openGet(ckptReceiver,
+                               jalib::Filesystem::BaseName(filename), &uid);
+    JASSERT(fd >= 0) (filename) (ckptReceiver)
+      .Text("Failed to fetch image from checkpoint receiver.");
+    // As for local images: the image must be ours.
+    JASSERT(uid == getuid() || noStrictChecking) (filename) (uid) (getuid())
+      .Text("Checkpoint image belongs to another user.  Aborting for security"
+            " reasons; use --no-strict-checking to restart it anyway.");
+    JASSERT(recv(fd, &fc, 1, MSG_PEEK | MSG_WAITALL) == 1) (filename)
+      .Text("ERROR: Error reading from checkpoint receiver");
+  } else {
+    fc = first_char(filename);
+    fd = open(filename, O_RDONLY);
+    JASSERT(fd>=0)(filename).Text("Failed to open file.");
+  }
 
   if (fc == DMTCP_MAGIC_FIRST) { /* no compression */
     return fd;
   }
-  else if (fc == GZIP_FIRST
+  else if (fc == GZIP_FIRST || fc == CHUNKS_FIRST
 #ifdef HBICT_DELTACOMP
            || fc == HBICT_FIRST
 #endif
@@ -579,6 +810,13 @@ static int open_ckpt_to_read(const char *filename)
     if (fc == GZIP_FIRST) {
       decomp_path = gzip_path;
       decomp_args = gzip_args;
+    } else if (fc == CHUNKS_FIRST) {
+      decomp_path = chunker_path.c_str();
+      decomp_args = chunker_args;
+      if (!chunkStore.empty()) {
+        chunker_args[2] = "-s";
+        chunker_args[3] = chunkStore.c_str();
+      }
     }
 #ifdef HBICT_DELTACOMP
     else {
@@ -707,6 +945,72 @@ static void setNewCkptDir(char *path)
   }
 }
 
+/* Ask the kernel to read all of the images into the page cache, from a
+ * detached grandchild, so that the I/O overlaps with re-creating the process
+ * tree; otherwise each mtcp_restart reads its image only when it gets to it.
+ * If bwLimit is not 0, the requests are paced to stay within bwLimit bytes
+ * per second.
+ */
+#define PREFETCH_CHUNK_SIZE (8 * 1024 * 1024)
+
+static void prefetchImages(const vector<string>& images, uint64_t bwLimit)
+{
+  struct timespec start;
+  uint64_t issued = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (size_t i = 0; i < images.size(); i++) {
+    int fd = open(images[i].c_str(), O_RDONLY);
+    if (fd == -1) {
+      continue;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+      close(fd);
+      continue;
+    }
+    for (off_t off = 0; off < st.st_size; off += PREFETCH_CHUNK_SIZE) {
+      if (bwLimit > 0) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        double elapsed = (now.tv_sec - start.tv_sec) +
+                         (now.tv_nsec - start.tv_nsec) / 1e9;
+        double ahead = (double) issued / bwLimit - elapsed;
+        if (ahead > 0) {
+          struct timespec delay;
+          delay.tv_sec = (time_t) ahead;
+          delay.tv_nsec = (long) ((ahead - delay.tv_sec) * 1e9);
+          nanosleep(&delay, NULL);
+        }
+      }
+      posix_fadvise(fd, off, PREFETCH_CHUNK_SIZE, POSIX_FADV_WILLNEED);
+      issued += PREFETCH_CHUNK_SIZE;
+    }
+    close(fd);
+  }
+}
+
+static void startImagePrefetch(const vector<string>& images, uint64_t bwLimit)
+{
+  // The prefetcher must not become a child of a restored process.
+  pid_t pid = fork();
+  if (pid == -1) {
+    JWARNING(false) (JASSERT_ERRNO) .Text("Not prefetching ckpt images");
+    return;
+  }
+  if (pid == 0) {
+    if (fork() == 0) {
+      // Don't hold on to a pipe that our caller may be waiting on.
+      close(STDIN_FILENO);
+      close(STDOUT_FILENO);
+      close(STDERR_FILENO);
+      prefetchImages(images, bwLimit);
+    }
+    _exit(0);
+  }
+  JASSERT(waitpid(pid, NULL, 0) == pid) (JASSERT_ERRNO);
+}
+
 //shift args
 #define shift argc--,argv++
 
@@ -714,6 +1018,12 @@ int main(int argc, char** argv)
 {
   char *tmpdir_arg = NULL;
   char *ckptdir_arg = NULL;
+  char *localckptdir_arg = NULL;
+  char *prefetchbw_arg = NULL;
+  bool prefetch = true;
+  char *xorreceivers_arg = NULL;
+  string localImageCkptDir;
+  vector<string> images;
 
   Util::setProtectedFdBase();
 
@@ -731,6 +1041,22 @@ int main(int argc, char** argv)
     ckptdir_arg = getenv(ENV_VAR_CHECKPOINT_DIR);
   }
 
+  if (getenv(ENV_VAR_LOCAL_CKPT_DIR)) {
+    localckptdir_arg = getenv(ENV_VAR_LOCAL_CKPT_DIR);
+  }
+
+  if (getenv(ENV_VAR_RESTART_PREFETCH_BW)) {
+    prefetchbw_arg = getenv(ENV_VAR_RESTART_PREFETCH_BW);
+  }
+
+  if (getenv(ENV_VAR_CKPT_RECEIVER)) {
+    ckptReceiver = getenv(ENV_VAR_CKPT_RECEIVER);
+  }
+
+  if (getenv(ENV_VAR_XOR_RECEIVERS)) {
+    xorreceivers_arg = getenv(ENV_VAR_XOR_RECEIVERS);
+  }
+
   if (argc == 1) {
     printf("%s", DMTCP_VERSION_AND_COPYRIGHT_INFO);
     printf("(For help: %s --help)\n\n", argv[0]);
@@ -793,6 +1119,24 @@ int main(int argc, char** argv)
     } else if (argc > 1 && (s == "-t" || s == "--tmpdir")) {
       tmpdir_arg = argv[1];
       shift; shift;
+    } else if (argc > 1 && s == "--local-ckptdir") {
+      localckptdir_arg = argv[1];
+      shift; shift;
+    } else if (argc > 1 && s == "--ckpt-receiver") {
+      ckptReceiver = argv[1];
+      shift; shift;
+    } else if (argc > 1 && s == "--ckpt-chunk-store") {
+      chunkStore = argv[1];
+      shift; shift;
+    } else if (argc > 1 && s == "--xor-receivers") {
+      xorreceivers_arg = argv[1];
+      shift; shift;
+    } else if (argc > 1 && s == "--prefetch-bandwidth") {
+      prefetchbw_arg = argv[1];
+      shift; shift;
+    } else if (s == "--no-prefetch") {
+      prefetch = false;
+      shift;
     } else if (argc > 1 && (s == "--gdb")) {
       requestedDebugLevel = atoi(argv[1]);
       shift; shift;
@@ -820,6 +1164,10 @@ int main(int argc, char** argv)
 
   jassert_quiet = *getenv(ENV_VAR_QUIET) - '0';
 
+  if (xorreceivers_arg != NULL) {
+    xorReceivers = Util::tokenizeString(xorreceivers_arg, ",");
+  }
+
   //make sure JASSERT initializes now, rather than during restart
   Util::initializeLogFile(tmpDir);
 
@@ -838,6 +1186,40 @@ int main(int argc, char** argv)
     string restorename(argv[0]);
     struct stat buf;
     int rc = stat(restorename.c_str(), &buf);
+    if (localckptdir_arg != NULL && Util::strEndsWith(restorename, ".dmtcp")) {
+      // Prefer the node-local copy, unless the one in the ckpt dir is newer:
+      // a drained copy keeps the mtime of the local one, so it is only newer
+      // if a later checkpoint was written to the ckpt dir directly.
+      string localname = string(localckptdir_arg) + "/" +
+                         jalib::Filesystem::BaseName(restorename);
+      struct stat localbuf;
+      if (localname != restorename &&
+          stat(localname.c_str(), &localbuf) == 0 &&
+          S_ISREG(localbuf.st_mode) &&
+          (rc == -1 || localbuf.st_mtim.tv_sec > buf.st_mtim.tv_sec ||
+           (localbuf.st_mtim.tv_sec == buf.st_mtim.tv_sec &&
+            localbuf.st_mtim.tv_nsec >= buf.st_mtim.tv_nsec))) {
+        JTRACE("Using node-local copy of ckpt image") (restorename) (localname);
+        // Later checkpoints still go to the global ckpt dir.
+        if (localImageCkptDir.empty()) {
+          localImageCkptDir = jalib::Filesystem::DirName(restorename);
+        }
+        restorename = localname;
+        buf = localbuf;
+        rc = 0;
+      }
+    }
+    if (rc == -1 && !xorReceivers.empty() &&
+        Util::strEndsWith(restorename, ".dmtcp")) {
+      vector<string> searchDirs;
+      if (localckptdir_arg != NULL) {
+        searchDirs.push_back(localckptdir_arg);
+      }
+      searchDirs.push_back(jalib::Filesystem::DirName(restorename));
+      if (rebuildFromParity(restorename, searchDirs)) {
+        rc = stat(restorename.c_str(), &buf);
+      }
+    }
     if (Util::strEndsWith(restorename, "_files")) {
       continue;
     } else if (!Util::strEndsWith(restorename, ".dmtcp")) {
@@ -845,12 +1227,12 @@ int main(int argc, char** argv)
       // Don't test for --quiet here.  We're aborting.  We need to say why.
       JASSERT_STDERR << theUsage;
       doAbort = true;
-    } else if (rc == -1) {
+    } else if (rc == -1 && !isRemoteImage(restorename)) {
       char error_msg[1024];
       sprintf(error_msg, "\ndmtcp_restart: ckpt image %s", restorename.c_str());
       perror(error_msg);
       doAbort = true;
-    } else if (buf.st_uid != getuid() && !noStrictChecking) {
+    } else if (rc == 0 && buf.st_uid != getuid() && !noStrictChecking) {
       /*Could also run if geteuid() matches*/
       printf("\nProcess uid (%d) doesn't match uid (%d) of\n" \
              "checkpoint image (%s).\n" \
@@ -864,11 +1246,27 @@ int main(int argc, char** argv)
       exit(DMTCP_FAIL_RC);
     }
 
-    JTRACE("Will restart ckpt image") (argv[0]);
-    RestoreTarget *t = new RestoreTarget(argv[0]);
+    JTRACE("Will restart ckpt image") (restorename);
+    images.push_back(restorename);
+  }
+
+  if (prefetch) {
+    uint64_t bwLimit = 0;
+    if (prefetchbw_arg != NULL && atof(prefetchbw_arg) > 0) {
+      bwLimit = (uint64_t) (atof(prefetchbw_arg) * 1024 * 1024);
+    }
+    startImagePrefetch(images, bwLimit);
+  }
+
+  for (size_t i = 0; i < images.size(); i++) {
+    RestoreTarget *t = new RestoreTarget(images[i]);
     targets[t->upid()] = t;
   }
 
+  if (ckptdir_arg == NULL && !localImageCkptDir.empty()) {
+    setNewCkptDir(const_cast<char*>(localImageCkptDir.c_str()));
+  }
+
   // Prepare list of independent process tree roots
   RestoreTargetMap::iterator i;
   for (i = targets.begin(); i != targets.end(); i++) {
@@ -39,6 +39,10 @@ DmtcpMessage::DmtcpMessage ( DmtcpMessageType t /*= DMT_NULL*/ )
     ,coordCmd('\0')
     ,coordCmdStatus(CoordCmdStatus::NOERROR)
     ,coordTimeStamp(0)
+    ,ckptImageSize(0)
+    ,ckptWriteBandwidth(0)
+    ,xorMember(0)
+    ,xorGroupSize(0)
     ,theCheckpointInterval ( DMTCPMESSAGE_SAME_CKPT_INTERVAL )
     ,uniqueIdOffset(0)
     ,logMask(0)
@@ -90,6 +94,7 @@ ostream& dmtcp::operator << ( dmtcp::ostream& o, const DmtcpMessageType & s )
       OSHIFTPRINTF ( DMT_NEW_WORKER )
       OSHIFTPRINTF ( DMT_NAME_SERVICE_WORKER )
       OSHIFTPRINTF ( DMT_RESTART_WORKER )
+      OSHIFTPRINTF ( DMT_NEW_SPARE_WORKER )
       OSHIFTPRINTF ( DMT_ACCEPT )
       OSHIFTPRINTF ( DMT_REJECT_NOT_RESTARTING )
       OSHIFTPRINTF ( DMT_REJECT_WRONG_COMP )
@@ -103,6 +108,7 @@ ostream& dmtcp::operator << ( dmtcp::ostream& o, const DmtcpMessageType & s )
       OSHIFTPRINTF ( DMT_USER_CMD_RESULT )
       OSHIFTPRINTF ( DMT_CKPT_FILENAME )
       OSHIFTPRINTF ( DMT_UNIQUE_CKPT_FILENAME )
+      OSHIFTPRINTF ( DMT_CKPT_DURABLE )
 
       //OSHIFTPRINTF ( DMT_RESTART_PROCESS )
       //OSHIFTPRINTF ( DMT_RESTART_PROCESS_REPLY )
@@ -132,6 +138,8 @@ ostream& dmtcp::operator << ( dmtcp::ostream& o, const DmtcpMessageType & s )
 
 #endif
       OSHIFTPRINTF ( DMT_UPDATE_LOGGING )
+      OSHIFTPRINTF ( DMT_DUMP_FLIGHT_RECORDER )
+      OSHIFTPRINTF ( DMT_ABORT_CKPT )
 
       OSHIFTPRINTF ( DMT_OK )
 
@@ -38,6 +38,8 @@ namespace dmtcp
     DMT_NEW_WORKER,   // on connect established worker-coordinator
     DMT_NAME_SERVICE_WORKER,
     DMT_RESTART_WORKER,   // on connect established worker-coordinator
+    DMT_NEW_SPARE_WORKER, // a connection registered ahead of time for the
+                          //   next fork()ed child of a worker
     DMT_ACCEPT,        // on connect established coordinator-worker
     DMT_REJECT_NOT_RESTARTING,
     DMT_REJECT_WRONG_COMP,
@@ -53,6 +55,7 @@ namespace dmtcp
     DMT_CKPT_FILENAME,       // a slave sending it's checkpoint filename to coordinator
     DMT_UNIQUE_CKPT_FILENAME,// same as DMT_CKPT_FILENAME, except when
                              //   unique-ckpt plugin is being used.
+    DMT_CKPT_DURABLE,        // a slave's image reached the global ckpt dir
 
     DMT_USER_CMD,            // on connect established dmtcp_command -> coordinator
     DMT_USER_CMD_RESULT,     // on reply coordinator -> dmtcp_command
@@ -82,6 +85,8 @@ namespace dmtcp
     DMT_NAME_SERVICE_GET_UNIQUE_ID_RESPONSE,
 
     DMT_UPDATE_LOGGING,
+    DMT_DUMP_FLIGHT_RECORDER,
+    DMT_ABORT_CKPT,          // coordinator gave up on the SUSPENDED barrier
 
     DMT_OK,                  // slave telling coordinator it is done (response
                              //   to DMT_DO_*)  this means slave reached barrier
@@ -92,7 +97,8 @@ namespace dmtcp
       NOERROR                 =  0,
       ERROR_INVALID_COMMAND   = -1,
       ERROR_NOT_RUNNING_STATE = -2,
-      ERROR_COORDINATOR_NOT_FOUND = -3
+      ERROR_COORDINATOR_NOT_FOUND = -3,
+      ERROR_CKPT_ABORTED      = -4
     };
   }
 
@@ -130,6 +136,13 @@ namespace dmtcp
     int32_t coordCmdStatus;
 
     uint64_t coordTimeStamp;
+    uint64_t ckptImageSize;
+    // With DMT_DO_CHECKPOINT: bytes/sec this writer may use (0: unlimited).
+    uint64_t ckptWriteBandwidth;
+    // With DMT_DO_CHECKPOINT: this writer's place in its XOR parity group;
+    // the receiver and the parity set name follow as extra data.
+    uint32_t xorMember;
+    uint32_t xorGroupSize;
 
     uint32_t theCheckpointInterval;
     struct in_addr ipAddr;
@@ -20,6 +20,8 @@
  ****************************************************************************/
 
 #include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
 #include "dmtcp.h"
 #include "dmtcpplugin.h"
 #include "dmtcpworker.h"
@@ -29,12 +31,19 @@
 #include "shareddata.h"
 #include "threadsync.h"
 #include "mtcpinterface.h"
+#include "ckptserializer.h"
 #include "util.h"
 
 #undef dmtcp_is_enabled
 #undef dmtcp_checkpoint
+#undef dmtcp_checkpoint_async
+#undef dmtcp_get_ckpt_eventfd
+#undef dmtcp_get_last_ckpt_result
 #undef dmtcp_disable_ckpt
 #undef dmtcp_enable_ckpt
+#undef dmtcp_ckpt_exclude_region
+#undef dmtcp_ckpt_include_region
+#undef dmtcp_set_excluded_region_callback
 #undef dmtcp_get_coordinator_status
 #undef dmtcp_get_local_status
 #undef dmtcp_get_uniquepid_str
@@ -51,6 +60,16 @@ using namespace dmtcp;
 static int numCheckpoints = 0;
 static int numRestarts    = 0;
 
+// State of the pending dmtcp_checkpoint_async() request, if any.
+static int asyncHandle = 0;
+static int asyncNextHandle = 1;
+static dmtcp_ckpt_callback_t asyncCallback = NULL;
+static void *asyncCallbackArg = NULL;
+static struct timespec asyncRequestTime;
+static int ckptEventFd = -1;
+static DmtcpCkptResult lastCkptResult;
+static bool haveLastCkptResult = false;
+
 //I wish we could use pthreads for the trickery in this file, but much of our
 //code is executed before the thread we want to wake is restored.  Thus we do
 //it the bad way.
@@ -136,6 +155,52 @@ EXTERNC int dmtcp_checkpoint()
   return rv;
 }
 
+EXTERNC int dmtcp_checkpoint_async(dmtcp_ckpt_callback_t fn, void *arg)
+{
+  int handle;
+
+  // Hold off checkpoints, so that a checkpoint can't complete before its
+  // request has been recorded.
+  ThreadSync::delayCheckpointsLock();
+  if (asyncHandle != 0) {
+    ThreadSync::delayCheckpointsUnlock();
+    return -1;
+  }
+  handle = asyncNextHandle++;
+  asyncHandle = handle;
+  asyncCallback = fn;
+  asyncCallbackArg = arg;
+  clock_gettime(CLOCK_MONOTONIC, &asyncRequestTime);
+  ThreadSync::delayCheckpointsUnlock();
+
+  if (!dmtcpRunCommand('c')) {
+    ThreadSync::delayCheckpointsLock();
+    asyncHandle = 0;
+    asyncCallback = NULL;
+    ThreadSync::delayCheckpointsUnlock();
+    return -1;
+  }
+  return handle;
+}
+
+EXTERNC int dmtcp_get_ckpt_eventfd(void)
+{
+  if (ckptEventFd == -1) {
+    // Created through the wrapper, so that it survives restart.
+    ckptEventFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+  }
+  return ckptEventFd;
+}
+
+EXTERNC int dmtcp_get_last_ckpt_result(DmtcpCkptResult *result)
+{
+  if (!haveLastCkptResult) {
+    return 0;
+  }
+  *result = lastCkptResult;
+  return DMTCP_IS_PRESENT;
+}
+
 EXTERNC int dmtcp_get_coordinator_status(int *numPeers, int *isRunning)
 {
   int coordCmdStatus;
@@ -162,6 +227,28 @@ EXTERNC int dmtcp_enable_ckpt()
   return 1;
 }
 
+EXTERNC int dmtcp_ckpt_exclude_region(void *addr, size_t len, int policy)
+{
+  ThreadSync::delayCheckpointsLock();
+  bool ok = ProcessInfo::instance().excludeRegion((uint64_t) addr, len, policy);
+  ThreadSync::delayCheckpointsUnlock();
+  return ok ? 1 : -1;
+}
+
+EXTERNC int dmtcp_ckpt_include_region(void *addr, size_t len)
+{
+  ThreadSync::delayCheckpointsLock();
+  bool ok = ProcessInfo::instance().includeRegion((uint64_t) addr, len);
+  ThreadSync::delayCheckpointsUnlock();
+  return ok ? 1 : -1;
+}
+
+EXTERNC int dmtcp_set_excluded_region_callback(dmtcp_excluded_region_fn_t fn)
+{
+  ProcessInfo::instance().setExcludedRegionCallback(fn);
+  return 1;
+}
+
 EXTERNC int dmtcp_get_ckpt_signal(void)
 {
   const int ckpt_signal = DmtcpWorker::determineCkptSignal();
@@ -547,3 +634,51 @@ void dmtcp::increment_counters(int isRestart)
     numCheckpoints++;
   }
 }
+
+// Record the result, and hand it to the pending dmtcp_checkpoint_async()
+// callback and to the eventfd.
+static void report_ckpt_result(DmtcpCkptResult *result)
+{
+  lastCkptResult = *result;
+  haveLastCkptResult = true;
+
+  dmtcp_ckpt_callback_t fn = asyncCallback;
+  asyncHandle = 0;
+  asyncCallback = NULL;
+  if (fn != NULL) {
+    fn(result, asyncCallbackArg);
+  }
+
+  if (ckptEventFd != -1) {
+    uint64_t one = 1;
+    JWARNING(write(ckptEventFd, &one, sizeof(one)) == sizeof(one))
+      (ckptEventFd) (JASSERT_ERRNO);
+  }
+}
+
+void dmtcp::notify_ckpt_complete(int isRestart)
+{
+  DmtcpCkptResult result;
+  memset(&result, 0, sizeof(result));
+  result.handle = asyncHandle;
+  result.isRestart = isRestart;
+  result.generation = ProcessInfo::instance().get_generation();
+  CkptSerializer::lastImageStats(&result.imageSize, &result.writeUsec);
+  if (asyncHandle != 0 && !isRestart) {
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    result.totalUsec = (now.tv_sec - asyncRequestTime.tv_sec) * 1000000 +
+                       (now.tv_nsec - asyncRequestTime.tv_nsec) / 1000;
+  }
+  report_ckpt_result(&result);
+}
+
+void dmtcp::notify_ckpt_aborted()
+{
+  DmtcpCkptResult result;
+  memset(&result, 0, sizeof(result));
+  result.handle = asyncHandle;
+  result.aborted = 1;
+  result.generation = ProcessInfo::instance().get_generation();
+  report_ckpt_result(&result);
+}
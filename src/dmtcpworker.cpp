@@ -33,6 +33,7 @@
 #include "syslogwrappers.h"
 #include "coordinatorapi.h"
 #include "shareddata.h"
+#include "ckptserializer.h"
 #include "threadlist.h"
 #include  "../jalib/jsocket.h"
 #include  "../jalib/jfilesystem.h"
@@ -215,9 +216,10 @@ static void prepareLogAndProcessdDataFromSerialFile()
     // of the new log file into that one.
     string prevLogFilePath = getLogFilePath();
 
-    jalib::JBinarySerializeReaderRaw rd ("", PROTECTED_LIFEBOAT_FD);
+    jalib::JBinarySerializeBufferedReader rd ("", PROTECTED_LIFEBOAT_FD);
     rd.rewind();
     UniquePid::serialize (rd);
+    rd.flush();
     Util::initializeLogFile(SharedData::getTmpDir(), "", prevLogFilePath);
 
     writeCurrentLogFileNameToPrevLogFile(prevLogFilePath);
@@ -402,7 +404,12 @@ static void ckptThreadPerformExit()
   while (1) sleep(1);
 }
 
-void DmtcpWorker::waitForCoordinatorMsg(string msgStr,
+/* Returns false if the coordinator aborted the checkpoint instead.  That can
+ * only happen while waiting at the SUSPENDED barrier (for
+ * DMT_DO_FD_LEADER_ELECTION); a process that connected after DMT_DO_SUSPEND
+ * was sent ignores the abort.
+ */
+bool DmtcpWorker::waitForCoordinatorMsg(string msgStr,
                                                DmtcpMessageType type)
 {
   if (dmtcp_no_coordinator()) {
@@ -414,7 +421,7 @@ void DmtcpWorker::waitForCoordinatorMsg(string msgStr,
       ProcessInfo::instance().numPeers(1);
       ProcessInfo::instance().compGroup(SharedData::getCompId());
     }
-    return;
+    return true;
   }
 
   if (type == DMT_DO_SUSPEND) {
@@ -457,6 +464,12 @@ void DmtcpWorker::waitForCoordinatorMsg(string msgStr,
     }
     if (msg.type == DMT_UPDATE_LOGGING) {
       SharedData::setLogMask(msg.logMask);
+    } else if (msg.type == DMT_DUMP_FLIGHT_RECORDER) {
+      jassert_internal::jflight_dump();
+    } else if (msg.type == DMT_ABORT_CKPT) {
+      if (type == DMT_DO_FD_LEADER_ELECTION) {
+        return false;
+      }
     } else {
       break;
     }
@@ -479,7 +492,28 @@ void DmtcpWorker::waitForCoordinatorMsg(string msgStr,
     JLOG(DMTCP)("Computation information") (msg.compGroup) (msg.numPeers);
     ProcessInfo::instance().compGroup(msg.compGroup);
     ProcessInfo::instance().numPeers(msg.numPeers);
+  } else if (type == DMT_DO_CHECKPOINT) {
+    CkptSerializer::setWriteBandwidth(msg.ckptWriteBandwidth);
+    // See the comment on write scheduling in dmtcp_coordinator.cpp.
+    static bool warnedForkedCkpt = false;
+    if (msg.ckptWriteBandwidth > 0 && getenv(ENV_VAR_FORKED_CKPT) != NULL &&
+        !warnedForkedCkpt) {
+      JWARNING(false)
+        .Text("Forked checkpointing: the coordinator's write slots are freed"
+              " before the image is written, so do not bound the writers.");
+      warnedForkedCkpt = true;
+    }
+    // The coordinator sends the receiver and parity set of the XOR group.
+    string receiver, paritySet;
+    if (msg.extraBytes > 0) {
+      receiver = replyData;
+      paritySet = replyData + receiver.length() + 1;
+      JALLOC_HELPER_FREE(replyData);
+    }
+    CkptSerializer::setXorGroup(msg.xorMember, msg.xorGroupSize,
+                                receiver, paritySet);
   }
+  return true;
 }
 
 void DmtcpWorker::informCoordinatorOfRUNNINGState()
@@ -507,7 +541,7 @@ void DmtcpWorker::waitForStage1Suspend()
   JLOG(DMTCP)("Starting checkpoint, suspending...");
 }
 
-void DmtcpWorker::waitForStage2Checkpoint()
+bool DmtcpWorker::waitForStage2Checkpoint()
 {
   WorkerState::setCurrentState (WorkerState::SUSPENDED);
   JLOG(DMTCP)("suspended");
@@ -525,7 +559,16 @@ void DmtcpWorker::waitForStage2Checkpoint()
 
   eventHook(DMTCP_EVENT_THREADS_SUSPEND, NULL);
 
-  waitForCoordinatorMsg ("FD_LEADER_ELECTION", DMT_DO_FD_LEADER_ELECTION);
+  if (!waitForCoordinatorMsg("FD_LEADER_ELECTION",
+                             DMT_DO_FD_LEADER_ELECTION)) {
+    // The coordinator gave up waiting for a straggler.  Nothing has been
+    // done for this checkpoint beyond DMTCP_EVENT_THREADS_SUSPEND.
+    JNOTE("Checkpoint aborted by coordinator; resuming");
+    eventHook(DMTCP_EVENT_CKPT_ABORTED, NULL);
+    WorkerState::setCurrentState(WorkerState::RUNNING);
+    informCoordinatorOfRUNNINGState();
+    return false;
+  }
 
   eventHook(DMTCP_EVENT_LEADER_ELECTION, NULL);
 
@@ -555,6 +598,7 @@ void DmtcpWorker::waitForStage2Checkpoint()
   eventHook(DMTCP_EVENT_WRITE_CKPT, NULL);
 
   SharedData::writeCkpt();
+  return true;
 }
 
 void DmtcpWorker::waitForStage3Refill(bool isRestart)
@@ -42,11 +42,11 @@ namespace dmtcp
       ~DmtcpWorker();
       static DmtcpWorker& instance();
 
-      static void waitForCoordinatorMsg(string signalStr,
+      static bool waitForCoordinatorMsg(string signalStr,
                                         DmtcpMessageType type);
       static void informCoordinatorOfRUNNINGState();
       static void waitForStage1Suspend();
-      static void waitForStage2Checkpoint();
+      static bool waitForStage2Checkpoint();
       static void waitForStage3Refill(bool isRestart);
       static void waitForStage4Resume(bool isRestart);
       static void restoreVirtualPidTable();
@@ -49,6 +49,9 @@ const static bool dbg = false;
 static bool pthread_atfork_enabled = false;
 static uint64_t child_time;
 static CoordinatorAPI coordinatorAPI;
+// Set in a vfork() child, which may only exec or _exit; its checkpoint thread
+// is created only if exec fails.
+static bool ckptThreadPending = false;
 
 // Allow plugins to call fork/exec/system to perform specific tasks during
 // preCKpt/postCkpt/PostRestart etc. event.
@@ -152,7 +155,7 @@ LIB_PRIVATE void pthread_atfork_child()
   DmtcpWorker::resetOnFork();
 }
 
-extern "C" pid_t fork()
+static pid_t forkChild(bool isVfork)
 {
   if (isPerformingCkptRestart() ||
       /*
@@ -196,7 +199,9 @@ extern "C" pid_t fork()
     // reset the lock. Calling ThreadList::resetOnFork here ensures that any
     // such locks would have been reset by the caller and hence it's safe to
     // call pthread_creat at this point.
-    ThreadList::resetOnFork();
+    if (!isVfork) {
+      ThreadList::resetOnFork();
+    }
 
     /* NOTE: Any work that needs to be done for the newly created child
      * should be put into pthread_atfork_child() function. That function is
@@ -208,9 +213,19 @@ extern "C" pid_t fork()
      * registered handle.
      */
     UniquePid child = UniquePid(host, getpid(), child_time);
-    JLOG(DMTCP)("fork() done [CHILD]") (child) (parent);
-
-    initializeMtcpEngine();
+    JLOG(DMTCP)("fork() done [CHILD]") (child) (parent) (isVfork);
+
+    if (isVfork) {
+      /* A vfork() child may only exec or _exit, and so it starts no
+       * checkpoint thread.  A checkpoint request that arrives before the
+       * exec is served by the checkpoint thread of the new program; until
+       * then, the child holds up the barrier.  A fork() child may run any
+       * code for any time, and so it still starts its thread right away.
+       */
+      ckptThreadPending = true;
+    } else {
+      initializeMtcpEngine();
+    }
   } else if (childPid > 0) { /* Parent Process */
     UniquePid child = UniquePid(host, childPid, child_time);
     ProcessInfo::instance().insertChild(childPid, child);
@@ -221,18 +236,38 @@ extern "C" pid_t fork()
 
   if (childPid != 0) {
     coordinatorAPI.closeConnection();
+    if (childPid > 0) {
+      coordinatorAPI.createSpareConnectionAfterFork(child_name);
+    }
     DmtcpWorker::eventHook(DMTCP_EVENT_ATFORK_PARENT, NULL);
     WRAPPER_EXECUTION_RELEASE_EXCL_LOCK();
   }
   return childPid;
 }
 
+extern "C" pid_t fork()
+{
+  return forkChild(false);
+}
+
 extern "C" pid_t vfork()
 {
   JLOG(DMTCP)("vfork wrapper calling fork");
   // This might not preserve the full semantics of vfork.
   // Used for checkpointing gdb.
-  return fork();
+  return forkChild(true);
+}
+
+/* A vfork() child whose exec failed may go on running; from here on, it needs
+ * its own checkpoint thread.
+ */
+static void startPendingCkptThread()
+{
+  if (ckptThreadPending) {
+    ckptThreadPending = false;
+    ThreadList::resetOnFork();
+    initializeMtcpEngine();
+  }
 }
 
 // Special short-lived processes from executables like /lib/libc.so.6
@@ -270,6 +305,30 @@ static void execShortLivedProcessAndExit(const char *path, char *const argv[])
   _exit(0);
 }
 
+/* The lifeboat carries our state across exec.  It is an anonymous memfd if
+ * the kernel supports it; otherwise an unlinked file in the tmpdir.
+ */
+static int createLifeBoat()
+{
+#ifdef SYS_memfd_create
+  int memfd = _real_syscall(SYS_memfd_create, "dmtcpLifeBoat", 0);
+  if (memfd != -1) {
+    return memfd;
+  }
+#endif
+
+  ostringstream os;
+  os << dmtcp_get_tmpdir() << "/dmtcpLifeBoat." << UniquePid::ThisProcess()
+     << "-XXXXXX";
+  char buf[PATH_MAX];
+  JASSERT(os.str().length() < sizeof(buf)) (os.str());
+  strcpy(buf, os.str().c_str());
+  int fd = _real_mkstemp(buf);
+  JASSERT(fd != -1) (JASSERT_ERRNO);
+  JASSERT(unlink(buf) == 0) (JASSERT_ERRNO);
+  return fd;
+}
+
 // FIXME:  Unify this code with code prior to execvp in dmtcp_launch.cpp
 //   Can use argument to dmtcpPrepareForExec() or getenv("DMTCP_...")
 //   from DmtcpWorker constructor, to distinguish the two cases.
@@ -331,17 +390,11 @@ static void dmtcpPrepareForExec(const char *path, char *const argv[],
     *newArgv = (char**)argv;
   }
 
-  ostringstream os;
-  os << dmtcp_get_tmpdir() << "/dmtcpLifeBoat." << UniquePid::ThisProcess()
-     << "-XXXXXX";
-  char *buf = (char*) JALLOC_HELPER_MALLOC(os.str().length()+1);
-  strcpy(buf, os.str().c_str());
-  int fd = _real_mkstemp(buf);
-  JASSERT(fd != -1) (JASSERT_ERRNO);
-  JASSERT(unlink(buf) == 0) (JASSERT_ERRNO);
-  Util::changeFd(fd, PROTECTED_LIFEBOAT_FD);
-  jalib::JBinarySerializeWriterRaw wr ("", PROTECTED_LIFEBOAT_FD);
+  Util::changeFd(createLifeBoat(), PROTECTED_LIFEBOAT_FD);
+  jalib::JBinarySerializeBufferedWriter wr ("", PROTECTED_LIFEBOAT_FD);
   UniquePid::serialize (wr);
+  // The plugins append to the lifeboat through their own serializers.
+  wr.flush();
   DmtcpEventData_t edata;
   edata.serializerInfo.fd = PROTECTED_LIFEBOAT_FD;
   DmtcpWorker::eventHook(DMTCP_EVENT_PRE_EXEC, &edata);
@@ -353,7 +406,9 @@ static void dmtcpPrepareForExec(const char *path, char *const argv[],
   Util::setProtectedFdBase();
 
   // Remove FD_CLOEXEC flag from protected file descriptors.
-  for (int i  = PROTECTED_FD_START; i < PROTECTED_FD_END; i++) {
+  // (PROTECTED_FD_END calls getenv(); don't evaluate it on every iteration.)
+  const int protectedFdEnd = PROTECTED_FD_END;
+  for (int i  = PROTECTED_FD_START; i < protectedFdEnd; i++) {
     int flags = fcntl(i, F_GETFD, NULL);
     if (flags != -1) {
       fcntl(i, F_SETFD, flags & ~FD_CLOEXEC);
@@ -374,6 +429,7 @@ static void dmtcpProcessFailedExec(const char *path, char *newArgv[])
 
   unsetenv(ENV_VAR_DLSYM_OFFSET);
   unsetenv(ENV_VAR_DLSYM_OFFSET_M32);
+  unsetenv(ENV_VAR_WRAPPER_CACHE);
 
   JLOG(DMTCP)("Processed failed Exec Attempt") (path) (getenv("LD_PRELOAD"));
   errno = saved_errno;
@@ -553,6 +609,7 @@ extern "C" int execve (const char *filename, char *const argv[],
   dmtcpProcessFailedExec(filename, newArgv);
 
   WRAPPER_EXECUTION_RELEASE_EXCL_LOCK();
+  startPendingCkptThread();
 
   return retVal;
 }
@@ -590,6 +647,7 @@ extern "C" int execvp (const char *filename, char *const argv[])
   dmtcpProcessFailedExec(filename, newArgv);
 
   WRAPPER_EXECUTION_RELEASE_EXCL_LOCK();
+  startPendingCkptThread();
 
   return retVal;
 }
@@ -622,6 +680,7 @@ extern "C" int execvpe (const char *filename, char *const argv[],
   dmtcpProcessFailedExec(filename, newArgv);
 
   WRAPPER_EXECUTION_RELEASE_EXCL_LOCK();
+  startPendingCkptThread();
 
   return retVal;
 }
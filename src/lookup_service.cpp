@@ -45,6 +45,14 @@ void LookupService::reset()
   _offsets.clear();
 }
 
+void LookupService::entryCounts(map<string, size_t> *counts) const
+{
+  map<string, KeyValueMap>::const_iterator i;
+  for (i = _maps.begin(); i != _maps.end(); i++) {
+    (*counts)[i->first] = i->second.size();
+  }
+}
+
 void LookupService::addKeyValue(string id,
                                        const void *key, size_t keyLen,
                                        const void *val, size_t valLen)
@@ -69,6 +69,7 @@ namespace dmtcp
       LookupService(){}
       ~LookupService() { reset(); }
       void reset();
+      void entryCounts(map<string, size_t> *counts) const;
       void registerData(const DmtcpMessage& msg, const void *data);
       void respondToQuery(jalib::JSocket& remote,
                           const DmtcpMessage& msg, const void *data);
@@ -47,6 +47,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/mman.h>
+#include <sys/shm.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <unistd.h>
@@ -127,6 +128,8 @@ static RestoreInfo rinfo;
 /* Internal routines */
 static void readmemoryareas(int fd, VA stackEnd);
 static int read_one_memory_area(int fd, VA stackEnd);
+static void restore_sysv_shm_area(int fd, Area *area);
+static void restore_file_backed_area(Area *area);
 #if 0
 static void adjust_for_smaller_file_size(Area *area, int fd);
 #endif
@@ -517,6 +520,7 @@ static void mtcp_simulateread(int fd, MtcpHeader *mtcpHdr)
     mtcp_readfile(fd, &area, sizeof area);
     if (area.size == -1) break;
     if ((area.properties & DMTCP_ZERO_PAGE) == 0 &&
+        (area.properties & DMTCP_FILE_BACKED_REF) == 0 &&
         (area.properties & DMTCP_SKIP_WRITING_TEXT_SEGMENTS) == 0) {
       void *addr = mtcp_sys_mmap(0, area.size, PROT_WRITE | PROT_READ,
                                  MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
@@ -927,6 +931,18 @@ static int read_one_memory_area(int fd, VA stackEnd)
 			  stackEnd, area.endAddr);
   }
 
+  /* CASE UNMODIFIED FILE PAGES: mapped from the original file. */
+  if ((area.properties & DMTCP_FILE_BACKED_REF) != 0) {
+    restore_file_backed_area(&area);
+    return 0;
+  }
+
+  /* CASE SYSV SHM SEGMENT: recreated here and filled in place. */
+  if ((area.properties & DMTCP_SYSV_SHM_AREA) != 0) {
+    restore_sysv_shm_area(fd, &area);
+    return 0;
+  }
+
   // We could have replaced MAP_SHARED with MAP_PRIVATE in writeckpt.cpp
   // instead of here. But we do it this way for debugging purposes. This way,
   // readdmtcp.sh will still be able to properly list the shared memory areas.
@@ -1079,6 +1095,106 @@ static int read_one_memory_area(int fd, VA stackEnd)
   return 0;
 }
 
+/* See write_sysv_shm_area() in writeckpt.cpp.  The first record of a SysV
+ * shm segment carries no data: create the segment and attach it at the
+ * original address (the kernel zero-fills it).  The records that follow
+ * hold the non-zero page ranges, which we read directly into the segment.
+ * The svipc plugin picks up the new shmid from /proc/self/maps.
+ */
+NO_OPTIMIZE
+static void restore_sysv_shm_area(int fd, Area *area)
+{
+  int mtcp_sys_errno;
+
+  if ((area->properties & DMTCP_ZERO_PAGE) == 0) {
+    mtcp_readfile(fd, area->addr, area->size);
+    return;
+  }
+
+#ifdef mtcp_sys_shmget
+  /* A keyed segment gets a fresh key, derived from the original one and our
+   * pid; if a segment with that key exists already, try the next one.
+   */
+  int key = area->shmkey;
+  int shmid;
+  int tries = 0;
+  if (key != IPC_PRIVATE) {
+    key += mtcp_sys_getpid();
+  }
+  while (1) {
+    shmid = mtcp_sys_shmget(key, area->size,
+                            (area->shmflg & 0777) | IPC_CREAT | IPC_EXCL);
+    if (shmid != -1 || mtcp_sys_errno != EEXIST ||
+        key == IPC_PRIVATE || ++tries == 1000) {
+      break;
+    }
+    if (++key == IPC_PRIVATE) {
+      key++;
+    }
+  }
+  if (shmid == -1) {
+    MTCP_PRINTF("error %d creating SysV shm segment of %p bytes\n",
+                mtcp_sys_errno, area->size);
+    mtcp_abort();
+  }
+  DPRINTF("restoring SysV shm segment %d, %p bytes at %p\n",
+          shmid, area->size, area->addr);
+  void *addr = mtcp_sys_shmat(shmid, area->addr, SHM_REMAP);
+  if (addr != area->addr) {
+    MTCP_PRINTF("error %d attaching SysV shm segment at %p\n",
+                mtcp_sys_errno, area->addr);
+    mtcp_abort();
+  }
+#else
+  MTCP_PRINTF("SysV shm segments can't be restored on this architecture.\n");
+  mtcp_abort();
+#endif
+}
+
+/* See write_file_backed_area() in writeckpt.cpp.  These pages were never
+ * modified by the process, so we map them privately from the original file,
+ * provided that the file hasn't changed since checkpoint.
+ */
+NO_OPTIMIZE
+static void restore_file_backed_area(Area *area)
+{
+  int mtcp_sys_errno;
+
+#ifdef mtcp_sys_fstat
+  struct stat st;
+  int imagefd = mtcp_sys_open(area->name, O_RDONLY, 0);
+  if (imagefd < 0) {
+    MTCP_PRINTF("error %d opening %s; can't restore its unmodified pages\n",
+                mtcp_sys_errno, area->name);
+    mtcp_abort();
+  }
+  if (mtcp_sys_fstat(imagefd, &st) == -1 ||
+      st.st_ino != area->inodenum ||
+      (uint64_t) st.st_size != area->filesize ||
+      (uint64_t) st.st_mtim.tv_sec != area->mtime_sec ||
+      (uint64_t) st.st_mtim.tv_nsec != area->mtime_nsec) {
+    MTCP_PRINTF("%s has changed since checkpoint; can't restore its"
+                " unmodified pages\n", area->name);
+    mtcp_abort();
+  }
+
+  DPRINTF("restoring unmodified file pages, %p bytes at %p from %s + 0x%X\n",
+          area->size, area->addr, area->name, area->offset);
+  void *mmappedat = mtcp_sys_mmap(area->addr, area->size, area->prot,
+                                  area->flags | MAP_FIXED, imagefd,
+                                  area->offset);
+  if (mmappedat != area->addr) {
+    MTCP_PRINTF("error %d mapping %p bytes at %p from %s\n",
+                mtcp_sys_errno, area->size, area->addr, area->name);
+    mtcp_abort();
+  }
+  mtcp_sys_close(imagefd);
+#else
+  MTCP_PRINTF("File-backed areas can't be restored on this architecture.\n");
+  mtcp_abort();
+#endif
+}
+
 #if 0
 // See note above.
 NO_OPTIMIZE
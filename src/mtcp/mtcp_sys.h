@@ -282,12 +282,21 @@ struct linux_dirent {
 #define mtcp_sys_munmap(args...)  mtcp_inline_syscall(munmap,2,args)
 #define mtcp_sys_mprotect(args...)  mtcp_inline_syscall(mprotect,3,args)
 #define mtcp_sys_nanosleep(args...)  mtcp_inline_syscall(nanosleep,2,args)
+#ifdef __NR_shmget
+/* i386 multiplexes the SysV IPC calls through ipc(); not supported there. */
+# define mtcp_sys_shmget(args...)  mtcp_inline_syscall(shmget,3,args)
+# define mtcp_sys_shmat(args...)  (void *)mtcp_inline_syscall(shmat,3,args)
+#endif
 #define mtcp_sys_brk(args...)  (void *)(mtcp_inline_syscall(brk,1,args))
 #define mtcp_sys_rt_sigaction(args...) mtcp_inline_syscall(rt_sigaction,4,args)
 #define mtcp_sys_set_tid_address(args...) \
   mtcp_inline_syscall(set_tid_address,1,args)
 
 //#define mtcp_sys_stat(args...) mtcp_inline_syscall(stat, 2, args)
+#if defined(__x86_64__) || defined(__aarch64__)
+/* The kernel and glibc agree on the layout of struct stat here. */
+# define mtcp_sys_fstat(args...) mtcp_inline_syscall(fstat, 2, args)
+#endif
 #define mtcp_sys_getuid(args...) mtcp_inline_syscall(getuid, 0)
 #define mtcp_sys_geteuid(args...) mtcp_inline_syscall(geteuid, 0)
 
@@ -30,6 +30,7 @@
 #include "protectedfds.h"
 #include "shareddata.h"
 #include "threadlist.h"
+#include "coordinatorapi.h"
 
 #include "../jalib/jfilesystem.h"
 #include "../jalib/jconvert.h"
@@ -65,10 +66,15 @@ void dmtcp::callbackSleepBetweenCheckpoint ( int sec )
   unmapRestoreArgv();
 }
 
-void dmtcp::callbackPreCheckpoint()
+// Returns false if the coordinator aborted the checkpoint.
+bool dmtcp::callbackPreCheckpoint()
 {
   //now user threads are stopped
-  DmtcpWorker::waitForStage2Checkpoint();
+  if (!DmtcpWorker::waitForStage2Checkpoint()) {
+    notify_ckpt_aborted();
+    return false;
+  }
+  return true;
 }
 
 void dmtcp::callbackPostCheckpoint(bool isRestart,
@@ -87,6 +93,10 @@ void dmtcp::callbackPostCheckpoint(bool isRestart,
     }
     DmtcpWorker::eventHook(DMTCP_EVENT_RESTART, NULL);
   } else {
+    // The image is complete by now (or being written by a forked child).
+    uint64_t imageSize, writeUsec;
+    CkptSerializer::lastImageStats(&imageSize, &writeUsec);
+    CoordinatorAPI::setCkptImageSize(imageSize);
     DmtcpWorker::eventHook(DMTCP_EVENT_RESUME, NULL);
   }
 
@@ -95,6 +105,7 @@ void dmtcp::callbackPostCheckpoint(bool isRestart,
   DmtcpWorker::waitForStage4Resume(isRestart);
 
   increment_counters(isRestart);
+  notify_ckpt_complete(isRestart);
 
   WorkerState::setCurrentState( WorkerState::RUNNING );
 
@@ -29,7 +29,7 @@ namespace dmtcp
   void initializeMtcpEngine();
 
   void callbackSleepBetweenCheckpoint(int sec);
-  void callbackPreCheckpoint();
+  bool callbackPreCheckpoint();
   void callbackPostCheckpoint(bool isRestart, char* mtcpRestoreArgvStartAddr);
   void callbackPreSuspendUserThread();
   void callbackPreResumeUserThread(bool isRestart);
@@ -40,5 +40,7 @@ namespace dmtcp
   void userHookTrampoline_postCkpt(bool isRestart);
 
   void increment_counters(int isRestart);
+  void notify_ckpt_complete(int isRestart);
+  void notify_ckpt_aborted();
 }
 #endif
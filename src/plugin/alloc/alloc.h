@@ -42,4 +42,34 @@ extern "C" void *__libc_memalign(size_t boundary, size_t size);
 #define _real_mmap64 NEXT_FNC_DEFAULT(mmap64)
 #define _real_munmap NEXT_FNC_DEFAULT(munmap)
 #define _real_mremap NEXT_FNC_DEFAULT(mremap)
+
+/* Instead of taking the wrapper-execution lock on every allocation, each
+ * thread marks itself as being inside the allocator.  If the checkpoint
+ * signal arrives while the marker is set, dmtcp_alloc_defer_ckpt_signal()
+ * (called from the signal handler) records it, and the thread re-raises it
+ * once it leaves the outermost allocator call.  This is the same scheme that
+ * ThreadSync uses for threads holding the wrapper-execution lock.
+ */
+#define ALLOC_TLS __thread __attribute__ ((tls_model("initial-exec")))
+extern ALLOC_TLS int dmtcpAllocDepth;
+extern ALLOC_TLS int dmtcpAllocPendingSignal;
+
+void dmtcp_alloc_raise_pending_signal();
+
+#define ENTER_ALLOCATOR() \
+  do { \
+    dmtcpAllocDepth++; \
+    __asm__ __volatile__ ("" : : : "memory"); \
+  } while (0)
+
+#define LEAVE_ALLOCATOR() \
+  do { \
+    __asm__ __volatile__ ("" : : : "memory"); \
+    if (--dmtcpAllocDepth == 0) { \
+      __asm__ __volatile__ ("" : : : "memory"); \
+      if (dmtcpAllocPendingSignal != 0) { \
+        dmtcp_alloc_raise_pending_signal(); \
+      } \
+    } \
+  } while (0)
 #endif //ALLOC_H
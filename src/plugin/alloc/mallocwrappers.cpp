@@ -19,6 +19,8 @@
  *  <http://www.gnu.org/licenses/>.                                         *
  ****************************************************************************/
 
+#include <errno.h>
+#include <signal.h>
 #include <stdlib.h>
 #include <unistd.h>
 #include "dmtcp.h"
@@ -26,11 +28,36 @@
 
 EXTERNC int dmtcp_alloc_enabled() { return 1; }
 
+ALLOC_TLS int dmtcpAllocDepth = 0;
+ALLOC_TLS int dmtcpAllocPendingSignal = 0;
+
+/* Called by libdmtcp from the checkpoint signal handler.  Returns 1 if the
+ * thread is inside the allocator; the signal is then re-raised from
+ * LEAVE_ALLOCATOR().
+ */
+EXTERNC int dmtcp_alloc_defer_ckpt_signal(int sig)
+{
+  if (dmtcpAllocDepth == 0) {
+    return 0;
+  }
+  dmtcpAllocPendingSignal = sig;
+  return 1;
+}
+
+void dmtcp_alloc_raise_pending_signal()
+{
+  int saved_errno = errno;
+  int sig = dmtcpAllocPendingSignal;
+  dmtcpAllocPendingSignal = 0;
+  raise(sig);
+  errno = saved_errno;
+}
+
 extern "C" void *calloc(size_t nmemb, size_t size)
 {
-  DMTCP_PLUGIN_DISABLE_CKPT();
+  ENTER_ALLOCATOR();
   void *retval = _real_calloc ( nmemb, size );
-  DMTCP_PLUGIN_ENABLE_CKPT();
+  LEAVE_ALLOCATOR();
   return retval;
 }
 
@@ -39,49 +66,49 @@ int dmtcpInMalloc = 0;
 extern "C" void *malloc(size_t size)
 {
   dmtcpInMalloc = 1;
-  DMTCP_PLUGIN_DISABLE_CKPT();
+  ENTER_ALLOCATOR();
   void *retval = _real_malloc ( size );
-  DMTCP_PLUGIN_ENABLE_CKPT();
+  LEAVE_ALLOCATOR();
   dmtcpInMalloc = 0;
   return retval;
 }
 
 extern "C" void *memalign(size_t boundary, size_t size)
 {
-  DMTCP_PLUGIN_DISABLE_CKPT();
+  ENTER_ALLOCATOR();
   void *retval = _real_memalign(boundary, size);
-  DMTCP_PLUGIN_ENABLE_CKPT();
+  LEAVE_ALLOCATOR();
   return retval;
 }
 
 extern "C" int posix_memalign(void **memptr, size_t alignment, size_t size)
 {
-  DMTCP_PLUGIN_DISABLE_CKPT();
+  ENTER_ALLOCATOR();
   int retval = _real_posix_memalign(memptr, alignment, size);
-  DMTCP_PLUGIN_ENABLE_CKPT();
+  LEAVE_ALLOCATOR();
   return retval;
 }
 
 extern "C" void *valloc(size_t size)
 {
-  DMTCP_PLUGIN_DISABLE_CKPT();
+  ENTER_ALLOCATOR();
   void *retval = _real_valloc(size);
-  DMTCP_PLUGIN_ENABLE_CKPT();
+  LEAVE_ALLOCATOR();
   return retval;
 }
 
 extern "C" void free(void *ptr)
 {
-  DMTCP_PLUGIN_DISABLE_CKPT();
+  ENTER_ALLOCATOR();
   _real_free ( ptr );
-  DMTCP_PLUGIN_ENABLE_CKPT();
+  LEAVE_ALLOCATOR();
 }
 
 extern "C" void *realloc(void *ptr, size_t size)
 {
-  DMTCP_PLUGIN_DISABLE_CKPT();
+  ENTER_ALLOCATOR();
   void *retval = _real_realloc ( ptr, size );
-  DMTCP_PLUGIN_ENABLE_CKPT();
+  LEAVE_ALLOCATOR();
   return retval;
 }
 
@@ -33,6 +33,8 @@ Connection::Connection(uint32_t t)
   , _fcntlOwner(-1)
   , _fcntlSignal(-1)
   , _hasLock(false)
+  , _lockPending(false)
+  , _ownerChanged(false)
 {}
 
 void Connection::addFd(int fd)
@@ -80,10 +82,15 @@ void Connection::restoreOptions()
     (_fds[0]) (_fcntlFlags) (JASSERT_ERRNO);
 
   errno = 0;
-  // Check to see if the owner is alive; if so, try to restore fd ownership.
-  if (kill(_fcntlOwner, 0) == 0) {
-    JASSERT(fcntl(_fds[0], F_SETOWN, (int)_fcntlOwner) == 0)
-      (_fds[0]) (_fcntlOwner) (JASSERT_ERRNO);
+  // Only applications doing async I/O set an owner.  Unless the fcntl()
+  // leader election replaced it, nothing else needs to be restored.
+  if (_fcntlOwner != 0 || _ownerChanged) {
+    // Check to see if the owner is alive; if so, try to restore fd ownership.
+    if (_fcntlOwner == 0 || kill(_fcntlOwner, 0) == 0) {
+      JASSERT(fcntl(_fds[0], F_SETOWN, (int)_fcntlOwner) == 0)
+        (_fds[0]) (_fcntlOwner) (JASSERT_ERRNO);
+    }
+    _ownerChanged = false;
   }
 
   //FIXME:  The comment below seems to be obsolete now.
@@ -92,24 +99,41 @@ void Connection::restoreOptions()
   //JASSERT(fcntl(_fds[0], F_GETOWN) == _fcntlOwner)
   //(fcntl(_fds[0], F_GETOWN)) (_fcntlOwner) (VIRTUAL_TO_REAL_PID(_fcntlOwner));
 
-  errno = 0;
-  JASSERT(fcntl(_fds[0], F_SETSIG, (int)_fcntlSignal) == 0)
-    (_fds[0]) (_fcntlSignal) (JASSERT_ERRNO);
+  if (_fcntlSignal != 0) {
+    errno = 0;
+    JASSERT(fcntl(_fds[0], F_SETSIG, (int)_fcntlSignal) == 0)
+      (_fds[0]) (_fcntlSignal) (JASSERT_ERRNO);
+  }
 }
 
+// Makes this connection a candidate for leadership of its open file
+// description.  Connections that do not call it are never leaders.
 void Connection::doLocking()
 {
-  errno = 0;
   _hasLock = false;
+  _lockPending = true;
+  _ownerChanged = false;
+}
+
+// Fallback for kernels without kcmp(): the last process to set itself as the
+// owner of the open file description is the leader.
+void Connection::fcntlLocking()
+{
+  errno = 0;
   JASSERT(fcntl(_fds[0], F_SETOWN, getpid()) == 0)
    (_fds[0]) (JASSERT_ERRNO);
+  _ownerChanged = true;
 }
 
 void Connection::checkLocking()
 {
+  if (!_lockPending) {
+    return;
+  }
   pid_t pid = fcntl(_fds[0], F_GETOWN);
   JASSERT(pid != -1);
   _hasLock = pid == getpid();
+  _lockPending = false;
 }
 
 void Connection::serialize(jalib::JBinarySerializer& o)
@@ -78,6 +78,10 @@ namespace dmtcp
       int32_t getMaxFd() { return _fds[0]; }
 
       void  checkLocking();
+      // Fd leader election; see ConnectionList::preCkptFdLeaderElection().
+      bool  isLockCandidate() const { return _lockPending; }
+      void  setLock(bool hasLock) { _hasLock = hasLock; _lockPending = false; }
+      void  fcntlLocking();
       const ConnectionIdentifier& id() const { return _id; }
 
       virtual void saveOptions();
@@ -106,6 +110,8 @@ namespace dmtcp
       int64_t              _fcntlOwner;
       int64_t              _fcntlSignal;
       bool                 _hasLock;
+      bool                 _lockPending;
+      bool                 _ownerChanged;
       vector<int32_t>      _fds;
   };
 }
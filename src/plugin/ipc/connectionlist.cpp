@@ -47,9 +47,11 @@
 // At the time of checkpoint, a leader election algorithm is used to decide
 //  on a unique process as leader, who will be responsible for restoring the
 //  state of a file descriptor (whether shared or not) at the time of restart.
-//  It is implemented through doLocking and checkLocking, in which each
-//  process uses fcntl() with SETOWN, and after a barrier, they check
-//  if they are still the owner using GETOWN.
+//  It is implemented in preCkptFdLeaderElection, in which each process
+//  enters its fd's in a per-host table in the shared area.  The first
+//  process to enter an open file description, as told by kcmp(), is its
+//  leader.  Without kcmp(), each process uses fcntl() with SETOWN, and
+//  after a barrier, they check if they are still the owner using GETOWN.
 // A list of connections (fd's) is found through /proc/*/fd and saved
 //  in the ConnectionList object.
 // At the time of restart, con->hasLock() will tell a process if it is the
@@ -102,7 +104,7 @@ void ConnectionList::eventHook(DmtcpEvent_t event,
 
     case DMTCP_EVENT_PRE_EXEC:
       {
-        jalib::JBinarySerializeWriterRaw wr("", data->serializerInfo.fd);
+        jalib::JBinarySerializeBufferedWriter wr("", data->serializerInfo.fd);
         serialize(wr);
       }
       break;
@@ -110,7 +112,7 @@ void ConnectionList::eventHook(DmtcpEvent_t event,
     case DMTCP_EVENT_POST_EXEC:
       {
         freshProcess = false;
-        jalib::JBinarySerializeReaderRaw rd("", data->serializerInfo.fd);
+        jalib::JBinarySerializeBufferedReader rd("", data->serializerInfo.fd);
         serialize(rd);
         deleteStaleConnections();
       }
@@ -434,10 +436,54 @@ void ConnectionList::preLockSaveOptions()
 void ConnectionList::preCkptFdLeaderElection()
 {
   deleteStaleConnections();
+  vector<Connection*> candidates;
+  vector<Connection*> anonCandidates;
+  vector<SharedData::FdLeaderMap> fds;
   for (iterator i = begin(); i != end(); ++i) {
     Connection *con = i->second;
     JASSERT(con->numFds() > 0);
+    con->setLock(false);
     con->doLocking();
+    if (!con->isLockCandidate()) {
+      continue;
+    }
+    // Epoll, eventfd, signalfd and inotify fds all share the one inode of
+    // the anon_inode filesystem, and would all probe the same chain of the
+    // leader table.  They use the fcntl() election instead.
+    switch (con->conType()) {
+      case Connection::EPOLL:
+      case Connection::EVENTFD:
+      case Connection::SIGNALFD:
+      case Connection::INOTIFY:
+        anonCandidates.push_back(con);
+        continue;
+      default:
+        break;
+    }
+    struct stat statbuf;
+    int fd = con->getFds()[0];
+    JASSERT(fstat(fd, &statbuf) == 0) (fd) (JASSERT_ERRNO);
+    SharedData::FdLeaderMap map;
+    memset(&map, 0, sizeof(map));
+    map.devnum = statbuf.st_dev;
+    map.inode = statbuf.st_ino;
+    map.fd = fd;
+    candidates.push_back(con);
+    fds.push_back(map);
+  }
+
+  vector<bool> isLeader;
+  if (SharedData::electFdLeaders(fds, &isLeader)) {
+    for (size_t i = 0; i < candidates.size(); i++) {
+      candidates[i]->setLock(isLeader[i]);
+    }
+  } else {
+    for (size_t i = 0; i < candidates.size(); i++) {
+      candidates[i]->fcntlLocking();
+    }
+  }
+  for (size_t i = 0; i < anonCandidates.size(); i++) {
+    anonCandidates[i]->fcntlLocking();
   }
 }
 
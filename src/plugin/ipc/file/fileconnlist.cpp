@@ -62,6 +62,7 @@
 #include <sys/socket.h>
 #include <sys/syscall.h>
 #include <sys/mman.h>
+#include <sys/sysmacros.h>
 #include <unistd.h>
 #include <mqueue.h>
 #include <stdint.h>
@@ -86,6 +87,7 @@ void dmtcp_FileConnList_EventHook(DmtcpEvent_t event, DmtcpEventData_t *data)
 static vector<ProcMapsArea> shmAreas;
 static vector<ProcMapsArea> unlinkedShmAreas;
 static vector<ProcMapsArea> missingUnlinkedShmFiles;
+static vector<ProcMapsArea> peerOwnedShmAreas;
 static vector<FileConnection*> shmAreaConn;
 static uint32_t virtPtyId = 0;
 
@@ -117,6 +119,30 @@ void FileConnList::preLockSaveOptions()
   ConnectionList::preLockSaveOptions();
 }
 
+void FileConnList::preCkptFdLeaderElection()
+{
+  ConnectionList::preCkptFdLeaderElection();
+
+  /* Elect a single process on this host to save the contents of each
+   * unlinked shared memory area.  The others only record a placeholder (see
+   * mtcp_writememoryareas()) and map the backing file recreated by the owner
+   * on restart.
+   */
+  vector<ProcMapsArea> ownedAreas;
+  for (size_t i = 0; i < unlinkedShmAreas.size(); i++) {
+    ProcMapsArea& area = unlinkedShmAreas[i];
+    dev_t devnum = makedev(area.devmajor, area.devminor);
+    if (SharedData::claimSharedArea(devnum, area.inodenum,
+                                    area.offset, area.size)) {
+      ownedAreas.push_back(area);
+    } else {
+      JLOG(FILEP)("Shared memory area saved by peer") (area.name);
+      peerOwnedShmAreas.push_back(area);
+    }
+  }
+  unlinkedShmAreas = ownedAreas;
+}
+
 void FileConnList::drain()
 {
   ConnectionList::drain();
@@ -212,6 +238,19 @@ void FileConnList::postRestart()
   ConnectionList::postRestart();
 }
 
+void FileConnList::registerNSData(bool isRestart)
+{
+  if (isRestart) {
+    // The backing file will be created as a result of restoreShmArea. We need
+    // to unlink all such files in the resume() call below. This is done one
+    // barrier ahead of refill() so that the processes that didn't save the
+    // area can map the recreated file in refill().
+    for (size_t i = 0; i < missingUnlinkedShmFiles.size(); i++) {
+      recreateShmFileAndMap(missingUnlinkedShmFiles[i]);
+    }
+  }
+}
+
 void FileConnList::refill(bool isRestart)
 {
   // Check comments in PtyConnection::preRefill()/refill()
@@ -224,10 +263,12 @@ void FileConnList::refill(bool isRestart)
   }
 
   if (isRestart) {
-    // The backing file will be created as a result of restoreShmArea. We need
-    // to unlink all such files in the resume() call below.
-    for (size_t i = 0; i < missingUnlinkedShmFiles.size(); i++) {
-      recreateShmFileAndMap(missingUnlinkedShmFiles[i]);
+    for (size_t i = 0; i < peerOwnedShmAreas.size(); i++) {
+      JASSERT(jalib::Filesystem::FileExists(peerOwnedShmAreas[i].name))
+        (peerOwnedShmAreas[i].name)
+        .Text("Shared memory area was saved by a process that did not "
+              "restart on this host");
+      restoreShmArea(peerOwnedShmAreas[i]);
     }
   }
 
@@ -258,6 +299,7 @@ void FileConnList::prepareShmList()
   shmAreas.clear();
   unlinkedShmAreas.clear();
   missingUnlinkedShmFiles.clear();
+  peerOwnedShmAreas.clear();
   shmAreaConn.clear();
   while (procSelfMaps.getNextArea(&area)) {
     if ((area.flags & MAP_SHARED) && area.prot != 0) {
@@ -46,8 +46,10 @@ namespace dmtcp
       static FileConnList& instance();
 
       virtual void preLockSaveOptions();
+      virtual void preCkptFdLeaderElection();
       virtual void drain();
       virtual void preCkpt();
+      virtual void registerNSData(bool isRestart);
       virtual void refill(bool isRestart);
       virtual void resume(bool isRestart);
       virtual void postRestart();
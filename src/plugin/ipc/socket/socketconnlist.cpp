@@ -45,7 +45,8 @@ void SocketConnList::preCkptRegisterNSData()
   for (iterator i = begin(); i != end(); ++i) {
     Connection *con = i->second;
     /* NOTE: We need to explicitly call checkLocking() here because
-     * _hasLock is set only in this function.
+     * with the fcntl() leader election, _hasLock is set only in this
+     * function.
      */
     con->checkLocking();
     if (con->hasLock() && con->conType() == Connection::TCP) {
@@ -94,14 +94,14 @@ static void pidVirt_PrepareForExec(DmtcpEventData_t *data)
   Util::setVirtualPidEnvVar(getpid(), virtPpid, realPpid);
 
   JASSERT(data != NULL);
-  jalib::JBinarySerializeWriterRaw wr ("", data->serializerInfo.fd);
+  jalib::JBinarySerializeBufferedWriter wr ("", data->serializerInfo.fd);
   VirtualPidTable::instance().serialize(wr);
 }
 
 static void pidVirt_PostExec(DmtcpEventData_t *data)
 {
   JASSERT(data != NULL);
-  jalib::JBinarySerializeReaderRaw rd ("", data->serializerInfo.fd);
+  jalib::JBinarySerializeBufferedReader rd ("", data->serializerInfo.fd);
   VirtualPidTable::instance().serialize(rd);
   VirtualPidTable::instance().refresh();
 }
@@ -32,6 +32,7 @@
 #include "util.h"
 #include "dmtcp.h"
 #include "shareddata.h"
+#include "procselfmaps.h"
 #include "jassert.h"
 #include "jfilesystem.h"
 #include "jconvert.h"
@@ -72,11 +73,11 @@ using namespace dmtcp;
  *     future conflicts.
  *  3. BARRIER -- CHECKPOINTED
  *  4. Read all original-shmids from the file
- *  5. Re-create shared-memory segments which were checkpointed by this process.
- *  6. Remap the shm-segment to a temp addr and copy the checkpointed contents
- *     to this address. Now unmap the area where the checkpointed contents were
- *     stored and map the shm-segment on that address. Unmap the temp addr now.
- *     Remap the shm-segment to the original location.
+ *  5. Find the shared-memory segments which were checkpointed by this process.
+ *  6. mtcp_restart has already re-created the shm-segment at the original
+ *     address and read the checkpointed contents directly into it (see
+ *     write_sysv_shm_area() in writeckpt.cpp). Look up the new shmid and, if
+ *     needed, re-attach it with the original shmat() flags.
  *  7. Write original->current mappings for all shmids which we got from
  *     shmget() in previous step.
  *  8. BARRIER -- REFILLED
@@ -90,6 +91,14 @@ using namespace dmtcp;
 
 static pthread_mutex_t tblLock = PTHREAD_MUTEX_INITIALIZER;
 
+/* Called by the ckpt-thread from mtcp_writememoryareas() while all user
+ * threads are suspended; so, don't take tblLock here.
+ */
+EXTERNC int dmtcp_svipc_shm_ckpt_info(const void *addr, int *key, int *shmflg)
+{
+  return SysVShm::instance().ckptLeaderInfo(addr, key, shmflg);
+}
+
 extern "C" void dmtcp_event_hook(DmtcpEvent_t event, DmtcpEventData_t *data)
 {
   switch (event) {
@@ -130,7 +139,7 @@ extern "C" void dmtcp_event_hook(DmtcpEvent_t event, DmtcpEventData_t *data)
 
     case DMTCP_EVENT_PRE_EXEC:
       {
-        jalib::JBinarySerializeWriterRaw wr("", data->serializerInfo.fd);
+        jalib::JBinarySerializeBufferedWriter wr("", data->serializerInfo.fd);
         SysVShm::instance().serialize(wr);
         SysVSem::instance().serialize(wr);
         SysVMsq::instance().serialize(wr);
@@ -139,7 +148,7 @@ extern "C" void dmtcp_event_hook(DmtcpEvent_t event, DmtcpEventData_t *data)
 
     case DMTCP_EVENT_POST_EXEC:
       {
-        jalib::JBinarySerializeReaderRaw rd("", data->serializerInfo.fd);
+        jalib::JBinarySerializeBufferedReader rd("", data->serializerInfo.fd);
         SysVShm::instance().serialize(rd);
         SysVSem::instance().serialize(rd);
         SysVMsq::instance().serialize(rd);
@@ -168,30 +177,6 @@ static void _do_unlock_tbl()
   JASSERT(_real_pthread_mutex_unlock(&tblLock) == 0) (JASSERT_ERRNO);
 }
 
-static void huge_memcpy(char *dest, char *src, size_t size)
-{
-  if (size < 100 * 1024 * 1024) {
-    memcpy(dest, src, size);
-    return;
-  }
-  const size_t hundredMB = (100 * 1024 * 1024);
-  //const size_t oneGB = (1024 * 1024 * 1024);
-  size_t chunkSize = hundredMB;
-  static long page_size = sysconf(_SC_PAGESIZE);
-  static long pagesPerChunk = chunkSize / page_size;
-  size_t n = size / chunkSize;
-  for (size_t i = 0; i < n; i++) {
-    if (!Util::areZeroPages(src, pagesPerChunk)) {
-      memcpy(dest, src, chunkSize);
-    }
-    madvise(src, chunkSize, MADV_DONTNEED);
-    dest += chunkSize;
-    src += chunkSize;
-    size -= chunkSize;
-  }
-  memcpy(dest, src, size);
-}
-
 static SysVShm *sysvShmInst = NULL;
 static SysVSem *sysvSemInst = NULL;
 static SysVMsq *sysvMsqInst = NULL;
@@ -439,6 +424,18 @@ void SysVShm::on_shmdt(const void *shmaddr)
   _do_unlock_tbl();
 }
 
+bool SysVShm::ckptLeaderInfo(const void *shmaddr, int *key, int *shmflg)
+{
+  for (Iterator i = _map.begin(); i != _map.end(); ++i) {
+    ShmSegment* shmObj = (ShmSegment*)i->second;
+    if (shmObj->isCkptLeaderAddr(shmaddr)) {
+      shmObj->ckptInfo(key, shmflg);
+      return true;
+    }
+  }
+  return false;
+}
+
 int SysVShm::shmaddrToShmid(const void* shmaddr)
 {
   DMTCP_PLUGIN_DISABLE_CKPT();
@@ -598,6 +595,18 @@ bool ShmSegment::isValidShmaddr(const void* shmaddr)
   return _shmaddrToFlag.find((void*)shmaddr) != _shmaddrToFlag.end();
 }
 
+bool ShmSegment::isCkptLeaderAddr(const void* shmaddr)
+{
+  return _isCkptLeader && !_shmaddrToFlag.empty() &&
+         _shmaddrToFlag.begin()->first == shmaddr;
+}
+
+void ShmSegment::ckptInfo(int *key, int *shmflg)
+{
+  *key = _key;
+  *shmflg = _flags;
+}
+
 bool ShmSegment::isStale()
 {
   struct shmid_ds shminfo;
@@ -672,29 +681,45 @@ void ShmSegment::postRestart()
 {
   if (!_isCkptLeader) return;
 
-  int tmpShmFlags = (_flags & IPC_CREAT) ? _flags : (_flags | IPC_CREAT);
-  key_t realKey = dmtcp_virtual_to_real_pid(getpid());
-  _realId = _real_shmget(realKey, _size, tmpShmFlags);
-  JASSERT(_realId != -1);
-  SysVShm::instance().updateMapping(_id, _realId);
-  SysVShm::instance().updateKeyMapping(_key, realKey);
-
-  // Re-map first address for owner on restart
-  JASSERT(_isCkptLeader);
+  // mtcp_restart re-created the segment at the first address and restored its
+  // contents in place. The inode of a SysV shm mapping is its shmid.
   ShmaddrToFlagIter i = _shmaddrToFlag.begin();
-  void *tmpaddr = _real_shmat(_realId, NULL, 0);
-  JASSERT(tmpaddr != (void*) -1) (_realId)(JASSERT_ERRNO);
-  huge_memcpy((char*) tmpaddr, (char*) i->first, _size);
-  JASSERT(_real_shmdt(tmpaddr) == 0);
-  munmap((void*)i->first, _size);
+  _realId = -1;
+  {
+    ProcSelfMaps procSelfMaps;
+    ProcMapsArea area;
+    while (procSelfMaps.getNextArea(&area)) {
+      if (area.addr == i->first && Util::isSysVShmArea(area)) {
+        _realId = area.inodenum;
+        break;
+      }
+    }
+  }
+  JASSERT(_realId != -1) (_id) (i->first)
+    .Text("Restored shared memory segment not found");
+  SysVShm::instance().updateMapping(_id, _realId);
+  if (_key != IPC_PRIVATE) {
+    // mtcp_restart picked a key that was free on this host.
+    struct shmid_ds info;
+    JASSERT(_real_shmctl(_realId, IPC_STAT, &info) != -1)
+      (_realId) (JASSERT_ERRNO);
+    SysVShm::instance().updateKeyMapping(_key, info.shm_perm.__key);
+  }
 
-  if (!_dmtcpMappedAddr) {
+  // mtcp_restart attached the segment read-write. Detach it if it was mapped
+  // only for the checkpoint, and re-attach with the original shmat() flags
+  // otherwise.
+  if (_dmtcpMappedAddr || i->second != 0) {
+    JASSERT(_real_shmdt(i->first) == 0) (JASSERT_ERRNO) (_realId) (i->first);
+  }
+  if (!_dmtcpMappedAddr && i->second != 0) {
     JASSERT (_real_shmat(_realId, i->first, i->second) != (void *) -1)
       (JASSERT_ERRNO) (_realId) (_id) (_isCkptLeader)
       (i->first) (i->second) (getpid())
       .Text ("Error remapping shared memory segment on restart");
   }
-  JLOG(SYSV)("Remapping shared memory segment to original address") (_id) (_realId);
+  JLOG(SYSV)("Restored shared memory segment at original address")
+    (_id) (_realId);
 }
 
 void ShmSegment::refill(bool isRestart)
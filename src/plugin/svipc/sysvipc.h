@@ -127,6 +127,7 @@ namespace dmtcp
       static SysVShm& instance();
 
       int  shmaddrToShmid(const void* shmaddr);
+      bool ckptLeaderInfo(const void *shmaddr, int *key, int *shmflg);
       virtual void on_shmget(int shmid, key_t realKey, key_t key,
                              size_t size, int shmflg);
       virtual void on_shmat(int shmid, const void *shmaddr, int shmflg,
@@ -227,6 +228,8 @@ namespace dmtcp
       virtual void preResume();
 
       bool isValidShmaddr(const void* shmaddr);
+      bool isCkptLeaderAddr(const void* shmaddr);
+      void ckptInfo(int *key, int *shmflg);
       void remapAll();
       void remapFirstAddrForOwnerOnRestart();
 
@@ -72,7 +72,7 @@ void dmtcp_ProcessInfo_EventHook(DmtcpEvent_t event, DmtcpEventData_t *data)
 
     case DMTCP_EVENT_PRE_EXEC:
       {
-        jalib::JBinarySerializeWriterRaw wr("", data->serializerInfo.fd);
+        jalib::JBinarySerializeBufferedWriter wr("", data->serializerInfo.fd);
         ProcessInfo::instance().refresh();
         ProcessInfo::instance().serialize(wr);
       }
@@ -80,7 +80,7 @@ void dmtcp_ProcessInfo_EventHook(DmtcpEvent_t event, DmtcpEventData_t *data)
 
     case DMTCP_EVENT_POST_EXEC:
       {
-        jalib::JBinarySerializeReaderRaw rd("", data->serializerInfo.fd);
+        jalib::JBinarySerializeBufferedReader rd("", data->serializerInfo.fd);
         ProcessInfo::instance().serialize(rd);
         ProcessInfo::instance().postExec();
       }
@@ -148,6 +148,7 @@ void dmtcp_ProcessInfo_EventHook(DmtcpEvent_t event, DmtcpEventData_t *data)
     case DMTCP_EVENT_THREADS_RESUME:
       if (data->refillInfo.isRestart) {
         _real_close(PROTECTED_ENVIRON_FD);
+        ProcessInfo::instance().regenerateExcludedRegions();
       }
       break;
 
@@ -173,6 +174,8 @@ ProcessInfo::ProcessInfo()
     // _generation is updated when _this_ process begins its checkpoint.
   _childTable.clear();
   _pthreadJoinId.clear();
+  _excludedRegions.clear();
+  _excludedRegionCallback = NULL;
   _procSelfExe = jalib::Filesystem::ResolveSymlink("/proc/self/exe");
   _maxUserFd = -1;
   _uppid = UniquePid();
@@ -399,6 +402,72 @@ void ProcessInfo::restoreHeap()
   }
 }
 
+bool ProcessInfo::excludeRegion(uint64_t addr, uint64_t len, int policy)
+{
+  uint64_t pageSize = Util::pageSize();
+  uint64_t start = addr & ~(pageSize - 1);
+  uint64_t end = (addr + len + pageSize - 1) & ~(pageSize - 1);
+
+  if (len == 0 || end < start ||
+      (policy != DMTCP_EXCLUDE_SKIP && policy != DMTCP_EXCLUDE_ZERO &&
+       policy != DMTCP_EXCLUDE_FILE)) {
+    return false;
+  }
+
+  includeRegion(start, end - start);
+  ExcludedRegion region = { start, end - start, policy };
+  vector<ExcludedRegion>::iterator it = _excludedRegions.begin();
+  while (it != _excludedRegions.end() && it->addr < start) {
+    it++;
+  }
+  _excludedRegions.insert(it, region);
+  JLOG(DMTCP)("excluding region from checkpoint")
+    ((void*) start) (end - start) (policy);
+  return true;
+}
+
+bool ProcessInfo::includeRegion(uint64_t addr, uint64_t len)
+{
+  uint64_t pageSize = Util::pageSize();
+  uint64_t start = addr & ~(pageSize - 1);
+  uint64_t end = (addr + len + pageSize - 1) & ~(pageSize - 1);
+  if (end < start) {
+    return false;
+  }
+
+  // Trim every overlapping region down to the parts outside [start, end).
+  vector<ExcludedRegion> regions;
+  for (size_t i = 0; i < _excludedRegions.size(); i++) {
+    const ExcludedRegion& r = _excludedRegions[i];
+    uint64_t rEnd = r.addr + r.len;
+    if (rEnd <= start || r.addr >= end) {
+      regions.push_back(r);
+      continue;
+    }
+    if (r.addr < start) {
+      ExcludedRegion head = { r.addr, start - r.addr, r.policy };
+      regions.push_back(head);
+    }
+    if (rEnd > end) {
+      ExcludedRegion tail = { end, rEnd - end, r.policy };
+      regions.push_back(tail);
+    }
+  }
+  _excludedRegions.swap(regions);
+  return true;
+}
+
+void ProcessInfo::regenerateExcludedRegions()
+{
+  if (_excludedRegionCallback == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < _excludedRegions.size(); i++) {
+    const ExcludedRegion& r = _excludedRegions[i];
+    _excludedRegionCallback((void*) r.addr, r.len, r.policy);
+  }
+}
+
 void ProcessInfo::restart()
 {
   // Unmap the restore buffer and remap it with PROT_NONE. We do munmap followed
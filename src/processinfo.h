@@ -123,10 +123,29 @@ namespace dmtcp
       void setCkptFilename(const char*);
       void updateCkptDirFileSubdir(string newCkptDir = "");
 
+      // Regions excluded with dmtcp_ckpt_exclude_region(); sorted by address
+      // and non-overlapping.  Not serialized: they don't survive an exec.
+      struct ExcludedRegion {
+        uint64_t addr;
+        uint64_t len;
+        int      policy;
+      };
+      typedef void (*ExcludedRegionCallback)(void *addr, size_t len,
+                                             int policy);
+      bool excludeRegion(uint64_t addr, uint64_t len, int policy);
+      bool includeRegion(uint64_t addr, uint64_t len);
+      const vector<ExcludedRegion>& excludedRegions() const
+        { return _excludedRegions; }
+      void setExcludedRegionCallback(ExcludedRegionCallback fn)
+        { _excludedRegionCallback = fn; }
+      void regenerateExcludedRegions();
+
     private:
       map<pid_t, UniquePid> _childTable;
       map<pthread_t, pthread_t> _pthreadJoinId;
       map<pid_t, pid_t> _sessionIds;
+      vector<ExcludedRegion> _excludedRegions;
+      ExcludedRegionCallback _excludedRegionCallback;
       typedef map<pid_t, UniquePid>::iterator iterator;
 
       uint32_t  _isRootOfProcessTree;
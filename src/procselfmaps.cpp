@@ -19,23 +19,71 @@
  *  <http://www.gnu.org/licenses/>.                                         *
  ****************************************************************************/
 
+#include <errno.h>
 #include <fcntl.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include "util.h"
 #include "procselfmaps.h"
 #include "syscallwrappers.h"
 #include "jassert.h"
 
+// PROCMAP_QUERY (Linux 6.11) returns one area per ioctl on /proc/self/maps,
+// without formatting and parsing text.  Define it for older headers.
+#ifndef PROCMAP_QUERY
+struct procmap_query {
+  uint64_t size;
+  uint64_t query_flags;
+  uint64_t query_addr;
+  uint64_t vma_start;
+  uint64_t vma_end;
+  uint64_t vma_flags;
+  uint64_t vma_page_size;
+  uint64_t vma_offset;
+  uint64_t inode;
+  uint32_t dev_major;
+  uint32_t dev_minor;
+  uint32_t vma_name_size;
+  uint32_t build_id_size;
+  uint64_t vma_name_addr;
+  uint64_t build_id_addr;
+};
+# define PROCMAP_QUERY _IOWR('f', 17, struct procmap_query)
+# define PROCMAP_QUERY_VMA_READABLE         0x01
+# define PROCMAP_QUERY_VMA_WRITABLE         0x02
+# define PROCMAP_QUERY_VMA_EXECUTABLE       0x04
+# define PROCMAP_QUERY_VMA_SHARED           0x08
+# define PROCMAP_QUERY_COVERING_OR_NEXT_VMA 0x10
+#endif
+
 using namespace dmtcp;
 
+// The arena is kept across snapshots and checkpoints.  It holds the area
+// records, followed by the area names (or by the raw text of
+// /proc/self/maps, if PROCMAP_QUERY isn't available).  A snapshot taken
+// while another one is alive gets a private arena instead.
+static char *sharedArena = NULL;
+static size_t sharedArenaSize = 0;
+static int sharedArenaInUse = 0;
+static size_t lastNumAreas = 0;
+static size_t lastNumNameBytes = 0;
+static bool useProcmapQuery = true;
 
 ProcSelfMaps::ProcSelfMaps()
-  : dataIdx(0),
+  : arena(NULL),
+    arenaSize(0),
+    areas(NULL),
+    names(NULL),
+    maxAreas(0),
+    maxNameBytes(0),
+    ownArena(false),
+    areaIdx(0),
     numAreas(0),
-    numBytes(0),
-    fd(-1),
+    numNameBytes(0),
     numAllocExpands(0)
 {
-  char buf[4096];
   // NOTE: preExpand() verifies that we have at least 10 chunks pre-allocated
   //   for each level of the allocator.  See jalib/jalloc.cpp:preExpand().
   //   It assumes no allocation larger than jalloc.cpp:MAX_CHUNKSIZE.
@@ -51,50 +99,53 @@ ProcSelfMaps::ProcSelfMaps()
   //   setcontext() on the various threads will be a memory leak on restart.
   //   We should check for that.
 
-  fd = _real_open("/proc/self/maps", O_RDONLY);
+  ownArena = !__sync_bool_compare_and_swap(&sharedArenaInUse, 0, 1);
+
+  int fd = _real_open("/proc/self/maps", O_RDONLY);
   JASSERT(fd != -1) (JASSERT_ERRNO);
-  ssize_t numRead = 0;
 
-  // Get an approximation of the required buffer size.
-  do {
-    numRead = Util::readAll(fd, buf, sizeof(buf));
-    if (numRead > 0) {
-      numBytes += numRead;
+  // Size the arena from the previous snapshot, with some headroom.  If it
+  // turns out to be too small, grow it and start over; growing it changes
+  // /proc/self/maps anyway.
+  size_t wantAreas = lastNumAreas + lastNumAreas / 4 + 1024;
+  size_t wantNameBytes = lastNumNameBytes + lastNumNameBytes / 4 + 64 * 1024;
+  while (true) {
+    allocArena(wantAreas, wantNameBytes);
+    if (useProcmapQuery) {
+      int rc = queryAreas(fd);
+      if (rc == 1) {
+        break;
+      } else if (rc == -1) {
+        JLOG(DMTCP)("PROCMAP_QUERY not available; parsing /proc/self/maps");
+        useProcmapQuery = false;
+        continue;
+      }
+    } else {
+      JASSERT(lseek(fd, 0, SEEK_SET) == 0) (JASSERT_ERRNO);
+      if (readText(fd) && parseText()) {
+        break;
+      }
     }
-  } while (numRead > 0);
-
-  // Now allocate a buffer. Note that this will most likely change the layout
-  // of /proc/self/maps, so we need to recalculate numBytes.
-  size_t size = numBytes + 4096; // Add a one page buffer.
-  data = (char*) JALLOC_HELPER_MALLOC(size);
-  JASSERT(lseek(fd, 0, SEEK_SET) == 0);
-
-  numBytes = Util::readAll(fd, data, size);
-  JASSERT(numBytes > 0) (numBytes);
-
-  // TODO(kapil): Replace this assert with more robust code that would
-  // reallocate the buffer with an extended size.
-  JASSERT(numBytes < size) (numBytes) (size);
-
-  // TODO(kapil): Validate the read data.
-  JASSERT(isValidData());
+    wantAreas = 2 * maxAreas;
+    wantNameBytes = 2 * maxNameBytes;
+  }
 
   _real_close(fd);
-
-  for (size_t i = 0; i < numBytes; i++) {
-    if (data[i] == '\n') {
-      numAreas++;
-    }
-  }
+  lastNumAreas = numAreas;
+  lastNumNameBytes = numNameBytes;
 }
 
 ProcSelfMaps::~ProcSelfMaps()
 {
-  JALLOC_HELPER_FREE(data);
-  fd = -1;
-  dataIdx = 0;
+  if (ownArena) {
+    _real_munmap(arena, arenaSize);
+  } else {
+    __sync_lock_release(&sharedArenaInUse);
+  }
+  arena = NULL;
+  areaIdx = 0;
   numAreas = 0;
-  numBytes = 0;
+  numNameBytes = 0;
   // Verify that JAlloc doesn't expand memory (via mmap)
   //   while reading /proc/self/maps.
   // FIXME:  Change from JWARNING to JASSERT when we have confidence in this.
@@ -104,35 +155,119 @@ ProcSelfMaps::~ProcSelfMaps()
                 "  Inconsistent JAlloc will be a problem on restart");
 }
 
-bool ProcSelfMaps::isValidData()
+bool ProcSelfMaps::isArenaAddr(VA addr)
 {
-  // TODO(kapil): Add validation check.
-  return true;
+  return sharedArena != NULL &&
+         addr >= (VA) sharedArena && addr < (VA) sharedArena + sharedArenaSize;
 }
 
-unsigned long int ProcSelfMaps::readDec()
+void ProcSelfMaps::allocArena(size_t wantAreas, size_t wantNameBytes)
 {
-  unsigned long int v = 0;
+  size_t pageSize = Util::pageSize();
+  size_t size = wantAreas * sizeof(Record) + wantNameBytes;
+  size = (size + pageSize - 1) & ~(pageSize - 1);
 
-  while (1) {
-    char c = data[dataIdx];
-    if ((c >= '0') && (c <= '9')) {
-      c -= '0';
-    } else {
-      break;
+  if (ownArena) {
+    if (arena != NULL) {
+      _real_munmap(arena, arenaSize);
     }
-    v = v * 10 + c;
-    dataIdx++;
+    arena = (char*) _real_mmap(NULL, size, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    JASSERT(arena != MAP_FAILED) (size) (JASSERT_ERRNO);
+    arenaSize = size;
+  } else {
+    if (sharedArenaSize < size) {
+      if (sharedArena != NULL) {
+        _real_munmap(sharedArena, sharedArenaSize);
+      }
+      sharedArena = (char*) _real_mmap(NULL, size, PROT_READ | PROT_WRITE,
+                                       MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      JASSERT(sharedArena != MAP_FAILED) (size) (JASSERT_ERRNO);
+      sharedArenaSize = size;
+    }
+    arena = sharedArena;
+    arenaSize = sharedArenaSize;
+  }
+
+  maxAreas = wantAreas;
+  maxNameBytes = arenaSize - wantAreas * sizeof(Record);
+  areas = (Record*) arena;
+  names = arena + wantAreas * sizeof(Record);
+  numAreas = 0;
+  numNameBytes = 0;
+}
+
+/* Returns 1 on success, 0 if the arena is too small, and -1 if the kernel
+ * doesn't support PROCMAP_QUERY.
+ */
+int ProcSelfMaps::queryAreas(int fd)
+{
+  struct procmap_query q;
+  uint64_t addr = 0;
+
+  while (true) {
+    if (numAreas == maxAreas || maxNameBytes - numNameBytes < FILENAMESIZE) {
+      return 0;
+    }
+    memset(&q, 0, sizeof(q));
+    q.size = sizeof(q);
+    q.query_flags = PROCMAP_QUERY_COVERING_OR_NEXT_VMA;
+    q.query_addr = addr;
+    q.vma_name_addr = (uint64_t) (names + numNameBytes);
+    q.vma_name_size = FILENAMESIZE;
+    if (_real_syscall(SYS_ioctl, fd, PROCMAP_QUERY, &q) == -1) {
+      if (errno == ENOENT) {
+        return 1;
+      }
+      JASSERT(numAreas == 0 && errno != ENAMETOOLONG) (errno) (numAreas);
+      return -1;
+    }
+
+    Record *r = &areas[numAreas++];
+    r->addr = q.vma_start;
+    r->endAddr = q.vma_end;
+    r->offset = q.vma_offset;
+    r->inodenum = q.inode;
+    r->devmajor = q.dev_major;
+    r->devminor = q.dev_minor;
+    r->prot = 0;
+    if (q.vma_flags & PROCMAP_QUERY_VMA_READABLE) {
+      r->prot |= PROT_READ;
+    }
+    if (q.vma_flags & PROCMAP_QUERY_VMA_WRITABLE) {
+      r->prot |= PROT_WRITE;
+    }
+    if (q.vma_flags & PROCMAP_QUERY_VMA_EXECUTABLE) {
+      r->prot |= PROT_EXEC;
+    }
+    r->shared = (q.vma_flags & PROCMAP_QUERY_VMA_SHARED) != 0;
+
+    // Same names as parseText() would record; vma_name_size counts the NUL.
+    const char *name = names + numNameBytes;
+    r->nameOffset = numNameBytes;
+    r->nameLen = 0;
+    if (q.vma_name_size > 1 &&
+        (name[0] == '/' || name[0] == '[' || name[0] == '(')) {
+      r->nameLen = q.vma_name_size - 1;
+      numNameBytes += r->nameLen;
+    }
+    addr = q.vma_end;
   }
-  return v;
 }
 
-unsigned long int ProcSelfMaps::readHex()
+/* Read all of /proc/self/maps into names.  Returns false if it didn't fit. */
+bool ProcSelfMaps::readText(int fd)
 {
-  unsigned long int v = 0;
+  numNameBytes = Util::readAll(fd, names, maxNameBytes);
+  JASSERT((ssize_t) numNameBytes > 0) (numNameBytes) (JASSERT_ERRNO);
+  return numNameBytes < maxNameBytes;
+}
 
+static inline uint64_t readHex(const char **p)
+{
+  uint64_t v = 0;
   while (1) {
-    char c = data[dataIdx];
+    char c = **p;
     if ((c >= '0') && (c <= '9')) {
       c -= '0';
     } else if ((c >= 'a') && (c <= 'f')) {
@@ -143,96 +278,106 @@ unsigned long int ProcSelfMaps::readHex()
       break;
     }
     v = v * 16 + c;
-    dataIdx++;
+    (*p)++;
   }
   return v;
 }
 
-int ProcSelfMaps::getNextArea(ProcMapsArea* area)
+static inline uint64_t readDec(const char **p)
 {
-  char rflag, sflag, wflag, xflag;
-
-  if (dataIdx >= numBytes || data[dataIdx] == 0) {
-    return 0;
+  uint64_t v = 0;
+  while (**p >= '0' && **p <= '9') {
+    v = v * 10 + (**p - '0');
+    (*p)++;
   }
+  return v;
+}
 
-  area->addr = (VA) readHex();
-  JASSERT(area->addr != NULL);
-
-  JASSERT(data[dataIdx++] == '-');
-
-  area->endAddr = (VA) readHex();
-  JASSERT(area->endAddr != NULL);
-
-  JASSERT(data[dataIdx++] == ' ');
-
-  JASSERT(area->endAddr >= area->addr);
-  area->size = area->endAddr - area->addr;
-
-  rflag = data[dataIdx++];
-  JASSERT((rflag == 'r') || (rflag == '-'));
-
-  wflag = data[dataIdx++];
-  JASSERT((wflag == 'w') || (wflag == '-'));
-
-  xflag = data[dataIdx++];
-  JASSERT((xflag == 'x') || (xflag == '-'));
-
-  sflag = data[dataIdx++];
-  JASSERT((sflag == 's') || (sflag == 'p'));
-
-  JASSERT(data[dataIdx++] == ' ');
-
-  area->offset = readHex();
-  JASSERT(data[dataIdx++] == ' ');
-
-  area->devmajor = readHex();
-  JASSERT(data[dataIdx++] == ':');
-
-  area->devminor = readHex();
-  JASSERT(data[dataIdx++] == ' ');
-
-  area->inodenum = readDec();
+/* Parse the text in names into records; the records refer to the names in
+ * place.  Returns false if there are more areas than records.
+ */
+bool ProcSelfMaps::parseText()
+{
+  const char *p = names;
+  const char *end = names + numNameBytes;
 
-  while (data[dataIdx] == ' ') {
-    dataIdx++;
-  }
+  while (p < end && *p != '\0') {
+    if (numAreas == maxAreas) {
+      return false;
+    }
+    Record *r = &areas[numAreas++];
 
-  area -> name[0] = '\0';
-  if (data[dataIdx] == '/' || data[dataIdx] == '[' || data[dataIdx] == '(') {
-    // absolute pathname, or [stack], [vdso], etc.
-    // On some machines, deleted files have a " (deleted)" prefix to the
-    // filename.
-    size_t i = 0;
-    while (data[dataIdx] != '\n') {
-      area->name[i++] = data[dataIdx++];
-      JASSERT(i < sizeof(area->name));
-    }
-    area -> name[i] = '\0';
-  }
+    r->addr = readHex(&p);
+    bool ok = *p++ == '-';
+    r->endAddr = readHex(&p);
+    ok = ok && *p++ == ' ' && r->endAddr > r->addr;
 
-  JASSERT(data[dataIdx++] == '\n');
+    r->prot = 0;
+    if (p[0] == 'r') {
+      r->prot |= PROT_READ;
+    }
+    if (p[1] == 'w') {
+      r->prot |= PROT_WRITE;
+    }
+    if (p[2] == 'x') {
+      r->prot |= PROT_EXEC;
+    }
+    r->shared = p[3] == 's';
+    ok = ok && (p[3] == 's' || p[3] == 'p') && p[4] == ' ';
+    p += 5;
+
+    r->offset = readHex(&p);
+    ok = ok && *p++ == ' ';
+    r->devmajor = readHex(&p);
+    ok = ok && *p++ == ':';
+    r->devminor = readHex(&p);
+    ok = ok && *p++ == ' ';
+    r->inodenum = readDec(&p);
+    while (*p == ' ') {
+      p++;
+    }
 
-  area -> prot = 0;
-  if (rflag == 'r') {
-    area -> prot |= PROT_READ;
-  }
-  if (wflag == 'w') {
-    area -> prot |= PROT_WRITE;
-  }
-  if (xflag == 'x') {
-    area -> prot |= PROT_EXEC;
+    // Absolute pathname, or [stack], [vdso], etc.  On some machines, deleted
+    // files have a " (deleted)" prefix to the filename.
+    const char *name = p;
+    while (p < end && *p != '\n') {
+      p++;
+    }
+    r->nameOffset = name - names;
+    r->nameLen = 0;
+    if (*name == '/' || *name == '[' || *name == '(') {
+      r->nameLen = p - name;
+    }
+    JASSERT(ok && p < end) (numAreas) (r->addr);
+    p++;
   }
+  return true;
+}
 
-  area -> flags = MAP_FIXED;
-  if (sflag == 's') {
-    area -> flags |= MAP_SHARED;
-  }
-  if (sflag == 'p') {
-    area -> flags |= MAP_PRIVATE;
+int ProcSelfMaps::getNextArea(ProcMapsArea* area)
+{
+  if (areaIdx >= numAreas) {
+    return 0;
   }
-  if (area -> name[0] == '\0') {
-    area -> flags |= MAP_ANONYMOUS;
+  const Record *r = &areas[areaIdx++];
+
+  area->addr = (VA) r->addr;
+  area->endAddr = (VA) r->endAddr;
+  area->size = r->endAddr - r->addr;
+  area->offset = r->offset;
+  area->devmajor = r->devmajor;
+  area->devminor = r->devminor;
+  area->inodenum = r->inodenum;
+  area->prot = r->prot;
+
+  JASSERT(r->nameLen < sizeof(area->name)) (r->nameLen);
+  memcpy(area->name, names + r->nameOffset, r->nameLen);
+  area->name[r->nameLen] = '\0';
+
+  area->flags = MAP_FIXED;
+  area->flags |= r->shared ? MAP_SHARED : MAP_PRIVATE;
+  if (area->name[0] == '\0') {
+    area->flags |= MAP_ANONYMOUS;
   }
 
   area->properties = 0;
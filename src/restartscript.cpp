@@ -273,6 +273,11 @@ static const char* rstrtCmdProcessing =
   "  coord_logfile=\"--coord-logfile $DMTCP_COORD_LOGFILE\"\n"
   "fi\n\n"
 
+  "local_ckpt_dir=\n"
+  "if [ ! -z \"$DMTCP_LOCAL_CKPT_DIR\" ]; then\n"
+  "  local_ckpt_dir=\"--local-ckptdir $DMTCP_LOCAL_CKPT_DIR\"\n"
+  "fi\n\n"
+
   "  check_local $worker_host\n"
   "  if [ \"$is_local_node\" -eq 1 -o \"$num_worker_hosts\" == \"1\" ]; then\n"
   "    localhost_ckpt_files_group=\"$new_ckpt_files_group $localhost_ckpt_files_group\"\n"
@@ -284,7 +289,7 @@ static const char* rstrtCmdProcessing =
   "      $dmt_rstr_cmd --coord-host \"$coord_host\""
                                              " --cord-port \"$coord_port\"\\\n"
   "      $ckpt_dir --join-coordinator --interval \"$checkpoint_interval\""
-                                             " $tmpdir \\\n"
+                                             " $tmpdir $local_ckpt_dir \\\n"
   "      $new_ckpt_files_group\n"
   "  else\n"
   "    $maybexterm /usr/bin/$remote_shell_cmd \"$worker_host\" \\\n"
@@ -293,14 +298,14 @@ static const char* rstrtCmdProcessing =
   "      \"/bin/sh -c \'$dmt_rstr_cmd --coord-host $coord_host"
                                                 " --coord-port $coord_port $coord_logfile\\\n"
   "      $ckpt_dir --join-coordinator --interval \"$checkpoint_interval\""
-                                                " $tmpdir \\\n"
+                                                " $tmpdir $local_ckpt_dir \\\n"
   "      $new_ckpt_files_group\'\" &\n"
   "  fi\n\n"
   "done\n\n"
   "if [ -n \"$localhost_ckpt_files_group\" ]; then\n"
   "exec $dmt_rstr_cmd --coord-host \"$coord_host\""
                                            " --coord-port \"$coord_port\" $coord_logfile \\\n"
-  "  $ckpt_dir $maybejoin --interval \"$checkpoint_interval\" $tmpdir $noStrictChecking $localhost_ckpt_files_group\n"
+  "  $ckpt_dir $maybejoin --interval \"$checkpoint_interval\" $tmpdir $local_ckpt_dir $noStrictChecking $localhost_ckpt_files_group\n"
   "fi\n\n"
 
   "#wait for them all to finish\n"
@@ -308,6 +313,7 @@ static const char* rstrtCmdProcessing =
 ;
 
 void writeScript(const string& ckptDir,
+                 const string& localCkptDir,
                  bool uniqueCkptFilenames,
                  const time_t& ckptTimeStamp,
                  const uint32_t theCheckpointInterval,
@@ -384,6 +390,16 @@ void writeScript(const string& ckptDir,
                 "export DMTCP_CHECKPOINT_INTERVAL=${checkpoint_interval}\n\n",
                 hostname, thePort, theCheckpointInterval );
 
+  if (!localCkptDir.empty()) {
+    fprintf ( fp, "# Images were first written to this node-local dir;"
+                  " dmtcp_restart\n"
+                  "# uses a copy found there in preference to the one listed"
+                  " below.\n"
+                  "if test -z \"$" ENV_VAR_LOCAL_CKPT_DIR "\"; then\n"
+                  "  " ENV_VAR_LOCAL_CKPT_DIR "=%s\nfi\n\n",
+                  localCkptDir.c_str() );
+  }
+
   fprintf ( fp, "%s", cmdlineArgHandler );
 
   fprintf ( fp, "dmt_rstr_cmd=%s/" DMTCP_RESTART_CMD "\n"
@@ -31,6 +31,7 @@ namespace dmtcp {
 namespace RestartScript {
 
   void writeScript(const string& ckptDir,
+                   const string& localCkptDir,
                    bool uniqueCkptFilenames,
                    const time_t& ckptTimeStamp,
                    const uint32_t theCheckpointInterval,
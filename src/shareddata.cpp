@@ -24,6 +24,10 @@
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/ipc.h>
+#include <sys/syscall.h>
+#ifdef SYS_kcmp
+# include <linux/kcmp.h>
+#endif
 
 #include "constants.h"
 #include "protectedfds.h"
@@ -202,6 +206,10 @@ void SharedData::prepareForCkpt()
 {
   sharedDataHeader->numInodeConnIdMaps = 0;
   sharedDataHeader->numIncomingConMaps = 0;
+  sharedDataHeader->numSharedAreaOwnerMaps = 0;
+  // Invalidates all fdLeaderMap entries.  Every process does it before the
+  // SUSPENDED barrier, so it is done before anyone starts the election.
+  __sync_fetch_and_add(&sharedDataHeader->fdLeaderGeneration, 1);
   WMB;
 }
 
@@ -622,6 +630,148 @@ bool SharedData::getCkptLeaderForFile(dev_t devnum, ino_t inode, void *id)
   return false;
 }
 
+static SharedData::SharedAreaOwnerMap *
+findSharedArea(dev_t devnum, ino_t inode, off_t offset, size_t size)
+{
+  for (size_t i = 0; i < sharedDataHeader->numSharedAreaOwnerMaps; i++) {
+    SharedData::SharedAreaOwnerMap& map = sharedDataHeader->sharedAreaOwnerMap[i];
+    if (map.devnum == devnum && map.inode == inode &&
+        map.offset == (uint64_t) offset && map.size == size) {
+      return &map;
+    }
+  }
+  return NULL;
+}
+
+/* The first process to claim a region becomes its ckpt owner.  Returns true
+ * if the calling process owns the region.  If the table is full, the caller
+ * is told that it owns the region so that it still gets written.
+ */
+bool SharedData::claimSharedArea(dev_t devnum, ino_t inode, off_t offset,
+                                 size_t size)
+{
+  if (sharedDataHeader == NULL) initialize();
+  DmtcpUniqueProcessId self = UniquePid::ThisProcess().upid();
+  bool isOwner = true;
+  Util::lockFile(PROTECTED_SHM_FD);
+  SharedAreaOwnerMap *map = findSharedArea(devnum, inode, offset, size);
+  if (map != NULL) {
+    isOwner = map->owner == self;
+  } else if (sharedDataHeader->numSharedAreaOwnerMaps < MAX_SHARED_AREA_MAPS) {
+    map = &sharedDataHeader->sharedAreaOwnerMap[
+             sharedDataHeader->numSharedAreaOwnerMaps++];
+    map->devnum = devnum;
+    map->inode = inode;
+    map->offset = offset;
+    map->size = size;
+    map->owner = self;
+  } else {
+    JWARNING(false) (MAX_SHARED_AREA_MAPS)
+      .Text("Too many shared memory areas; contents will be duplicated");
+  }
+  Util::unlockFile(PROTECTED_SHM_FD);
+  return isOwner;
+}
+
+// Returns 0 if the two fds refer to the same open file description.
+static int kcmpFile(pid_t pid1, pid_t pid2, int fd1, int fd2)
+{
+#ifdef SYS_kcmp
+  return _real_syscall(SYS_kcmp, pid1, pid2, KCMP_FILE, fd1, fd2);
+#else
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+static uint64_t fdLeaderHash(uint64_t devnum, uint64_t inode)
+{
+  uint64_t h = (devnum * 0x9e3779b97f4a7c15ULL) ^ inode;
+  return (h ^ (h >> 29)) * 0xbf58476d1ce4e5b9ULL;
+}
+
+/* The first process to enter an open file description leads it.  All fds of
+ * the calling process are entered under a single lock of the shared area.
+ * Returns false, without electing anything, if kcmp() is not available; as
+ * all processes on this host run the same kernel, they then all have to fall
+ * back to the fcntl(F_SETOWN) election.  If the table is full, the remaining
+ * fds are given to the caller, so that they are still checkpointed.
+ */
+bool SharedData::electFdLeaders(vector<FdLeaderMap> &fds,
+                                vector<bool> *isLeader)
+{
+  if (sharedDataHeader == NULL) initialize();
+  static bool warnedKcmpFailed = false;
+  pid_t self = (pid_t) _real_syscall(SYS_getpid);
+  isLeader->assign(fds.size(), true);
+  if (fds.empty()) {
+    return true;
+  }
+  if (kcmpFile(self, self, fds[0].fd, fds[0].fd) != 0) {
+    JLOG(DMTCP)("kcmp() not available; using fcntl() for fd leader election")
+      (JASSERT_ERRNO);
+    return false;
+  }
+
+  Util::lockFile(PROTECTED_SHM_FD);
+  uint32_t generation = sharedDataHeader->fdLeaderGeneration;
+  size_t numFree = MAX_FD_LEADER_MAPS;
+  for (size_t i = 0; i < fds.size(); i++) {
+    FdLeaderMap &fd = fds[i];
+    uint64_t slot = fdLeaderHash(fd.devnum, fd.inode);
+    FdLeaderMap *map;
+    size_t probes = 0;
+    for (; probes < MAX_FD_LEADER_MAPS; probes++, slot++) {
+      map = &sharedDataHeader->fdLeaderMap[slot & (MAX_FD_LEADER_MAPS - 1)];
+      if (map->generation != generation) {
+        break;
+      }
+      if (map->devnum != fd.devnum || map->inode != fd.inode) {
+        continue;
+      }
+      int res = kcmpFile(self, map->realPid, fd.fd, map->fd);
+      if (res == -1 && !warnedKcmpFailed) {
+        // EPERM if the leader runs with other credentials or an LSM policy
+        // forbids the access, or ESRCH if it has exited.  Leading an fd that
+        // is in fact shared only costs a second drain; not leading one would
+        // lose its data.
+        JWARNING(false) (map->realPid) (JASSERT_ERRNO)
+          .Text("kcmp() failed; taking the fds to be distinct");
+        warnedKcmpFailed = true;
+      }
+      if (res == 0) {
+        (*isLeader)[i] = false;
+        break;
+      }
+    }
+    if ((*isLeader)[i]) {
+      if (probes == MAX_FD_LEADER_MAPS) {
+        JWARNING(false) (MAX_FD_LEADER_MAPS)
+          .Text("Too many fds for leader election; may drain shared fds twice");
+        break;
+      }
+      *map = fd;
+      map->generation = generation;
+      map->realPid = self;
+    }
+  }
+  Util::unlockFile(PROTECTED_SHM_FD);
+  return true;
+}
+
+bool SharedData::getSharedAreaOwner(dev_t devnum, ino_t inode, off_t offset,
+                                    size_t size, DmtcpUniqueProcessId *owner)
+{
+  if (sharedDataHeader == NULL) initialize();
+  JASSERT(owner != NULL);
+  SharedAreaOwnerMap *map = findSharedArea(devnum, inode, offset, size);
+  if (map == NULL) {
+    return false;
+  }
+  *owner = map->owner;
+  return true;
+}
+
 uint32_t
 SharedData::getLogMask(void)
 {
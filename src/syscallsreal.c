@@ -33,6 +33,8 @@
 #include <ctype.h>
 #include <dlfcn.h>
 #include <fcntl.h>
+#include <link.h>
+#include <limits.h>
 #include <malloc.h>
 #include <poll.h>
 #include <pthread.h>
@@ -278,14 +280,224 @@ static void initialize_libpthread_wrappers()
 }
 #endif // #ifdef ENABLE_PTHREAD_COND_WRAPPERS
 
+/*
+ * Wrapper cache:
+ *   Resolving all of the wrappers with dmtcp_dlsym() is a noticeable part of
+ *   the startup cost of a short-lived process that was exec'd under DMTCP.
+ *   The resolved addresses depend only on the list of loaded objects, so we
+ *   save them, as offsets from the load address of the defining object, in a
+ *   file named after a hash of the link map: the name and the identity
+ *   (device, inode, size and mtime) of each object, so that a library
+ *   upgraded in place gets a new file.  The file prefix is passed in
+ *   ENV_VAR_WRAPPER_CACHE (see Util::prepareDlsymWrapper()).  The first
+ *   process with a given link map writes the file; later ones just read it.
+ *
+ *   We are called before any _real_XXX function can be used, and so the file
+ *   is accessed through libc:syscall().
+ */
+#define WRAPPER_CACHE_MAGIC 0x434d5744  /* "DWMC" */
+#define WRAPPER_CACHE_MAX_OBJS 256
+
+typedef struct WrapperCacheEntry {
+  int64_t obj;     /* index into the link map, or -1 if not found */
+  uint64_t offset;
+} WrapperCacheEntry;
+
+typedef struct WrapperCache {
+  uint32_t magic;
+  uint32_t numWrappers;
+  uint32_t numObjs;
+  uint32_t pad;
+  WrapperCacheEntry entries[numLibcWrappers];
+} WrapperCache;
+
+typedef long (*syscall_fnptr_t) (long sys_num, ...);
+static syscall_fnptr_t wrapper_cache_syscall = NULL;
+
+/* The kernel's struct stat matches libc's only for newfstatat(), or else for
+ * fstatat64() and struct stat64.
+ */
+#ifdef SYS_newfstatat
+# define WRAPPER_CACHE_SYS_FSTATAT SYS_newfstatat
+typedef struct stat wrapper_cache_stat_t;
+#else
+# define WRAPPER_CACHE_SYS_FSTATAT SYS_fstatat64
+typedef struct stat64 wrapper_cache_stat_t;
+#endif
+
+static uint64_t wrapper_cache_hash(uint64_t hash, const void *buf, size_t len)
+{
+  const unsigned char *p = (const unsigned char*) buf;
+  size_t i;
+  for (i = 0; i < len; i++) {
+    hash = (hash ^ p[i]) * 1099511628211ULL;
+  }
+  return hash;
+}
+
+/* Fills in the cache file name and the load address of each object in the
+ * link map; returns the number of objects, or -1 if the cache can't be used.
+ */
+static int wrapper_cache_init(char *path, size_t len, ElfW(Addr) *bases)
+{
+  const char *prefix = getenv(ENV_VAR_WRAPPER_CACHE);
+  Dl_info info;
+  struct link_map *map;
+
+  if (prefix == NULL ||
+      !dladdr1((void*)&dmtcp_prepare_wrappers, &info, (void**)&map,
+               RTLD_DL_LINKMAP)) {
+    return -1;
+  }
+  wrapper_cache_syscall =
+    (syscall_fnptr_t) dmtcp_dlsym_lib(LIBC_FILENAME, "syscall");
+  if (wrapper_cache_syscall == NULL) {
+    return -1;
+  }
+  while (map->l_prev) {
+    map = map->l_prev;
+  }
+
+  /* FNV-1a over the object names and identities, in load order. */
+  uint64_t hash = 14695981039346656037ULL;
+  int numObjs = 0;
+  for (; map != NULL; map = map->l_next, numObjs++) {
+    if (numObjs == WRAPPER_CACHE_MAX_OBJS) {
+      return -1;
+    }
+    /* The main program has an empty name; the vdso has no file. */
+    const char *name = map->l_name[0] != '\0' ? map->l_name
+                                                : "/proc/self/exe";
+    hash = wrapper_cache_hash(hash, map->l_name, strlen(map->l_name) + 1);
+    wrapper_cache_stat_t st;
+    if (wrapper_cache_syscall(WRAPPER_CACHE_SYS_FSTATAT, AT_FDCWD, name,
+                              &st, 0) == 0) {
+      uint64_t id[5] = { st.st_dev, st.st_ino, st.st_size,
+                         st.st_mtim.tv_sec, st.st_mtim.tv_nsec };
+      hash = wrapper_cache_hash(hash, id, sizeof(id));
+    } else if (strchr(name, '/') != NULL) {
+      /* A file we can't identify: don't trust the cache. */
+      return -1;
+    }
+    bases[numObjs] = map->l_addr;
+  }
+  hash = (hash ^ numLibcWrappers) * 1099511628211ULL;
+  hash = (hash ^ sizeof(void*)) * 1099511628211ULL;
+
+  if (snprintf(path, len, "%s.%016llx", prefix,
+               (unsigned long long) hash) >= (int) len) {
+    return -1;
+  }
+  return numObjs;
+}
+
+static int wrapper_cache_load(const char *path, int numObjs,
+                              ElfW(Addr) *bases)
+{
+  WrapperCache cache;
+  int fd = wrapper_cache_syscall(SYS_openat, AT_FDCWD, path, O_RDONLY);
+  if (fd < 0) {
+    return 0;
+  }
+  long rc = wrapper_cache_syscall(SYS_read, fd, &cache, sizeof(cache));
+  wrapper_cache_syscall(SYS_close, fd);
+  if (rc != sizeof(cache) ||
+      cache.magic != WRAPPER_CACHE_MAGIC ||
+      cache.numWrappers != numLibcWrappers ||
+      cache.numObjs != (uint32_t) numObjs) {
+    return 0;
+  }
+
+  int i;
+  for (i = 0; i < numLibcWrappers; i++) {
+    if (cache.entries[i].obj >= numObjs) {
+      return 0;
+    }
+  }
+  for (i = 0; i < numLibcWrappers; i++) {
+    if (cache.entries[i].obj < 0) {
+      _real_func_addr[i] = NULL;
+    } else {
+      _real_func_addr[i] = (void*) (bases[cache.entries[i].obj] +
+                                    cache.entries[i].offset);
+    }
+  }
+  return 1;
+}
+
+static void wrapper_cache_save(const char *path, int numObjs,
+                               ElfW(Addr) *bases)
+{
+  WrapperCache cache;
+  char tmpPath[PATH_MAX];
+  int i;
+
+  memset(&cache, 0, sizeof(cache));
+  cache.magic = WRAPPER_CACHE_MAGIC;
+  cache.numWrappers = numLibcWrappers;
+  cache.numObjs = numObjs;
+  for (i = 0; i < numLibcWrappers; i++) {
+    Dl_info info;
+    struct link_map *map;
+    cache.entries[i].obj = -1;
+    if (_real_func_addr[i] == NULL) {
+      continue;
+    }
+    if (!dladdr1(_real_func_addr[i], &info, (void**)&map, RTLD_DL_LINKMAP)) {
+      return;
+    }
+    int obj = 0;
+    for (; map->l_prev != NULL; map = map->l_prev) {
+      obj++;
+    }
+    if (obj >= numObjs) {
+      return;
+    }
+    cache.entries[i].obj = obj;
+    cache.entries[i].offset = (char*) _real_func_addr[i] - (char*) bases[obj];
+  }
+
+  /* Write to a private file and rename it, so that readers never see a
+   * partial table.
+   */
+  if (snprintf(tmpPath, sizeof(tmpPath), "%s.%ld", path,
+               wrapper_cache_syscall(SYS_getpid)) >= (int) sizeof(tmpPath)) {
+    return;
+  }
+  int fd = wrapper_cache_syscall(SYS_openat, AT_FDCWD, tmpPath,
+                                 O_WRONLY | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) {
+    return;
+  }
+  long rc = wrapper_cache_syscall(SYS_write, fd, &cache, sizeof(cache));
+  wrapper_cache_syscall(SYS_close, fd);
+  if (rc != sizeof(cache) ||
+      wrapper_cache_syscall(SYS_renameat, AT_FDCWD, tmpPath,
+                            AT_FDCWD, path) != 0) {
+    wrapper_cache_syscall(SYS_unlinkat, AT_FDCWD, tmpPath, 0);
+  }
+}
+
 void dmtcp_prepare_wrappers(void)
 {
   if (!dmtcp_wrappers_initialized) {
+    char path[PATH_MAX];
+    ElfW(Addr) bases[WRAPPER_CACHE_MAX_OBJS];
+    int numObjs = wrapper_cache_init(path, sizeof(path), bases);
+    if (numObjs > 0 && wrapper_cache_load(path, numObjs, bases)) {
+      dmtcp_wrappers_initialized = 1;
+      return;
+    }
+
     initialize_libc_wrappers();
     dmtcp_wrappers_initialized = 1;
 #ifdef ENABLE_PTHREAD_COND_WRAPPERS
     initialize_libpthread_wrappers();
 #endif // #ifdef ENABLE_PTHREAD_COND_WRAPPERS
+
+    if (numObjs > 0) {
+      wrapper_cache_save(path, numObjs, bases);
+    }
   }
 }
 
@@ -46,6 +46,7 @@ void dmtcp_Syslog_EventHook(DmtcpEvent_t event, DmtcpEventData_t *data)
       break;
 
     case DMTCP_EVENT_REFILL:
+    case DMTCP_EVENT_CKPT_ABORTED:
       SyslogCheckpointer_RestoreService();
       break;
 
@@ -36,6 +36,8 @@ extern "C"
 pid_t dmtcp_get_real_tid() __attribute((weak));
 pid_t dmtcp_get_real_pid() __attribute((weak));
 int dmtcp_real_tgkill(pid_t pid, pid_t tid, int sig) __attribute((weak));
+// Defined by the alloc plugin.
+int dmtcp_alloc_defer_ckpt_signal(int sig) __attribute((weak));
 
 #define THREAD_REAL_PID() \
   (dmtcp_get_real_pid != NULL ? dmtcp_get_real_pid() : getpid())
@@ -81,6 +83,12 @@ struct Thread {
 
   ThreadTLSInfo tlsInfo;
 
+  int64_t suspendLatency; // usec from start of suspendThreads() to suspended
+  int64_t restoreLatency; // usec from start of postRestart() to restored
+
+  int restoreCloneBegin;  // on restart, this thread re-creates the threads
+  int restoreCloneEnd;    //   restoreThreads[restoreCloneBegin..End-1]
+
   ///JA: new code ported from v54b
 #ifdef SETJMP
   sigjmp_buf jmpbuf;     // sigjmp_buf saved by sigsetjmp on ckpt
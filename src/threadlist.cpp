@@ -4,7 +4,11 @@
 #include <sys/syscall.h>
 #include <unistd.h>
 #include <semaphore.h>
+#include <time.h>
+#include <limits.h>
 #include <sys/resource.h>
+#include <sys/mman.h>
+#include <linux/futex.h>
 #include <linux/version.h>
 #include "config.h"
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(2,6,11) || defined(HAS_PR_SET_PTRACER)
@@ -55,8 +59,6 @@ static Thread *threads_freelist = NULL;
 static pthread_mutex_t threadlistLock = PTHREAD_MUTEX_INITIALIZER;
 static pthread_mutex_t threadStateLock = PTHREAD_MUTEX_INITIALIZER;
 
-static pthread_rwlock_t *threadResumeLock = NULL;
-
 static __thread Thread *curThread = NULL;
 static Thread *ckptThread = NULL;
 static int numUserThreads = 0;
@@ -64,13 +66,36 @@ static bool originalstartup;
 
 extern bool sem_launch_first_time;
 extern sem_t sem_launch; // allocated in coordinatorapi.cpp
-static sem_t semNotifyCkptThread;
-static sem_t semWaitForCkptThreadSignal;
+
+/* Thread quiescence.  User threads acknowledge the ckpt thread (once
+ * suspended, and again once restored on restart) by decrementing
+ * threadsPendingAck; the ckpt thread adds the number of threads it expects
+ * and sleeps on the counter until it drops to zero.  The counter is signed
+ * since threads may ack before the ckpt thread has added their count.
+ * Threads are released all at once by bumping threadReleaseGen, which they
+ * wait on.  Raw futexes are used here for the same reason that sem_wait can't
+ * be: see the comment in stopthisthread().
+ */
+static volatile int threadsPendingAck = 0;
+static volatile int threadReleaseGen = 0;
+static struct timespec suspendStartTime;
+
+/* On restart, the user threads are re-created in a tree: each new thread
+ * clones a share of the remaining ones, so the depth is logarithmic in the
+ * number of threads rather than linear.
+ */
+static Thread **restoreThreads = NULL;
+static size_t restoreThreadsSize = 0;
+static struct timespec restoreStartTime;
+
+#define SUSPEND_RESCAN_TIMEOUT_NS (10 * 1000 * 1000)
 
 static void *checkpointhread (void *dummy);
 static void suspendThreads();
+static void releaseUserThreads();
 static void stopthisthread(int sig);
 static int restarthread(void *threadv);
+static void recreateThreads(int begin, int end);
 static int Thread_UpdateState(Thread *th,
                               ThreadState newval,
                               ThreadState oldval);
@@ -180,8 +205,6 @@ void ThreadList::init()
   updateTid(motherofall);
 
   sem_init(&sem_launch, 0, 0);
-  sem_init(&semNotifyCkptThread, 0, 0);
-  sem_init(&semWaitForCkptThreadSignal, 0, 0);
 
   originalstartup = true;
   pthread_t checkpointhreadid;
@@ -383,11 +406,6 @@ static void *checkpointhread (void *dummy)
 
     restoreInProgress = false;
 
-    // We need to reinitialize the lock.
-    pthread_rwlock_t rwLock = PTHREAD_RWLOCK_INITIALIZER;
-    threadResumeLock = &rwLock;
-    JASSERT(_real_pthread_rwlock_wrlock(threadResumeLock) == 0) (JASSERT_ERRNO);
-
     suspendThreads();
     SigInfo::saveSigHandlers();
     /* Do this once, same for all threads.  But restore for each thread. */
@@ -404,7 +422,11 @@ static void *checkpointhread (void *dummy)
     ProcessInfo::instance().set_generation(computation_generation);
 
     JLOG(DMTCP)("before callbackSleepBetweenCheckpoint(0)");
-    callbackPreCheckpoint();
+    if (!callbackPreCheckpoint()) {
+      releaseUserThreads();
+      JLOG(DMTCP)("checkpoint aborted, everything resumed");
+      continue;
+    }
 
     // Remove stale threads from activeThreads list.
     ThreadList::emptyFreeList();
@@ -442,88 +464,160 @@ static void *checkpointhread (void *dummy)
 
     /* Resume all threads. */
     JLOG(DMTCP)("resuming everything");
-    JASSERT(_real_pthread_rwlock_unlock(threadResumeLock) == 0) (JASSERT_ERRNO);
+    releaseUserThreads();
     JLOG(DMTCP)("everything resumed");
   }
   return NULL;
 }
 
+static int futex(volatile int *uaddr, int op, int val,
+                 const struct timespec *timeout)
+{
+  return _real_syscall(SYS_futex, uaddr, op | FUTEX_PRIVATE_FLAG, val,
+                       timeout, NULL, 0);
+}
+
+/* Called by a user thread once it is suspended or restored. */
+static void ackCkptThread()
+{
+  if (__sync_sub_and_fetch(&threadsPendingAck, 1) == 0) {
+    futex(&threadsPendingAck, FUTEX_WAKE, 1, NULL);
+  }
+}
+
+/* Called by a user thread after ackCkptThread(); gen must have been read
+ * before the ack so that the release can't be missed.
+ */
+static void waitForRelease(int gen)
+{
+  while (threadReleaseGen == gen) {
+    futex(&threadReleaseGen, FUTEX_WAIT, gen, NULL);
+  }
+}
+
+static void releaseUserThreads()
+{
+  __sync_add_and_fetch(&threadReleaseGen, 1);
+  futex(&threadReleaseGen, FUTEX_WAKE, INT_MAX, NULL);
+}
+
+/* Wait for the acks of numThreads more threads.  If timeout is non-NULL,
+ * returns false when it expires before all acks have arrived.
+ */
+static bool waitForAcks(int numThreads, const struct timespec *timeout)
+{
+  int pending = __sync_add_and_fetch(&threadsPendingAck, numThreads);
+  while (pending > 0) {
+    if (futex(&threadsPendingAck, FUTEX_WAIT, pending, timeout) == -1 &&
+        errno == ETIMEDOUT) {
+      return false;
+    }
+    pending = threadsPendingAck;
+  }
+  return true;
+}
+
+/* Returns the number of acks to expect from this thread: one if it has been
+ * (or already was being) stopped, zero otherwise.  Called with the thread
+ * list locked.
+ */
+static int signalThreadToSuspend(Thread *thread)
+{
+  while (1) {
+    switch (thread->state) {
+      case ST_RUNNING:
+        /* Thread is running. Send it a signal so it will call stopthisthread.
+         * If the update fails, the thread changed its own state; recheck.
+         */
+        if (!Thread_UpdateState(thread, ST_SIGNALED, ST_RUNNING)) {
+          continue;
+        }
+        if (THREAD_TGKILL(motherpid, thread->tid, SigInfo::ckptSignal()) < 0) {
+          JASSERT(errno == ESRCH) (JASSERT_ERRNO) (thread->tid)
+            .Text("error signalling thread");
+          ThreadList::threadIsDead(thread);
+          return 0;
+        }
+        return 1;
+
+      case ST_ZOMBIE:
+      {
+        int ret = THREAD_TGKILL(motherpid, thread->tid, 0);
+        JASSERT(ret == 0 || errno == ESRCH);
+        if (ret == -1 && errno == ESRCH) {
+          ThreadList::threadIsDead(thread);
+        }
+        return 0;
+      }
+
+      case ST_SIGNALED:
+      case ST_SUSPINPROG:
+      case ST_SUSPENDED:
+        return 1;
+
+      case ST_CKPNTHREAD:
+        return 0;
+
+      default:
+        JASSERT(false);
+    }
+  }
+}
+
 static void suspendThreads()
 {
-  int needrescan;
   Thread *thread;
   Thread *next;
 
-  /* Halt all other threads - force them to call stopthisthread
-   * If any have blocked checkpointing, wait for them to unblock before
-   * signalling
+  /* Halt all other threads - force them to call stopthisthread.  All threads
+   * are signalled in a single pass; those that have blocked checkpointing
+   * will stop once they unblock.
    */
+  clock_gettime(CLOCK_MONOTONIC, &suspendStartTime);
   lock_threads();
-  do {
-    needrescan = 0;
-    numUserThreads = 0;
+  int numThreads = 0;
+  for (thread = activeThreads; thread != NULL; thread = next) {
+    next = thread->next;
+    numThreads += signalThreadToSuspend(thread);
+  }
+
+  /* A signalled thread may exit before it handles the signal, and so never
+   * ack.  If the acks are slow in coming, look for such threads (and for new
+   * threads that need to be signalled).
+   */
+  struct timespec timeout = {0, SUSPEND_RESCAN_TIMEOUT_NS};
+  while (!waitForAcks(numThreads, &timeout)) {
+    numThreads = 0;
     for (thread = activeThreads; thread != NULL; thread = next) {
       next = thread->next;
-      int ret;
-      /* Do various things based on thread's state */
-      switch (thread->state) {
-
-        case ST_RUNNING:
-          /* Thread is running. Send it a signal so it will call stopthisthread.
-           * We will need to rescan (hopefully it will be suspended by then)
-           */
-          if (Thread_UpdateState(thread, ST_SIGNALED, ST_RUNNING)) {
-            if (THREAD_TGKILL(motherpid, thread->tid, SigInfo::ckptSignal()) < 0) {
-              JASSERT(errno == ESRCH) (JASSERT_ERRNO) (thread->tid)
-                .Text("error signalling thread");
-              ThreadList::threadIsDead(thread);
-            } else {
-              needrescan = 1;
-            }
-          }
-          break;
-
-        case ST_ZOMBIE:
-          ret = THREAD_TGKILL(motherpid, thread->tid, 0);
-          JASSERT(ret == 0 || errno == ESRCH);
-          if (ret == -1 && errno == ESRCH) {
-            ThreadList::threadIsDead(thread);
-          }
-          break;
-
-        case ST_SIGNALED:
-          if (THREAD_TGKILL(motherpid, thread->tid, 0) == -1 && errno == ESRCH) {
-            ThreadList::threadIsDead(thread);
-          } else {
-            needrescan = 1;
-          }
-          break;
-
-        case ST_SUSPINPROG:
-          numUserThreads++;
-          break;
-
-        case ST_SUSPENDED:
-          numUserThreads++;
-          break;
-
-        case ST_CKPNTHREAD:
-          break;
-
-        default:
-          JASSERT(false);
+      if (thread->state == ST_SIGNALED &&
+          THREAD_TGKILL(motherpid, thread->tid, 0) == -1 && errno == ESRCH) {
+        ThreadList::threadIsDead(thread);
+        numThreads--;
+      } else if (thread->state == ST_RUNNING) {
+        numThreads += signalThreadToSuspend(thread);
       }
     }
-    if (needrescan) usleep(10);
-  } while (needrescan);
-  unlk_threads();
+  }
 
-  for (int i = 0; i < numUserThreads; i++) {
-    sem_wait(&semNotifyCkptThread);
+  numUserThreads = 0;
+  Thread *slowest = NULL;
+  for (thread = activeThreads; thread != NULL; thread = thread->next) {
+    if (thread->state == ST_SUSPENDED) {
+      numUserThreads++;
+      if (slowest == NULL || thread->suspendLatency > slowest->suspendLatency) {
+        slowest = thread;
+      }
+    }
   }
+  unlk_threads();
 
   JASSERT(activeThreads != NULL);
   JLOG(DMTCP)("everything suspended") (numUserThreads);
+  if (slowest != NULL) {
+    JLOG(DMTCP)("slowest thread to suspend")
+      (slowest->tid) (slowest->procname) (slowest->suspendLatency);
+  }
 }
 
 /*************************************************************************
@@ -561,6 +655,15 @@ void stopthisthread (int signum)
     if (retval) return;
   }
 
+  /* If we are inside malloc/free (alloc plugin), stay in ST_SIGNALED; the
+   * plugin re-raises the signal once we leave the allocator.
+   */
+  if (dmtcp_alloc_defer_ckpt_signal != NULL &&
+      curThread->state == ST_SIGNALED &&
+      dmtcp_alloc_defer_ckpt_signal(signum)) {
+    return;
+  }
+
   // make sure we don't get called twice for same thread
   if (Thread_UpdateState(curThread, ST_SUSPINPROG, ST_SIGNALED)) {
 
@@ -597,8 +700,14 @@ void stopthisthread (int signum)
       }
 
       /* Tell the checkpoint thread that we're all saved away */
+      struct timespec now;
+      clock_gettime(CLOCK_MONOTONIC, &now);
+      curThread->suspendLatency =
+        (now.tv_sec - suspendStartTime.tv_sec) * 1000000 +
+        (now.tv_nsec - suspendStartTime.tv_nsec) / 1000;
+      int gen = threadReleaseGen;
       JASSERT(Thread_UpdateState(curThread, ST_SUSPENDED, ST_SUSPINPROG));
-      sem_post(&semNotifyCkptThread);
+      ackCkptThread();
 
       /* This sets a static variable in dmtcp.  It must be passed
        * from this user thread to ckpt thread before writing ckpt image
@@ -619,10 +728,7 @@ void stopthisthread (int signum)
       // However, the sem_wait cleanup handler is now invalid and thus we get a
       // segfault.
       // The change in sem_wait behavior was first introduce in glibc 2.21.
-      JASSERT(_real_pthread_rwlock_rdlock(threadResumeLock) == 0)
-        (JASSERT_ERRNO);
-      JASSERT(_real_pthread_rwlock_unlock(threadResumeLock) == 0)
-        (JASSERT_ERRNO);
+      waitForRelease(gen);
 
       JLOG(DMTCP)("User thread resuming") (curThread->tid);
     } else {
@@ -665,8 +771,22 @@ void ThreadList::waitForAllRestored(Thread *thread)
 {
   if (thread == ckptThread) {
     int i;
-    for (i = 0; i < numUserThreads; i++) {
-      sem_wait(&semNotifyCkptThread);
+    waitForAcks(numUserThreads, NULL);
+
+    if (restoreThreads != NULL) {
+      munmap(restoreThreads, restoreThreadsSize);
+      restoreThreads = NULL;
+    }
+    Thread *slowest = NULL;
+    for (Thread *th = activeThreads; th != NULL; th = th->next) {
+      if (th != ckptThread &&
+          (slowest == NULL || th->restoreLatency > slowest->restoreLatency)) {
+        slowest = th;
+      }
+    }
+    if (slowest != NULL) {
+      JLOG(DMTCP)("slowest thread to restore")
+        (slowest->tid) (slowest->procname) (slowest->restoreLatency);
     }
 
     // Now that all threads have been created, restore the signal handler. We
@@ -693,12 +813,17 @@ void ThreadList::waitForAllRestored(Thread *thread)
     }
 
     // if this was last of all, wake everyone up
-    for (i = 0; i < numUserThreads; i++) {
-      sem_post(&semWaitForCkptThreadSignal);
-    }
+    releaseUserThreads();
   } else {
-    sem_post(&semNotifyCkptThread);
-    sem_wait(&semWaitForCkptThreadSignal);
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    thread->restoreLatency =
+      (now.tv_sec - restoreStartTime.tv_sec) * 1000000 +
+      (now.tv_nsec - restoreStartTime.tv_nsec) / 1000;
+    JLOG(DMTCP)("thread restored") (thread->tid) (thread->restoreLatency);
+    int gen = threadReleaseGen;
+    ackCkptThread();
+    waitForRelease(gen);
     Thread_RestoreSigState(thread);
   }
 
@@ -791,13 +916,54 @@ ThreadList::postRestart(void)
 
   Util::allowGdbDebug(DEBUG_POST_RESTART);
 
+  clock_gettime(CLOCK_MONOTONIC, &restoreStartTime);
+
+  int numThreads = 0;
   sigfillset(&tmp);
   for (thread = activeThreads; thread != NULL; thread = thread->next) {
-    struct MtcpRestartThreadArg mtcpRestartThreadArg;
     sigandset(&sigpending_global, &tmp, &(thread->sigpending));
     tmp = sigpending_global;
 
-    if (thread == motherofall) continue;
+    if (thread != motherofall) {
+      numThreads++;
+    }
+  }
+
+  // Not JAlloc; the TLS of this thread hasn't been restored yet.
+  restoreThreadsSize = numThreads * sizeof(Thread*);
+  if (numThreads > 0) {
+    restoreThreads = (Thread**) mmap(NULL, restoreThreadsSize,
+                                     PROT_READ | PROT_WRITE,
+                                     MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    JASSERT(restoreThreads != MAP_FAILED) (numThreads) (JASSERT_ERRNO);
+  }
+  int i = 0;
+  for (thread = activeThreads; thread != NULL; thread = thread->next) {
+    if (thread != motherofall) {
+      restoreThreads[i++] = thread;
+    }
+  }
+
+  recreateThreads(0, numThreads);
+  restarthread (motherofall);
+}
+
+/*****************************************************************************
+ *
+ *  Re-create restoreThreads[begin..end-1].  The first thread is created with
+ *  the upper half of the rest to re-create itself, and so on, so that the
+ *  calling thread makes only about log2(end - begin) clone calls.
+ *
+ *****************************************************************************/
+static void recreateThreads(int begin, int end)
+{
+  while (begin < end) {
+    Thread *thread = restoreThreads[begin];
+    int mid = begin + 1 + (end - begin - 1) / 2;
+    thread->restoreCloneBegin = mid;
+    thread->restoreCloneEnd = end;
+
+    struct MtcpRestartThreadArg mtcpRestartThreadArg;
 
     /* DMTCP needs to know virtual_tid of the thread being recreated by the
      *  following clone() call.
@@ -826,8 +992,10 @@ ThreadList::postRestart(void)
 
     JASSERT (tid > 0); // (JASSERT_ERRNO) .Text("Error recreating thread");
     JLOG(DMTCP)("Thread recreated") (thread->tid) (tid);
+
+    begin++;
+    end = mid;
   }
-  restarthread (motherofall);
 }
 
 /*****************************************************************************
@@ -843,6 +1011,10 @@ static int restarthread (void *threadv)
   if (TLSInfo_HaveThreadSysinfoOffset())
     TLSInfo_SetThreadSysinfo(saved_sysinfo);
 
+  if (thread != motherofall) {
+    recreateThreads(thread->restoreCloneBegin, thread->restoreCloneEnd);
+  }
+
   if (thread == motherofall) { // if this is a user thread
     /* If DMTCP_RESTART_PAUSE==3, wait for gdb attach.*/
     char * pause_param = getenv("DMTCP_RESTART_PAUSE");
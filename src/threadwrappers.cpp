@@ -68,6 +68,7 @@ int clone_start(void *arg)
   int ret = thread->fn(thread->arg);
 
   ThreadList::threadExit();
+  jalib::JAllocDispatcher::flushThreadCache();
   return ret;
 }
 
@@ -169,6 +170,7 @@ static void *pthread_start(void *arg)
   DmtcpWorker::eventHook(DMTCP_EVENT_PTHREAD_RETURN, NULL);
   WRAPPER_EXECUTION_ENABLE_CKPT();
   ThreadSync::unsetOkToGrabLock();
+  jalib::JAllocDispatcher::flushThreadCache();
   return result;
 }
 
@@ -232,6 +234,7 @@ extern "C" void pthread_exit(void * retval)
   DmtcpWorker::eventHook(DMTCP_EVENT_PTHREAD_EXIT, NULL);
   WRAPPER_EXECUTION_ENABLE_CKPT();
   ThreadSync::unsetOkToGrabLock();
+  jalib::JAllocDispatcher::flushThreadCache();
   _real_pthread_exit(retval);
   for (;;); // To hide compiler warning about "noreturn" function
 }
@@ -87,4 +87,6 @@ namespace dmtcp
   bool operator!=(const DmtcpUniqueProcessId& a, const DmtcpUniqueProcessId& b);
 }
 
+JSERIALIZE_POD_TYPE(dmtcp::UniquePid)
+
 #endif
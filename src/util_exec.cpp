@@ -394,6 +394,10 @@ void Util::prepareDlsymWrapper()
   setenv(ENV_VAR_DLSYM_OFFSET, str, 1);
   sprintf(str, "%d", offset_m32);
   setenv(ENV_VAR_DLSYM_OFFSET_M32, str, 1);
+
+  // See the wrapper cache in syscallsreal.c.
+  string cachePrefix = SharedData::getTmpDir() + "/dmtcpWrapperCache";
+  setenv(ENV_VAR_WRAPPER_CACHE, cachePrefix.c_str(), 1);
 }
 
 static int32_t getDlsymOffset()
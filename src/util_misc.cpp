@@ -704,6 +704,8 @@ stringToEnumMask(const char *s)
     m = jassert_internal::SYSV;
   } else if (strcmp(s, "TIMER") == 0) {
     m = jassert_internal::TIMER;
+  } else if (strcmp(s, "FLIGHTREC") == 0) {
+    m = jassert_internal::FLIGHTREC;
   } else if (strcmp(s, "ALL") == 0) {
     m = jassert_internal::ALL;
   } else {
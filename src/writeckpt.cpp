@@ -29,11 +29,16 @@
 #include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/fcntl.h>
+#include <sys/syscall.h>
+#include <sys/sysmacros.h>
 #include "dmtcp.h"
+#include "ckptserializer.h"
 #include "constants.h"
 #include "processinfo.h"
 #include "procmapsarea.h"
 #include "procselfmaps.h"
+#include "shareddata.h"
+#include "uniquepid.h"
 #include "jassert.h"
 #include "util.h"
 
@@ -52,29 +57,34 @@
 using namespace dmtcp;
 
 EXTERNC int dmtcp_infiniband_enabled(void) __attribute__((weak));
+EXTERNC int dmtcp_svipc_shm_ckpt_info(const void *addr, int *key, int *shmflg)
+  __attribute__((weak));
 
 static bool skipWritingTextSegments = false;
+static bool skipUnmodifiedFilePages = false;
 
-// FIXME:  Why do we create two global variable here?  They should at least
+// FIXME:  Why do we create a global variable here?  It should at least
 //         be static (file-private), and preferably local to a function.
 ProcSelfMaps *procSelfMaps = NULL;
-vector<ProcMapsArea> *nscdAreas = NULL;
-// FIXME:  If we allocate in the middle of reading
-//         /proc/self/maps, we modify the mapping.  But whenever we
-//         add to nscdAreas, we risk allocating memory.  So, we're depending
-//         on this memory being smaller than any pre-allocated memory,
-//         so that the memory allocator does not call mmap in the middle
-//         of reading /proc/self/maps.  A better design would be to create
-//         an nscdArea method of the ProcSelfMaps class, and that
-//         class can then be careful about allocating memory.
-
 
 /* Internal routines */
 //static void sync_shared_mem(void);
 static void writememoryarea (int fd, Area *area,
                              int stack_was_seen);
+static bool write_sysv_shm_area(int fd, Area *area);
+static bool is_shared_area_owned_by_peer(const Area& area);
+static bool write_file_backed_area(int fd, Area *area);
+static bool write_excluded_region(int fd, Area *area, Area *rest,
+                                  bool *haveRest);
+
+static void remap_nscd_areas(ProcSelfMaps *maps);
 
-static void remap_nscd_areas(const vector<ProcMapsArea> & areas);
+static const char *alloc_stats()
+{
+  static char buf[1024];
+  jalib::JAllocDispatcher::formatStats(buf, sizeof(buf));
+  return buf;
+}
 
 /*****************************************************************************
  *
@@ -96,8 +106,13 @@ void mtcp_writememoryareas(int fd)
   if (getenv(ENV_VAR_SKIP_WRITING_TEXT_SEGMENTS) != NULL) {
     skipWritingTextSegments = true;
   }
+  if (getenv(ENV_VAR_SKIP_UNMODIFIED_FILE_PAGES) != NULL) {
+    skipUnmodifiedFilePages = true;
+  }
 
   JLOG(DMTCP)("Performing checkpoint.");
+  JLOG(ALLOC)("allocator memory reserved (chunk:bytes/expansions)")
+    (alloc_stats());
 
   // Here we want to sync the shared memory pages with the backup files
   // FIXME: Why do we need this?
@@ -111,29 +126,6 @@ void mtcp_writememoryareas(int fd)
   /* inconsistent state.  See note in restoreverything routine.             */
   /**************************************************************************/
 
-  {
-    if (nscdAreas == NULL) {
-      nscdAreas = new vector<ProcMapsArea>();
-    }
-    nscdAreas->clear();
-    // This block is to ensure that the object is deleted as soon as we leave
-    // this block.
-    ProcSelfMaps procSelfMaps;
-    // Preprocess memory regions as needed.
-    while (procSelfMaps.getNextArea(&area)) {
-      if (Util::isNscdArea(area)) {
-        /* Special Case Handling: nscd is enabled*/
-        JLOG(DMTCP)("NSCD daemon shared memory area present.\n"
-               "  DMTCP will now try to remap this area in read/write mode as\n"
-               "  private (zero pages), so that glibc will automatically\n"
-               "  stop using NSCD or ask NSCD daemon for new shared area\n")
-          (area.name);
-
-        nscdAreas->push_back(area);
-      }
-    }
-  }
-
   if (procSelfMaps != NULL) {
     // We need to explicitly delete this object here because on restart, we
     // never get back to this function and the object is never released.
@@ -142,7 +134,15 @@ void mtcp_writememoryareas(int fd)
 
   /* Finally comes the memory contents */
   procSelfMaps = new ProcSelfMaps();
-  while (procSelfMaps->getNextArea(&area)) {
+  Area rest;
+  bool haveRest = false;
+  while (haveRest || procSelfMaps->getNextArea(&area)) {
+    if (haveRest) {
+      /* The remainder of an area split by write_excluded_region(). */
+      area = rest;
+      haveRest = false;
+    }
+
     // TODO(kapil): Verify that we are not doing any operation that might
     // result in a change of memory layout. For example, a call to JALLOC_NEW
     // will invoke mmap if the JAlloc arena is full. Similarly, for STL objects
@@ -154,6 +154,13 @@ void mtcp_writememoryareas(int fd)
       continue;
     } else if (SharedData::isSharedDataRegion(area.addr)) {
       continue;
+    } else if (ProcSelfMaps::isArenaAddr(area.addr)) {
+      /* The /proc/self/maps snapshot is of no use after restart. */
+      area.properties |= DMTCP_ZERO_PAGE;
+      area.flags = MAP_PRIVATE | MAP_ANONYMOUS;
+      int rc = Util::writeAll(fd, &area, sizeof(area));
+      JASSERT(rc != -1)(JASSERT_ERRNO).Text("writeAll failed at ckpt");
+      continue;
     }
 
     /* Original comment:  Skip anything in kernel address space ---
@@ -178,6 +185,10 @@ void mtcp_writememoryareas(int fd)
       continue;
 #endif
 
+    if (write_excluded_region(fd, &area, &rest, &haveRest)) {
+      continue;
+    }
+
     /* Skip anything that has no read or execute permission.  This occurs
      * on one page in a Linux 2.6.9 installation.  No idea why.  This code
      * would also take care of kernel sections since we don't have read/execute
@@ -232,11 +243,19 @@ void mtcp_writememoryareas(int fd)
       area.flags = MAP_PRIVATE | MAP_ANONYMOUS;
       area.name[0] = '\0';
     } else if (Util::isSysVShmArea(area)) {
+      if (write_sysv_shm_area(fd, &area)) {
+        continue;
+      }
       JLOG(DMTCP)("saving area as Anonymous") (area.name);
       area.flags = MAP_PRIVATE | MAP_ANONYMOUS;
       area.name[0] = '\0';
     } else if (Util::isNscdArea(area)) {
       /* Special Case Handling: nscd is enabled*/
+      JLOG(DMTCP)("NSCD daemon shared memory area present.\n"
+             "  DMTCP will now try to remap this area in read/write mode as\n"
+             "  private (zero pages), so that glibc will automatically\n"
+             "  stop using NSCD or ask NSCD daemon for new shared area\n")
+        (area.name);
       area.prot = PROT_READ | PROT_WRITE;
       area.properties |= DMTCP_ZERO_PAGE;
       area.flags = MAP_PRIVATE | MAP_ANONYMOUS;
@@ -245,6 +264,18 @@ void mtcp_writememoryareas(int fd)
     } else if (Util::isIBShmArea(area)) {
       // TODO: Don't checkpoint infiniband shared area for now.
       continue;
+    } else if ((area.flags & MAP_SHARED) &&
+               is_shared_area_owned_by_peer(area)) {
+      /* Another process on this host saves the contents of this shared
+       * region.  Write only a placeholder record; the ipc plugin maps the
+       * restored backing file over it during refill.
+       */
+      JLOG(DMTCP)("saving reference to shared area") (area.name);
+      area.properties |= DMTCP_ZERO_PAGE | DMTCP_SHARED_AREA_REF;
+      area.flags = MAP_PRIVATE | MAP_ANONYMOUS;
+      int rc = Util::writeAll(fd, &area, sizeof(area));
+      JASSERT(rc != -1)(JASSERT_ERRNO).Text("writeAll failed at ckpt");
+      continue;
     } else if (Util::strEndsWith(area.name, DELETED_FILE_SUFFIX)) {
       /* Deleted File */
     } else if (area.name[0] == '/' && strstr(&area.name[1], "/") != NULL) {
@@ -253,6 +284,14 @@ void mtcp_writememoryareas(int fd)
        */
     }
 
+    /* Pages of a private file mapping that were never written to are still
+     * backed by the file; record them as file references instead of data.
+     */
+    if (skipUnmodifiedFilePages && (area.flags & MAP_PRIVATE) &&
+        write_file_backed_area(fd, &area)) {
+      continue;
+    }
+
     /* Force the anonymous flag if it's a private writeable section, as the
      * data has probably changed from the contents of the original images.
      */
@@ -277,13 +316,13 @@ void mtcp_writememoryareas(int fd)
     writememoryarea(fd, &area, stack_was_seen);
   }
 
+  /* It's now safe to do this, since we're done using writememoryarea() */
+  remap_nscd_areas(procSelfMaps);
+
   // Release the memory.
   delete procSelfMaps;
   procSelfMaps = NULL;
 
-  /* It's now safe to do this, since we're done using writememoryarea() */
-  remap_nscd_areas(*nscdAreas);
-
   area.addr = NULL; // End of data
   area.size = -1; // End of data
   Util::writeAll(fd, &area, sizeof(area));
@@ -292,18 +331,253 @@ void mtcp_writememoryareas(int fd)
   JASSERT(_real_close (fd) == 0);
 }
 
-static void remap_nscd_areas(const vector<ProcMapsArea>& areas)
+static void remap_nscd_areas(ProcSelfMaps *maps)
 {
-  for (size_t i = 0; i < areas.size(); i++) {
-    JASSERT(munmap(areas[i].addr, areas[i].size) == 0) (JASSERT_ERRNO)
+  Area area;
+  maps->rewind();
+  while (maps->getNextArea(&area)) {
+    if (!Util::isNscdArea(area)) {
+      continue;
+    }
+    JASSERT(munmap(area.addr, area.size) == 0) (JASSERT_ERRNO)
       .Text("error unmapping NSCD shared area");
-    JASSERT(mmap(areas[i].addr, areas[i].size, areas[i].prot,
+    JASSERT(mmap(area.addr, area.size, area.prot,
             MAP_ANONYMOUS | MAP_PRIVATE | MAP_FIXED, 0, 0) != MAP_FAILED)
       (JASSERT_ERRNO) .Text("error remapping NSCD shared area.");
   }
 }
 
 
+/* See SharedData::claimSharedArea().  Regions that no process claimed (e.g.,
+ * the ipc plugin isn't loaded) are written as usual.
+ */
+static bool is_shared_area_owned_by_peer(const Area& area)
+{
+  DmtcpUniqueProcessId owner;
+  dev_t devnum = makedev(area.devmajor, area.devminor);
+  if (!SharedData::getSharedAreaOwner(devnum, area.inodenum, area.offset,
+                                      area.size, &owner)) {
+    return false;
+  }
+  return owner != UniquePid::ThisProcess().upid();
+}
+
+#define PAGEMAP_PRESENT (1ULL << 63)
+#define PAGEMAP_SWAPPED (1ULL << 62)
+#define PAGEMAP_FILE    (1ULL << 61)
+
+/* Shorter unmodified runs are written as data: every area record takes
+ * sizeof(Area) bytes in the ckpt image.
+ */
+#define MIN_FILE_BACKED_REF_PAGES 16
+
+// Static, so that we don't allocate memory while walking /proc/self/maps.
+static uint64_t pagemapBuf[512];
+static VA pagemapBufStart;
+static size_t pagemapBufCount;
+
+/* A page of a private file mapping has been modified if it was copied on
+ * write, i.e., it's now an anonymous page (resident or swapped out).
+ * Pages that were never touched are not present and are still file-backed.
+ */
+static bool page_is_modified(int pagemapFd, VA page)
+{
+  size_t pageSize = Util::pageSize();
+  if (page < pagemapBufStart ||
+      page >= pagemapBufStart + pagemapBufCount * pageSize) {
+    off_t offset = ((uint64_t) page / pageSize) * sizeof(uint64_t);
+    ssize_t rc = pread(pagemapFd, pagemapBuf, sizeof(pagemapBuf), offset);
+    if (rc < (ssize_t) sizeof(uint64_t)) {
+      pagemapBufCount = 0;
+      return true;
+    }
+    pagemapBufStart = page;
+    pagemapBufCount = rc / sizeof(uint64_t);
+  }
+  uint64_t entry = pagemapBuf[(page - pagemapBufStart) / pageSize];
+  return (entry & PAGEMAP_SWAPPED) ||
+         ((entry & PAGEMAP_PRESENT) && !(entry & PAGEMAP_FILE));
+}
+
+/* Fill in *ref as a reference to the file that backs *area, to be mapped
+ * from that file on restart.  Returns false if the area isn't a mapping of
+ * an existing regular file, or can't be restored that way here.
+ */
+static bool make_file_backed_ref(const Area *area, Area *ref)
+{
+#if defined(__x86_64__) || defined(__aarch64__)
+  struct stat st;
+  size_t pageSize = Util::pageSize();
+
+  if (area->name[0] != '/' ||
+      Util::strEndsWith(area->name, DELETED_FILE_SUFFIX) ||
+      (area->prot & PROT_READ) == 0 ||
+      stat(area->name, &st) == -1 ||
+      !S_ISREG(st.st_mode) ||
+      st.st_ino != area->inodenum ||
+      (uint64_t) area->offset + area->size >
+        ((uint64_t) st.st_size + pageSize - 1) / pageSize * pageSize) {
+    return false;
+  }
+
+  *ref = *area;
+  ref->flags &= ~MAP_ANONYMOUS;
+  ref->properties = DMTCP_FILE_BACKED_REF;
+  ref->filesize = st.st_size;
+  ref->mtime_sec = st.st_mtim.tv_sec;
+  ref->mtime_nsec = st.st_mtim.tv_nsec;
+  return true;
+#else
+  return false;
+#endif
+}
+
+/* Write a private file mapping as alternating runs of modified pages (saved
+ * as anonymous data, as usual) and unmodified pages (saved as a reference to
+ * the file, validated by inode, size and mtime on restart).  Returns false if
+ * the area can't be referenced; the caller then writes all of it.
+ */
+static bool write_file_backed_area(int fd, Area *area)
+{
+  Area ref;
+  size_t pageSize = Util::pageSize();
+
+  if (!make_file_backed_ref(area, &ref)) {
+    return false;
+  }
+
+  int pagemapFd = _real_open("/proc/self/pagemap", O_RDONLY);
+  if (pagemapFd == -1) {
+    return false;
+  }
+  pagemapBufCount = 0;
+
+  VA end = area->addr + area->size;
+  VA dataStart = area->addr;
+  VA pg = area->addr;
+  while (pg < end) {
+    if (page_is_modified(pagemapFd, pg)) {
+      pg += pageSize;
+      continue;
+    }
+    VA refStart = pg;
+    while (pg < end && !page_is_modified(pagemapFd, pg)) {
+      pg += pageSize;
+    }
+    if ((size_t)(pg - refStart) < MIN_FILE_BACKED_REF_PAGES * pageSize) {
+      continue;
+    }
+
+    if (dataStart < refStart) {
+      Area a = *area;
+      a.addr = dataStart;
+      a.endAddr = refStart;
+      a.size = refStart - dataStart;
+      a.offset = area->offset + (dataStart - area->addr);
+      a.flags |= MAP_ANONYMOUS;
+      writememoryarea(fd, &a, 0);
+    }
+
+    Area a = ref;
+    a.addr = refStart;
+    a.endAddr = pg;
+    a.size = pg - refStart;
+    a.offset = area->offset + (refStart - area->addr);
+    JLOG(DMTCP)("save unmodified file pages as reference")
+      (a.name) ((void*)a.addr) (a.size) (a.offset);
+    int rc = Util::writeAll(fd, &a, sizeof(a));
+    JASSERT(rc != -1)(JASSERT_ERRNO).Text("writeAll failed at ckpt");
+
+    dataStart = pg;
+  }
+
+  if (dataStart < end) {
+    Area a = *area;
+    a.addr = dataStart;
+    a.size = end - dataStart;
+    a.offset = area->offset + (dataStart - area->addr);
+    a.flags |= MAP_ANONYMOUS;
+    writememoryarea(fd, &a, 0);
+  }
+
+  _real_close(pagemapFd);
+  return true;
+}
+
+/* Split *area at addr; *rest gets the part from addr on. */
+static void split_area(Area *area, Area *rest, VA addr)
+{
+  *rest = *area;
+  rest->addr = addr;
+  rest->size = area->endAddr - addr;
+  rest->offset = area->offset + (addr - area->addr);
+  area->endAddr = addr;
+  area->size = addr - area->addr;
+}
+
+/* Handle the regions excluded with dmtcp_ckpt_exclude_region().  If *area
+ * starts inside an excluded region, write the placeholder record its policy
+ * asks for (or nothing, for DMTCP_EXCLUDE_SKIP) and return true.  If an
+ * excluded region starts later in *area, truncate *area in front of it and
+ * return false, so that the caller saves the head as usual.  In both cases,
+ * any remainder is left in *rest for the next iteration.
+ */
+static bool write_excluded_region(int fd, Area *area, Area *rest,
+                                  bool *haveRest)
+{
+  const vector<ProcessInfo::ExcludedRegion>& regions =
+    ProcessInfo::instance().excludedRegions();
+
+  for (size_t i = 0; i < regions.size(); i++) {
+    VA start = (VA) regions[i].addr;
+    VA end = start + regions[i].len;
+    if (end <= area->addr || start >= area->endAddr) {
+      continue;
+    }
+
+    if (start > area->addr) {
+      split_area(area, rest, start);
+      *haveRest = true;
+      return false;
+    }
+    if (end < area->endAddr) {
+      split_area(area, rest, end);
+      *haveRest = true;
+    }
+
+    Area ref;
+    int rc;
+    switch (regions[i].policy) {
+      case DMTCP_EXCLUDE_SKIP:
+        JLOG(DMTCP)("skipping excluded region")
+          ((void*) area->addr) (area->size);
+        return true;
+
+      case DMTCP_EXCLUDE_FILE:
+        if (make_file_backed_ref(area, &ref)) {
+          JLOG(DMTCP)("saving excluded region as file reference")
+            (ref.name) ((void*) ref.addr) (ref.size) (ref.offset);
+          rc = Util::writeAll(fd, &ref, sizeof(ref));
+          JASSERT(rc != -1)(JASSERT_ERRNO).Text("writeAll failed at ckpt");
+          return true;
+        }
+        JNOTE("excluded region is not a file mapping; restoring zero pages")
+          (area->name) ((void*) area->addr) (area->size);
+        // Fall through.
+
+      default:
+        JLOG(DMTCP)("saving excluded region as zero pages")
+          ((void*) area->addr) (area->size);
+        area->properties |= DMTCP_ZERO_PAGE;
+        area->flags = MAP_PRIVATE | MAP_ANONYMOUS;
+        rc = Util::writeAll(fd, area, sizeof(*area));
+        JASSERT(rc != -1)(JASSERT_ERRNO).Text("writeAll failed at ckpt");
+        return true;
+    }
+  }
+  return false;
+}
+
 /* This function returns a range of zero or non-zero pages. If the first page
  * is non-zero, it searches for all contiguous non-zero pages and returns them.
  * If the first page is all-zero, it searches for contiguous zero pages and
@@ -386,7 +660,7 @@ static void mtcp_write_non_rwx_and_anonymous_pages(int fd, Area *orig_area)
     rc = Util::writeAll(fd, &a, sizeof(a));
     JASSERT(rc != -1)(JASSERT_ERRNO).Text("writeAll failed at ckpt");
     if (!is_zero) {
-      rc = Util::writeAll(fd, a.addr, a.size);
+      rc = CkptSerializer::writeAll(fd, a.addr, a.size);
       JASSERT(rc != -1)(JASSERT_ERRNO).Text("writeAll failed at ckpt");
     } else {
       if (madvise(a.addr, a.size, MADV_DONTNEED) == -1) {
@@ -407,6 +681,70 @@ static void mtcp_write_non_rwx_and_anonymous_pages(int fd, Area *orig_area)
   }
 }
 
+/* Write the segment kept attached by the SysV shm ckpt-leader directly from
+ * the shared mapping.  The first record describes the whole segment (no data)
+ * so that mtcp_restart can recreate and attach it; it is followed by one
+ * record per non-zero page range, read straight into the new segment.  Zero
+ * page ranges are not written at all, since a fresh segment is zero-filled.
+ * Returns false if the svipc plugin doesn't own this area; the caller then
+ * saves it as an anonymous area.
+ */
+static bool write_sysv_shm_area(int fd, Area *area)
+{
+#ifdef SYS_shmget
+  int key;
+  int shmflg;
+  if (dmtcp_svipc_shm_ckpt_info == NULL ||
+      !dmtcp_svipc_shm_ckpt_info(area->addr, &key, &shmflg)) {
+    return false;
+  }
+
+  JLOG(DMTCP)("save SysV shm segment") ((void*)area->addr) (area->size) (key);
+  Area seg = *area;
+  seg.flags = MAP_SHARED;
+  seg.properties = DMTCP_SYSV_SHM_AREA | DMTCP_ZERO_PAGE;
+  seg.shmkey = key;
+  seg.shmflg = shmflg;
+  int rc = Util::writeAll(fd, &seg, sizeof(seg));
+  JASSERT(rc != -1)(JASSERT_ERRNO).Text("writeAll failed at ckpt");
+
+  if ((area->prot & PROT_READ) == 0) {
+    JASSERT(mprotect(area->addr, area->size, area->prot | PROT_READ) == 0)
+      (JASSERT_ERRNO) (area->size) (area->addr)
+      .Text("error adding PROT_READ to SysV shm segment");
+  }
+
+  Area rest = *area;
+  while (rest.size > 0) {
+    size_t size;
+    int is_zero;
+    mtcp_get_next_page_range(&rest, &size, &is_zero);
+    if (!is_zero) {
+      Area a = seg;
+      a.addr = rest.addr;
+      a.endAddr = rest.addr + size;
+      a.size = size;
+      a.properties = DMTCP_SYSV_SHM_AREA;
+      rc = Util::writeAll(fd, &a, sizeof(a));
+      JASSERT(rc != -1)(JASSERT_ERRNO).Text("writeAll failed at ckpt");
+      rc = CkptSerializer::writeAll(fd, a.addr, a.size);
+      JASSERT(rc != -1)(JASSERT_ERRNO).Text("writeAll failed at ckpt");
+    }
+    rest.addr += size;
+    rest.size -= size;
+  }
+
+  if ((area->prot & PROT_READ) == 0) {
+    JASSERT(mprotect(area->addr, area->size, area->prot) == 0)
+      (JASSERT_ERRNO) (area->addr) (area->size)
+      .Text("error removing PROT_READ from SysV shm segment.");
+  }
+  return true;
+#else
+  return false;
+#endif
+}
+
 static void writememoryarea (int fd, Area *area, int stack_was_seen)
 {
   int rc = 0;
@@ -489,7 +827,7 @@ static void writememoryarea (int fd, Area *area, int stack_was_seen)
     } else {
       rc = Util::writeAll(fd, area, sizeof(*area));
       JASSERT(rc != -1)(JASSERT_ERRNO).Text("writeAll failed at ckpt");
-      rc = Util::writeAll(fd, area->addr, area->size);
+      rc = CkptSerializer::writeAll(fd, area->addr, area->size);
       JASSERT(rc != -1)(JASSERT_ERRNO).Text("writeAll failed at ckpt");
     }
   }
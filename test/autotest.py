@@ -451,6 +451,13 @@ def SHUTDOWN():
   os.system("rm -rf  %s" % ckptDir)
   os.close(devnullFd)
 
+#run a new coordinator, with the current coordinator_cmdline, on the same port
+def restartCoordinator():
+  global coordinator
+  coordinatorCmd(b'q')
+  coordinator.wait()
+  coordinator = runCmd(coordinator_cmdline)
+
 #make sure val is true
 def CHECK(val, msg):
   if not val:
@@ -508,11 +515,11 @@ def getStatus():
 
   return (peers, (running=="yes"))
 
-#delete all files in ckptDir
-def clearCkptDir():
+#delete all files in ckptDir (or in dir)
+def clearCkptDir(dir=ckptDir):
   for TRIES in range(2):  # Try twice in case ckpt_*_dmtcp.temp is renamed.
     #clear checkpoint dir
-    for root, dirs, files in os.walk(ckptDir, topdown=False):
+    for root, dirs, files in os.walk(dir, topdown=False):
       for name in files:
         try:
           # if name.endswith(".dmtcp") :
@@ -534,7 +541,12 @@ def getNumCkptFiles(dir):
 
 # Test a given list of commands to see if they checkpoint
 # runTest() sets up a keyboard interrupt handler, and then calls this function.
-def runTestRaw(name, numProcs, cmds):
+# The images are looked for in imageDir (default: ckptDir), and restarted from
+# ckptDir with the extra dmtcp_restart options restartArgs.  afterLaunch() is
+# called once the processes have started, afterCkpt() after each checkpoint,
+# and beforeRestart(images) before each restart.
+def runTestRaw(name, numProcs, cmds, restartArgs="", imageDir=ckptDir,
+               afterLaunch=None, afterCkpt=None, beforeRestart=None):
   #the expected/correct running status
 #  if USE_M32:
 #    def forall(fnc, lst):
@@ -600,7 +612,7 @@ def runTestRaw(name, numProcs, cmds):
 
     #wait for files to appear and status to return to original
     # b'Kc' input to dmtcp_coordinator is equivalent to 'dmtcp_command -kc'
-    WAITFOR(lambda: getNumCkptFiles(ckptDir)>0 and \
+    WAITFOR(lambda: getNumCkptFiles(imageDir)>0 and \
                  (CKPT_CMD == b'Kc' or doesStatusSatisfy(getStatus(), status)),
             wfMsg("checkpoint error"))
     #we now know there was at least one checkpoint file, and the correct number
@@ -611,7 +623,7 @@ def runTestRaw(name, numProcs, cmds):
       sleep(S*SLOW)
 
     #make sure the right files are there
-    numFiles=getNumCkptFiles(ckptDir) # len(os.listdir(ckptDir))
+    numFiles=getNumCkptFiles(imageDir) # len(os.listdir(imageDir))
     CHECK(doesStatusSatisfy((numFiles,True),status),
           "unexpected number of checkpoint files, %s procs, %d files"
           % (str(status[0]), numFiles))
@@ -623,12 +635,17 @@ def runTestRaw(name, numProcs, cmds):
       CHECK(doesStatusSatisfy(getStatus(), status),
             "error: processes checkpointed, but died upon resume")
 
+    if afterCkpt:
+      afterCkpt()
+
   def testRestart():
     #build restart command
-    cmd=BIN+"dmtcp_restart --quiet"
-    for i in os.listdir(ckptDir):
-      if i.endswith(".dmtcp"):
-        cmd+= " "+ckptDir+"/"+i
+    cmd=BIN+"dmtcp_restart --quiet "+restartArgs
+    images=[ckptDir+"/"+i for i in os.listdir(imageDir) if i.endswith(".dmtcp")]
+    if beforeRestart:
+      beforeRestart(images)
+    for i in images:
+      cmd+= " "+i
     #run restart and test if it worked
     procs.append(runCmd(cmd))
     sleep(POST_RESTART_SLEEP)
@@ -641,6 +658,7 @@ def runTestRaw(name, numProcs, cmds):
             "error:  processes restarted and then died")
     if HBICT_DELTACOMP == "no":
       clearCkptDir()
+      clearCkptDir(imageDir)
 
   try:
     sys.stdout.flush()
@@ -663,6 +681,8 @@ def runTestRaw(name, numProcs, cmds):
 
     # Additional sleep to allow the test to boot.
     sleep(POST_LAUNCH_SLEEP)
+    if afterLaunch:
+      afterLaunch()
 
     #Will sleep(S*SLOW) in the following for loop.
 
@@ -739,9 +759,11 @@ def runTestRaw(name, numProcs, cmds):
       sys.exit(1)
     if RETRY_ONCE:
       clearCkptDir()
+      clearCkptDir(imageDir)
       raise e
 
   clearCkptDir()
+  clearCkptDir(imageDir)
 
 def getProcessChildren(pid):
     p = subprocess.Popen("ps --no-headers -o pid --ppid %d" % pid, shell = True,
@@ -750,12 +772,12 @@ def getProcessChildren(pid):
     return [int(pid) for pid in stdout.split()]
 
 # If the user types ^C, then kill all child processes.
-def runTest(name, numProcs, cmds):
+def runTest(name, numProcs, cmds, **kwargs):
   if PARALLEL and parallel_test(name):
     return
   for i in range(2):
     try:
-      runTestRaw(name, numProcs, cmds)
+      runTestRaw(name, numProcs, cmds, **kwargs)
       break;
     except KeyboardInterrupt:
       for pid in getProcessChildren(os.getpid()):
@@ -863,6 +885,39 @@ runTest("stat",         1, ["./test/stat"])
 # Test for stack grow works on restart
 runTest("stack-growsdown",         1, ["./test/stack-growsdown"])
 
+# Test for memory excluded from the checkpoint with each restore policy
+runTest("exclude-skip",  1, ["./test/exclude-region1 skip"])
+runTest("exclude-zero",  1, ["./test/exclude-region1 zero"])
+runTest("exclude-file",  1, ["./test/exclude-region1 file"])
+
+# Test for dmtcp_checkpoint_async() and dmtcp_get_ckpt_eventfd().  Don't
+# checkpoint until the requested checkpoint is done, and the test has created
+# its marker file.
+asyncMarker = os.path.abspath(ckptDir + "-async-done")
+asyncHeld = os.path.abspath(ckptDir + "-async-held")
+def waitForAsyncMarker():
+  WAITFOR(lambda: os.path.exists(asyncMarker),
+          lambda: "requested checkpoint not done")
+  os.remove(asyncMarker)
+
+runTest("ckpt-async1",   1, ["./test/ckpt-async1 "+asyncMarker],
+        afterLaunch=waitForAsyncMarker)
+
+# The same, when the first requested checkpoint is aborted: the second process
+# holds the SUSPENDED barrier back past its deadline.
+old_coordinator_cmdline = coordinator_cmdline
+coordinator_cmdline += " --barrier-timeout SUSPENDED=1 --abort-on-timeout"
+restartCoordinator()
+runTest("ckpt-async2",   2, ["./test/ckpt-async1 --abort "+asyncHeld+" "+
+                             asyncMarker,
+                             "./test/ckpt-async1 --hold 3 "+asyncHeld],
+        afterLaunch=waitForAsyncMarker)
+coordinator_cmdline = old_coordinator_cmdline
+restartCoordinator()
+for f in [asyncMarker, asyncHeld]:
+  if os.path.exists(f):
+    os.remove(f)
+
 PWD=os.getcwd()
 runTest("plugin-sleep2", 1, ["--with-plugin "+
                              PWD+"/test/plugin/sleep1/dmtcp_sleep1hijack.so:"+
@@ -914,6 +969,8 @@ runTest("environ",       1, ["./test/environ"])
 
 runTest("forkexec",      2, ["./test/forkexec"])
 
+runTest("vfork1",        2, ["./test/vfork1"])
+
 runTest("realpath",      1, ["./test/realpath"])
 runTest("pthread1",      1, ["./test/pthread1"])
 runTest("pthread2",      1, ["./test/pthread2"])
@@ -1033,6 +1090,70 @@ os.environ['DMTCP_GZIP'] = "1"
 runTest("gzip",          1, ["./test/dmtcp1"])
 os.environ['DMTCP_GZIP'] = GZIP
 
+# Images streamed to a dmtcp_ckpt_receiver on this host, and fetched back from
+# it by dmtcp_restart.  The same receiver then keeps the XOR parity of a group
+# of three processes, from which a deleted image is rebuilt.
+receiverDir = os.path.abspath(ckptDir + "-receiver")
+localDir = os.path.abspath(ckptDir + "-local")
+os.mkdir(receiverDir)
+os.mkdir(localDir)
+receiverPort = str(randint(10001,20000))
+os.environ['DMTCP_CKPT_RECEIVER_SECRET'] = str(randint(100000000,999999999))
+receiver = runCmd(BIN+"dmtcp_ckpt_receiver -q -l :"+receiverPort+
+                  " -d "+receiverDir)
+sleep(S)
+
+runTest("ckpt-receiver", 1,
+        ["--ckpt-receiver localhost:"+receiverPort+" ./test/dmtcp1"],
+        restartArgs="--ckpt-receiver localhost:"+receiverPort,
+        imageDir=receiverDir)
+
+def deleteOneImage(images):
+  # Wait for the images to be drained to ckptDir, then delete both copies.
+  WAITFOR(lambda: getNumCkptFiles(ckptDir) == len(images),
+          lambda: "images not drained to the ckpt dir")
+  name = os.path.basename(images[0])
+  os.remove(ckptDir + "/" + name)
+  os.remove(localDir + "/" + name)
+
+old_coordinator_cmdline = coordinator_cmdline
+coordinator_cmdline += " --xor-group-size 3 --xor-receiver-port "+receiverPort
+restartCoordinator()
+runTest("xor-rebuild",   3, ["--local-ckptdir "+localDir+" ./test/dmtcp1"]*3,
+        restartArgs="--local-ckptdir "+localDir+
+                    " --xor-receivers localhost:"+receiverPort,
+        imageDir=localDir, beforeRestart=deleteOneImage)
+coordinator_cmdline = old_coordinator_cmdline
+restartCoordinator()
+
+os.kill(receiver.pid, signal.SIGTERM)
+receiver.wait()
+del os.environ['DMTCP_CKPT_RECEIVER_SECRET']
+
+# Images kept as chunks in a chunk store: the image of the second checkpoint
+# (after restart) should share most of its chunks with the first.
+chunkStore = os.path.abspath(ckptDir + "-chunks")
+os.mkdir(chunkStore)
+chunkStoreSizes = []
+def checkChunkDedup():
+  size = 0
+  for root, dirs, files in os.walk(chunkStore):
+    for name in files:
+      size += os.path.getsize(os.path.join(root, name))
+  chunkStoreSizes.append(size)
+  if len(chunkStoreSizes) > 1:
+    added = chunkStoreSizes[-1] - chunkStoreSizes[-2]
+    CHECK(added < chunkStoreSizes[0] / 2,
+          "chunks not shared across generations: %d bytes added to %d"
+          % (added, chunkStoreSizes[-2]))
+
+runTest("chunk-store",   1, ["--ckpt-chunk-store "+chunkStore+" ./test/dmtcp1"],
+        afterCkpt=checkChunkDedup)
+
+for d in [receiverDir, localDir, chunkStore]:
+  clearCkptDir(d)
+  os.rmdir(d)
+
 if HAS_READLINE == "yes":
   runTest("readline",    1,  ["./test/readline"])
 
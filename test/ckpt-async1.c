@@ -0,0 +1,137 @@
+/* Request a checkpoint with dmtcp_checkpoint_async(), and wait for it on the
+ * eventfd of dmtcp_get_ckpt_eventfd().  Once the result has been checked,
+ * create the file MARKER, then keep counting, and check the result of every
+ * later checkpoint or restart as the eventfd reports it.
+ *
+ * With "--abort HELD MARKER", the first checkpoint is expected to be aborted
+ * by the coordinator (--barrier-timeout, --abort-on-timeout): it is requested
+ * once the file HELD exists, created by another process run with
+ * "--hold SECONDS HELD", which keeps checkpoints from starting for SECONDS
+ * and then removes HELD.  A second request must then succeed.
+ */
+#include <poll.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "dmtcp.h"
+
+static volatile int callbackHandle = 0;
+static volatile int callbackAborted = 0;
+
+static void ckpt_done(const DmtcpCkptResult *result, void *arg)
+{
+  if (arg != &callbackHandle || result->isRestart) {
+    fprintf(stderr, "ckpt-async1: unexpected callback\n");
+    _exit(1);
+  }
+  callbackHandle = result->handle;
+  callbackAborted = result->aborted;
+}
+
+// Read the result of the checkpoint or restart the eventfd reported.
+static void check_result(int efd, uint32_t *generation, int aborted)
+{
+  DmtcpCkptResult result;
+  uint64_t n;
+
+  if (read(efd, &n, sizeof(n)) != sizeof(n) ||
+      dmtcp_get_last_ckpt_result(&result) != DMTCP_IS_PRESENT) {
+    fprintf(stderr, "ckpt-async1: no checkpoint result\n");
+    exit(1);
+  }
+  if (result.aborted != aborted || result.generation < *generation ||
+      (!result.isRestart && !result.aborted && result.imageSize == 0)) {
+    fprintf(stderr, "ckpt-async1: bad checkpoint result (aborted %d,"
+            " generation %u, image size %llu)\n", result.aborted,
+            result.generation, (unsigned long long) result.imageSize);
+    exit(1);
+  }
+  *generation = result.generation;
+}
+
+// Request a checkpoint, and check its result and that the callback ran.
+static void checkpoint(struct pollfd *pfd, uint32_t *generation, int aborted)
+{
+  int handle = dmtcp_checkpoint_async(ckpt_done, (void *) &callbackHandle);
+  if (handle <= 0 || pfd->fd == -1) {
+    fprintf(stderr, "ckpt-async1: dmtcp_checkpoint_async failed\n");
+    exit(1);
+  }
+  // The callback has run by the time the eventfd is readable.
+  if (poll(pfd, 1, 60 * 1000) != 1) {
+    fprintf(stderr, "ckpt-async1: checkpoint not done\n");
+    exit(1);
+  }
+  check_result(pfd->fd, generation, aborted);
+  if (callbackHandle != handle || callbackAborted != aborted) {
+    fprintf(stderr, "ckpt-async1: callback got handle %d (aborted %d),"
+            " not %d\n", callbackHandle, callbackAborted, handle);
+    exit(1);
+  }
+}
+
+static void create_file(const char *path)
+{
+  FILE *fp = fopen(path, "w");
+  if (fp == NULL || fclose(fp) != 0) {
+    perror(path);
+    exit(1);
+  }
+}
+
+int main(int argc, char* argv[])
+{
+  int count = 1;
+  uint32_t generation = 0;
+  struct pollfd pfd;
+  const char *marker;
+
+  if (argc == 4 && strcmp(argv[1], "--hold") == 0) {
+    dmtcp_disable_ckpt();
+    create_file(argv[3]);
+    sleep(atoi(argv[2]));
+    dmtcp_enable_ckpt();
+    unlink(argv[3]);
+    pfd.fd = -1;
+  } else {
+    if (argc == 4 && strcmp(argv[1], "--abort") == 0) {
+      marker = argv[3];
+    } else if (argc == 2) {
+      marker = argv[1];
+    } else {
+      fprintf(stderr, "USAGE: %s [--abort HELD] MARKER\n"
+                      "       %s --hold SECONDS HELD\n", argv[0], argv[0]);
+      return 1;
+    }
+    pfd.fd = dmtcp_get_ckpt_eventfd();
+    pfd.events = POLLIN;
+    if (dmtcp_is_enabled()) {
+      if (argc == 4) {
+        while (access(argv[2], F_OK) != 0) {
+          usleep(100 * 1000);
+        }
+        checkpoint(&pfd, &generation, 1);
+        // Until the holder lets go, the next checkpoint would be aborted too.
+        while (access(argv[2], F_OK) == 0) {
+          usleep(100 * 1000);
+        }
+      }
+      checkpoint(&pfd, &generation, 0);
+    } else {
+      fprintf(stderr, "ckpt-async1: not running under DMTCP\n");
+    }
+    create_file(marker);
+  }
+
+  while (1) {
+    if (pfd.fd != -1 && poll(&pfd, 1, 0) == 1) {
+      check_result(pfd.fd, &generation, 0);
+    }
+    printf(" %2d ", count++);
+    fflush(stdout);
+    sleep(2);
+  }
+  return 0;
+}
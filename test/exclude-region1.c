@@ -0,0 +1,131 @@
+/* Exclude part of a buffer from the checkpoint with dmtcp_ckpt_exclude_region()
+ * and the policy given on the command line (skip, zero or file), and check
+ * that the callback sees it restored as the policy says after restart, and
+ * that the rest of the buffer was checkpointed.  With "file", the buffer is
+ * a private mapping of our own executable.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "dmtcp.h"
+
+#define NUM_PAGES 4
+
+static char *buf;
+static char *expected;  // what every page of buf should hold
+static size_t pagesize;
+static int policy;
+
+static void fill(char *p, size_t len, char c)
+{
+  if (policy == DMTCP_EXCLUDE_FILE) {
+    memcpy(p, expected + (p - buf), len);
+  } else {
+    memset(p, c, len);
+  }
+}
+
+static void excluded_region_restored(void *addr, size_t len, int pol)
+{
+  char *p = addr;
+  size_t i;
+
+  if (p != buf + pagesize || len != 2 * pagesize || pol != policy) {
+    fprintf(stderr, "exclude-region1: unexpected region %p+%zu (policy %d)\n",
+            addr, len, pol);
+    _exit(1);
+  }
+  if (policy == DMTCP_EXCLUDE_SKIP) {
+    // Left unmapped: map it again.
+    if (msync(p, len, MS_ASYNC) != -1 || errno != ENOMEM) {
+      fprintf(stderr, "exclude-region1: skipped region is mapped\n");
+      _exit(1);
+    }
+    if (mmap(p, len, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1, 0) != p) {
+      perror("mmap");
+      _exit(1);
+    }
+  } else if (policy == DMTCP_EXCLUDE_ZERO) {
+    for (i = 0; i < len; i++) {
+      if (p[i] != 0) {
+        fprintf(stderr, "exclude-region1: zeroed region not zero\n");
+        _exit(1);
+      }
+    }
+  }
+  // With DMTCP_EXCLUDE_FILE, the file contents are already back.
+  fill(p, len, 'x');
+}
+
+int main(int argc, char* argv[])
+{
+  int count = 1;
+  int i;
+
+  if (argc != 2) {
+    fprintf(stderr, "USAGE: %s skip|zero|file\n", argv[0]);
+    return 1;
+  }
+  if (strcmp(argv[1], "skip") == 0) {
+    policy = DMTCP_EXCLUDE_SKIP;
+  } else if (strcmp(argv[1], "zero") == 0) {
+    policy = DMTCP_EXCLUDE_ZERO;
+  } else if (strcmp(argv[1], "file") == 0) {
+    policy = DMTCP_EXCLUDE_FILE;
+  } else {
+    fprintf(stderr, "USAGE: %s skip|zero|file\n", argv[0]);
+    return 1;
+  }
+
+  pagesize = sysconf(_SC_PAGESIZE);
+  expected = malloc(NUM_PAGES * pagesize);
+  if (policy == DMTCP_EXCLUDE_FILE) {
+    struct stat st;
+    int fd = open("/proc/self/exe", O_RDONLY);
+    if (fd == -1 || fstat(fd, &st) == -1 ||
+        st.st_size < NUM_PAGES * pagesize ||
+        read(fd, expected, NUM_PAGES * pagesize) != NUM_PAGES * pagesize) {
+      fprintf(stderr, "exclude-region1: can't read own executable\n");
+      return 1;
+    }
+    buf = mmap(NULL, NUM_PAGES * pagesize, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE, fd, 0);
+    close(fd);
+  } else {
+    buf = mmap(NULL, NUM_PAGES * pagesize, PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    memset(expected, 'x', NUM_PAGES * pagesize);
+  }
+  if (buf == MAP_FAILED) {
+    perror("mmap");
+    return 1;
+  }
+  fill(buf, NUM_PAGES * pagesize, 'x');
+
+  // Exclude the two middle pages; the first and last are checkpointed.
+  dmtcp_set_excluded_region_callback(excluded_region_restored);
+  i = dmtcp_ckpt_exclude_region(buf + pagesize, 2 * pagesize, policy);
+  if (i != 1 && i != DMTCP_NOT_PRESENT) {
+    fprintf(stderr, "exclude-region1: dmtcp_ckpt_exclude_region failed\n");
+    return 1;
+  }
+
+  while (1) {
+    for (i = 0; i < NUM_PAGES; i++) {
+      if (memcmp(buf + i * pagesize, expected + i * pagesize, pagesize) != 0) {
+        fprintf(stderr, "exclude-region1: page %d has changed\n", i);
+        return 1;
+      }
+    }
+    printf(" %2d ", count++);
+    fflush(stdout);
+    sleep(2);
+  }
+  return 0;
+}
@@ -0,0 +1,54 @@
+/* A vfork()ed child execs a copy of this program, which keeps running.  The
+ * child first tries a program that does not exist, so that it also runs
+ * between a failed exec and the next one.
+ *
+ * With "-n N", instead do N vfork()/exec()s of /bin/true and exit (see
+ * util/exec_startup_bench.sh).
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+int main(int argc, char* argv[])
+{
+  int count = 1;
+
+  if (argc == 3 && strcmp(argv[1], "-n") == 0) {
+    int i;
+    int n = atoi(argv[2]);
+    for (i = 0; i < n; i++) {
+      pid_t pid = vfork();
+      if (pid == 0) {
+        execl("/bin/true", "true", NULL);
+        _exit(1);
+      }
+      waitpid(pid, NULL, 0);
+    }
+    return 0;
+  }
+
+  if (argc == 1) {
+    pid_t pid = vfork();
+    if (pid == -1) {
+      perror("vfork");
+      return 1;
+    }
+    if (pid == 0) {
+      char *args[] = { argv[0], "child", NULL };
+      execv("/nonexistent/vfork1", args);
+      execv(argv[0], args);
+      perror("execv");
+      _exit(1);
+    }
+  }
+
+  while (1) {
+    printf(" %2d ", count++);
+    fflush(stdout);
+    sleep(2);
+  }
+  return 0;
+}
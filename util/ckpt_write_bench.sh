@@ -0,0 +1,70 @@
+#!/bin/sh
+
+# Measure the total checkpoint time of N processes that write their images to
+# one device at the same time, with and without the coordinator's write
+# scheduling (--write-slots-per-host, --write-bandwidth).  Each process holds
+# MB megabytes of random data, so the images don't compress.
+# USAGE:  util/ckpt_write_bench.sh [N] [MB] [CKPTDIR] [BANDWIDTH_MB/s]
+#   (run from the DMTCP top directory)
+#
+# To simulate a slow shared filesystem, put CKPTDIR on a throttled device.
+# For example, as root with cgroup v2:
+#   truncate -s 8G /tmp/ckpt.img; dev=`losetup -f --show /tmp/ckpt.img`
+#   mkfs.ext4 -q $dev; mkdir -p /mnt/ckpt; mount $dev /mnt/ckpt
+#   mkdir /sys/fs/cgroup/ckptbench
+#   echo "`lsblk -no MAJ:MIN $dev | tr -d ' '` wbps=52428800" \
+#     > /sys/fs/cgroup/ckptbench/io.max
+#   CKPT_CGROUP=/sys/fs/cgroup/ckptbench util/ckpt_write_bench.sh 16 64 \
+#     /mnt/ckpt 50
+# The processes then start in that cgroup, and the image writes share
+# 50 MB/s.  The device is synced after each checkpoint, and that is timed too.
+
+N=${1:-8}
+MB=${2:-64}
+DIR=${3:-/tmp/ckpt_write_bench}
+BW=${4:-50}
+BIN=`dirname $0`/../bin
+PORT=7782
+
+if [ -n "$CKPT_CGROUP" ]; then
+  echo $$ > $CKPT_CGROUP/cgroup.procs || exit 1
+fi
+mkdir -p $DIR
+
+now() {
+  date +%s.%N
+}
+
+# run LABEL COORDINATOR-OPTIONS...
+run() {
+  label=$1
+  shift
+  rm -f $DIR/ckpt_*.dmtcp
+  $BIN/dmtcp_coordinator --daemon -p $PORT --ckptdir $DIR "$@" \
+    > /dev/null 2>&1
+  i=0
+  while [ $i -lt $N ]; do
+    $BIN/dmtcp_launch -q -q -j -p $PORT --no-gzip sh -c \
+      "x=\`head -c ${MB}M /dev/urandom | base64 -w0\`; sleep 3600" &
+    i=$((i+1))
+  done
+  # Wait until every process holds its data.
+  sleep `expr 2 + $N \* $MB / 64`
+  sync
+  t0=`now`
+  $BIN/dmtcp_command -p $PORT -bc
+  t1=`now`
+  sync
+  t2=`now`
+  $BIN/dmtcp_command -p $PORT -q > /dev/null 2>&1
+  wait
+  echo "$label: checkpoint `echo "$t1 - $t0" | bc` s," \
+       "then sync `echo "$t2 - $t1" | bc` s," \
+       "images `du -sm $DIR | cut -f1` MB"
+}
+
+run "unscheduled"
+run "--write-slots-per-host 1" --write-slots-per-host 1
+run "--write-slots-per-host 4" --write-slots-per-host 4
+run "--write-bandwidth $BW" --write-bandwidth $BW
+rm -f $DIR/ckpt_*.dmtcp
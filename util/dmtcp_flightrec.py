@@ -0,0 +1,54 @@
+#!/usr/bin/env python
+
+# Decode a JLOG flight recorder dump ($DMTCP_TMPDIR/flightrec.<uniquePid>),
+# written on a failed JASSERT or by 'dmtcp_command --flight-recorder'.
+# See jassert_internal::jflight_dump() in jalib/jassert.cpp for the layout.
+
+import struct
+import sys
+
+logSources = [(0x00000001, 'JTRACE'), (0x00000002, 'ALLOC'),
+              (0x00000004, 'DL'), (0x00000008, 'DMTCP'),
+              (0x00000010, 'EVENT'), (0x00000020, 'FILEP'),
+              (0x00000040, 'SOCKET'), (0x00000080, 'SSH'),
+              (0x00000100, 'PID'), (0x00000200, 'SYSV'),
+              (0x00000400, 'TIMER')]
+
+if len(sys.argv) != 2 or sys.argv[1] in ('--help', '-h'):
+  print("USAGE:  dmtcp_flightrec.py FLIGHTREC_FILE\n"
+        + "  Prints the recorded JLOG events of all threads, oldest first.")
+  sys.exit(1)
+
+data = open(sys.argv[1], 'rb').read()
+if data[:8] != b'JFLIGHT1':
+  print(sys.argv[1] + ": not a flight recorder dump")
+  sys.exit(1)
+
+def readString(data, pos):
+  (length,) = struct.unpack_from('=I', data, pos)
+  pos += 4
+  return (data[pos:pos+length].decode('latin-1'), pos + length)
+
+events = []
+pos = 8
+while pos < len(data):
+  (tid, logSrc, numArgs, timestamp) = struct.unpack_from('=iIIQ', data, pos)
+  pos += struct.calcsize('=iIIQ')
+  args = struct.unpack_from('=' + 'Q' * numArgs, data, pos)
+  pos += 8 * numArgs
+  (fileLine, pos) = readString(data, pos)
+  (func, pos) = readString(data, pos)
+  (msg, pos) = readString(data, pos)
+  events.append((timestamp, tid, logSrc, fileLine, func, msg, args))
+
+events.sort()
+start = events[0][0] if events else 0
+for (timestamp, tid, logSrc, fileLine, func, msg, args) in events:
+  src = '|'.join([name for (bit, name) in logSources if logSrc & bit])
+  if msg.endswith("'\n"):
+    msg = msg[:-2]
+  print("%12.6f [%d] %s %s in %s; REASON='%s'" %
+        ((timestamp - start) / 1e9, tid, src, fileLine.split('/')[-1],
+         func, msg))
+  for arg in args:
+    print("     %d (0x%x)" % (arg, arg))
@@ -0,0 +1,58 @@
+#!/bin/sh
+
+# Measure the startup cost of exec under DMTCP.  Runs a chain of N execs, in
+# which each shell execs the next one without forking, natively, as N
+# separate dmtcp_launch invocations, and as one dmtcp_launch whose process
+# execs N times.  If test/vfork1 has been built (make check), vfork()+exec,
+# whose children start no checkpoint thread, is timed too.
+# USAGE:  util/exec_startup_bench.sh [N]   (run from the DMTCP top directory)
+
+N=${1:-200}
+BIN=`dirname $0`/../bin
+VFORK1=`dirname $0`/../test/vfork1
+PORT=7781
+
+# sh -c "$chain" N "$chain" execs itself N times.
+chain='if [ $0 -gt 0 ]; then exec sh -c "$1" $(($0 - 1)) "$1"; fi'
+
+now() {
+  date +%s.%N
+}
+
+report() {
+  echo "$1: `echo "($3 - $2) * 1000000 / $N" | bc` us/exec"
+}
+
+t0=`now`
+sh -c "$chain" $N "$chain"
+t1=`now`
+report "native" $t0 $t1
+
+$BIN/dmtcp_coordinator --daemon -p $PORT > /dev/null 2>&1
+t0=`now`
+i=0
+while [ $i -lt $N ]; do
+  $BIN/dmtcp_launch -q -q -j -p $PORT /bin/true
+  i=$((i+1))
+done
+t1=`now`
+report "dmtcp_launch" $t0 $t1
+
+t0=`now`
+$BIN/dmtcp_launch -q -q -j -p $PORT sh -c "$chain" $N "$chain"
+t1=`now`
+report "exec chain under dmtcp" $t0 $t1
+
+if [ -x $VFORK1 ]; then
+  t0=`now`
+  $VFORK1 -n $N
+  t1=`now`
+  report "vfork+exec native" $t0 $t1
+
+  t0=`now`
+  $BIN/dmtcp_launch -q -q -j -p $PORT $VFORK1 -n $N
+  t1=`now`
+  report "vfork+exec under dmtcp" $t0 $t1
+fi
+
+$BIN/dmtcp_command -q -p $PORT > /dev/null 2>&1